@@ -22,6 +22,7 @@
 #ifndef _DF_H_
 #define _DF_H_
 
+#include <stdint.h>
 
 #define DF_ASCII  1
 #define DF_BINARY 2
@@ -711,8 +712,31 @@ typedef struct {
 
 /***********************************************************************
  *
- *   Structure: DYN_LIST
+ *   Structure: DYN_BUFFER
  *   Refers to: None
+ *   Found in:  DYN_LIST
+ *   Purpose:   Reference counted block of memory (typically a whole
+ *              decompressed dg file) which borrowed DYN_LISTs point
+ *              into.  The block is freed when the last reference goes.
+ *
+ ***********************************************************************/
+
+typedef struct {
+  unsigned char *data;		/* malloc'd block, owned by buffer */
+  int size;			/* number of valid bytes in data   */
+  int refcount;			/* outstanding users (atomic)      */
+  void (*release)(unsigned char *, int); /* frees data if not free() */
+} DYN_BUFFER;
+
+#define DYN_BUFFER_DATA(b)     ((b)->data)
+#define DYN_BUFFER_SIZE(b)     ((b)->size)
+#define DYN_BUFFER_REFCOUNT(b) ((b)->refcount)
+#define DYN_BUFFER_RELEASE(b)  ((b)->release)
+
+/***********************************************************************
+ *
+ *   Structure: DYN_LIST
+ *   Refers to: DYN_BUFFER
  *   Found in:  None
  *   Purpose:   Used as a means for managing dynamically growing,
  *              shrinking lists of data.
@@ -720,7 +744,10 @@ typedef struct {
  ***********************************************************************/
 
 #define DYN_LIST_NAME_SIZE 64
-typedef struct {
+typedef struct _dyn_lazy DYN_LAZY;
+typedef struct _dyn_csr DYN_CSR;
+typedef struct _dyn_pool DYN_POOL;
+typedef struct _dyn_list {
   char name[DYN_LIST_NAME_SIZE];/* buffer to hold name of list*/
   int datatype;			/* kind of data store in vals */
   int increment;		/* how much to reallocate by  */
@@ -728,6 +755,10 @@ typedef struct {
   int n;			/* number of slots filled     */
   int flags;			/* info about the dynlist     */
   void *vals;			/* pointer to actual data     */
+  DYN_BUFFER *owner;		/* holds vals if DL_BORROWED  */
+  DYN_LAZY *lazy;		/* undecoded sublists if DL_LAZY */
+  DYN_CSR *csr;			/* flattened sublists if DL_CSR  */
+  DYN_POOL *pool;		/* holds strings if DL_POOLED    */
 } DYN_LIST;
 
 #define DYN_LIST_NAME(d)      ((d)->name)
@@ -737,12 +768,113 @@ typedef struct {
 #define DYN_LIST_N(d)         ((d)->n)
 #define DYN_LIST_VALS(d)      ((d)->vals)
 #define DYN_LIST_FLAGS(d)     ((d)->flags)
+#define DYN_LIST_OWNER(d)     ((d)->owner)
+#define DYN_LIST_LAZY(d)      ((d)->lazy)
+#define DYN_LIST_CSR(d)       ((d)->csr)
+#define DYN_LIST_POOL(d)      ((d)->pool)
 
+/*
+ * DL_BORROWED marks a list whose vals point into DYN_LIST_OWNER()
+ * rather than into their own allocation.  DL_LAZY marks a DF_LIST
+ * list some of whose sublists are still NULL in vals; they are decoded
+ * from DYN_LIST_LAZY() the first time dfuGetDynListList() asks for
+ * them.  DL_CSR marks a DF_LIST list of flat numeric lists whose
+ * elements are all held end to end in DYN_LIST_CSR(); its sublists are
+ * likewise only made (as borrowed views) when asked for.  Code that
+ * walks the vals of a DF_LIST list itself must therefore get each
+ * sublist through dfuGetDynListList(), or call dfuLoadDynList() first;
+ * the dfu calls that change a list load it themselves.  DL_POOLED
+ * marks a DF_STRING list whose strings belong to DYN_LIST_POOL() rather
+ * than each being malloc'd.  These are all run-time states only and are
+ * never written to (or honored when read from) a file.  DL_GEOMETRIC
+ * (see dfuSetDynListGeometric()) asks that the list double its capacity
+ * when it fills rather than grow by its increment; it is saved with the
+ * list like DL_SUBLIST.
+ */
 enum DL_FLAG {
   DL_SUBLIST = 0x01,
-  DL_TCLOBJ = 0x02
+  DL_TCLOBJ = 0x02,
+  DL_BORROWED = 0x04,
+  DL_LAZY = 0x08,
+  DL_CSR = 0x10,
+  DL_POOLED = 0x20,
+  DL_GEOMETRIC = 0x40
 };
 
+/***********************************************************************
+ *
+ *   Structure: DYN_LAZY
+ *   Refers to: DYN_BUFFER, DYN_LIST
+ *   Found in:  DYN_LIST
+ *   Purpose:   Where the undecoded sublists of a DL_LAZY list are,
+ *              and how to decode one.  Set up by the dg reader.
+ *
+ ***********************************************************************/
+
+struct _dyn_lazy {
+  DYN_BUFFER *buf;		/* stream holding the sublists     */
+  int n;			/* number of sublists it covers    */
+  int *offsets;			/* where each one starts in buf    */
+  int flip;			/* stream byte order differs       */
+  int flags;			/* reader options to decode with   */
+  DYN_LIST *(*decode)(DYN_LAZY *lazy, int i); /* sublist i, or NULL */
+};
+
+#define DYN_LAZY_BUFFER(l)    ((l)->buf)
+#define DYN_LAZY_N(l)         ((l)->n)
+#define DYN_LAZY_OFFSETS(l)   ((l)->offsets)
+#define DYN_LAZY_FLIP(l)      ((l)->flip)
+#define DYN_LAZY_FLAGS(l)     ((l)->flags)
+
+/***********************************************************************
+ *
+ *   Structure: DYN_CSR
+ *   Refers to: DYN_BUFFER
+ *   Found in:  DYN_LIST
+ *   Purpose:   The sublists of a DL_CSR list in compressed sparse row
+ *              form: one array of values, all of the same type, and
+ *              n+1 offsets into it, so that sublist i holds elements
+ *              [offsets[i], offsets[i+1]).  Lists with named sublists
+ *              are never flattened, as the names couldn't be kept.
+ *
+ ***********************************************************************/
+
+struct _dyn_csr {
+  int datatype;			/* DF_LONG/SHORT/FLOAT/CHAR        */
+  DYN_BUFFER *values;		/* every sublist's elements        */
+  int64_t *offsets;		/* n+1 element offsets into values */
+};
+
+#define DYN_CSR_DATATYPE(c)   ((c)->datatype)
+#define DYN_CSR_VALUES(c)     ((c)->values)
+#define DYN_CSR_DATA(c)       (DYN_BUFFER_DATA((c)->values))
+#define DYN_CSR_OFFSETS(c)    ((c)->offsets)
+
+/***********************************************************************
+ *
+ *   Structure: DYN_POOL
+ *   Refers to: DYN_BUFFER
+ *   Found in:  DYN_LIST
+ *   Purpose:   Storage for the strings of a DL_POOLED list: a few large
+ *              blocks that strings are packed into one after another
+ *              (so there's no malloc or free per string), and perhaps
+ *              a buffer that some of them point straight into.
+ *
+ ***********************************************************************/
+
+#define DYN_POOL_BLOCK_SIZE 4096
+
+struct _dyn_pool {
+  DYN_BUFFER *source;		/* strings may point in here too   */
+  char **blocks;		/* arena blocks, newest last       */
+  int nblocks;			/* number of blocks                */
+  int size;			/* bytes in the newest block       */
+  int used;			/* and how many of those are taken */
+};
+
+#define DYN_POOL_SOURCE(p)    ((p)->source)
+#define DYN_POOL_NBLOCKS(p)   ((p)->nblocks)
+
 /***********************************************************************
  *
  *   Structure: DYN_OLIST
@@ -772,6 +904,12 @@ typedef struct {
  *   Found in:  None
  *   Purpose:   Keep more than one dyn_list together (for em's, events)
  *
+ *   The optional index is an open addressing hash table of list
+ *   names, made by dfuIndexDynGroup() and kept up to date by the
+ *   dfuAddDynGroup / dfuCopyDynGroup functions from then on.  Each
+ *   slot holds a position in lists plus one (0 is empty); nindex is
+ *   always a power of two.  dfuFindDynList() only reads it.
+ *
  ***********************************************************************/
 
 #define DYN_GROUP_NAME_SIZE DYN_LIST_NAME_SIZE
@@ -782,6 +920,8 @@ typedef struct {
   int max;			/* maximum slots currently av.*/
   int nlists;
   DYN_LIST **lists;		/* pointer to allocated lists */
+  int nindex;			/* slots in index (0 if none) */
+  int *index;			/* name hash table, or NULL   */
 } DYN_GROUP;
 
 #define DYN_GROUP_NAME(d)      ((d)->name)
@@ -791,6 +931,8 @@ typedef struct {
 #define DYN_GROUP_NLISTS(d)    ((d)->nlists)
 #define DYN_GROUP_LISTS(d)     ((d)->lists)
 #define DYN_GROUP_LIST(d,i)    (DYN_GROUP_LISTS(d)[i])
+#define DYN_GROUP_NINDEX(d)    ((d)->nindex)
+#define DYN_GROUP_INDEX(d)     ((d)->index)
 
 
 /***********************************************************************
@@ -908,8 +1050,22 @@ DYN_GROUP *dfuCopyDynGroup(DYN_GROUP *dg, char *name);
 int dfuAddDynGroupNewList(DYN_GROUP *, char *name, int type, int increment);
 int dfuAddDynGroupExistingList(DYN_GROUP *dg, char *name, DYN_LIST *list);
 int dfuCopyDynGroupExistingList(DYN_GROUP *dg, char *name, DYN_LIST *list);
+DYN_LIST *dfuFindDynList(DYN_GROUP *dg, char *name);
+int dfuIndexDynGroup(DYN_GROUP *dg);
 
 DYN_LIST *dfuCopyDynList(DYN_LIST *old);
+int dfuDetachDynList(DYN_LIST *dl);
+DYN_LIST *dfuGetDynListList(DYN_LIST *dl, int i);
+int dfuLoadDynList(DYN_LIST *dl);
+
+DYN_POOL *dfuCreateDynPool(DYN_BUFFER *source, int size);
+char *dfuPoolAlloc(DYN_POOL *pool, int n);
+void dfuFreeDynPool(DYN_POOL *pool);
+int dfuPoolDynList(DYN_LIST *dl);
+
+DYN_BUFFER *dfuCreateDynBuffer(unsigned char *data, int size);
+DYN_BUFFER *dfuRefDynBuffer(DYN_BUFFER *buf);
+void dfuUnrefDynBuffer(DYN_BUFFER *buf);
 
 void dfuFreeDynList(DYN_LIST *);
 void dfuResetDynList(DYN_LIST *);
@@ -923,6 +1079,9 @@ void dfuFreeDynOList(DYN_OLIST *);
 void dfuFreeDynGroup(DYN_GROUP *);
 void dfuResetDynGroup(DYN_GROUP *);
 
+int dfuSetDynListGeometric(DYN_LIST *dynlist, int flag);
+int dfuSetGeometricGrowth(int flag);
+
 void dfuAddDynListLong(DYN_LIST *, int);
 void dfuAddDynListShort(DYN_LIST *, short);
 void dfuAddDynListFloat(DYN_LIST *, float);
@@ -946,6 +1105,14 @@ int dfuInsertDynListChar(DYN_LIST *, unsigned char, int pos);
 int dfuInsertDynListList(DYN_LIST *, DYN_LIST *, int pos);
 int dfuInsertDynListString(DYN_LIST *dynlist, char *string, int pos);
 
+int dfuReserveDynList(DYN_LIST *dynlist, int n);
+int dfuAppendDynListLongs(DYN_LIST *dynlist, int n, int *vals);
+int dfuAppendDynListShorts(DYN_LIST *dynlist, int n, short *vals);
+int dfuAppendDynListFloats(DYN_LIST *dynlist, int n, float *vals);
+int dfuAppendDynListChars(DYN_LIST *dynlist, int n, unsigned char *vals);
+int dfuAppendDynListDoubles(DYN_LIST *dynlist, int n, double *vals);
+int dfuInsertDynListRange(DYN_LIST *dynlist, int pos, int n, void *vals);
+
 void dfuAddObsPeriod(DYN_OLIST *dynolist, OBS_P *obsp);
 void dfuAddEvData(DYN_GROUP *evgroup, int type, int val, int time);
 void dfuAddEvData4Params(DYN_GROUP *evgroup, int type, int val, int time,
@@ -21,8 +21,10 @@
 #include <zlib.h>
 #include "dynio.h"
 
-/* gzip (.dgz) reads are decompressed fully in memory by
- * dguGzipFileToStruct() (dynio.c) -- no temp file. */
+/* gzip (.dgz) reads go through dgReaderGzipFileToStruct() (dynio.c),
+ * which decompresses in memory -- no temp file -- and, as the reader
+ * borrows, leaves numeric lists pointing straight into the inflated
+ * buffer. */
 
 /* isValidString() was removed from R's public API (R 4.6.0 keeps the remap
    macro but no longer declares Rf_isValidString); inline the equivalent. */
@@ -36,16 +38,17 @@ SEXP dynListToSexp(DYN_LIST *dl) /* Create a list from a group of dl's */
 {
   int length;
   int i;
-  DYN_LIST **sublists;
+  DYN_LIST *sublist;
   SEXP retval = NULL, cell;
   length = DYN_LIST_N(dl);
 
   switch(DYN_LIST_DATATYPE(dl)) {
   case DF_LIST:
     PROTECT(retval=allocVector(VECSXP, length));
-    sublists = (DYN_LIST **) DYN_LIST_VALS(dl);
     for (i = 0; i < DYN_LIST_N(dl); i++) {
-      cell = dynListToSexp(sublists[i]);
+      /* lazy and flattened (DL_LAZY, DL_CSR) sublists are made here */
+      if (!(sublist = dfuGetDynListList(dl, i))) continue;
+      cell = dynListToSexp(sublist);
       SET_VECTOR_ELT(retval, i, cell);
     }
     UNPROTECT(1);
@@ -108,19 +111,56 @@ dynGroupFileToSexp(SEXP call)
   FILE *fp;
   char *suffix;
   char tempname[128];
-  SEXP retval, names, fname;
+  SEXP retval, names, fname, cols, trials = R_NilValue;
   char *filename; 
+  const char **columns = NULL;
+  int ncolumns = 0;
+  double first, last;
+  DG_READER r;
 
   if (!dg_isValidString(fname = CADR(call)))
     error("first argument must be a file name\n");
   
   filename = R_ExpandFileName(CHAR(STRING_ELT(fname,0)));
 
+  /* optional second argument: names of the lists to load */
+  cols = CDDR(call);
+  if (cols != R_NilValue && (cols = CAR(cols)) != R_NilValue) {
+    if (TYPEOF(cols) != STRSXP)
+      error("columns must be a character vector\n");
+    ncolumns = LENGTH(cols);
+    if (!ncolumns) return allocVector(VECSXP, 0);
+    columns = (const char **) R_alloc(ncolumns, sizeof(char *));
+    for (i = 0; i < ncolumns; i++)
+      columns[i] = CHAR(STRING_ELT(cols, i));
+  }
+
+  /* optional third argument: c(first, last) trials to keep (1-based) */
+  if (CDDR(call) != R_NilValue && CDR(CDDR(call)) != R_NilValue)
+    trials = CADDDR(call);
+  if (trials != R_NilValue) {
+    if (TYPEOF(trials) != REALSXP || LENGTH(trials) != 2)
+      error("trials must be c(first, last)\n");
+    first = REAL(trials)[0];
+    last = REAL(trials)[1];
+    if (!(first >= 1) || !(last >= first-1))
+      error("trials must be c(first, last) with 1 <= first <= last+1\n");
+  }
+
+  dgInitReader(&r);
+  DG_READER_FLAGS(&r) |= DG_READ_BORROW | DG_READ_POOL;
+  dgReaderSetColumns(&r, columns, ncolumns);
+  dgReaderSetThreads(&r, 0);	/* large files decode on all cores */
+  if (trials != R_NilValue)
+    dgReaderSetRange(&r, first-1 >= DG_READ_END ? DG_READ_END : (int) first-1,
+		     last >= DG_READ_END ? DG_READ_END : (int) last);
+
   /* No need to uncompress a .dg file */
   if ((suffix = strrchr(filename, '.')) && strstr(suffix, "dg") &&
       !strstr(suffix, "dgz")) {
     fp = fopen(filename, "rb");
     if (!fp) {
+      dgFreeReader(&r);
       error("error opening data file \"%s\".", filename);
     }
     tempname[0] = 0;
@@ -131,12 +171,15 @@ dynGroupFileToSexp(SEXP call)
 	   ((suffix[1] == 'l' && suffix[2] == 'z' && suffix[3] == '4') ||
 	    (suffix[1] == 'L' && suffix[2] == 'Z' && suffix[3] == '4'))) {
     if (!(dg = dfuCreateDynGroup(4))) {
+      dgFreeReader(&r);
       error("dg_read: error creating new dyngroup");
     }
-    if (dgReadDynGroup(filename, dg) == DF_OK) {
+    if (dgReaderReadDynGroup(&r, filename, dg) == DF_OK) {
       goto process_dg;
     }
     else {
+      dfuFreeDynGroup(dg);
+      dgFreeReader(&r);
       error("dg_read: file %s not recognized as lz4/dg format", 
 	      filename);
     }
@@ -148,19 +191,21 @@ dynGroupFileToSexp(SEXP call)
     char fullname[256];
     int gstat;
     if (!(dg = dfuCreateDynGroup(4))) {
+      dgFreeReader(&r);
       error("dg_read: error creating new dyngroup");
     }
-    gstat = dguGzipFileToStruct(filename, dg);
+    gstat = dgReaderGzipFileToStruct(&r, filename, dg);
     if (gstat != DF_OK) {
       snprintf(fullname, sizeof(fullname), "%s.dg", filename);
-      gstat = dguGzipFileToStruct(fullname, dg);
+      gstat = dgReaderGzipFileToStruct(&r, fullname, dg);
     }
     if (gstat != DF_OK) {
       snprintf(fullname, sizeof(fullname), "%s.dgz", filename);
-      gstat = dguGzipFileToStruct(fullname, dg);
+      gstat = dgReaderGzipFileToStruct(&r, fullname, dg);
     }
     if (gstat != DF_OK) {
       dfuFreeDynGroup(dg);
+      dgFreeReader(&r);
       error("dg_read: file %s not found", filename);
     }
     goto process_dg;
@@ -168,12 +213,16 @@ dynGroupFileToSexp(SEXP call)
 
   /* Only the raw uncompressed .dg branch reaches here (fp set above). */
   if (!(dg = dfuCreateDynGroup(4))) {
+    fclose(fp);
+    dgFreeReader(&r);
     error("error creating dyn group");
   }
 
-  if (!dguFileToStruct(fp, dg)) {
+  if (!dgReaderMapFileToStruct(&r, fp, dg)) {
     fclose(fp);
     if (tempname[0]) unlink(tempname);
+    dfuFreeDynGroup(dg);
+    dgFreeReader(&r);
     error("dg_read: file %s not recognized as dg format", 
 	  filename);
   }
@@ -182,6 +231,7 @@ dynGroupFileToSexp(SEXP call)
 
 
  process_dg:
+  dgFreeReader(&r);
   PROTECT(retval=allocVector(VECSXP, DYN_GROUP_NLISTS(dg)));
   for (i = 0; i < DYN_GROUP_NLISTS(dg); i++) {
     SET_VECTOR_ELT(retval, i, dynListToSexp(DYN_GROUP_LIST(dg, i)));
@@ -323,30 +373,24 @@ static DYN_LIST *SexpToDynList(SEXP sexp)
 
   switch (TYPEOF(sexp)) {
   case REALSXP:
-    {
-      double *v = REAL(sexp);
-      float *fvals;
-      n = length(sexp);
+    n = length(sexp);
+    if (!n) return dfuCreateDynList(DF_FLOAT, 5);
 
-      if (!n) return dfuCreateDynList(DF_FLOAT, 5);
-
-      fvals = (float *) calloc(n, sizeof(float));
-      for (i = 0; i < n; i++) fvals[i] = v[i];
-      retlist = dfuCreateDynListWithVals(DF_FLOAT, n, fvals);
+    retlist = dfuCreateDynList(DF_FLOAT, n);
+    if (retlist && !dfuAppendDynListDoubles(retlist, n, REAL(sexp))) {
+      dfuFreeDynList(retlist);
+      return NULL;
     }
     break;
   case LGLSXP:
   case INTSXP:
-    {
-      int *v = INTEGER(sexp);
-      int *ivals;
-      n = length(sexp);
-
-      if (!n) return dfuCreateDynList(DF_LONG, 5);
+    n = length(sexp);
+    if (!n) return dfuCreateDynList(DF_LONG, 5);
 
-      ivals = (int *) calloc(n, sizeof(int));
-      for (i = 0; i < n; i++) ivals[i] = v[i];
-      retlist = dfuCreateDynListWithVals(DF_LONG, n, ivals);
+    retlist = dfuCreateDynList(DF_LONG, n);
+    if (retlist && !dfuAppendDynListLongs(retlist, n, INTEGER(sexp))) {
+      dfuFreeDynList(retlist);
+      return NULL;
     }
     break;
   case STRSXP:
@@ -356,6 +400,7 @@ static DYN_LIST *SexpToDynList(SEXP sexp)
       if (!n) return dfuCreateDynList(DF_STRING, 5);
 
       retlist = dfuCreateDynList(DF_STRING, n);
+      dfuPoolDynList(retlist);
       for (i = 0; i < n; i++) { 
 	dfuAddDynListString(retlist, (char *) CHAR(STRING_ELT(sexp, i)));
       }
@@ -424,7 +469,9 @@ static SEXP
 SexpToDynGroupFile(SEXP call)
 {
   DYN_GROUP *dg;
+  DG_WRITER w;
   char *filename;
+  int status;
   SEXP fname, s, ans;
 
   if (!isNewList(s = CADR(call)))
@@ -436,13 +483,17 @@ SexpToDynGroupFile(SEXP call)
   
   dg = SexpToDynGroup(s, "dg");
 
-  dgInitBuffer();
-  dgRecordDynGroup(dg);
-  if (!dgWriteBufferCompressed(filename)) {
-    error("error writing data (permissions? / disk full?)\n");
+  if (!dgInitWriter(&w)) {
+    dfuFreeDynGroup(dg);
+    error("unable to allocate write buffer\n");
   }
-  dgCloseBuffer();
+  dgWriterRecordDynGroup(&w, dg);
+  status = dgWriterWriteBufferCompressed(&w, filename);
+  dgFreeWriter(&w);
   dfuFreeDynGroup(dg);
+  if (!status) {
+    error("error writing data (permissions? / disk full?)\n");
+  }
   
   PROTECT(ans = allocVector(INTSXP, 1));
   INTEGER(ans)[0] = 1;
@@ -0,0 +1,116 @@
+/************************************************************************/
+/*                                                                      */
+/*                             dgthread.h                               */
+/*          minimal threads and atomics for the dg readers              */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef __DGTHREAD_H__
+#define __DGTHREAD_H__
+
+/*
+ * Just enough of a portable thread API for the core to farm work out
+ * to a handful of workers: create, join, count processors, bump an
+ * int atomically, and a mutex and condition variable for one thread to
+ * wait on another's progress.  Everything is static inline so no extra source
+ * file needs to be added to the bindings' builds.
+ */
+
+#if defined(_MSC_VER) && !defined(__cplusplus)
+#define DG_INLINE __inline
+#else
+#define DG_INLINE inline
+#endif
+
+#ifdef _WIN32
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+
+typedef HANDLE DG_THREAD;
+#define DG_THREAD_FUNC(f, arg)   DWORD WINAPI f(LPVOID arg)
+#define DG_THREAD_RETURN         return(0)
+
+static DG_INLINE int dgThreadCreate(DG_THREAD *t,
+				    LPTHREAD_START_ROUTINE func, void *arg)
+{
+  *t = CreateThread(NULL, 0, func, arg, 0, NULL);
+  return(*t != NULL);
+}
+
+static DG_INLINE void dgThreadJoin(DG_THREAD t)
+{
+  WaitForSingleObject(t, INFINITE);
+  CloseHandle(t);
+}
+
+static DG_INLINE int dgNumProcessors(void)
+{
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return((int) info.dwNumberOfProcessors);
+}
+
+/* both return the new value */
+#define dgAtomicIncrement(p) ((int) InterlockedIncrement((volatile LONG *)(p)))
+#define dgAtomicDecrement(p) ((int) InterlockedDecrement((volatile LONG *)(p)))
+
+typedef CRITICAL_SECTION DG_MUTEX;
+typedef CONDITION_VARIABLE DG_COND;
+
+#define dgMutexInit(m)       InitializeCriticalSection(m)
+#define dgMutexLock(m)       EnterCriticalSection(m)
+#define dgMutexUnlock(m)     LeaveCriticalSection(m)
+#define dgMutexDestroy(m)    DeleteCriticalSection(m)
+#define dgCondInit(c)        InitializeConditionVariable(c)
+#define dgCondWait(c, m)     SleepConditionVariableCS((c), (m), INFINITE)
+#define dgCondBroadcast(c)   WakeAllConditionVariable(c)
+#define dgCondDestroy(c)
+
+#else
+
+#include <pthread.h>
+#include <unistd.h>
+
+typedef pthread_t DG_THREAD;
+#define DG_THREAD_FUNC(f, arg)   void *f(void *arg)
+#define DG_THREAD_RETURN         return(NULL)
+
+static DG_INLINE int dgThreadCreate(DG_THREAD *t,
+				    void *(*func)(void *), void *arg)
+{
+  return(pthread_create(t, NULL, func, arg) == 0);
+}
+
+static DG_INLINE void dgThreadJoin(DG_THREAD t)
+{
+  pthread_join(t, NULL);
+}
+
+static DG_INLINE int dgNumProcessors(void)
+{
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return(n > 0 ? (int) n : 1);
+}
+
+/* both return the new value */
+#define dgAtomicIncrement(p) __sync_add_and_fetch((p), 1)
+#define dgAtomicDecrement(p) __sync_sub_and_fetch((p), 1)
+
+typedef pthread_mutex_t DG_MUTEX;
+typedef pthread_cond_t DG_COND;
+
+#define dgMutexInit(m)       pthread_mutex_init((m), NULL)
+#define dgMutexLock(m)       pthread_mutex_lock(m)
+#define dgMutexUnlock(m)     pthread_mutex_unlock(m)
+#define dgMutexDestroy(m)    pthread_mutex_destroy(m)
+#define dgCondInit(c)        pthread_cond_init((c), NULL)
+#define dgCondWait(c, m)     pthread_cond_wait((c), (m))
+#define dgCondBroadcast(c)   pthread_cond_broadcast(c)
+#define dgCondDestroy(c)     pthread_cond_destroy(c)
+
+#endif
+
+#endif /* __DGTHREAD_H__ */
@@ -3,6 +3,8 @@
 #include <string.h>
 #include <math.h>
 #include <limits.h>
+#include <stdint.h>
+#include <errno.h>
 
 #if defined(SUN4) || defined(LYNX) || defined(LINUX) || defined(FREEBSD)
 #include <unistd.h>
@@ -11,6 +13,16 @@
 #include "utilc.h"
 #include "df.h"
 #include "dynio.h"
+#include "dgthread.h"
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#endif
 
 #ifdef WINDOWS
 #define ZLIB_DLL
@@ -19,36 +31,70 @@
 #include <zlib.h>
 
 extern size_t compress_buffer_to_lz4_file(unsigned char *, int, FILE *);
+extern size_t compress_buffer_to_lz4_file_mode(unsigned char *, int, FILE *,
+					       int);
 extern int decompress_lz4_file_to_buffer(FILE *, int *, unsigned char **);
+extern int decompress_lz4_file_progress(FILE *, int *, unsigned char **,
+					void (*)(void *, unsigned char *,
+						 size_t, size_t),
+					void *);
+extern int decompress_lz4_buffer_parallel(unsigned char *, size_t, int,
+					  int *, unsigned char **);
+extern void *lz4_sink_open(FILE *, int, unsigned long long);
+extern int lz4_sink_write(void *, unsigned char *, size_t);
+extern int lz4_sink_close(void *);
 
 
-static int dgFlipEvents = 0;	/* to make up for byte ordering probs */
 char dgMagicNumber[] = { 0x21, 0x12, 0x36, 0x63 };
 float dgVersion = 1.0;
 
 #define DG_DATA_BUFFER_SIZE 64000
 
 static void dgDumpBuffer(unsigned char *buffer, int n, int type, FILE *fp);
-static unsigned char *DgBuffer = NULL;
-static int DgBufferIndex = 0;
-static int DgBufferSize;
 static int DgRecording = 0;
 static int DgBufferIncrement = DG_DATA_BUFFER_SIZE;
+static int DgLZ4Independent = 0;
+static int DgGzipThreads = 0;
 
-/* Keep track of which structure we're in using a stack */
-static int DgCurStruct = DG_TOP_LEVEL;
-static char *DgCurStructName = "DG_TOP_LEVEL";
-static TAG_INFO *DgStructStack = NULL;
+/* The writer used by dgInitBuffer(), dgRecordDynGroup() and the like */
+static DG_WRITER DgWriter = {
+  .increment = DG_DATA_BUFFER_SIZE,
+  .structs = { .cur = DG_TOP_LEVEL, .curname = "DG_TOP_LEVEL", .index = -1 }
+};
 static int DgStructStackIncrement = 10;
-static int DgStructStackSize = 0;
-static int DgStructStackIndex = -1;
 
-static void send_event(unsigned char type, unsigned char *data);
-static void send_bytes(int n, unsigned char *data);
-static void push(unsigned char *data, int, int);
-
-static int dguBufferToDynGroup(BUF_DATA *bdata, DYN_GROUP *dg);
-static int dguBufferToDynList(BUF_DATA *bdata, DYN_LIST *dl);
+static void send_event(DG_WRITER *w, unsigned char type, unsigned char *data);
+static void send_bytes(DG_WRITER *w, int n, unsigned char *data);
+static void push(DG_WRITER *w, unsigned char *data, int, int);
+static int reserve(DG_WRITER *w, int nbytes);
+static void sink_flush(DG_WRITER *w);
+static void record_header(DG_WRITER *w);
+static int gather_add(DG_WRITER *w, unsigned char *data, int n);
+static int gather_write(DG_WRITER *w, FILE *fp, int format);
+static int gather_gzwrite(DG_WRITER *w, gzFile file);
+static void record_dyn_list(DG_WRITER *w, unsigned char tag, DYN_LIST *dl);
+static void record_dyn_group(DG_WRITER *w, DYN_GROUP *dg);
+static void push_struct(DG_STRUCT_STACK *s, int newstruct, char *name);
+static int pop_struct(DG_STRUCT_STACK *s);
+static void free_struct_stack(DG_STRUCT_STACK *s);
+static int toc_scan_list(DG_READER *r, BUF_DATA *bdata, DG_TOC_ENTRY *e,
+			 int *depth);
+static int csr_sublists(DG_READER *r, BUF_DATA *bdata, DYN_LIST *dl,
+			int n, int start, int stop);
+static int stream_wait_bytes(DG_STREAM *s, int n);
+static int stream_wait(DG_READER *r, BUF_DATA *bdata, int toplevel);
+static int gz_stream(DG_READER *r, char *filename, DYN_GROUP *dg);
+static int lz4_stream(DG_READER *r, FILE *fp, DYN_GROUP *dg);
+static int gz_index_read(DG_READER *r, char *filename, DYN_GROUP *dg);
+static int stream_element_size(DG_READER *r, BUF_DATA *bdata, int toplevel);
+static void group_truncate(DYN_GROUP *dg, int n);
+static int buffer_to_chunk(DG_READER *r, BUF_DATA *bdata, DYN_GROUP *dg);
+static int file_to_chunk(DG_READER *r, FILE *InFP, DYN_GROUP *dg);
+static int stream_has_chunks(DG_READER *r, unsigned char *vbuf, int bufsize);
+
+static int dguBufferToDynGroup(DG_READER *r, BUF_DATA *bdata, DYN_GROUP *dg);
+static int dguBufferToDynList(DG_READER *r, BUF_DATA *bdata, DYN_LIST *dl,
+			      int toplevel);
 
 int dguBufferToStruct(unsigned char *vbuf, int bufsize, DYN_GROUP *dg);
 
@@ -62,7 +108,8 @@ int dguBufferToStruct(unsigned char *vbuf, int bufsize, DYN_GROUP *dg);
 
 TAG_INFO DGTopLevelTags[] = {
   { DG_VERSION_TAG,  "VERSION",    DF_VERSION,    DG_TOP_LEVEL },
-  { DG_BEGIN_TAG,    "DYN_GROUP",  DF_STRUCTURE,  DYN_GROUP_STRUCT }
+  { DG_BEGIN_TAG,    "DYN_GROUP",  DF_STRUCTURE,  DYN_GROUP_STRUCT },
+  { DG_CHUNK_TAG,    "DYN_CHUNK",  DF_STRUCTURE,  DYN_GROUP_STRUCT }
 };
 
 TAG_INFO DGTags[] = {
@@ -86,62 +133,251 @@ TAG_INFO DLTags[] = {
 };
 
 TAG_INFO *DGTagTable[] = { DGTopLevelTags, DGTags, DLTags };
+static int DGTagTableSize[] = {
+  sizeof(DGTopLevelTags)/sizeof(TAG_INFO),
+  sizeof(DGTags)/sizeof(TAG_INFO),
+  sizeof(DLTags)/sizeof(TAG_INFO)
+};
 
 /**************************************************************************/
 /*                      Initialization Routines                           */
 /**************************************************************************/
 
-void dgInitBuffer(void)
+/*
+ * dgInitReader -- prepare r for use.  Readers are usually declared on the
+ * stack; each thread parsing dg data needs one of its own.
+ */
+void dgInitReader(DG_READER *r)
 {
-  DgBufferSize = DG_DATA_BUFFER_SIZE;
-  if (!(DgBuffer = (unsigned char *)
-	calloc(DgBufferSize, sizeof(unsigned char)))) {
-    fprintf(stderr,"Unable to allocate dg buffer\n");
+  memset(r, 0, sizeof(DG_READER));
+  free_struct_stack(DG_READER_STRUCTS(r));
+}
+
+/* dgFreeReader -- release anything r allocated (it may be reused after) */
+void dgFreeReader(DG_READER *r)
+{
+  free_struct_stack(DG_READER_STRUCTS(r));
+}
+
+/*
+ * dgReaderSetColumns -- only read the top-level lists named in names[];
+ * all others are skipped without being converted.  The names are not
+ * copied, so must stay valid while r is in use.  n = 0 reads every list.
+ */
+void dgReaderSetColumns(DG_READER *r, const char **names, int n)
+{
+  DG_READER_COLUMNS(r) = names;
+  DG_READER_NCOLUMNS(r) = n;
+}
+
+/*
+ * dgReaderSetThreads -- decode the top-level lists of large buffers on
+ * n threads; n <= 0 uses one per processor and 1 (or a fresh reader)
+ * parses serially.  Lists still end up in the group in file order.
+ */
+void dgReaderSetThreads(DG_READER *r, int n)
+{
+  DG_READER_NTHREADS(r) = (n > 0) ? n : dgNumProcessors();
+}
+
+/*
+ * dgReaderSetRange -- only keep elements [start, stop) of each top-level
+ * list (e.g. a range of trials, applied to every column alike so rows
+ * stay aligned).  Sublists outside the range are skipped without being
+ * converted.  Negative values count back from the end of each list and
+ * stop = DG_READ_END keeps the rest, so (-50, DG_READ_END) is the last 50.
+ */
+void dgReaderSetRange(DG_READER *r, int start, int stop)
+{
+  DG_READER_START(r) = start;
+  DG_READER_STOP(r) = stop;
+  DG_READER_FLAGS(r) |= DG_READ_RANGE;
+}
+
+/* reader_range -- the part of an n element top-level list to keep */
+static void reader_range(DG_READER *r, int n, int *start, int *stop)
+{
+  int b = 0, e = n;
+
+  if (DG_READER_FLAGS(r) & DG_READ_RANGE) {
+    b = DG_READER_START(r);
+    e = DG_READER_STOP(r);
+    if (b < 0) b += n;
+    if (e < 0) e += n;
+    if (b < 0) b = 0;
+    if (b > n) b = n;
+    if (e > n) e = n;
+    if (e < b) e = b;
+  }
+  *start = b;
+  *stop = e;
+}
+
+/*
+ * slice_list -- trim a top-level list to the reader's range.  Borrowed
+ * data just moves its vals pointer along, and lazy or flattened lists
+ * (DL_LAZY, DL_CSR) drop the sublists out of range without making any.
+ */
+static void slice_list(DG_READER *r, DYN_LIST *dl)
+{
+  int i, start, stop, size;
+  char *vals;
+
+  reader_range(r, DYN_LIST_N(dl), &start, &stop);
+  if (start == 0 && stop == DYN_LIST_N(dl)) return;
+
+  switch (DYN_LIST_DATATYPE(dl)) {
+  case DF_STRING:
+    {
+      char **strings = (char **) DYN_LIST_VALS(dl);
+      if (!(DYN_LIST_FLAGS(dl) & DL_POOLED)) {
+	for (i = 0; i < start; i++) free(strings[i]);
+	for (i = stop; i < DYN_LIST_N(dl); i++) free(strings[i]);
+      }
+      memmove(strings, strings+start, (stop-start)*sizeof(char *));
+      DYN_LIST_N(dl) = stop-start;
+    }
+    return;
+  case DF_LIST:
+    {
+      DYN_LIST **sublists = (DYN_LIST **) DYN_LIST_VALS(dl);
+      for (i = 0; i < start; i++) dfuFreeDynList(sublists[i]);
+      for (i = stop; i < DYN_LIST_N(dl); i++) dfuFreeDynList(sublists[i]);
+      memmove(sublists, sublists+start, (stop-start)*sizeof(DYN_LIST *));
+
+      /* sublists not made yet stay that way; their sources move too */
+      if (DYN_LIST_FLAGS(dl) & DL_LAZY) {
+	DYN_LAZY *lazy = DYN_LIST_LAZY(dl);
+	int n = (DYN_LAZY_N(lazy) < stop ? DYN_LAZY_N(lazy) : stop) - start;
+	if (n < 0) n = 0;
+	if (n) memmove(DYN_LAZY_OFFSETS(lazy), DYN_LAZY_OFFSETS(lazy)+start,
+		       n*sizeof(int));
+	DYN_LAZY_N(lazy) = n;
+      }
+      if (DYN_LIST_FLAGS(dl) & DL_CSR) {
+	DYN_CSR *csr = DYN_LIST_CSR(dl);
+	memmove(DYN_CSR_OFFSETS(csr), DYN_CSR_OFFSETS(csr)+start,
+		(stop-start+1)*sizeof(int64_t));
+      }
+      DYN_LIST_N(dl) = stop-start;
+    }
+    return;
+  case DF_LONG:  size = sizeof(int);   break;
+  case DF_SHORT: size = sizeof(short); break;
+  case DF_FLOAT: size = sizeof(float); break;
+  case DF_CHAR:  size = sizeof(char);  break;
+  default:
     return;
   }
+
+  vals = (char *) DYN_LIST_VALS(dl);
+  if (DYN_LIST_FLAGS(dl) & DL_BORROWED) {
+    DYN_LIST_VALS(dl) = vals + start*size;
+    DYN_LIST_MAX(dl) = stop-start;
+  }
+  else memmove(vals, vals + start*size, (stop-start)*size);
+  DYN_LIST_N(dl) = stop-start;
+}
+
+static int reader_wants_list(DG_READER *r, char *name)
+{
+  int i;
+  if (!DG_READER_NCOLUMNS(r)) return(1);
+  for (i = 0; i < DG_READER_NCOLUMNS(r); i++) {
+    if (!strncmp(DG_READER_COLUMNS(r)[i], name, DYN_LIST_NAME_SIZE-1))
+      return(1);
+  }
+  return(0);
+}
+
+/*
+ * dgInitWriter -- prepare w for recording, with an empty buffer holding
+ * just the stream header.  Returns 1 on success, 0 if the buffer can't
+ * be allocated.
+ */
+int dgInitWriter(DG_WRITER *w)
+{
+  memset(w, 0, sizeof(DG_WRITER));
+  free_struct_stack(&w->structs);
+  w->increment = DgBufferIncrement;
+  w->size = DG_DATA_BUFFER_SIZE;
+  if (!(w->buffer = (unsigned char *)
+	calloc(w->size, sizeof(unsigned char)))) {
+    fprintf(stderr,"Unable to allocate dg buffer\n");
+    w->size = 0;
+    return 0;
+  }
   
-  dgResetBuffer();
+  dgResetWriter(w);
+  return 1;
+}
+
+/* dgResetWriter -- empty w's buffer, leaving just the stream header */
+void dgResetWriter(DG_WRITER *w)
+{
+  w->index = 0;
+  w->overflow = 0;
+  w->nsegs = 0;
+
+  w->structs.index = -1;	/* anything left open is abandoned */
+  push_struct(&w->structs, DG_TOP_LEVEL, "DG_TOP_LEVEL");
+  record_header(w);
+}
+
+/* dgFreeWriter -- close w's sink (if any) and release its buffer */
+void dgFreeWriter(DG_WRITER *w)
+{
+  if (w->sink) dgWriterCloseSink(w);
+  if (w->buffer && !w->fixed) free(w->buffer);
+  if (w->segs) free(w->segs);
+  if (w->iov) free(w->iov);
+  w->buffer = NULL;
+  w->segs = NULL;
+  w->iov = NULL;
+  w->size = w->index = w->nsegs = w->maxsegs = 0;
+  free_struct_stack(&w->structs);
+}
+
+void dgInitBuffer(void)
+{
+  if (dgInitWriter(&DgWriter)) DgRecording = 1;
 }
 
 void dgResetBuffer(void)
 {
   DgRecording = 1;
-  DgBufferIndex = 0;
-  
-  dgPushStruct(DG_TOP_LEVEL, "DG_TOP_LEVEL");
-  
-  dgRecordMagicNumber();
-  dgRecordFloat(T_VERSION_TAG, dgVersion);
+  dgResetWriter(&DgWriter);
 }
 
 void dgCloseBuffer(void)
 {
-  if (DgBuffer) free(DgBuffer);
-  dgFreeStructStack();
+  dgFreeWriter(&DgWriter);
   DgRecording = 0;
 }
 
 unsigned char *dgGetBuffer(void)
 {
-  return DgBuffer;
+  return DG_WRITER_BUFFER(&DgWriter);
 }
 
 int dgGetBufferSize(void)
 {
-  return DgBufferIndex;
+  return DG_WRITER_SIZE(&DgWriter);
 }
 
 
-/* get estimate of list size (in bytes) */
+/*
+ * get estimate of list size (in bytes).  The sublists of a flattened
+ * (DL_CSR) list are sized from its offsets; those of a lazy list are
+ * decoded, as writing the list would.
+ */
 static int get_list_length(DYN_LIST *dl)
 {
   int i, sum = 64;		/* overhead */
-  DYN_LIST **vals;
+  int64_t *offsets;
 
   if (!dl) return sum;
 
-  vals = (DYN_LIST **) DYN_LIST_VALS(dl);
-
   if (DYN_LIST_DATATYPE(dl) != DF_LIST) {
     switch (DYN_LIST_DATATYPE(dl)) {
     case DF_LONG:
@@ -159,10 +395,24 @@ static int get_list_length(DYN_LIST *dl)
       break;
     }
   }
+  else if (DYN_LIST_FLAGS(dl) & DL_CSR) {
+    offsets = DYN_CSR_OFFSETS(DYN_LIST_CSR(dl));
+    switch (DYN_CSR_DATATYPE(DYN_LIST_CSR(dl))) {
+    case DF_LONG:
+    case DF_FLOAT:
+      sum += 4*(int) (offsets[DYN_LIST_N(dl)] - offsets[0]);
+      break;
+    case DF_SHORT:
+      sum += 2*(int) (offsets[DYN_LIST_N(dl)] - offsets[0]);
+      break;
+    case DF_CHAR:
+      sum += (int) (offsets[DYN_LIST_N(dl)] - offsets[0]);
+      break;
+    }
+  }
   else {
-    vals = (DYN_LIST **) DYN_LIST_VALS(dl);
     for (i = 0; i < DYN_LIST_N(dl); i++) {
-      sum += get_list_length(vals[i]);
+      sum += get_list_length(dfuGetDynListList(dl, i));
     }
   }
   return sum;
@@ -179,17 +429,169 @@ int dgEstimateGroupSize(DYN_GROUP *dg)
   return nelts;
 }
 
+/*
+ * list_size -- the exact number of bytes dgRecordDynList() adds for dl
+ * (loading it first, as that does)
+ */
+static size_t list_size(DYN_LIST *dl)
+{
+  size_t n;
+  int i;
+  char **strings;
+  DYN_LIST **sublists;
+
+  dfuLoadDynList(dl);
+  n = 1				/* the list's own tag           */
+    + 1 + sizeof(int) + strlen(DYN_LIST_NAME(dl)) + 1
+    + 2 * (1 + sizeof(int))	/* INCREMENT and FLAGS          */
+    + 1				/* DATA                         */
+    + 1;			/* END_STRUCT                   */
+
+  switch (DYN_LIST_DATATYPE(dl)) {
+  case DF_CHAR:
+    n += 1 + sizeof(int) + (size_t) DYN_LIST_N(dl) * sizeof(char);
+    break;
+  case DF_SHORT:
+    n += 1 + sizeof(int) + (size_t) DYN_LIST_N(dl) * sizeof(short);
+    break;
+  case DF_LONG:
+    n += 1 + sizeof(int) + (size_t) DYN_LIST_N(dl) * sizeof(int);
+    break;
+  case DF_FLOAT:
+    n += 1 + sizeof(int) + (size_t) DYN_LIST_N(dl) * sizeof(float);
+    break;
+  case DF_STRING:
+    if (!(strings = (char **) DYN_LIST_VALS(dl))) break;
+    n += 1 + sizeof(int);
+    for (i = 0; i < DYN_LIST_N(dl); i++)
+      n += sizeof(int) + strlen(strings[i]) + 1;
+    break;
+  case DF_LIST:
+    sublists = (DYN_LIST **) DYN_LIST_VALS(dl);
+    n += 1 + sizeof(int);
+    for (i = 0; i < DYN_LIST_N(dl); i++) n += list_size(sublists[i]);
+    break;
+  }
+  return n;
+}
+
+/* group_size -- the exact number of bytes dgRecordDynGroup() adds */
+static size_t group_size(DYN_GROUP *dg)
+{
+  size_t n;
+  int i;
+
+  n = 1 + 1 + sizeof(int) + strlen(DYN_GROUP_NAME(dg)) + 1 +
+    1 + sizeof(int) + 1;
+  for (i = 0; i < DYN_GROUP_NLISTS(dg); i++)
+    n += list_size(DYN_GROUP_LIST(dg,i));
+  return n;
+}
+
+/*
+ * dgComputeSerializedSize -- the exact length of the dg stream holding
+ * just dg (magic number, version and group), as dgSerializeDynGroup()
+ * or a fresh buffer and dgRecordDynGroup() would produce it, or -1 if
+ * that would be INT_MAX bytes or more.
+ */
+int dgComputeSerializedSize(DYN_GROUP *dg)
+{
+  size_t n = DG_MAGIC_NUMBER_SIZE + 1 + sizeof(float) + group_size(dg);
+  return(n < (size_t) INT_MAX ? (int) n : -1);
+}
+
+/*
+ * dgSerializeDynGroup -- write the dg stream holding dg into buf,
+ * which has room for size bytes (a shared memory slot, say), without
+ * touching the current buffer.  Returns the number of bytes written,
+ * or 0 if it doesn't fit (see dgComputeSerializedSize()).
+ */
+int dgSerializeDynGroup(DYN_GROUP *dg, unsigned char *buf, int size)
+{
+  DG_WRITER w;
+  int n;
+
+  memset(&w, 0, sizeof(DG_WRITER));
+  free_struct_stack(&w.structs);
+  w.buffer = buf;
+  w.size = size;
+  w.fixed = 1;
+
+  push_struct(&w.structs, DG_TOP_LEVEL, "DG_TOP_LEVEL");
+  record_header(&w);
+  record_dyn_group(&w, dg);
+  n = w.overflow ? 0 : w.index;
+  dgFreeWriter(&w);
+  return(n);
+}
+
+/*
+ * dgSerializeDynGroupAlloc -- dgSerializeDynGroup() into a malloc'd
+ * buffer of exactly the right size, returned with its size in *size
+ * (or NULL on failure).
+ */
+unsigned char *dgSerializeDynGroupAlloc(DYN_GROUP *dg, int *size)
+{
+  unsigned char *buf;
+  int n;
+
+  if ((n = dgComputeSerializedSize(dg)) < 0 ||
+      !(buf = (unsigned char *) malloc(n))) return(NULL);
+  if (dgSerializeDynGroup(dg, buf, n) != n) {
+    free(buf);
+    return(NULL);
+  }
+  *size = n;
+  return(buf);
+}
+
+/*
+ * dgSetBufferIncrement -- set how much the global buffer, and writers
+ * initialized from now on, grow by at a time.  Returns the old setting.
+ */
 int dgSetBufferIncrement(int increment)
 {
   int old = DgBufferIncrement;
-  if (increment >= 0) DgBufferIncrement = increment;
+  if (increment >= 0) DgBufferIncrement = DgWriter.increment = increment;
+  return old;
+}
+
+/*
+ * dgSetLZ4Independent -- with flag set, .lz4 files are written as
+ * independent blocks, which threaded readers decompress in parallel
+ * (at a small cost in compression).  Returns the old setting.
+ */
+int dgSetLZ4Independent(int flag)
+{
+  int old = DgLZ4Independent;
+  if (flag >= 0) DgLZ4Independent = flag;
+  return old;
+}
+
+/*
+ * dgSetGzipThreads -- deflate buffers of DG_GZ_PARALLEL_MIN_SIZE or more
+ * on n threads (1 writes serially; 0, the default, means one per
+ * processor).  Returns the old setting.
+ */
+int dgSetGzipThreads(int n)
+{
+  int old = DgGzipThreads;
+  if (n >= 0) DgGzipThreads = n;
   return old;
 }
 
 int dgWriteBuffer(char *filename, char format)
+{
+  return dgWriterWriteBuffer(&DgWriter, filename, format);
+}
+
+/* dgWriterWriteBuffer -- write w's buffer to filename (or stdout) */
+int dgWriterWriteBuffer(DG_WRITER *w, char *filename, char format)
 {
    FILE *fp = stdout;
    char *filemode = "wb+";
+
+   if (w->overflow) return 0;	/* the buffer is missing something */
    
    switch (format) {
    case DF_BINARY:
@@ -207,25 +609,189 @@ int dgWriteBuffer(char *filename, char format)
      }
    }
 
+   if (w->nsegs) {
+     int status = gather_write(w, fp, format);
+     if (filename && filename[0] && fclose(fp)) status = 0;
+     return status;
+   }
+
    if (format == DF_LZ4) {
      int bytes_written;
-     bytes_written = compress_buffer_to_lz4_file(DgBuffer, DgBufferIndex, fp);
+     bytes_written = compress_buffer_to_lz4_file_mode(w->buffer, w->index,
+						      fp, DgLZ4Independent);
      if (!bytes_written) {
        fclose(fp);
        return 0;
      }
    }
    else {
-     dgDumpBuffer(DgBuffer, DgBufferIndex, format, fp);
+     dgDumpBuffer(w->buffer, w->index, format, fp);
    }
 
    if (filename && filename[0]) fclose(fp);
    return 1;
 }
 
+/*
+ * Large buffers are compressed pigz-style: the buffer is cut into
+ * blocks which are deflated on their own threads, each primed with the
+ * 32K of input before it (so compression hardly suffers) and ended on a
+ * byte boundary with a sync flush, and the raw deflate data is written
+ * out in order between one gzip header and trailer.  The result is an
+ * ordinary single-member gzip file.
+ */
+#ifndef DG_GZ_PARALLEL_MIN_SIZE
+#define DG_GZ_PARALLEL_MIN_SIZE (1<<20)
+#endif
+#define DG_GZ_BLOCK_SIZE  (1<<17)
+#define DG_GZ_DICT_SIZE   32768
+
+typedef struct {
+  unsigned char  *data;
+  int             size;
+  int             nblocks;
+  unsigned char **out;		/* deflated blocks                     */
+  int            *outsize;	/* their lengths (0 until done, -1 on failure) */
+  uLong          *crc;		/* and their uncompressed CRCs         */
+  int             next;		/* next block to claim (atomic)        */
+  DG_MUTEX        lock;
+  DG_COND         cond;
+} DG_GZ_JOB;
+
+static DG_THREAD_FUNC(gz_deflate_worker, arg)
+{
+  DG_GZ_JOB *job = (DG_GZ_JOB *) arg;
+  unsigned char *in, *out;
+  int i, n, last, status;
+  uLong bound;
+  z_stream zs;
+
+  while ((i = dgAtomicIncrement(&job->next) - 1) < job->nblocks) {
+    in = job->data + (size_t) i * DG_GZ_BLOCK_SIZE;
+    last = (i == job->nblocks-1);
+    n = last ? job->size - i * DG_GZ_BLOCK_SIZE : DG_GZ_BLOCK_SIZE;
+    job->crc[i] = crc32(crc32(0L, Z_NULL, 0), in, n);
+
+    out = NULL;
+    memset(&zs, 0, sizeof(zs));
+    status = deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS,
+			  8, Z_DEFAULT_STRATEGY);
+    if (status == Z_OK) {
+      if (i) deflateSetDictionary(&zs, in - DG_GZ_DICT_SIZE, DG_GZ_DICT_SIZE);
+      bound = deflateBound(&zs, n) + 16;	/* plus the sync flush */
+      if ((out = (unsigned char *) malloc(bound))) {
+	zs.next_in = in;
+	zs.avail_in = n;
+	zs.next_out = out;
+	zs.avail_out = bound;
+	status = deflate(&zs, last ? Z_FINISH : Z_SYNC_FLUSH);
+	if (status != (last ? Z_STREAM_END : Z_OK) || zs.avail_in) {
+	  free(out);
+	  out = NULL;
+	}
+      }
+      deflateEnd(&zs);
+    }
+
+    dgMutexLock(&job->lock);
+    job->out[i] = out;
+    job->outsize[i] = out ? (int) zs.total_out : -1;
+    dgCondBroadcast(&job->cond);
+    dgMutexUnlock(&job->lock);
+  }
+  DG_THREAD_RETURN;
+}
+
+/*
+ * gz_write_parallel -- write data[size] to fp as gzip, deflating on
+ * several threads.  Returns 1 on success, 0 on a write or compression
+ * error, or -1 (having written nothing) if it isn't worth it.
+ */
+static int gz_write_parallel(unsigned char *data, int size, FILE *fp)
+{
+  static unsigned char header[10] =
+    { 0x1f, 0x8b, Z_DEFLATED, 0, 0, 0, 0, 0, 0, 0xff };
+  DG_GZ_JOB job;
+  DG_THREAD *threads;
+  unsigned char trailer[8];
+  uLong crc;
+  int i, n, nthreads, nstarted = 0, ok = 1;
+
+  nthreads = DgGzipThreads ? DgGzipThreads : dgNumProcessors();
+  if (nthreads < 2 || size < DG_GZ_PARALLEL_MIN_SIZE) return(-1);
+
+  memset(&job, 0, sizeof(job));
+  job.data = data;
+  job.size = size;
+  job.nblocks = (size + DG_GZ_BLOCK_SIZE - 1) / DG_GZ_BLOCK_SIZE;
+  if (nthreads > job.nblocks) nthreads = job.nblocks;
+  job.out = (unsigned char **) calloc(job.nblocks, sizeof(unsigned char *));
+  job.outsize = (int *) calloc(job.nblocks, sizeof(int));
+  job.crc = (uLong *) calloc(job.nblocks, sizeof(uLong));
+  threads = (DG_THREAD *) calloc(nthreads, sizeof(DG_THREAD));
+  if (!job.out || !job.outsize || !job.crc || !threads) {
+    free(job.out); free(job.outsize); free(job.crc); free(threads);
+    return(-1);
+  }
+  dgMutexInit(&job.lock);
+  dgCondInit(&job.cond);
+  for (i = 0; i < nthreads; i++) {
+    if (!dgThreadCreate(&threads[nstarted], gz_deflate_worker, &job)) break;
+    nstarted++;
+  }
+  if (!nstarted) gz_deflate_worker(&job);
+
+  /* write each block as soon as it and those before it are done */
+  ok = fwrite(header, 1, sizeof(header), fp) == sizeof(header);
+  crc = crc32(0L, Z_NULL, 0);
+  for (i = 0; i < job.nblocks; i++) {
+    dgMutexLock(&job.lock);
+    while (!job.outsize[i]) dgCondWait(&job.cond, &job.lock);
+    dgMutexUnlock(&job.lock);
+    n = (i == job.nblocks-1) ? size - i * DG_GZ_BLOCK_SIZE : DG_GZ_BLOCK_SIZE;
+    if (job.outsize[i] < 0) ok = 0;
+    else if (ok && fwrite(job.out[i], 1, job.outsize[i], fp) !=
+	     (size_t) job.outsize[i]) ok = 0;
+    crc = crc32_combine(crc, job.crc[i], n);
+    if (job.out[i]) free(job.out[i]);
+  }
+  for (i = 0; i < nstarted; i++) dgThreadJoin(threads[i]);
+
+  for (i = 0; i < 4; i++) {
+    trailer[i] = (crc >> (8*i)) & 0xff;
+    trailer[4+i] = ((unsigned int) size >> (8*i)) & 0xff;
+  }
+  if (ok) ok = fwrite(trailer, 1, sizeof(trailer), fp) == sizeof(trailer);
+
+  dgCondDestroy(&job.cond);
+  dgMutexDestroy(&job.lock);
+  free(job.out); free(job.outsize); free(job.crc); free(threads);
+  return(ok);
+}
+
 int dgWriteBufferCompressed(char *filename)
+{
+  return dgWriterWriteBufferCompressed(&DgWriter, filename);
+}
+
+/* dgWriterWriteBufferCompressed -- gzip w's buffer to filename (or stdout) */
+int dgWriterWriteBufferCompressed(DG_WRITER *w, char *filename)
 {
   gzFile file;
+  FILE *fp = stdout;
+  int status;
+
+  if (w->overflow) return 0;
+
+  if (!w->nsegs && w->index >= DG_GZ_PARALLEL_MIN_SIZE) {
+    if (filename && filename[0] && !(fp = fopen(filename, "wb"))) return 0;
+    status = gz_write_parallel(w->buffer, w->index, fp);
+    if (fp != stdout) {
+      if (fclose(fp)) status = 0;
+    }
+    else fflush(fp);
+    if (status >= 0) return status;
+  }
   
   if (filename && filename[0]) {
     if (!(file = gzopen(filename, "wb"))) {
@@ -236,1060 +802,1313 @@ int dgWriteBufferCompressed(char *filename)
     file = gzdopen(fileno(stdout), "wb");
   }
   
-  if (gzwrite(file, DgBuffer, DgBufferIndex) != DgBufferIndex) {
-    return 0;
-  }
+  if (w->nsegs) status = gather_gzwrite(w, file);
+  else status = gzwrite(file, w->buffer, w->index) == w->index;
   
   if (filename && filename[0]) {
     if (gzclose(file) != Z_OK) {
       return 0;
     }
   }
-  return 1;
+  return status;
 }
 
-int dgReadDynGroup(char *filename, DYN_GROUP *dg)
-{
-  FILE *fp = stdin;
-  char *filemode = "rb";
-  int status = 0;
-  char *suffix;
-  unsigned char *data;
-  int size;
-  
-  if (filename && filename[0]) {
-    if (!(fp = fopen(filename, filemode))) {
-      return(0);
-    }
-  }
-  
-  if ((suffix = strrchr(filename, '.'))) {
-    if (strlen(suffix) == 4) {
-      if ((suffix[1] == 'l' && suffix[2] == 'z' && suffix[3] == '4') ||
-	  (suffix[1] == 'L' && suffix[2] == 'Z' && suffix[3] == '4')) {
-	if (decompress_lz4_file_to_buffer(fp, &size, &data)) {
-	  fclose(fp);
-	  status = dguBufferToStruct(data, size, dg);
-	  free(data);
-	  return status;
-	}
-	else {
-	  fclose(fp);
-	  return DF_ABORT;
-	}
-      }
-    }
-  }
+/*--------------------------------------------------------------------
+  -----                  Streaming (Sink) Writes                 -----
 
-  status = dguFileToStruct(fp, dg);
+      Normally a whole group is serialized into a writer's buffer
+      before it is written out.  Once dgWriterOpenSink() has given
+      the buffer a sink, it is instead handed to the sink (and
+      emptied) whenever it holds DG_SINK_BLOCK_SIZE bytes, and arrays
+      at least that big go to the sink directly, so writing takes one
+      block of memory rather than a copy of the whole stream.  The
+      contents of the buffer are then only the part not yet written.
 
-  if (filename && filename[0]) fclose(fp);
-  return(status);
+  -----                                                          -----
+  -------------------------------------------------------------------*/
+
+static void sink_flush(DG_WRITER *w)
+{
+  if (w->index && w->sinkstatus &&
+      !w->sink->write(w->sink->state, w->buffer, w->index))
+    w->sinkstatus = 0;
+  w->index = 0;
 }
 
 /*
- * dguGzipFileToStruct -- read a gzip-compressed dg file (.dgz) fully into
- * memory and parse it directly, with NO temporary file (the gzip analogue
- * of the in-memory LZ4 path above).  dguBufferToStruct copies all data out,
- * so the buffer is freed immediately after.  Returns DF_OK on success,
- * 0 on any failure.
+ * dgWriterOpenSink -- write what is in w's buffer so far to sink, and
+ * everything recorded from now on, until dgWriterCloseSink().  Returns
+ * 1 on success, 0 if there is no buffer or it already has a sink.
  */
-int dguGzipFileToStruct(char *filename, DYN_GROUP *dg)
+int dgWriterOpenSink(DG_WRITER *w, DG_SINK *sink)
+{
+  if (!w->buffer || w->fixed || w->sink || w->nsegs || !sink) return 0;
+  w->sink = sink;
+  w->sinkstatus = 1;
+  sink_flush(w);
+  return w->sinkstatus;
+}
+
+/*
+ * dgWriterCloseSink -- write the rest of w's buffer and close the sink.
+ * Returns 1 if everything was written, 0 otherwise.
+ */
+int dgWriterCloseSink(DG_WRITER *w)
 {
-  gzFile in;
-  unsigned char *buf = NULL;
-  size_t cap = 0, total = 0;
-  const size_t CHUNK = 65536;
   int status;
 
-  if (!filename || !filename[0]) return 0;
-  if (!(in = gzopen(filename, "rb"))) return 0;
+  if (!w->sink) return 0;
+  sink_flush(w);
+  status = w->sink->close(w->sink->state) && w->sinkstatus && !w->overflow;
+  w->sink = NULL;
+  return status;
+}
 
-  for (;;) {
-    int len;
+int dgOpenBufferSink(DG_SINK *sink)
+{
+  return dgWriterOpenSink(&DgWriter, sink);
+}
 
-    if (total > (size_t) INT_MAX - CHUNK - 1) {
-      fprintf(stderr, "dg: \"%s\" too large to decompress in memory\n",
-	      filename);
-      free(buf); gzclose(in); return 0;
-    }
+int dgCloseBufferSink(void)
+{
+  return dgWriterCloseSink(&DgWriter);
+}
 
-    if (total + CHUNK + 1 > cap) {
-      size_t newcap = cap ? cap : (CHUNK * 4);
-      unsigned char *tmp;
-      while (newcap < total + CHUNK + 1) newcap *= 2;
-      tmp = (unsigned char *) realloc(buf, newcap);
-      if (!tmp) {
-	fprintf(stderr, "dg: out of memory decompressing \"%s\"\n", filename);
-	free(buf); gzclose(in); return 0;
-      }
-      buf = tmp; cap = newcap;
-    }
+/*
+ * dgWriteDynGroup -- stream dg to sink, which is closed afterwards.
+ * This uses a writer of its own, so the global buffer is untouched.
+ */
+int dgWriteDynGroup(DYN_GROUP *dg, DG_SINK *sink)
+{
+  DG_WRITER w;
+  int status;
 
-    len = gzread(in, buf + total, (unsigned) CHUNK);
-    if (len < 0) {
-      int err = 0;
-      fprintf(stderr, "dg: gzread error on \"%s\": %s\n",
-	      filename, gzerror(in, &err));
-      free(buf); gzclose(in); return 0;
-    }
-    if (len == 0) break;
-    total += (size_t) len;
+  if (!dgInitWriter(&w) || !dgWriterOpenSink(&w, sink)) {
+    sink->close(sink->state);
+    dgFreeWriter(&w);
+    return 0;
   }
-
-  if (gzclose(in) != Z_OK) { free(buf); return 0; }
-  if (total == 0)          { free(buf); return 0; }
-
-  status = dguBufferToStruct(buf, (int) total, dg);
-  free(buf);
+  record_dyn_group(&w, dg);
+  status = dgWriterCloseSink(&w);
+  dgFreeWriter(&w);
   return status;
 }
 
-#ifdef COMPRESSION
-/* Legacy entry point; dguGzipFileToStruct() above is the real (in-memory)
-   implementation now. */
-int dgReadDynGroupCompressed(char *filename, DYN_GROUP *dg)
+static int file_sink_write(void *state, unsigned char *data, int n)
 {
-  return dguGzipFileToStruct(filename, dg);
+  return(fwrite(data, 1, n, (FILE *) state) == (size_t) n);
 }
-#endif
-
-
 
-void dgLoadStructure(DYN_GROUP *dg)
+static int file_sink_close(void *state)
 {
-  dguBufferToStruct(DgBuffer, DgBufferIndex, dg);
+  FILE *fp = (FILE *) state;
+  if (fp == stdout) return(fflush(fp) == 0);
+  return(fclose(fp) == 0);
 }
 
-/*********************************************************************/
-/*                   High Level Recording Funcs                      */
-/*********************************************************************/
+/*
+ * dgOpenFileSink -- sink for an uncompressed .dg file (stdout if
+ * filename is NULL or empty).  Returns 1 on success, 0 on failure.
+ */
+int dgOpenFileSink(DG_SINK *sink, char *filename)
+{
+  FILE *fp = stdout;
+
+  if (filename && filename[0] && !(fp = fopen(filename, "wb"))) return(0);
+  sink->write = file_sink_write;
+  sink->close = file_sink_close;
+  sink->state = fp;
+  return(1);
+}
 
+static int gz_sink_write(void *state, unsigned char *data, int n)
+{
+  return(gzwrite((gzFile) state, data, n) == n);
+}
 
-void dgRecordDynList(unsigned char tag, DYN_LIST *dl)
+static int gz_sink_close(void *state)
 {
-  dgBeginStruct(tag);
-  dgRecordString(DL_NAME_TAG, DYN_LIST_NAME(dl));
-  dgRecordLong(DL_INCREMENT_TAG, DYN_LIST_INCREMENT(dl));
-  dgRecordLong(DL_FLAGS_TAG, DYN_LIST_FLAGS(dl));
-  dgRecordVoidArray(DL_DATA_TAG, DYN_LIST_DATATYPE(dl), DYN_LIST_N(dl),
-		    DYN_LIST_VALS(dl));
-  dgEndStruct();
+  return(gzclose((gzFile) state) == Z_OK);
 }
 
-void dgRecordDynGroup(DYN_GROUP *dg)
+/* dgOpenGzipSink -- as dgOpenFileSink(), for a gzip compressed .dgz */
+int dgOpenGzipSink(DG_SINK *sink, char *filename)
 {
-  int i = 0;
-  dgBeginStruct(DG_BEGIN_TAG);
-  dgRecordString(DG_NAME_TAG, DYN_GROUP_NAME(dg));
-  dgRecordLong(DG_NLISTS_TAG, DYN_GROUP_NLISTS(dg));
-  for (i = 0; i < DYN_GROUP_NLISTS(dg); i++) 
-    dgRecordDynList(DG_DYNLIST_TAG, DYN_GROUP_LIST(dg,i));
-  dgEndStruct();
+  gzFile file;
+
+  if (filename && filename[0]) file = gzopen(filename, "wb");
+  else file = gzdopen(fileno(stdout), "wb");
+  if (!file) return(0);
+  sink->write = gz_sink_write;
+  sink->close = gz_sink_close;
+  sink->state = file;
+  return(1);
 }
 
-/*********************************************************************/
-/*                   Array Event Recording Funcs                     */
-/*********************************************************************/
+typedef struct {
+  FILE *fp;
+  void *lz4;
+} DG_LZ4_SINK;
 
-void dgBeginStruct(unsigned char tag)
+static int lz4_sink_write_dg(void *state, unsigned char *data, int n)
 {
-  dgRecordFlag(tag);
-  dgPushStruct(dgGetStructureType(tag), dgGetTagName(tag));
+  return(lz4_sink_write(((DG_LZ4_SINK *) state)->lz4, data, n));
 }
 
-void dgEndStruct(void)
+static int lz4_sink_close_dg(void *state)
 {
-  dgRecordFlag(END_STRUCT);
-  dgPopStruct();
+  DG_LZ4_SINK *s = (DG_LZ4_SINK *) state;
+  int status = lz4_sink_close(s->lz4);
+
+  if (s->fp == stdout) status = (fflush(s->fp) == 0) && status;
+  else status = (fclose(s->fp) == 0) && status;
+  free(s);
+  return(status);
 }
 
-void dgRecordVoidArray(unsigned char type, int datatype, int n, void *data)
+/*
+ * dgOpenLZ4Sink -- as dgOpenFileSink(), for an .lz4 file.  The frame
+ * can't record its content size, so it is read back serially.
+ */
+int dgOpenLZ4Sink(DG_SINK *sink, char *filename)
 {
-  int i;
-  send_event(type, NULL);
-  switch (datatype) {
-  case DF_CHAR:
-    dgRecordCharArray(DL_CHAR_DATA_TAG, n, (char *) data);
-    break;
-  case DF_SHORT:
-    dgRecordShortArray(DL_SHORT_DATA_TAG, n, (short *) data);
-    break;
-  case DF_LONG:
-    dgRecordLongArray(DL_LONG_DATA_TAG, n, (int *) data);
-    break;
-  case DF_FLOAT:
-    dgRecordFloatArray(DL_FLOAT_DATA_TAG, n, (float *) data);
-    break;
-  case DF_STRING:
-    dgRecordStringArray(DL_STRING_DATA_TAG, n, (char **) data);
-    break;
-  case DF_LIST:
-    {
-      DYN_LIST **vals = (DYN_LIST **) data;
-      dgRecordListArray(DL_LIST_DATA_TAG, n);
-      for (i = 0; i < n; i++) {
-	dgRecordDynList(DL_SUBLIST_TAG, vals[i]);
-      }
-    }
-    break;
+  DG_LZ4_SINK *s;
+
+  if (!(s = (DG_LZ4_SINK *) calloc(1, sizeof(DG_LZ4_SINK)))) return(0);
+  s->fp = stdout;
+  if ((filename && filename[0] && !(s->fp = fopen(filename, "wb"))) ||
+      !(s->lz4 = lz4_sink_open(s->fp, DgLZ4Independent, 0))) {
+    if (s->fp && s->fp != stdout) fclose(s->fp);
+    free(s);
+    return(0);
   }
+  sink->write = lz4_sink_write_dg;
+  sink->close = lz4_sink_close_dg;
+  sink->state = s;
+  return(1);
 }
 
+/*--------------------------------------------------------------------
+  -----                  Scatter-Gather Writes                   -----
 
-void dgRecordString(unsigned char type, char *str)
+      A writer set to gather (dgWriterSetGather()) leaves the big
+      arrays of the lists it records where they are, and its buffer
+      holds only the tags, names and small arrays between them.  The
+      stream is written straight from the pieces: with writev() for
+      a .dg file, or fed through the compressor a piece at a time, so
+      each byte of a big array is only touched once on its way out.
+
+  -----                                                          -----
+  -------------------------------------------------------------------*/
+
+#define DG_WRITEV_MAX 64	/* pieces handed to writev() at once */
+
+/*
+ * dgWriterSetGather -- with flag set, w references arrays of at least
+ * DG_GATHER_MIN_SIZE bytes instead of copying them (see DG_WRITER).
+ * Writers given a buffer by dgSerializeDynGroup() can't gather.
+ * Returns the old setting.
+ */
+int dgWriterSetGather(DG_WRITER *w, int flag)
 {
-  int length;
-  if (!str) return;
-  length = strlen(str) + 1;
-  send_event(type, (unsigned char *) &length);
-  send_bytes(length, (unsigned char *)str);
+  int old = w->gather;
+  if (flag >= 0 && !w->fixed) w->gather = flag;
+  return old;
 }
 
-void dgRecordStringArray(unsigned char type, int n, char **s)
+static int gather_add(DG_WRITER *w, unsigned char *data, int n)
 {
-  int length, i;
-  char *str;
-  
-  if (!s) return;
-  send_event(type, (unsigned char *) &n);
-  
-  for (i = 0; i < n; i++) {
-    str = s[i];
-    length = strlen(str) + 1;
-    send_bytes(sizeof(int), (unsigned char *) &length);
-    send_bytes(length, (unsigned char *)str);
+  DG_GATHER_SEG *segs;
+
+  if (w->nsegs == w->maxsegs) {
+    int max = w->maxsegs ? 2*w->maxsegs : 64;
+    if (!(segs = (DG_GATHER_SEG *) realloc(w->segs,
+					    max*sizeof(DG_GATHER_SEG))))
+      return(0);		/* just copy it instead */
+    w->segs = segs;
+    w->maxsegs = max;
   }
+  w->segs[w->nsegs].bufend = w->index;
+  w->segs[w->nsegs].data = data;
+  w->segs[w->nsegs].n = n;
+  w->nsegs++;
+  return(1);
 }
 
-void dgRecordLongArray(unsigned char type, int n, int *a)
+/*
+ * dgWriterGather -- point *iov at the pieces of w's stream, in order,
+ * returning how many there are (-1 if out of memory, or if something
+ * recorded didn't fit in the buffer).  The list
+ * belongs to w, and lasts until it next records something.
+ */
+int dgWriterGather(DG_WRITER *w, DG_IOVEC **iov)
 {
-  send_event(type, (unsigned char *) &n);
-  send_bytes(n*sizeof(int), (unsigned char *) a);
+  DG_IOVEC *v;
+  int i, n = 0, start = 0;
+
+  if (w->overflow) return(-1);
+  if (!(v = (DG_IOVEC *) realloc(w->iov,
+				 (2*w->nsegs+1)*sizeof(DG_IOVEC)))) return(-1);
+  w->iov = v;
+  for (i = 0; i < w->nsegs; i++) {
+    if (w->segs[i].bufend > start) {
+      v[n].base = w->buffer + start;
+      v[n++].len = w->segs[i].bufend - start;
+      start = w->segs[i].bufend;
+    }
+    v[n].base = w->segs[i].data;
+    v[n++].len = w->segs[i].n;
+  }
+  if (w->index > start) {
+    v[n].base = w->buffer + start;
+    v[n++].len = w->index - start;
+  }
+  *iov = v;
+  return(n);
 }
 
-void dgRecordCharArray(unsigned char type, int n, char *a)
+#ifndef _WIN32
+static int gather_writev(int fd, DG_IOVEC *v, int n)
 {
-  send_event(type, (unsigned char *) &n);
-  send_bytes(n*sizeof(char), (unsigned char *) a);
+  struct iovec iov[DG_WRITEV_MAX];
+  ssize_t r;
+  int i, k;
+
+  while (n > 0) {
+    k = n < DG_WRITEV_MAX ? n : DG_WRITEV_MAX;
+    for (i = 0; i < k; i++) {
+      iov[i].iov_base = v[i].base;
+      iov[i].iov_len = v[i].len;
+    }
+    if ((r = writev(fd, iov, k)) < 0) {
+      if (errno == EINTR) continue;
+      return(0);
+    }
+    /* skip what went out, which may end partway through a piece */
+    while (n && (size_t) r >= v->len) {
+      r -= v->len;
+      v++;
+      n--;
+    }
+    if (r) {
+      v->base = (unsigned char *) v->base + r;
+      v->len -= r;
+    }
+  }
+  return(1);
 }
+#endif
 
-void dgRecordShortArray(unsigned char type, int n, short *a)
+/* gather_write -- dgWriterWriteBuffer() for a writer holding pieces */
+static int gather_write(DG_WRITER *w, FILE *fp, int format)
 {
-  send_event(type, (unsigned char *) &n);
-  send_bytes(n*sizeof(short), (unsigned char *) a);
-}
+  DG_IOVEC *v;
+  unsigned char *buf, *p;
+  size_t total = 0;
+  void *lz4;
+  int i, n, status = 1;
 
-void dgRecordFloatArray(unsigned char type, int n, float *a)
-{
-  send_event(type, (unsigned char *) &n);
-  send_bytes(n*sizeof(float), (unsigned char *) a);
-}
+  if ((n = dgWriterGather(w, &v)) < 0) return(0);
+  for (i = 0; i < n; i++) total += v[i].len;
 
-void dgRecordListArray(unsigned char type, int n)
-{
-  send_event(type, (unsigned char *) &n);
+  switch (format) {
+  case DF_BINARY:
+#ifdef _WIN32
+    for (i = 0; i < n && status; i++)
+      status = fwrite(v[i].base, 1, v[i].len, fp) == v[i].len;
+    return(status && !fflush(fp));
+#else
+    if (fflush(fp)) return(0);
+    return(gather_writev(fileno(fp), v, n));
+#endif
+  case DF_LZ4:
+    if (!(lz4 = lz4_sink_open(fp, DgLZ4Independent, total))) return(0);
+    for (i = 0; i < n && status; i++)
+      status = lz4_sink_write(lz4, (unsigned char *) v[i].base, v[i].len);
+    return(lz4_sink_close(lz4) && status);
+  default:
+    /* the ASCII dump walks the stream, so needs it in one piece */
+    if (total >= INT_MAX || !(buf = (unsigned char *) malloc(total)))
+      return(0);
+    for (i = 0, p = buf; i < n; p += v[i].len, i++)
+      memcpy(p, v[i].base, v[i].len);
+    dgDumpBuffer(buf, (int) total, format, fp);
+    free(buf);
+    return(1);
+  }
 }
 
-/*********************************************************************/
-/*                  Low Level Event Recording Funcs                  */
-/*********************************************************************/
-
-void dgRecordMagicNumber(void)
+static int gather_gzwrite(DG_WRITER *w, gzFile file)
 {
-  send_bytes(DG_MAGIC_NUMBER_SIZE, (unsigned char *) dgMagicNumber);
+  DG_IOVEC *v;
+  int i, n;
+
+  if ((n = dgWriterGather(w, &v)) < 0) return(0);
+  for (i = 0; i < n; i++) {
+    if (gzwrite(file, v[i].base, (unsigned) v[i].len) != (int) v[i].len)
+      return(0);
+  }
+  return(1);
 }
 
-void dgRecordFlag(unsigned char type)
+/*
+ * map_file -- map all of fp into memory.  The mapping is copy-on-write,
+ * so borrowed reads may rearrange it without touching the file.  Returns
+ * 1 on success, or 0 if fp isn't a regular file (a pipe, say) that can
+ * be mapped, in which case it has to be read through stdio.
+ */
+static int map_file(FILE *fp, unsigned char **data, int *size)
 {
-  send_event(type, (unsigned char *) NULL);
+#ifdef _WIN32
+  HANDLE file = (HANDLE) _get_osfhandle(_fileno(fp)), map;
+  LARGE_INTEGER length;
+  void *p;
+
+  if (file == INVALID_HANDLE_VALUE || GetFileType(file) != FILE_TYPE_DISK ||
+      !GetFileSizeEx(file, &length) ||
+      length.QuadPart <= 0 || length.QuadPart > INT_MAX) return(0);
+  if (!(map = CreateFileMapping(file, NULL, PAGE_WRITECOPY, 0, 0, NULL)))
+    return(0);
+  p = MapViewOfFile(map, FILE_MAP_COPY, 0, 0, 0);
+  CloseHandle(map);
+  if (!p) return(0);
+  *size = (int) length.QuadPart;
+#else
+  struct stat st;
+  void *p;
+
+  if (fstat(fileno(fp), &st) || !S_ISREG(st.st_mode) ||
+      st.st_size <= 0 || st.st_size > INT_MAX) return(0);
+  p = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+	   fileno(fp), 0);
+  if (p == MAP_FAILED) return(0);
+#ifdef MADV_SEQUENTIAL
+  madvise(p, st.st_size, MADV_SEQUENTIAL);
+#endif
+  *size = (int) st.st_size;
+#endif
+  *data = (unsigned char *) p;
+  return(1);
 }
 
-void dgRecordChar(unsigned char type, unsigned char val)
+static void unmap_file(unsigned char *data, int size)
 {
-  send_event(type, (unsigned char *) &val);
+#ifdef _WIN32
+  UnmapViewOfFile(data);
+#else
+  munmap(data, size);
+#endif
 }
 
-void dgRecordLong(unsigned char type, int val)
+/*
+ * read_whole_buffer -- parse a complete stream that was read or mapped
+ * into memory, then release it (with release, or free() if NULL).  With
+ * DG_READ_BORROW (or DG_READ_LAZY) the buffer instead lives on for as
+ * long as any of the lists read from it.
+ */
+static int read_whole_buffer(DG_READER *r, unsigned char *data, int size,
+			     void (*release)(unsigned char *, int),
+			     DYN_GROUP *dg)
 {
-  send_event(type, (unsigned char *) &val);
+  DYN_BUFFER *buf;
+  int status;
+
+  if (DG_READER_FLAGS(r) & (DG_READ_BORROW | DG_READ_LAZY)) {
+    if (!(buf = dfuCreateDynBuffer(data, size))) {
+      if (release) release(data, size);
+      else free(data);
+      return(DF_ABORT);
+    }
+    DYN_BUFFER_RELEASE(buf) = release;
+    DG_READER_BORROW(r) = buf;
+    status = dgReaderBufferToStruct(r, data, size, dg);
+    DG_READER_BORROW(r) = NULL;
+    dfuUnrefDynBuffer(buf);
+  }
+  else {
+    status = dgReaderBufferToStruct(r, data, size, dg);
+    if (release) release(data, size);
+    else free(data);
+  }
+  return(status);
 }
 
-void dgRecordShort(unsigned char type, short val)
+/*
+ * dgReaderMapFileToStruct -- read the dg stream making up all of fp
+ * into dg.  Regular files are mapped into memory and handed to the
+ * buffer parser (so with DG_READ_BORROW, lists point straight into the
+ * mapping); pipes and the like are read through dgReaderFileToStruct().
+ */
+int dgReaderMapFileToStruct(DG_READER *r, FILE *fp, DYN_GROUP *dg)
 {
-  send_event(type, (unsigned char *) &val);
+  unsigned char *data;
+  int size;
+
+  if (!map_file(fp, &data, &size)) return(dgReaderFileToStruct(r, fp, dg));
+  return(read_whole_buffer(r, data, size, unmap_file, dg));
 }
 
-void dgRecordFloat(unsigned char type, float val)
+/*
+ * lz4_parallel -- decompress a .lz4 file written with independent
+ * blocks on DG_READER_NTHREADS(r) threads, then parse it.  Returns -1
+ * (having read nothing) if the file wasn't written that way.
+ */
+static int lz4_parallel(DG_READER *r, FILE *fp, DYN_GROUP *dg)
 {
-  send_event(type, (unsigned char *) &val);
+  unsigned char *in, *data;
+  int insize, size, status;
+
+  if (DG_READER_NTHREADS(r) < 2 || !map_file(fp, &in, &insize)) return(-1);
+  status = decompress_lz4_buffer_parallel(in, insize, DG_READER_NTHREADS(r),
+					  &size, &data);
+  unmap_file(in, insize);
+  if (status < 0) return(-1);
+  if (!status) return(DF_ABORT);
+  return(read_whole_buffer(r, data, size, NULL, dg));
 }
 
-
-/*********************************************************************/
-/*                    Keep Track of Current Structure                */
-/*********************************************************************/
-
-void dgPushStruct(int newstruct, char *name)
+/*
+ * dgReaderReadDynGroup -- read a .dg or .lz4 file into dg using reader r.
+ * If r has DG_READ_BORROW set, lists point straight into the
+ * decompressed (.lz4) or mapped (.dg) file (DL_BORROWED) instead of
+ * being copied out of it.  Only stdin is read through stdio.
+ */
+int dgReaderReadDynGroup(DG_READER *r, char *filename, DYN_GROUP *dg)
 {
-  if (!DgStructStack) 
-    DgStructStack = 
-      (TAG_INFO *) calloc(DgStructStackIncrement, sizeof(TAG_INFO));
+  FILE *fp = stdin;
+  char *filemode = "rb";
+  int status = 0;
+  char *suffix;
+  unsigned char *data;
+  int size;
   
-  else if (DgStructStackIndex == (DgStructStackSize-1)) {
-    DgStructStackSize += DgStructStackIncrement;
-    DgStructStack = 
-      (TAG_INFO *) realloc(DgStructStack, DgStructStackSize*sizeof(TAG_INFO));
+  if (filename && filename[0]) {
+    if (!(fp = fopen(filename, filemode))) {
+      return(0);
+    }
   }
-  DgStructStackIndex++;
-  DgStructStack[DgStructStackIndex].struct_type = newstruct;
-  DgStructStack[DgStructStackIndex].tag_name = name;
-  DgCurStruct = newstruct;
-  DgCurStructName = name;
-}
-    
-int dgPopStruct(void)
-{
-  if (!DgStructStackIndex) {
-    fprintf(stderr, "dgPopStruct(): popped to an empty stack\n");
-    return(-1);
+  
+  if ((suffix = strrchr(filename, '.'))) {
+    if (strlen(suffix) == 4) {
+      if ((suffix[1] == 'l' && suffix[2] == 'z' && suffix[3] == '4') ||
+	  (suffix[1] == 'L' && suffix[2] == 'Z' && suffix[3] == '4')) {
+	if ((status = lz4_parallel(r, fp, dg)) >= 0 ||
+	    (status = lz4_stream(r, fp, dg)) >= 0) {
+	  fclose(fp);
+	  return(status);
+	}
+	if (decompress_lz4_file_to_buffer(fp, &size, &data)) {
+	  fclose(fp);
+	  return(read_whole_buffer(r, data, size, NULL, dg));
+	}
+	else {
+	  fclose(fp);
+	  return DF_ABORT;
+	}
+      }
+    }
   }
 
-  DgStructStackIndex--;
-  DgCurStruct = DgStructStack[DgStructStackIndex].struct_type;
-  DgCurStructName = DgStructStack[DgStructStackIndex].tag_name;
+  if (fp == stdin) return(dgReaderFileToStruct(r, fp, dg));
 
-  return(DgCurStruct);
+  status = dgReaderMapFileToStruct(r, fp, dg);
+  fclose(fp);
+  return(status);
 }
 
-void dgFreeStructStack(void)
+int dgReadDynGroup(char *filename, DYN_GROUP *dg)
 {
-  if (DgStructStack) free(DgStructStack);
-  DgStructStack = NULL;
-  DgStructStackSize = 0;
-  DgStructStackIndex = -1;
-}
+  DG_READER r;
+  int status;
 
-int dgGetCurrentStruct(void)
-{
-  return(DgCurStruct);
+  dgInitReader(&r);
+  status = dgReaderReadDynGroup(&r, filename, dg);
+  dgFreeReader(&r);
+  return(status);
 }
 
-char *dgGetCurrentStructName(void)
+/*
+ * dgReadDynGroupBorrowed -- as dgReadDynGroup(), but with DG_READ_BORROW
+ * set (see dgReaderReadDynGroup).
+ */
+int dgReadDynGroupBorrowed(char *filename, DYN_GROUP *dg)
 {
-  return(DgCurStructName);
-}
+  DG_READER r;
+  int status;
 
+  dgInitReader(&r);
+  DG_READER_FLAGS(&r) |= DG_READ_BORROW;
+  status = dgReaderReadDynGroup(&r, filename, dg);
+  dgFreeReader(&r);
+  return(status);
+}
 
-char *dgGetTagName(int type)
+/*
+ * dgReadDynGroupColumns -- read only the named lists from a .dg, .lz4
+ * or gzip-compressed (.dgz) file.  The payloads of all other lists are
+ * skipped over using the lengths in the stream.  Lists are added to dg
+ * in file order; names that aren't found are simply absent.
+ */
+int dgReadDynGroupColumns(char *filename, const char **names, int n,
+			  DYN_GROUP *dg)
 {
-  return(DGTagTable[DgCurStruct][type].tag_name);
+  DG_READER r;
+  char *suffix;
+  int status;
+
+  dgInitReader(&r);
+  dgReaderSetColumns(&r, names, n);
+  if (filename && (suffix = strrchr(filename, '.')) && strstr(suffix, "gz"))
+    status = dgReaderGzipFileToStruct(&r, filename, dg);
+  else
+    status = dgReaderReadDynGroup(&r, filename, dg);
+  dgFreeReader(&r);
+  return(status);
 }
 
-int dgGetDataType(int type)
+/*
+ * gz_isize -- the uncompressed size recorded in the trailer of the
+ * gzip data in[], if it is gzip data and the size is believable.
+ */
+static int gz_isize(unsigned char *in, int insize, unsigned int *isize)
 {
-  return(DGTagTable[DgCurStruct][type].data_type);
+  unsigned int n;
+
+  if (insize < 18 || in[0] != 0x1f || in[1] != 0x8b) return 0;
+
+  /* deflate can't shrink data by more than about 1032:1 */
+  n = (unsigned int) in[insize-4] | ((unsigned int) in[insize-3] << 8) |
+    ((unsigned int) in[insize-2] << 16) | ((unsigned int) in[insize-1] << 24);
+  if (n == 0 || n >= (unsigned int) INT_MAX ||
+      (double) n * 1032. < (double) (insize - 18)) return 0;
+  *isize = n;
+  return 1;
 }
 
-int dgGetStructureType(int type)
+/*
+ * gz_inflate_mapped -- inflate a single-member gzip file in one go.
+ * The file is mapped, the output buffer is allocated once at the size
+ * given by the ISIZE trailer, and inflate() runs straight from one to
+ * the other.  ISIZE is only the length modulo 2^32, so it is treated
+ * as a hint: if the stream doesn't end exactly there (or there is a
+ * second member, or the file can't be mapped) this returns 0 and the
+ * caller falls back to reading through gzread().
+ */
+static int gz_inflate_mapped(char *filename, unsigned char **data, int *size)
 {
-  return(DGTagTable[DgCurStruct][type].struct_type);
+  FILE *fp;
+  unsigned char *in, *buf;
+  unsigned int isize;
+  int insize, status;
+  z_stream zs;
+
+  if (!(fp = fopen(filename, "rb"))) return 0;
+  if (!map_file(fp, &in, &insize)) { fclose(fp); return 0; }
+  fclose(fp);
+
+  if (!gz_isize(in, insize, &isize) ||
+      !(buf = (unsigned char *) malloc(isize))) {
+    unmap_file(in, insize);
+    return 0;
+  }
+
+  memset(&zs, 0, sizeof(zs));
+  if (inflateInit2(&zs, 16 + MAX_WBITS) != Z_OK) {
+    free(buf);
+    unmap_file(in, insize);
+    return 0;
+  }
+  zs.next_in = in;
+  zs.avail_in = (uInt) insize;
+  zs.next_out = buf;
+  zs.avail_out = (uInt) isize;
+  status = inflate(&zs, Z_FINISH);
+  inflateEnd(&zs);
+  unmap_file(in, insize);
+
+  if (status != Z_STREAM_END || zs.avail_in || zs.total_out != isize) {
+    free(buf);
+    return 0;
+  }
+  *data = buf;
+  *size = (int) isize;
+  return 1;
 }
-/*********************************************************************/
-/*               Local Byte Stream Handling Functions                */
-/*********************************************************************/
 
-static void send_event(unsigned char type, unsigned char *data)
+/*
+ * gz_file_to_buffer -- inflate a whole gzip file into a single
+ * malloc'd buffer: sized up front when possible (gz_inflate_mapped),
+ * otherwise grown by realloc as gzread() delivers it (multi-member
+ * files, pipes, plain files).  Returns 1 on success, 0 on failure.
+ */
+static int gz_file_to_buffer(char *filename, unsigned char **data, int *size)
 {
-/* First push the tag into the buffer */
-  push((unsigned char *)&type, 1, 1);
-  
-/* The only "special" tag is the END_STRUCT tag, which means pop up */
-  if (type == END_STRUCT) return;
+  gzFile in;
+  unsigned char *buf = NULL;
+  size_t cap = 0, total = 0;
+  const size_t CHUNK = 65536;
 
-/* All other tags may have data; check the current struct tag table  */
-  switch(DGTagTable[DgCurStruct][type].data_type) {
-  case DF_STRUCTURE:            /* data follows via tags             */
-  case DF_FLAG:		
-  case DF_VOID_ARRAY:
-    break;
-  case DF_STRING:		/* all of these start w/a long int   */
-  case DF_STRING_ARRAY:
-  case DF_LONG_ARRAY:
-  case DF_SHORT_ARRAY:
-  case DF_FLOAT_ARRAY:
-  case DF_CHAR_ARRAY:
-  case DF_LIST_ARRAY:
-  case DF_LONG:
-    push(data, sizeof(int), 1);
-    break;
-  case DF_CHAR:
-    push(data, sizeof(char), 1);
-    break;
-  case DF_SHORT:
-    push(data, sizeof(short), 1);
-    break;
-  case DF_VERSION:
-  case DF_FLOAT:
-    push(data, sizeof(float), 1);
-    break;
-  default:
-    fprintf(stderr,"Unrecognized event type: %d\n", type);
-    break;
+  if (!filename || !filename[0]) return 0;
+  if (gz_inflate_mapped(filename, data, size)) return 1;
+  if (!(in = gzopen(filename, "rb"))) return 0;
+
+  for (;;) {
+    int len;
+
+    if (total > (size_t) INT_MAX - CHUNK - 1) {
+      fprintf(stderr, "dg: \"%s\" too large to decompress in memory\n",
+	      filename);
+      free(buf); gzclose(in); return 0;
+    }
+
+    if (total + CHUNK + 1 > cap) {		/* grow geometrically */
+      size_t newcap = cap ? cap : (CHUNK * 4);
+      unsigned char *tmp;
+      while (newcap < total + CHUNK + 1) newcap *= 2;
+      tmp = (unsigned char *) realloc(buf, newcap);
+      if (!tmp) {
+	fprintf(stderr, "dg: out of memory decompressing \"%s\"\n", filename);
+	free(buf); gzclose(in); return 0;
+      }
+      buf = tmp; cap = newcap;
+    }
+
+    len = gzread(in, buf + total, (unsigned) CHUNK);
+    if (len < 0) {				/* decompression error */
+      int err = 0;
+      fprintf(stderr, "dg: gzread error on \"%s\": %s\n",
+	      filename, gzerror(in, &err));
+      free(buf); gzclose(in); return 0;
+    }
+    if (len == 0) break;			/* EOF (short reads just loop) */
+    total += (size_t) len;
   }
+
+  if (gzclose(in) != Z_OK) { free(buf); return 0; }
+  if (total == 0)          { free(buf); return 0; }
+
+  *data = buf;
+  *size = (int) total;
+  return 1;
 }
 
-static void send_bytes(int n, unsigned char *data)
+/*
+ * dgReaderGzipFileToStruct -- read a gzip-compressed dg file (.dgz)
+ * fully into memory and parse it directly, with NO temporary file.  The
+ * whole gzip stream is inflated into a single buffer (see
+ * gz_file_to_buffer), then handed to dgReaderBufferToStruct.  Normally all data is copied out via
+ * the vget_* helpers and the buffer is freed immediately after; with
+ * DG_READ_BORROW set the numeric lists keep the buffer alive instead.
+ * This is the gzip analogue of the in-memory LZ4 path in
+ * dgReaderReadDynGroup() above.  If r only wants some columns and
+ * the file has an up to date sidecar index (see dgIndexGzFile), just
+ * those lists are inflated.
+ *
+ * Returns DF_OK (1) on success, 0 on any failure (open / decompress / parse).
+ */
+int dgReaderGzipFileToStruct(DG_READER *r, char *filename, DYN_GROUP *dg)
 {
-  push(data, sizeof(unsigned char), n);
+  unsigned char *data;
+  int size, status;
+  DYN_BUFFER *buf;
+
+  if (DG_READER_NCOLUMNS(r) &&
+      (status = gz_index_read(r, filename, dg)) >= 0) return status;
+  if ((status = gz_stream(r, filename, dg)) >= 0) return status;
+  if (!gz_file_to_buffer(filename, &data, &size)) return 0;
+
+  if (!(DG_READER_FLAGS(r) & (DG_READ_BORROW | DG_READ_LAZY))) {
+    status = dgReaderBufferToStruct(r, data, size, dg);
+    free(data);
+    return status;
+  }
+
+  if (!(buf = dfuCreateDynBuffer(data, size))) {
+    free(data);
+    return 0;
+  }
+  DG_READER_BORROW(r) = buf;
+  status = dgReaderBufferToStruct(r, data, size, dg);
+  DG_READER_BORROW(r) = NULL;
+  dfuUnrefDynBuffer(buf);
+  return status;
 }
 
-static void push(unsigned char *data, int size, int count)
+int dguGzipFileToStruct(char *filename, DYN_GROUP *dg)
 {
-   int nbytes, newsize;
-   int buffer_increment = DgBufferIncrement;
-   
-   nbytes = count * size;
-   
-   if (DgBufferIndex + nbytes >= DgBufferSize) {
-     if (nbytes > buffer_increment)
-       buffer_increment = 2*nbytes;
-     do {
-       newsize = DgBufferSize + buffer_increment;
-       DgBuffer = (unsigned char *) realloc(DgBuffer, newsize);
-       /* Really need to check that buffer was reallocated properly */
-       DgBufferSize = newsize;
-     } while(DgBufferIndex + nbytes >= DgBufferSize);
-   }
-   
-   memcpy(&DgBuffer[DgBufferIndex], data, nbytes);
-   DgBufferIndex += nbytes;
+  DG_READER r;
+  int status;
+
+  dgInitReader(&r);
+  status = dgReaderGzipFileToStruct(&r, filename, dg);
+  dgFreeReader(&r);
+  return status;
 }
 
+/*
+ * dguGzipFileToStructBorrowed -- as dguGzipFileToStruct(), but the
+ * numeric lists in dg point straight into the inflated buffer rather
+ * than into copies of it, roughly halving peak memory.  The buffer stays
+ * alive until the last such list is freed (see dfuFreeDynList).
+ */
+int dguGzipFileToStructBorrowed(char *filename, DYN_GROUP *dg)
+{
+  DG_READER r;
+  int status;
 
-/*************************************************************************/
-/*                         Dump Helper Funcs                             */
-/*************************************************************************/
+  dgInitReader(&r);
+  DG_READER_FLAGS(&r) |= DG_READ_BORROW;
+  status = dgReaderGzipFileToStruct(&r, filename, dg);
+  dgFreeReader(&r);
+  return status;
+}
 
-static void dgDumpBuffer(unsigned char *buffer, int n, int type, FILE *fp)
+#ifdef COMPRESSION
+/* Legacy entry point; the in-memory dguGzipFileToStruct() above is the real
+   implementation now (no temp file). */
+int dgReadDynGroupCompressed(char *filename, DYN_GROUP *dg)
 {
-  switch(type) {
-  case DF_BINARY:
-    fwrite(buffer, sizeof(unsigned char), n, fp);
-    fflush(fp);
-    break;
-  case DF_ASCII:
-    dguBufferToAscii(buffer, n, fp);
-    break;
-  default:
-    break;
-  }
+  return dguGzipFileToStruct(filename, dg);
 }
+#endif
 
 
-/*--------------------------------------------------------------------
-  -----               Magic Number Functions                     -----
-  -------------------------------------------------------------------*/
 
-static 
-int confirm_magic_number(FILE *InFP)
+void dgLoadStructure(DYN_GROUP *dg)
 {
-  int i;
-  for (i = 0; i < DG_MAGIC_NUMBER_SIZE; i++) {
-    if (getc(InFP) != dgMagicNumber[i]) return(0);
-  }
-  return(1);
+  dguBufferToStruct(DgWriter.buffer, DgWriter.index, dg);
 }
 
-static 
-int vconfirm_magic_number(char *s)
+/*********************************************************************/
+/*                   High Level Recording Funcs                      */
+/*********************************************************************/
+
+
+static void begin_struct(DG_WRITER *w, unsigned char tag)
 {
-  int i;
-  char number[DG_MAGIC_NUMBER_SIZE];
-  memcpy(number, s, DG_MAGIC_NUMBER_SIZE);
-  for (i = 0; i < DG_MAGIC_NUMBER_SIZE; i++) {
-    if (number[i] != dgMagicNumber[i]) return(0);
-  }
-  return(1);
+  send_event(w, tag, NULL);
+  push_struct(&w->structs, DGTagTable[w->structs.cur][tag].struct_type,
+	      DGTagTable[w->structs.cur][tag].tag_name);
 }
 
+static void end_struct(DG_WRITER *w)
+{
+  send_event(w, END_STRUCT, NULL);
+  pop_struct(&w->structs);
+}
 
-/*--------------------------------------------------------------------
-  -----                   File Read Functions                    -----
-  -------------------------------------------------------------------*/
-
+static void record_string(DG_WRITER *w, unsigned char type, char *str)
+{
+  int length;
+  if (!str) return;
+  length = strlen(str) + 1;
+  send_event(w, type, (unsigned char *) &length);
+  send_bytes(w, length, (unsigned char *)str);
+}
 
-static 
-void read_version(FILE *InFP, FILE *OutFP)
+static void record_string_array(DG_WRITER *w, unsigned char type,
+				int n, char **s)
 {
-  float val;
-  if (fread(&val, sizeof(float), 1, InFP) != 1) {
-     fprintf(stderr,"Error reading float info\n");
-     exit(-1);
+  int length, i;
+  char *str;
+  
+  if (!s) return;
+  send_event(w, type, (unsigned char *) &n);
+  
+  for (i = 0; i < n; i++) {
+    str = s[i];
+    length = strlen(str) + 1;
+    send_bytes(w, sizeof(int), (unsigned char *) &length);
+    send_bytes(w, length, (unsigned char *)str);
   }
+}
 
-  /* 
-   * The VERSION should stay as a float, so that byte ordering can be 
-   * checked dynamically.  If it doesn't match the first way, then the
-   * dgFlipEvents flag is set and it's tried again.
-   */
+/* record_array -- a count then n elements of size bytes each */
+static void record_array(DG_WRITER *w, unsigned char type, int n,
+			 int size, void *a)
+{
+  send_event(w, type, (unsigned char *) &n);
+  send_bytes(w, n*size, (unsigned char *) a);
+}
 
-  if (val != dgVersion) {
-    dgFlipEvents = 1;
-    val = flipfloat(val);
-    if (val != dgVersion) {
-      fprintf(stderr,
-	      "Unable to read this version of data file (V %5.1f/%5.1f)\n",
-	      val, flipfloat(val));
-      exit(-1);
+static void record_void_array(DG_WRITER *w, unsigned char type,
+			      int datatype, int n, void *data)
+{
+  int i;
+  send_event(w, type, NULL);
+  switch (datatype) {
+  case DF_CHAR:
+    record_array(w, DL_CHAR_DATA_TAG, n, sizeof(char), data);
+    break;
+  case DF_SHORT:
+    record_array(w, DL_SHORT_DATA_TAG, n, sizeof(short), data);
+    break;
+  case DF_LONG:
+    record_array(w, DL_LONG_DATA_TAG, n, sizeof(int), data);
+    break;
+  case DF_FLOAT:
+    record_array(w, DL_FLOAT_DATA_TAG, n, sizeof(float), data);
+    break;
+  case DF_STRING:
+    record_string_array(w, DL_STRING_DATA_TAG, n, (char **) data);
+    break;
+  case DF_LIST:
+    {
+      DYN_LIST **vals = (DYN_LIST **) data;
+      send_event(w, DL_LIST_DATA_TAG, (unsigned char *) &n);
+      for (i = 0; i < n; i++) {
+	record_dyn_list(w, DL_SUBLIST_TAG, vals[i]);
+      }
     }
+    break;
   }
-  else dgFlipEvents = 0;
-  fprintf(OutFP,"%-20s\t%3.1f\n", "DG_VERSION", val);
 }
 
-static 
-void read_flag(char type, FILE *InFP, FILE *OutFP)
+static void record_header(DG_WRITER *w)
 {
-  fprintf(OutFP, "%-20s\n", dgGetTagName(type));
+  float version = dgVersion;
+  send_bytes(w, DG_MAGIC_NUMBER_SIZE, (unsigned char *) dgMagicNumber);
+  send_event(w, T_VERSION_TAG, (unsigned char *) &version);
 }
 
-static 
-void read_float(char type, FILE *InFP, FILE *OutFP)
+static void record_dyn_list(DG_WRITER *w, unsigned char tag, DYN_LIST *dl)
 {
-  float val;
-  if (fread(&val, sizeof(float), 1, InFP) != 1) {
-     fprintf(stderr,"Error reading float info\n");
-     exit(-1);
-  }
-  if (dgFlipEvents) val = flipfloat(val);
+  int val;
 
-  fprintf(OutFP, "%-20s\t%6.3f\n", dgGetTagName(type), val);
+  dfuLoadDynList(dl);		/* every sublist has to be there */
+  begin_struct(w, tag);
+  record_string(w, DL_NAME_TAG, DYN_LIST_NAME(dl));
+  val = DYN_LIST_INCREMENT(dl);
+  send_event(w, DL_INCREMENT_TAG, (unsigned char *) &val);
+  val = DYN_LIST_FLAGS(dl) & ~(DL_BORROWED | DL_LAZY | DL_CSR | DL_POOLED);
+  send_event(w, DL_FLAGS_TAG, (unsigned char *) &val);
+  record_void_array(w, DL_DATA_TAG, DYN_LIST_DATATYPE(dl), DYN_LIST_N(dl),
+		    DYN_LIST_VALS(dl));
+  end_struct(w);
 }
 
-static 
-void read_char(char type, FILE *InFP, FILE *OutFP)
+static void record_dyn_group(DG_WRITER *w, DYN_GROUP *dg)
 {
-  char val;
-  if (fread(&val, sizeof(char), 1, InFP) != 1) {
-     fprintf(stderr,"Error reading char val\n");
-     exit(-1);
+  int i = 0, n;
+
+  /* grow the buffer once, rather than an increment at a time */
+  if (!w->sink && !w->fixed && !w->gather && w->buffer) {
+    size_t size = group_size(dg);
+    if (size < (size_t) INT_MAX) reserve(w, (int) size);
   }
-  fprintf(OutFP, "%-20s\t%d\n", dgGetTagName(type), val);
+  begin_struct(w, DG_BEGIN_TAG);
+  record_string(w, DG_NAME_TAG, DYN_GROUP_NAME(dg));
+  n = DYN_GROUP_NLISTS(dg);
+  send_event(w, DG_NLISTS_TAG, (unsigned char *) &n);
+  for (i = 0; i < DYN_GROUP_NLISTS(dg); i++) 
+    record_dyn_list(w, DG_DYNLIST_TAG, DYN_GROUP_LIST(dg,i));
+  end_struct(w);
 }
 
-
-static
-void read_long(char type, FILE *InFP, FILE *OutFP)
+/*
+ * The record calls return 0 if the buffer couldn't hold what was
+ * recorded (or anything before it since the last reset), in which
+ * case the writes that follow fail too, rather than save a stream
+ * with pieces missing.
+ */
+int dgWriterRecordDynList(DG_WRITER *w, unsigned char tag, DYN_LIST *dl)
 {
-  int val;
-  
-  if (fread(&val, sizeof(int), 1, InFP) != 1) {
-    fprintf(stderr,"Error reading int val\n");
-    exit(-1);
-  }
-  
-  if (dgFlipEvents) val = fliplong(val);
-  
-  fprintf(OutFP, "%-20s\t%d\n", dgGetTagName(type), val);
+  record_dyn_list(w, tag, dl);
+  return(!w->overflow);
 }
 
-static
-void read_short(char type, FILE *InFP, FILE *OutFP)
+int dgWriterRecordDynGroup(DG_WRITER *w, DYN_GROUP *dg)
 {
-  short val;
-  
-  if (fread(&val, sizeof(short), 1, InFP) != 1) {
-    fprintf(stderr,"Error reading short val\n");
-    exit(-1);
-  }
-  
-  if (dgFlipEvents) val = flipshort(val);
+  record_dyn_group(w, dg);
+  return(!w->overflow);
+}
 
-  fprintf(OutFP, "%-20s\t%d\n", dgGetTagName(type), val);
-}   
+int dgRecordDynList(unsigned char tag, DYN_LIST *dl)
+{
+  return dgWriterRecordDynList(&DgWriter, tag, dl);
+}
 
+int dgRecordDynGroup(DYN_GROUP *dg)
+{
+  return dgWriterRecordDynGroup(&DgWriter, dg);
+}
 
-/*********************** ARRAY VERSIONS ************************/
+/*********************************************************************/
+/*                   Array Event Recording Funcs                     */
+/*********************************************************************/
 
-static
-void read_string(char type, FILE *InFP, FILE *OutFP)
+void dgBeginStruct(unsigned char tag)
 {
-  int length;
-  char *str = "";
-
-  if (fread(&length, sizeof(int), 1, InFP) != 1) {
-    fprintf(stderr,"Error reading string length\n");
-    exit(-1);
-  }
-  
-  if (dgFlipEvents) length = fliplong(length);
-  if (length) {
-    str = (char *) malloc(length);
-    
-    if (fread(str, length, 1, InFP) != 1) {
-      fprintf(stderr,"Error reading\n");
-      exit(-1);
-    }
-  }
+  begin_struct(&DgWriter, tag);
+}
 
-  fprintf(OutFP, "%-20s\t%s\n", dgGetTagName(type), str);
-  if (length) free(str);
+void dgEndStruct(void)
+{
+  end_struct(&DgWriter);
 }
 
-static
-void read_strings(char type, FILE *InFP, FILE *OutFP)
+void dgRecordVoidArray(unsigned char type, int datatype, int n, void *data)
 {
-  int n, i;
-  int length;
-  char *str;
+  record_void_array(&DgWriter, type, datatype, n, data);
+}
 
-  if (fread(&n, sizeof(int), 1, InFP) != 1) {
-    fprintf(stderr,"Error reading string length\n");
-    exit(-1);
-  }
-  if (dgFlipEvents) n = fliplong(n);
-  fprintf(OutFP, "%-20s\t%d\n", dgGetTagName(type),n);
 
-  for (i = 0; i < n; i++) {
-    if (fread(&length, sizeof(int), 1, InFP) != 1) {
-      fprintf(stderr,"Error reading string length\n");
-      exit(-1);
-    }
-    if (dgFlipEvents) length = fliplong(length);
-    
-    str = "";
-    if (length) {
-      str = (char *) malloc(length);
-      
-      if (fread(str, length, 1, InFP) != 1) {
-	fprintf(stderr,"Error reading\n");
-	exit(-1);
-      }
-    }
-    
-    fprintf(OutFP, "%d\t%s\n", i, str);
-    if (length) free(str);
-  }
+void dgRecordString(unsigned char type, char *str)
+{
+  record_string(&DgWriter, type, str);
 }
 
-static
-void read_chars(char type, FILE *InFP, FILE *OutFP)
+void dgRecordStringArray(unsigned char type, int n, char **s)
 {
-  int nchars, i;
-  char *vals = NULL;
-  
-  if (fread(&nchars, sizeof(int), 1, InFP) != 1) {
-    fprintf(stderr,"Error reading number of chars\n");
-    exit(-1);
-  }
-
-  if (dgFlipEvents) nchars = fliplong(nchars);
-  
-  if (nchars) {
-    if (!(vals = (char *) calloc(nchars, sizeof(char)))) {
-      fprintf(stderr,"Error allocating memory for char array\n");
-      exit(-1);
-    }
-    
-    if (fread(vals, sizeof(char), nchars, InFP) != nchars) {
-      fprintf(stderr,"Error reading char array\n");
-      exit(-1);
-    }
-  }
-  
-  fprintf(OutFP, "%-20s\t%d\n", dgGetTagName(type), nchars); 
-  
-  for (i = 0; i < nchars; i++) {
-    fprintf(OutFP, "%d\t%c\n", i+1, vals[i]);
-  }
-  if (vals) free(vals);
+  record_string_array(&DgWriter, type, n, s);
 }
 
-
-static
-void read_longs(char type, FILE *InFP, FILE *OutFP)
+void dgRecordLongArray(unsigned char type, int n, int *a)
 {
-  int nlongs, i;
-  int *vals = NULL;
-  
-  if (fread(&nlongs, sizeof(int), 1, InFP) != 1) {
-    fprintf(stderr,"Error reading number of longs\n");
-    exit(-1);
-  }
-  
-  if (dgFlipEvents) nlongs = fliplong(nlongs);
-  
-  if (nlongs) {
-    if (!(vals = (int *) calloc(nlongs, sizeof(int)))) {
-      fprintf(stderr,"Error allocating memory for long array\n");
-      exit(-1);
-    }
-    
-    if (fread(vals, sizeof(int), nlongs, InFP) != nlongs) {
-      fprintf(stderr,"Error reading int array\n");
-      exit(-1);
-    }
-    
-    if (dgFlipEvents) fliplongs(nlongs, vals);
-  }
-
-  fprintf(OutFP, "%-20s\t%d\n", dgGetTagName(type), nlongs); 
-  
-  for (i = 0; i < nlongs; i++) {
-    fprintf(OutFP, "%d\t%d\n", i+1, vals[i]);
-  }
-  if (vals) free(vals);
+  record_array(&DgWriter, type, n, sizeof(int), a);
 }
 
-
-static
-void read_shorts(char type, FILE *InFP, FILE *OutFP)
+void dgRecordCharArray(unsigned char type, int n, char *a)
 {
-  int nshorts, i;
-  short *vals = NULL;
-  
-  if (fread(&nshorts, sizeof(int), 1, InFP) != 1) {
-    fprintf(stderr,"Error reading number of shorts\n");
-    exit(-1);
-  }
-  
-  if (dgFlipEvents) nshorts = fliplong(nshorts);
-  
-  if (nshorts) {
-    if (!(vals = (short *) calloc(nshorts, sizeof(short)))) {
-      fprintf(stderr,"Error allocating memory for short array\n");
-      exit(-1);
-    }
-    
-    if (fread(vals, sizeof(short), nshorts, InFP) != nshorts) {
-      fprintf(stderr,"Error reading short array\n");
-      exit(-1);
-    }
-    
-    if (dgFlipEvents) flipshorts(nshorts, vals);
-  }
-  
-  fprintf(OutFP, "%-20s\t%d\n", dgGetTagName(type), nshorts); 
-  
-  for (i = 0; i < nshorts; i++) {
-    fprintf(OutFP, "%d\t%d\n", i+1, vals[i]);
-  }
-  if (vals) free(vals);
+  record_array(&DgWriter, type, n, sizeof(char), a);
 }
 
-static
-void read_floats(char type, FILE *InFP, FILE *OutFP)
+void dgRecordShortArray(unsigned char type, int n, short *a)
 {
-  int nfloats, i;
-  float *vals = NULL;
-  
-  if (fread(&nfloats, sizeof(int), 1, InFP) != 1) {
-    fprintf(stderr,"Error reading number of floats\n");
-    exit(-1);
-  }
-  
-  if (dgFlipEvents) nfloats = fliplong(nfloats);
-  
-  if (nfloats) {
-    if (!(vals = (float *) calloc(nfloats, sizeof(float)))) {
-      fprintf(stderr,"Error allocating memory for float array\n");
-      exit(-1);
-    }
-    
-    if (fread(vals, sizeof(float), nfloats, InFP) != nfloats) {
-      fprintf(stderr,"Error reading float array\n");
-      exit(-1);
-    }
-    
-    if (dgFlipEvents) flipfloats(nfloats, vals);
-  }
-  fprintf(OutFP, "%-20s\t%d\n", dgGetTagName(type), nfloats); 
-  
-  for (i = 0; i < nfloats; i++) {
-    fprintf(OutFP, "%d\t%6.2f\n", i+1, vals[i]);
-  }
-  if (vals) free(vals);
+  record_array(&DgWriter, type, n, sizeof(short), a);
 }
 
+void dgRecordFloatArray(unsigned char type, int n, float *a)
+{
+  record_array(&DgWriter, type, n, sizeof(float), a);
+}
 
+void dgRecordListArray(unsigned char type, int n)
+{
+  send_event(&DgWriter, type, (unsigned char *) &n);
+}
 
-/*--------------------------------------------------------------------
-  -----                 Buffer Read Functions                    -----
+/*********************************************************************/
+/*                  Low Level Event Recording Funcs                  */
+/*********************************************************************/
 
-      Routines for reading from a buffer & dumping events to stdout
-      These functions (which start with a v...) all return the number
-      of bytes which were accessed from the buffer.
+void dgRecordMagicNumber(void)
+{
+  send_bytes(&DgWriter, DG_MAGIC_NUMBER_SIZE, (unsigned char *) dgMagicNumber);
+}
 
-  -----                                                          -----
-  -------------------------------------------------------------------*/
+void dgRecordFlag(unsigned char type)
+{
+  send_event(&DgWriter, type, (unsigned char *) NULL);
+}
 
-static 
-int vread_version(float *version, FILE *OutFP)
+void dgRecordChar(unsigned char type, unsigned char val)
 {
-  float val;
-  memcpy(&val, version, sizeof(float));
-  
-  /* 
-   * The VERSION should stay as a float, so that byte ordering can be 
-   * checked dynamically.  If it doesn't match the first way, then the
-   * FlipEvents flag is set and it's tried again.
-   */
+  send_event(&DgWriter, type, (unsigned char *) &val);
+}
 
-  if (val != dgVersion) {
-    dgFlipEvents = 1;
-    val = flipfloat(val);
-    if (val != dgVersion) {
-      fprintf(stderr,
-	      "Unable to read this version of data file (V %5.1f/%5.1f)\n",
-	      val, flipfloat(val));
-      exit(-1);
-    }
-  }
-  else dgFlipEvents = 0;
-  fprintf(OutFP,"%-20s\t%3.1f\n", "DG_VERSION", val);
-  return(sizeof(float));
+void dgRecordLong(unsigned char type, int val)
+{
+  send_event(&DgWriter, type, (unsigned char *) &val);
 }
 
-static int
-vread_flag(char type, FILE *OutFP)
+void dgRecordShort(unsigned char type, short val)
 {
-  fprintf(OutFP, "%-20s\n", dgGetTagName(type));
-  return(0);
+  send_event(&DgWriter, type, (unsigned char *) &val);
 }
 
-static 
-int vread_float(char type, float *fval, FILE *OutFP)
+void dgRecordFloat(unsigned char type, float val)
 {
-  float val;
-  memcpy(&val, fval, sizeof(float));
+  send_event(&DgWriter, type, (unsigned char *) &val);
+}
 
-  if (dgFlipEvents) val = flipfloat(val);
 
-  fprintf(OutFP, "%-20s\t%6.3f\n", dgGetTagName(type), val);
-  return(sizeof(float));
-}
+/*********************************************************************/
+/*                    Keep Track of Current Structure                */
+/*********************************************************************/
 
+static void push_struct(DG_STRUCT_STACK *s, int newstruct, char *name)
+{
+  if (!s->stack) {
+    s->stack = (TAG_INFO *) calloc(DgStructStackIncrement, sizeof(TAG_INFO));
+    s->size = DgStructStackIncrement;
+  }
+  else if (s->index == (s->size-1)) {
+    s->size += DgStructStackIncrement;
+    s->stack = (TAG_INFO *) realloc(s->stack, s->size*sizeof(TAG_INFO));
+  }
+  s->index++;
+  s->stack[s->index].struct_type = newstruct;
+  s->stack[s->index].tag_name = name;
+  s->cur = newstruct;
+  s->curname = name;
+}
 
-static 
-int vread_char(char type, char *cval, FILE *OutFP)
+static int pop_struct(DG_STRUCT_STACK *s)
 {
-  char val;
-  memcpy(&val, cval, sizeof(char));
+  if (!s->index) {
+    fprintf(stderr, "dgPopStruct(): popped to an empty stack\n");
+    return(-1);
+  }
 
-  fprintf(OutFP, "%-20s\t%d\n", dgGetTagName(type), val);
-  return(sizeof(char));
+  s->index--;
+  s->cur = s->stack[s->index].struct_type;
+  s->curname = s->stack[s->index].tag_name;
+
+  return(s->cur);
 }
 
+static void free_struct_stack(DG_STRUCT_STACK *s)
+{
+  if (s->stack) free(s->stack);
+  s->stack = NULL;
+  s->size = 0;
+  s->index = -1;
+  s->cur = DG_TOP_LEVEL;
+  s->curname = "DG_TOP_LEVEL";
+}
 
-static
-int vread_long(char type, int *ival, FILE *OutFP)
+void dgPushStruct(int newstruct, char *name)
 {
-  int val;
-  memcpy(&val, ival, sizeof(int));
+  push_struct(&DgWriter.structs, newstruct, name);
+}
+    
+int dgPopStruct(void)
+{
+  return(pop_struct(&DgWriter.structs));
+}
 
-  if (dgFlipEvents) val = fliplong(val);
-  fprintf(OutFP, "%-20s\t%d\n", dgGetTagName(type), val);
-  return(sizeof(int));
-}   
+void dgFreeStructStack(void)
+{
+  free_struct_stack(&DgWriter.structs);
+}
 
+int dgGetCurrentStruct(void)
+{
+  return(DgWriter.structs.cur);
+}
 
-static
-int vread_short(char type, short *sval, FILE *OutFP)
+char *dgGetCurrentStructName(void)
 {
-  short val;
-  memcpy(&val, sval, sizeof(short));
+  return(DgWriter.structs.curname);
+}
 
-  if (dgFlipEvents) val = flipshort(val);
-  
-  fprintf(OutFP, "%-20s\t%d\n", dgGetTagName(type), val);
-  return(sizeof(short));
-}   
 
-/*********************** ARRAY VERSIONS ************************/
+char *dgGetTagName(int type)
+{
+  return(DGTagTable[DgWriter.structs.cur][type].tag_name);
+}
 
-static 
-int vread_string(char type, int *iptr, FILE *OutFP)
+int dgGetDataType(int type)
 {
-  int length;
-  int *next = iptr+1;
-  char *str = (char *) next;
+  return(DGTagTable[DgWriter.structs.cur][type].data_type);
+}
 
-  memcpy(&length, iptr, sizeof(int));
+int dgGetStructureType(int type)
+{
+  return(DGTagTable[DgWriter.structs.cur][type].struct_type);
+}
 
-  if (dgFlipEvents) length = fliplong(length);
-  
-  if (length) fprintf(OutFP, "%-20s\t%s\n", dgGetTagName(type), str);
-  return(length+sizeof(int));
+/* Per-reader versions of the above, used by the ASCII dumps */
+static char *reader_tag_name(DG_READER *r, int type)
+{
+  return(DGTagTable[DG_READER_STRUCTS(r)->cur][type].tag_name);
 }
 
-static 
-int vread_strings(char type, int *iptr, FILE *OutFP)
+static int reader_data_type(DG_READER *r, int type)
 {
-  int n, i;
-  int length, sum = 0;
-  char *next = (char *) iptr + sizeof(int);
-  char *str = "";
-  
-  memcpy(&n, iptr++, sizeof(int));
-  if (dgFlipEvents) n = fliplong(n);
-  
-  fprintf(OutFP, "%-20s\t%d\n", dgGetTagName(type), n);
-
-  for (i = 0; i < n; i++) {
-    memcpy(&length, next, sizeof(int));
-    if (dgFlipEvents) length = fliplong(length);
-
-    if (length) str = (char *) next+sizeof(int);
-    
-    fprintf(OutFP, "%d\t%s\n", i, str);
-    sum += length;
-    next += sizeof(int)+length;
-  }
-  return(sum+(n*sizeof(int))+sizeof(int));
+  return(DGTagTable[DG_READER_STRUCTS(r)->cur][type].data_type);
 }
 
-static
-int vread_longs(char type, int *n, FILE *OutFP)
+static int reader_structure_type(DG_READER *r, int type)
 {
-  int i;
-  int nvals;
-  int *next = n+1;
-  int *vl = (int *) next;
-  int *vals = NULL;
-
-  memcpy(&nvals, n, sizeof(int));
-  if (dgFlipEvents) nvals = fliplong(nvals);
+  return(DGTagTable[DG_READER_STRUCTS(r)->cur][type].struct_type);
+}
 
-  if (nvals) {
-    if (!(vals = (int *) calloc(nvals, sizeof(int)))) {
-      fprintf(stderr,"dgutils: error allocating space for int array\n");
-      exit(-1);
-    }
-    memcpy(vals, vl, sizeof(int)*nvals);
+/*********************************************************************/
+/*               Local Byte Stream Handling Functions                */
+/*********************************************************************/
 
-    if (dgFlipEvents) fliplongs(nvals, vals);
-  }
-  fprintf(OutFP, "%-20s\t%d\n", dgGetTagName(type), nvals);
+static void send_event(DG_WRITER *w, unsigned char type, unsigned char *data)
+{
+/* First push the tag into the buffer */
+  push(w, (unsigned char *)&type, 1, 1);
   
-  for (i = 0; i < nvals; i++) {
-    fprintf(OutFP, "%d\t%d\n", i+1, vals[i]);
+/* The only "special" tag is the END_STRUCT tag, which means pop up */
+  if (type == END_STRUCT) return;
+
+/* All other tags may have data; check the current struct tag table  */
+  switch(DGTagTable[w->structs.cur][type].data_type) {
+  case DF_STRUCTURE:            /* data follows via tags             */
+  case DF_FLAG:		
+  case DF_VOID_ARRAY:
+    break;
+  case DF_STRING:		/* all of these start w/a long int   */
+  case DF_STRING_ARRAY:
+  case DF_LONG_ARRAY:
+  case DF_SHORT_ARRAY:
+  case DF_FLOAT_ARRAY:
+  case DF_CHAR_ARRAY:
+  case DF_LIST_ARRAY:
+  case DF_LONG:
+    push(w, data, sizeof(int), 1);
+    break;
+  case DF_CHAR:
+    push(w, data, sizeof(char), 1);
+    break;
+  case DF_SHORT:
+    push(w, data, sizeof(short), 1);
+    break;
+  case DF_VERSION:
+  case DF_FLOAT:
+    push(w, data, sizeof(float), 1);
+    break;
+  default:
+    fprintf(stderr,"Unrecognized event type: %d\n", type);
+    break;
   }
-  
-  if (vals) free(vals);
-  return(sizeof(int)+nvals*sizeof(int));
 }
 
+static void send_bytes(DG_WRITER *w, int n, unsigned char *data)
+{
+  push(w, data, sizeof(unsigned char), n);
+}
 
-static
-int vread_shorts(char type, int *n, FILE *OutFP)
+static void push(DG_WRITER *w, unsigned char *data, int size, int count)
 {
-  int i;
-  int nvals;
-  int *next = n+1;
-  short *vl = (short *) next;
-  short *vals = NULL;
+   int nbytes, newsize;
+   int buffer_increment = w->increment;
 
-  memcpy(&nvals, n, sizeof(int));
-  if (dgFlipEvents) nvals = fliplong(nvals);
+   /* once something is lost, the rest would be out of place anyway */
+   if (w->overflow) return;
+   if (count < 0 || (size && count > INT_MAX / size)) {
+     w->overflow = 1;
+     return;
+   }
+   nbytes = count * size;
 
-  if (nvals) {
-    if (!(vals = (short *) calloc(nvals, sizeof(short)))) {
-      fprintf(stderr,"dgutils: error allocating space for short array\n");
-      exit(-1);
-    }
-    memcpy(vals, vl, sizeof(short)*nvals);
-    
-    if (dgFlipEvents) flipshorts(nvals, vals);
-  }
-  fprintf(OutFP, "%-20s\t%d\n", dgGetTagName(type), nvals);
-  
-  for (i = 0; i < nvals; i++) {
-    fprintf(OutFP, "%d\t%d\n", i+1, vals[i]);
-  }
-  
-  if (vals) free(vals);
-  return(sizeof(int)+nvals*sizeof(short));
-}
+   /* when streaming, pass large arrays straight on to the sink */
+   if (w->sink && w->index + nbytes > DG_SINK_BLOCK_SIZE) {
+     sink_flush(w);
+     if (nbytes >= DG_SINK_BLOCK_SIZE) {
+       if (w->sinkstatus && !w->sink->write(w->sink->state, data, nbytes))
+	 w->sinkstatus = 0;
+       return;
+     }
+   }
 
+   /* a gathering writer just notes where big arrays go */
+   if (w->gather && !w->sink && nbytes >= DG_GATHER_MIN_SIZE &&
+       gather_add(w, data, nbytes)) return;
+   
+   if (w->fixed) {
+     if (nbytes > w->size - w->index) {
+       w->overflow = 1;
+       return;
+     }
+   }
+   else if (nbytes >= w->size - w->index) {
+     if (nbytes >= INT_MAX - w->index) {
+       fprintf(stderr, "dg buffer too large\n");
+       w->overflow = 1;
+       return;
+     }
+     if (nbytes > buffer_increment)
+       buffer_increment = nbytes > INT_MAX/2 ? nbytes : 2*nbytes;
+     newsize = w->size;
+     if (buffer_increment > INT_MAX - newsize ||
+	 w->index + nbytes >= newsize + buffer_increment)
+       newsize = w->index + nbytes + 1;
+     else newsize += buffer_increment;
+     if (!reserve(w, newsize - w->index - 1)) {
+       w->overflow = 1;
+       return;
+     }
+   }
+   
+   if (nbytes) memcpy(&w->buffer[w->index], data, nbytes);
+   w->index += nbytes;
+}
 
-static
-int vread_chars(char type, int *n, FILE *OutFP)
+/*
+ * reserve -- make sure the buffer has room for nbytes more (and the
+ * spare byte push() keeps), returning 0 if it can't be grown
+ */
+static int reserve(DG_WRITER *w, int nbytes)
 {
-  int i;
-  int nvals;
-  int *next = n+1;
-  char *vl = (char *) next;
-  char *vals = NULL;
-
-  memcpy(&nvals, n, sizeof(int));
-  if (dgFlipEvents) nvals = fliplong(nvals);
+  unsigned char *p;
+  int newsize;
 
-  if (nvals) {
-    if (!(vals = (char *) calloc(nvals, sizeof(char)))) {
-      fprintf(stderr,"dgutils: error allocating space for char array\n");
-      exit(-1);
-    }
-    memcpy(vals, vl, sizeof(char)*nvals);
+  if (nbytes < w->size - w->index) return(1);
+  if (nbytes >= INT_MAX - w->index) {
+    fprintf(stderr, "dg buffer too large\n");
+    return(0);
   }
-
-  fprintf(OutFP, "%-20s\t%d\n", dgGetTagName(type), nvals);
-  
-  for (i = 0; i < nvals; i++) {
-    fprintf(OutFP, "%d\t%c\n", i+1, vals[i]);
+  newsize = w->index + nbytes + 1;
+  if (!(p = (unsigned char *) realloc(w->buffer, newsize))) {
+    fprintf(stderr, "Unable to grow dg buffer\n");
+    return(0);
   }
-  
-  if (vals) free(vals);
-  return(sizeof(int)+nvals*sizeof(char));
+  w->buffer = p;
+  w->size = newsize;
+  return(1);
 }
 
-static
-int vread_floats(char type, int *n, FILE *OutFP)
-{
-  int i;
-  int nvals;
-  int *next = n+1;
-  float *vl = (float *) next;
-  float *vals = NULL;
 
-  memcpy(&nvals, n, sizeof(int));
-  if (dgFlipEvents) nvals = fliplong(nvals);
+/*************************************************************************/
+/*                         Dump Helper Funcs                             */
+/*************************************************************************/
 
-  if (nvals) {
-    if (!(vals = (float *) calloc(nvals, sizeof(float)))) {
-      fprintf(stderr,"dgutils: error allocating space for float array\n");
-      exit(-1);
-    }
-    memcpy(vals, vl, sizeof(float)*nvals);
-    
-    if (dgFlipEvents) flipfloats(nvals, vals);
-  }
-  fprintf(OutFP, "%-20s\t%d\n", dgGetTagName(type), nvals);
-  
-  for (i = 0; i < nvals; i++) {
-    fprintf(OutFP, "%d\t%6.2f\n", i+1, vals[i]);
+static void dgDumpBuffer(unsigned char *buffer, int n, int type, FILE *fp)
+{
+  switch(type) {
+  case DF_BINARY:
+    fwrite(buffer, sizeof(unsigned char), n, fp);
+    fflush(fp);
+    break;
+  case DF_ASCII:
+    dguBufferToAscii(buffer, n, fp);
+    break;
+  default:
+    break;
   }
-  
-  if (vals) free(vals);
-  return(sizeof(int)+nvals*sizeof(float));
 }
 
+
 /*--------------------------------------------------------------------
-  -----                   File Skip Functions                    -----
+  -----               Magic Number Functions                     -----
   -------------------------------------------------------------------*/
 
-static
-int skip_bytes(FILE *InFP, int n)
+static 
+int confirm_magic_number(FILE *InFP)
 {
-  if (fseek(InFP, (int) sizeof(float), SEEK_CUR)) {
-    fprintf(stderr,"Error skipping float\n");
-    return(0);
+  int i;
+  for (i = 0; i < DG_MAGIC_NUMBER_SIZE; i++) {
+    if (getc(InFP) != dgMagicNumber[i]) return(0);
   }
   return(1);
 }
 
-static
-void skip_version(FILE *InFP) 
+static 
+int vconfirm_magic_number(char *s)
+{
+  int i;
+  char number[DG_MAGIC_NUMBER_SIZE];
+  memcpy(number, s, DG_MAGIC_NUMBER_SIZE);
+  for (i = 0; i < DG_MAGIC_NUMBER_SIZE; i++) {
+    if (number[i] != dgMagicNumber[i]) return(0);
+  }
+  return(1);
+}
+
+
+/*--------------------------------------------------------------------
+  -----                   File Read Functions                    -----
+  -------------------------------------------------------------------*/
+
+
+static 
+void read_version(DG_READER *r, FILE *InFP, FILE *OutFP)
 {
   float val;
   if (fread(&val, sizeof(float), 1, InFP) != 1) {
@@ -1300,11 +2119,11 @@ void skip_version(FILE *InFP)
   /* 
    * The VERSION should stay as a float, so that byte ordering can be 
    * checked dynamically.  If it doesn't match the first way, then the
-   * dgFlipEvents flag is set and it's tried again.
+   * reader's flip flag is set and it's tried again.
    */
 
   if (val != dgVersion) {
-    dgFlipEvents = 1;
+    DG_READER_FLIP(r) = 1;
     val = flipfloat(val);
     if (val != dgVersion) {
       fprintf(stderr,
@@ -1313,211 +2132,300 @@ void skip_version(FILE *InFP)
       exit(-1);
     }
   }
-  else dgFlipEvents = 0;
+  else DG_READER_FLIP(r) = 0;
+  fprintf(OutFP,"%-20s\t%3.1f\n", "DG_VERSION", val);
 }
 
-static int skip_float(FILE *InFP) 
+static 
+void read_flag(DG_READER *r, char type, FILE *InFP, FILE *OutFP)
 {
-  return(skip_bytes(InFP, sizeof(float)));
+  fprintf(OutFP, "%-20s\n", reader_tag_name(r, type));
 }
 
-static int skip_char(FILE *InFP)
+static 
+void read_float(DG_READER *r, char type, FILE *InFP, FILE *OutFP)
 {
-  return(skip_bytes(InFP, sizeof(char)));
-}
+  float val;
+  if (fread(&val, sizeof(float), 1, InFP) != 1) {
+     fprintf(stderr,"Error reading float info\n");
+     exit(-1);
+  }
+  if (DG_READER_FLIP(r)) val = flipfloat(val);
 
-static int skip_short(FILE *InFP)
-{
-  return(skip_bytes(InFP, sizeof(short)));
+  fprintf(OutFP, "%-20s\t%6.3f\n", reader_tag_name(r, type), val);
 }
 
-static int skip_long(FILE *InFP)
+static 
+void read_char(DG_READER *r, char type, FILE *InFP, FILE *OutFP)
 {
-  return(skip_bytes(InFP, sizeof(int)));
+  char val;
+  if (fread(&val, sizeof(char), 1, InFP) != 1) {
+     fprintf(stderr,"Error reading char val\n");
+     exit(-1);
+  }
+  fprintf(OutFP, "%-20s\t%d\n", reader_tag_name(r, type), val);
 }
 
-static int skip_string(FILE *InFP)
+
+static
+void read_long(DG_READER *r, char type, FILE *InFP, FILE *OutFP)
 {
-  int length;
+  int val;
   
-  if (fread(&length, sizeof(int), 1, InFP) != 1) {
-    fprintf(stderr,"Error reading string length\n");
-    return(0);
+  if (fread(&val, sizeof(int), 1, InFP) != 1) {
+    fprintf(stderr,"Error reading int val\n");
+    exit(-1);
   }
-  if (dgFlipEvents) length = fliplong(length);
-  return(skip_bytes(InFP, length));
+  
+  if (DG_READER_FLIP(r)) val = fliplong(val);
+  
+  fprintf(OutFP, "%-20s\t%d\n", reader_tag_name(r, type), val);
 }
 
-static int skip_strings(FILE *InFP)
+static
+void read_short(DG_READER *r, char type, FILE *InFP, FILE *OutFP)
 {
-  int i, n, sum = 0, size; 
+  short val;
   
-  if (fread(&n, sizeof(int), 1, InFP) != 1) {
-    fprintf(stderr,"Error reading number of strings\n");
-    return(0);
-  }
-  if (dgFlipEvents) n = fliplong(n);
-  for (i = 0; i < n; i++) {
-    size = skip_string(InFP);
-    if (!size) return(0);
-    sum += size;
+  if (fread(&val, sizeof(short), 1, InFP) != 1) {
+    fprintf(stderr,"Error reading short val\n");
+    exit(-1);
   }
-  return(sizeof(int)+sum);
-}
+  
+  if (DG_READER_FLIP(r)) val = flipshort(val);
 
-static int skip_longs(FILE *InFP)
-{
-  int nvals;
-  if (fread(&nvals, sizeof(int), 1, InFP) != 1) {
-    fprintf(stderr,"Error reading number of ints\n");
-    exit(-1);
-  }
-  if (dgFlipEvents) nvals = fliplong(nvals);
-  return(skip_bytes(InFP, nvals*sizeof(int)));
-}
+  fprintf(OutFP, "%-20s\t%d\n", reader_tag_name(r, type), val);
+}   
+
+
+/*********************** ARRAY VERSIONS ************************/
 
-static int skip_shorts(FILE *InFP)
+static
+void read_string(DG_READER *r, char type, FILE *InFP, FILE *OutFP)
 {
-  int nvals;
-  if (fread(&nvals, sizeof(int), 1, InFP) != 1) {
-    fprintf(stderr,"Error reading number of shorts\n");
+  int length;
+  char *str = "";
+
+  if (fread(&length, sizeof(int), 1, InFP) != 1) {
+    fprintf(stderr,"Error reading string length\n");
     exit(-1);
   }
-  if (dgFlipEvents) nvals = fliplong(nvals);
-  return(skip_bytes(InFP, nvals*sizeof(short)));
+  
+  if (DG_READER_FLIP(r)) length = fliplong(length);
+  if (length) {
+    str = (char *) malloc(length);
+    
+    if (fread(str, length, 1, InFP) != 1) {
+      fprintf(stderr,"Error reading\n");
+      exit(-1);
+    }
+  }
+
+  fprintf(OutFP, "%-20s\t%s\n", reader_tag_name(r, type), str);
+  if (length) free(str);
 }
 
-static int skip_floats(FILE *InFP)
+static
+void read_strings(DG_READER *r, char type, FILE *InFP, FILE *OutFP)
 {
-  int nvals;
-  if (fread(&nvals, sizeof(int), 1, InFP) != 1) {
-    fprintf(stderr,"Error reading number of floats\n");
+  int n, i;
+  int length;
+  char *str;
+
+  if (fread(&n, sizeof(int), 1, InFP) != 1) {
+    fprintf(stderr,"Error reading string length\n");
     exit(-1);
   }
-  if (dgFlipEvents) nvals = fliplong(nvals);
-  return(skip_bytes(InFP, nvals*sizeof(float)));
-}
+  if (DG_READER_FLIP(r)) n = fliplong(n);
+  fprintf(OutFP, "%-20s\t%d\n", reader_tag_name(r, type),n);
 
-/*--------------------------------------------------------------------
-  -----                   Buffer Skip Functions                  -----
-  -------------------------------------------------------------------*/
+  for (i = 0; i < n; i++) {
+    if (fread(&length, sizeof(int), 1, InFP) != 1) {
+      fprintf(stderr,"Error reading string length\n");
+      exit(-1);
+    }
+    if (DG_READER_FLIP(r)) length = fliplong(length);
+    
+    str = "";
+    if (length) {
+      str = (char *) malloc(length);
+      
+      if (fread(str, length, 1, InFP) != 1) {
+	fprintf(stderr,"Error reading\n");
+	exit(-1);
+      }
+    }
+    
+    fprintf(OutFP, "%d\t%s\n", i, str);
+    if (length) free(str);
+  }
+}
 
-static 
-int vskip_version(float *version)
+static
+void read_chars(DG_READER *r, char type, FILE *InFP, FILE *OutFP)
 {
-  float val;
-  memcpy(&val, version, sizeof(float));
+  int nchars, i;
+  char *vals = NULL;
   
-  /* 
-   * The VERSION should stay as a float, so that byte ordering can be 
-   * checked dynamically.  If it doesn't match the first way, then the
-   * FlipEvents flag is set and it's tried again.
-   */
+  if (fread(&nchars, sizeof(int), 1, InFP) != 1) {
+    fprintf(stderr,"Error reading number of chars\n");
+    exit(-1);
+  }
 
-  if (val != dgVersion) {
-    dgFlipEvents = 1;
-    val = flipfloat(val);
-    if (val != dgVersion) {
-      fprintf(stderr,
-	      "Unable to read this version of data file (V %5.1f/%5.1f)\n",
-	      val, flipfloat(val));
+  if (DG_READER_FLIP(r)) nchars = fliplong(nchars);
+  
+  if (nchars) {
+    if (!(vals = (char *) calloc(nchars, sizeof(char)))) {
+      fprintf(stderr,"Error allocating memory for char array\n");
+      exit(-1);
+    }
+    
+    if (fread(vals, sizeof(char), nchars, InFP) != nchars) {
+      fprintf(stderr,"Error reading char array\n");
       exit(-1);
     }
   }
-  else dgFlipEvents = 0;
-  return(sizeof(float));
+  
+  fprintf(OutFP, "%-20s\t%d\n", reader_tag_name(r, type), nchars); 
+  
+  for (i = 0; i < nchars; i++) {
+    fprintf(OutFP, "%d\t%c\n", i+1, vals[i]);
+  }
+  if (vals) free(vals);
 }
 
-static int vskip_float(void)
-{ 
-  return(sizeof(float)); 
-}
 
-static int vskip_char(void) 
-{ 
-  return(sizeof(char));  
-}
+static
+void read_longs(DG_READER *r, char type, FILE *InFP, FILE *OutFP)
+{
+  int nlongs, i;
+  int *vals = NULL;
+  
+  if (fread(&nlongs, sizeof(int), 1, InFP) != 1) {
+    fprintf(stderr,"Error reading number of longs\n");
+    exit(-1);
+  }
+  
+  if (DG_READER_FLIP(r)) nlongs = fliplong(nlongs);
+  
+  if (nlongs) {
+    if (!(vals = (int *) calloc(nlongs, sizeof(int)))) {
+      fprintf(stderr,"Error allocating memory for long array\n");
+      exit(-1);
+    }
+    
+    if (fread(vals, sizeof(int), nlongs, InFP) != nlongs) {
+      fprintf(stderr,"Error reading int array\n");
+      exit(-1);
+    }
+    
+    if (DG_READER_FLIP(r)) fliplongs(nlongs, vals);
+  }
 
-static int vskip_short(void) 
-{ 
-  return(sizeof(short)); 
+  fprintf(OutFP, "%-20s\t%d\n", reader_tag_name(r, type), nlongs); 
+  
+  for (i = 0; i < nlongs; i++) {
+    fprintf(OutFP, "%d\t%d\n", i+1, vals[i]);
+  }
+  if (vals) free(vals);
 }
 
-static int vskip_long(void) 
-{ 
-  return(sizeof(int)); 
-}
 
-static int vskip_string(int *l)
+static
+void read_shorts(DG_READER *r, char type, FILE *InFP, FILE *OutFP)
 {
-  int length;
-  memcpy(&length, l, sizeof(int));
+  int nshorts, i;
+  short *vals = NULL;
   
-  if (dgFlipEvents) length = fliplong(length);
-  return(sizeof(int)+length);
-}
-
-static int vskip_strings(int *l)
-{
-  int n, size, sum = 0, i;
-  char *next = (char *) (l) + sizeof(int);
-
-  memcpy(&n, l, sizeof(int));
-  if (dgFlipEvents) n = fliplong(n);
+  if (fread(&nshorts, sizeof(int), 1, InFP) != 1) {
+    fprintf(stderr,"Error reading number of shorts\n");
+    exit(-1);
+  }
   
-  for (i = 0; i < n; i++) {
-    size = vskip_string((int *)next);
-    sum += size;
-    next += size;
+  if (DG_READER_FLIP(r)) nshorts = fliplong(nshorts);
+  
+  if (nshorts) {
+    if (!(vals = (short *) calloc(nshorts, sizeof(short)))) {
+      fprintf(stderr,"Error allocating memory for short array\n");
+      exit(-1);
+    }
+    
+    if (fread(vals, sizeof(short), nshorts, InFP) != nshorts) {
+      fprintf(stderr,"Error reading short array\n");
+      exit(-1);
+    }
+    
+    if (DG_READER_FLIP(r)) flipshorts(nshorts, vals);
   }
-  return(sizeof(int)+sum);
+  
+  fprintf(OutFP, "%-20s\t%d\n", reader_tag_name(r, type), nshorts); 
+  
+  for (i = 0; i < nshorts; i++) {
+    fprintf(OutFP, "%d\t%d\n", i+1, vals[i]);
+  }
+  if (vals) free(vals);
 }
 
-static int vskip_floats(int *n)
+static
+void read_floats(DG_READER *r, char type, FILE *InFP, FILE *OutFP)
 {
-  int nvals;
-  memcpy(&nvals, n, sizeof(int));
-  if (dgFlipEvents) nvals = fliplong(nvals);
-  return(sizeof(int)+(nvals*sizeof(float)));
+  int nfloats, i;
+  float *vals = NULL;
+  
+  if (fread(&nfloats, sizeof(int), 1, InFP) != 1) {
+    fprintf(stderr,"Error reading number of floats\n");
+    exit(-1);
+  }
+  
+  if (DG_READER_FLIP(r)) nfloats = fliplong(nfloats);
+  
+  if (nfloats) {
+    if (!(vals = (float *) calloc(nfloats, sizeof(float)))) {
+      fprintf(stderr,"Error allocating memory for float array\n");
+      exit(-1);
+    }
+    
+    if (fread(vals, sizeof(float), nfloats, InFP) != nfloats) {
+      fprintf(stderr,"Error reading float array\n");
+      exit(-1);
+    }
+    
+    if (DG_READER_FLIP(r)) flipfloats(nfloats, vals);
+  }
+  fprintf(OutFP, "%-20s\t%d\n", reader_tag_name(r, type), nfloats); 
+  
+  for (i = 0; i < nfloats; i++) {
+    fprintf(OutFP, "%d\t%6.2f\n", i+1, vals[i]);
+  }
+  if (vals) free(vals);
 }
 
-static int vskip_shorts(int *n)
-{
-  int nvals;
-  memcpy(&nvals, n, sizeof(int));
-  if (dgFlipEvents) nvals = fliplong(nvals);
-  return(sizeof(int)+(nvals*sizeof(short)));
-}
 
-static int vskip_longs(int *n)
-{
-  int nvals;
-  memcpy(&nvals, n, sizeof(int));
-  if (dgFlipEvents) nvals = fliplong(nvals);
-  return(sizeof(int)+(nvals*sizeof(int)));
-}
 
 /*--------------------------------------------------------------------
-  -----                    File Get Functions                    -----
+  -----                 Buffer Read Functions                    -----
+
+      Routines for reading from a buffer & dumping events to stdout
+      These functions (which start with a v...) all return the number
+      of bytes which were accessed from the buffer.
+
+  -----                                                          -----
   -------------------------------------------------------------------*/
 
 static 
-void get_version(FILE *InFP, float *version)
+int vread_version(DG_READER *r, float *version, FILE *OutFP)
 {
   float val;
-  if (fread(&val, sizeof(float), 1, InFP) != 1) {
-     fprintf(stderr,"Error reading float info\n");
-     exit(-1);
-  }
-
+  memcpy(&val, version, sizeof(float));
+  
   /* 
    * The VERSION should stay as a float, so that byte ordering can be 
    * checked dynamically.  If it doesn't match the first way, then the
-   * dgFlipEvents flag is set and it's tried again.
+   * reader's flip flag is set and it's tried again.
    */
 
   if (val != dgVersion) {
-    dgFlipEvents = 1;
+    DG_READER_FLIP(r) = 1;
     val = flipfloat(val);
     if (val != dgVersion) {
       fprintf(stderr,
@@ -1526,245 +2434,276 @@ void get_version(FILE *InFP, float *version)
       exit(-1);
     }
   }
-  else dgFlipEvents = 0;
-  *version = val;
+  else DG_READER_FLIP(r) = 0;
+  fprintf(OutFP,"%-20s\t%3.1f\n", "DG_VERSION", val);
+  return(sizeof(float));
 }
 
+static int
+vread_flag(DG_READER *r, char type, FILE *OutFP)
+{
+  fprintf(OutFP, "%-20s\n", reader_tag_name(r, type));
+  return(0);
+}
 
 static 
-void get_float(FILE *InFP, float *fval)
+int vread_float(DG_READER *r, char type, float *fval, FILE *OutFP)
 {
   float val;
-  if (fread(&val, sizeof(float), 1, InFP) != 1) {
-     fprintf(stderr,"Error reading float info\n");
-     exit(-1);
-  }
-  if (dgFlipEvents) val = flipfloat(val);
-  *fval = val;
+  memcpy(&val, fval, sizeof(float));
+
+  if (DG_READER_FLIP(r)) val = flipfloat(val);
+
+  fprintf(OutFP, "%-20s\t%6.3f\n", reader_tag_name(r, type), val);
+  return(sizeof(float));
 }
 
-static
-void get_char(FILE *InFP, char *cval)
+
+static 
+int vread_char(DG_READER *r, char type, char *cval, FILE *OutFP)
 {
   char val;
-  if (fread(&val, sizeof(char), 1, InFP) != 1) {
-     fprintf(stderr,"Error reading char val\n");
-     exit(-1);
-  }
-  *cval = val;
+  memcpy(&val, cval, sizeof(char));
+
+  fprintf(OutFP, "%-20s\t%d\n", reader_tag_name(r, type), val);
+  return(sizeof(char));
 }
 
-static 
-void get_long(FILE *InFP,  int *ival)
+
+static
+int vread_long(DG_READER *r, char type, int *ival, FILE *OutFP)
 {
   int val;
-  
-  if (fread(&val, sizeof(int), 1, InFP) != 1) {
-    fprintf(stderr,"Error reading int val\n");
-    exit(-1);
-  }
-  
-  if (dgFlipEvents) val = fliplong(val);
+  memcpy(&val, ival, sizeof(int));
+
+  if (DG_READER_FLIP(r)) val = fliplong(val);
+  fprintf(OutFP, "%-20s\t%d\n", reader_tag_name(r, type), val);
+  return(sizeof(int));
+}   
 
-  *ival = val;
-}
 
 static
-void get_short(FILE *InFP,  short *sval)
+int vread_short(DG_READER *r, char type, short *sval, FILE *OutFP)
 {
   short val;
+  memcpy(&val, sval, sizeof(short));
+
+  if (DG_READER_FLIP(r)) val = flipshort(val);
   
-  if (fread(&val, sizeof(short), 1, InFP) != 1) {
-    fprintf(stderr,"Error reading short val\n");
-    exit(-1);
-  }
-  
-  if (dgFlipEvents) val = flipshort(val);
-  *sval = val;
-}
+  fprintf(OutFP, "%-20s\t%d\n", reader_tag_name(r, type), val);
+  return(sizeof(short));
+}   
 
-static
-void get_string(FILE *InFP, int *n, char **s)
+/*********************** ARRAY VERSIONS ************************/
+
+static 
+int vread_string(DG_READER *r, char type, int *iptr, FILE *OutFP)
 {
   int length;
-  char *str;
-  
-  if (fread(&length, sizeof(int), 1, InFP) != 1) {
-    fprintf(stderr,"Error reading string length\n");
-    exit(-1);
-  }
-  
-  if (dgFlipEvents) length = fliplong(length);
-  
-  if (length) {
-    str = (char *) malloc(length);
-    
-    if (fread(str, length, 1, InFP) != 1) {
-      fprintf(stderr,"Error reading\n");
-      exit(-1);
-    }
-  }
-  else str = strdup("");	/* malloc'd empty string */
+  int *next = iptr+1;
+  char *str = (char *) next;
+
+  memcpy(&length, iptr, sizeof(int));
+
+  if (DG_READER_FLIP(r)) length = fliplong(length);
   
-  *n = length;
-  *s = str;
-}   
+  if (length) fprintf(OutFP, "%-20s\t%s\n", reader_tag_name(r, type), str);
+  return(length+sizeof(int));
+}
 
-static
-void get_strings(FILE *InFP, int *num, char ***s)
+static 
+int vread_strings(DG_READER *r, char type, int *iptr, FILE *OutFP)
 {
-  int i, n, length;
-  char **strings = NULL;
+  int n, i;
+  int length, sum = 0;
+  char *next = (char *) iptr + sizeof(int);
+  char *str = "";
   
-  if (fread(&n, sizeof(int), 1, InFP) != 1) {
-    fprintf(stderr,"Error reading number of strings\n");
-    exit(-1);
-  }
-  if (dgFlipEvents) n = fliplong(n);
+  memcpy(&n, iptr++, sizeof(int));
+  if (DG_READER_FLIP(r)) n = fliplong(n);
+  
+  fprintf(OutFP, "%-20s\t%d\n", reader_tag_name(r, type), n);
 
-  if (n) {
-    strings = (char **) calloc(n, sizeof(char *));
-    for (i = 0; i < n; i++) {
-      get_string(InFP, &length, &strings[i]);
-    }
+  for (i = 0; i < n; i++) {
+    memcpy(&length, next, sizeof(int));
+    if (DG_READER_FLIP(r)) length = fliplong(length);
+
+    if (length) str = (char *) next+sizeof(int);
+    
+    fprintf(OutFP, "%d\t%s\n", i, str);
+    sum += length;
+    next += sizeof(int)+length;
   }
-  
-  *num = n;
-  *s = strings;
-}   
+  return(sum+(n*sizeof(int))+sizeof(int));
+}
 
 static
-void get_chars(FILE *InFP, int *n, char **v)
+int vread_longs(DG_READER *r, char type, int *n, FILE *OutFP)
 {
+  int i;
   int nvals;
-  char *vals = NULL;
+  int *next = n+1;
+  int *vl = (int *) next;
+  int *vals = NULL;
+
+  memcpy(&nvals, n, sizeof(int));
+  if (DG_READER_FLIP(r)) nvals = fliplong(nvals);
 
-  if (fread(&nvals, sizeof(int), 1, InFP) != 1) {
-    fprintf(stderr,"Error reading number of chars\n");
-    exit(-1);
-  }
-  
-  if (dgFlipEvents) nvals = fliplong(nvals);
-  
   if (nvals) {
-    if (!(vals = (char *) calloc(nvals, sizeof(char)))) {
-      fprintf(stderr,"Error allocating memory for char elements\n");
-      exit(-1);
-    }
-    
-    if (fread(vals, sizeof(char), nvals, InFP) != nvals) {
-      fprintf(stderr,"Error reading char elements\n");
+    if (!(vals = (int *) calloc(nvals, sizeof(int)))) {
+      fprintf(stderr,"dgutils: error allocating space for int array\n");
       exit(-1);
     }
-  }
+    memcpy(vals, vl, sizeof(int)*nvals);
 
-  *n = nvals;
-  *v = vals;
+    if (DG_READER_FLIP(r)) fliplongs(nvals, vals);
+  }
+  fprintf(OutFP, "%-20s\t%d\n", reader_tag_name(r, type), nvals);
+  
+  for (i = 0; i < nvals; i++) {
+    fprintf(OutFP, "%d\t%d\n", i+1, vals[i]);
+  }
+  
+  if (vals) free(vals);
+  return(sizeof(int)+nvals*sizeof(int));
 }
 
+
 static
-void get_shorts(FILE *InFP, int *n, short **v)
+int vread_shorts(DG_READER *r, char type, int *n, FILE *OutFP)
 {
+  int i;
   int nvals;
+  int *next = n+1;
+  short *vl = (short *) next;
   short *vals = NULL;
 
-  if (fread(&nvals, sizeof(int), 1, InFP) != 1) {
-    fprintf(stderr,"Error reading number of shorts\n");
-    exit(-1);
-  }
-  
-  if (dgFlipEvents) nvals = fliplong(nvals);
-  
+  memcpy(&nvals, n, sizeof(int));
+  if (DG_READER_FLIP(r)) nvals = fliplong(nvals);
+
   if (nvals) {
     if (!(vals = (short *) calloc(nvals, sizeof(short)))) {
-      fprintf(stderr,"Error allocating memory for short elements\n");
+      fprintf(stderr,"dgutils: error allocating space for short array\n");
       exit(-1);
     }
+    memcpy(vals, vl, sizeof(short)*nvals);
     
-    if (fread(vals, sizeof(short), nvals, InFP) != nvals) {
-      fprintf(stderr,"Error reading short elements\n");
-      exit(-1);
-    }
-  if (dgFlipEvents) flipshorts(nvals, vals);
+    if (DG_READER_FLIP(r)) flipshorts(nvals, vals);
   }
-
-  *n = nvals;
-  *v = vals;
+  fprintf(OutFP, "%-20s\t%d\n", reader_tag_name(r, type), nvals);
+  
+  for (i = 0; i < nvals; i++) {
+    fprintf(OutFP, "%d\t%d\n", i+1, vals[i]);
+  }
+  
+  if (vals) free(vals);
+  return(sizeof(int)+nvals*sizeof(short));
 }
 
+
 static
-void get_longs(FILE *InFP, int *n, int **v)
+int vread_chars(DG_READER *r, char type, int *n, FILE *OutFP)
 {
+  int i;
   int nvals;
-  int *vals = NULL;
+  int *next = n+1;
+  char *vl = (char *) next;
+  char *vals = NULL;
+
+  memcpy(&nvals, n, sizeof(int));
+  if (DG_READER_FLIP(r)) nvals = fliplong(nvals);
 
-  if (fread(&nvals, sizeof(int), 1, InFP) != 1) {
-    fprintf(stderr,"Error reading number of ints\n");
-    exit(-1);
-  }
-  
-  if (dgFlipEvents) nvals = fliplong(nvals);
-  
   if (nvals) {
-    if (!(vals = (int *) calloc(nvals, sizeof(int)))) {
-      fprintf(stderr,"Error allocating memory for long elements\n");
-      exit(-1);
-    }
-    
-    if (fread(vals, sizeof(int), nvals, InFP) != nvals) {
-      fprintf(stderr,"Error reading long elements\n");
+    if (!(vals = (char *) calloc(nvals, sizeof(char)))) {
+      fprintf(stderr,"dgutils: error allocating space for char array\n");
       exit(-1);
     }
-    
-    if (dgFlipEvents) fliplongs(nvals, vals);
+    memcpy(vals, vl, sizeof(char)*nvals);
   }
 
-  *n = nvals;
-  *v = vals;
+  fprintf(OutFP, "%-20s\t%d\n", reader_tag_name(r, type), nvals);
+  
+  for (i = 0; i < nvals; i++) {
+    fprintf(OutFP, "%d\t%c\n", i+1, vals[i]);
+  }
+  
+  if (vals) free(vals);
+  return(sizeof(int)+nvals*sizeof(char));
 }
 
 static
-void get_floats(FILE *InFP, int *n, float **v)
+int vread_floats(DG_READER *r, char type, int *n, FILE *OutFP)
 {
+  int i;
   int nvals;
+  int *next = n+1;
+  float *vl = (float *) next;
   float *vals = NULL;
 
-  if (fread(&nvals, sizeof(int), 1, InFP) != 1) {
-    fprintf(stderr,"Error reading number of floats\n");
-    exit(-1);
-  }
-  
-  if (dgFlipEvents) nvals = fliplong(nvals);
-  
+  memcpy(&nvals, n, sizeof(int));
+  if (DG_READER_FLIP(r)) nvals = fliplong(nvals);
+
   if (nvals) {
     if (!(vals = (float *) calloc(nvals, sizeof(float)))) {
-      fprintf(stderr,"Error allocating memory for float elements\n");
-      exit(-1);
-    }
-    
-    if (fread(vals, sizeof(float), nvals, InFP) != nvals) {
-      fprintf(stderr,"Error reading float elements\n");
+      fprintf(stderr,"dgutils: error allocating space for float array\n");
       exit(-1);
     }
+    memcpy(vals, vl, sizeof(float)*nvals);
     
-    if (dgFlipEvents) flipfloats(nvals, vals);
+    if (DG_READER_FLIP(r)) flipfloats(nvals, vals);
   }
-
-  *n = nvals;
-  *v = vals;
+  fprintf(OutFP, "%-20s\t%d\n", reader_tag_name(r, type), nvals);
+  
+  for (i = 0; i < nvals; i++) {
+    fprintf(OutFP, "%d\t%6.2f\n", i+1, vals[i]);
+  }
+  
+  if (vals) free(vals);
+  return(sizeof(int)+nvals*sizeof(float));
 }
 
 /*--------------------------------------------------------------------
-  -----                  Buffer Get Functions                    -----
+  -----                   File Skip Functions                    -----
   -------------------------------------------------------------------*/
 
 static
-int vget_version(float *v, float *version)
+int skip_bytes(FILE *InFP, int n)
+{
+  char buf[1024];
+  int nread;
+
+  if (n < 0) return(0);
+  if (!fseek(InFP, n, SEEK_CUR)) return(1);
+
+  /* not seekable (e.g. a pipe), so read through instead */
+  while (n > 0) {
+    nread = n < (int) sizeof(buf) ? n : (int) sizeof(buf);
+    if (fread(buf, 1, nread, InFP) != (size_t) nread) {
+      fprintf(stderr,"Error skipping %d bytes\n", n);
+      return(0);
+    }
+    n -= nread;
+  }
+  return(1);
+}
+
+static
+void skip_version(DG_READER *r, FILE *InFP) 
 {
   float val;
-  memcpy(&val, v, sizeof(float));
+  if (fread(&val, sizeof(float), 1, InFP) != 1) {
+     fprintf(stderr,"Error reading float info\n");
+     exit(-1);
+  }
+
+  /* 
+   * The VERSION should stay as a float, so that byte ordering can be 
+   * checked dynamically.  If it doesn't match the first way, then the
+   * reader's flip flag is set and it's tried again.
+   */
+
   if (val != dgVersion) {
-    dgFlipEvents = 1;
+    DG_READER_FLIP(r) = 1;
     val = flipfloat(val);
     if (val != dgVersion) {
       fprintf(stderr,
@@ -1773,625 +2712,3668 @@ int vget_version(float *v, float *version)
       exit(-1);
     }
   }
-  else dgFlipEvents = 0;
-  *version = val;
-  return(sizeof(float));
+  else DG_READER_FLIP(r) = 0;
 }
-   
 
-static 
-int vget_float(float *fval, float *v)
+static int skip_float(DG_READER *r, FILE *InFP) 
 {
-  float val;
-  memcpy(&val, fval, sizeof(float));
-
-  if (dgFlipEvents) val = flipfloat(val);
-  *v = val;
-  return(sizeof(float));
+  return(skip_bytes(InFP, sizeof(float)));
 }
 
-static 
-int vget_char(char *cval, char *c)
+static int skip_char(DG_READER *r, FILE *InFP)
 {
-  *c = *cval;
-  return(sizeof(char));
+  return(skip_bytes(InFP, sizeof(char)));
 }
 
-static
-int vget_long(int *ival, int *l)
+static int skip_short(DG_READER *r, FILE *InFP)
 {
-  int val;
-  memcpy(&val, ival, sizeof(int));
-
-  if (dgFlipEvents) val = fliplong(val);
-  *l = val;
-  return(sizeof(int));
+  return(skip_bytes(InFP, sizeof(short)));
 }
 
-static 
-int vget_short(short *sval, short *s)
+static int skip_long(DG_READER *r, FILE *InFP)
 {
-  short val;
-  memcpy(&val, sval, sizeof(short));
-
-  if (dgFlipEvents) val = flipshort(val);
-  *s = val;
-  return(sizeof(short));
+  return(skip_bytes(InFP, sizeof(int)));
 }
 
-static 
-int vget_string(int *iptr, int *l, char **s)
+static int skip_string(DG_READER *r, FILE *InFP)
 {
   int length;
-  int *next = iptr+1;
-  static char *str;
-  
-  memcpy(&length, iptr, sizeof(int));
   
-  if (dgFlipEvents) length = fliplong(length);
-  
-  if (length) {
-    str = (char *) malloc(length);
-    memcpy(str, (char *) next, length);
+  if (fread(&length, sizeof(int), 1, InFP) != 1) {
+    fprintf(stderr,"Error reading string length\n");
+    return(0);
   }
-  else str = strdup("");
-
-  *l = length;
-  *s = str;
-  
-  return(sizeof(int)+length);
+  if (DG_READER_FLIP(r)) length = fliplong(length);
+  return(skip_bytes(InFP, length));
 }
 
-
-static 
-int vget_strings(int *iptr, int *num, char ***s)
+static int skip_strings(DG_READER *r, FILE *InFP)
 {
-  int n, i, size, sum, length;
-  char *next = (char *) iptr + sizeof(int);
-  char **strings = NULL;
+  int i, n, sum = 0, size; 
   
-  memcpy(&n, iptr, sizeof(int));
-  if (dgFlipEvents) n = fliplong(n);
-
-  if (n) strings = (char **) calloc(n, sizeof(char *));
-  for (i = 0, sum = 0; i < n; i++) {
-    size = vget_string((int *) next, &length, &strings[i]);
+  if (fread(&n, sizeof(int), 1, InFP) != 1) {
+    fprintf(stderr,"Error reading number of strings\n");
+    return(0);
+  }
+  if (DG_READER_FLIP(r)) n = fliplong(n);
+  for (i = 0; i < n; i++) {
+    size = skip_string(r, InFP);
+    if (!size) return(0);
     sum += size;
-    next += size;
   }
-  *num = n;
-  *s = strings;
-
   return(sizeof(int)+sum);
 }
 
-static
-int vget_shorts(int *n, int *nv, short **v)
+static int skip_longs(DG_READER *r, FILE *InFP)
 {
   int nvals;
-  int *next = n+1;
-  short *vl = (short *) next;
-  short *vals = NULL;
-
-  memcpy(&nvals, n, sizeof(int));
-  if (dgFlipEvents) nvals = fliplong(nvals);
-
-  if (nvals) {
-    if (!(vals = (short *) calloc(nvals, sizeof(short)))) {
-      fprintf(stderr,"dgutils: error allocating space for short array\n");
-      exit(-1);
-    }
-    memcpy(vals, vl, sizeof(short)*nvals);
-    
-    if (dgFlipEvents) flipshorts(nvals, vals);
+  if (fread(&nvals, sizeof(int), 1, InFP) != 1) {
+    fprintf(stderr,"Error reading number of ints\n");
+    exit(-1);
   }
-
-  *nv = nvals;
-  *v  = vals;
-
-  return(sizeof(int)+nvals*sizeof(short));
+  if (DG_READER_FLIP(r)) nvals = fliplong(nvals);
+  return(skip_bytes(InFP, nvals*sizeof(int)));
 }
 
-static
-int vget_chars(int *n, int *nv, char **v)
+static int skip_shorts(DG_READER *r, FILE *InFP)
 {
   int nvals;
-  int *next = n+1;
-  char *vl = (char *) next;
-  char *vals = NULL;
-
-  memcpy(&nvals, n, sizeof(int));
-  if (dgFlipEvents) nvals = fliplong(nvals);
-
-  if (nvals) {
-    if (!(vals = (char *) calloc(nvals, sizeof(char)))) {
-      fprintf(stderr,"dgutils: error allocating space for char array\n");
-      exit(-1);
-    }
-    memcpy(vals, vl, sizeof(char)*nvals);
+  if (fread(&nvals, sizeof(int), 1, InFP) != 1) {
+    fprintf(stderr,"Error reading number of shorts\n");
+    exit(-1);
   }
-
-  *nv = nvals;
-  *v  = vals;
-
-  return(sizeof(int)+nvals*sizeof(char));
+  if (DG_READER_FLIP(r)) nvals = fliplong(nvals);
+  return(skip_bytes(InFP, nvals*sizeof(short)));
 }
 
-static
-int vget_longs(int *n, int *nv, int **v)
+static int skip_floats(DG_READER *r, FILE *InFP)
 {
   int nvals;
-  int *next = n+1;
-  int *vl = (int *) next;
-  int *vals = NULL;
-
-  memcpy(&nvals, n, sizeof(int));
-  if (dgFlipEvents) nvals = fliplong(nvals);
-
-  if (nvals) {
-    if (!(vals = (int *) calloc(nvals, sizeof(int)))) {
-      fprintf(stderr,"dgutils: error allocating space for int array\n");
-      exit(-1);
-    }
-    memcpy(vals, vl, sizeof(int)*nvals);
-    
-    if (dgFlipEvents) fliplongs(nvals, vals);
+  if (fread(&nvals, sizeof(int), 1, InFP) != 1) {
+    fprintf(stderr,"Error reading number of floats\n");
+    exit(-1);
   }
-
-  *nv = nvals;
-  *v  = vals;
-
-  return(sizeof(int)+nvals*sizeof(int));
+  if (DG_READER_FLIP(r)) nvals = fliplong(nvals);
+  return(skip_bytes(InFP, nvals*sizeof(float)));
 }
 
-static
-int vget_floats(int *n, int *nv, float **v)
+static int skip_chars(DG_READER *r, FILE *InFP)
 {
   int nvals;
-  int *next = n+1;
-  float *vl = (float *) next;
-  float *vals = NULL;
-
-  memcpy(&nvals, n, sizeof(int));
-  if (dgFlipEvents) nvals = fliplong(nvals);
-
-  if (nvals) {
-    if (!(vals = (float *) calloc(nvals, sizeof(float)))) {
-      fprintf(stderr,"dgutils: error allocating space for float array\n");
-      exit(-1);
-    }
-    memcpy(vals, vl, sizeof(float)*nvals);
-    
-    if (dgFlipEvents) flipfloats(nvals, vals);
+  if (fread(&nvals, sizeof(int), 1, InFP) != 1) {
+    fprintf(stderr,"Error reading number of chars\n");
+    exit(-1);
   }
-
-  *nv = nvals;
-  *v  = vals;
-
-  return(sizeof(int)+nvals*sizeof(float));
+  if (DG_READER_FLIP(r)) nvals = fliplong(nvals);
+  return(skip_bytes(InFP, nvals*sizeof(char)));
 }
 
-
-
-/*--------------------------------------------------------------------
-  -----           File to Structure Transfer Functions           -----
-  -------------------------------------------------------------------*/
-
-int dguFileToStruct(FILE *InFP, DYN_GROUP *dg)
+/*
+ * skip_list -- step over the rest of a DYN_LIST structure (up to and
+ * including its END_STRUCT) without converting anything.  Returns 1 on
+ * success, 0 on error.
+ */
+static int skip_list(DG_READER *r, FILE *InFP)
 {
-  int c, status = DF_OK;
-  float version;
-  
-  if (!confirm_magic_number(InFP)) {
-    //    fprintf(stderr,"dgutils: file not recognized as dg format\n");
-    return(0);
-  }
-  
-  while(status == DF_OK && (c = getc(InFP)) != EOF) {
+  int c, n, i, status = 1;
+
+  while (status && (c = getc(InFP)) != EOF) {
     switch (c) {
     case END_STRUCT:
-      status = DF_FINISHED;
+      return(1);
+    case DL_NAME_TAG:
+      status = skip_string(r, InFP);
       break;
-    case DG_VERSION_TAG:
-      get_version(InFP, &version);
+    case DL_INCREMENT_TAG:
+    case DL_FLAGS_TAG:
+      status = skip_long(r, InFP);
       break;
-    case DG_BEGIN_TAG:
-      status = dguFileToDynGroup(InFP, dg);
+    case DL_DATA_TAG:
       break;
-    default:
-      fprintf(stderr,"unknown event type %d\n", c);
-      status = DF_ABORT;
+    case DL_STRING_DATA_TAG:
+      status = skip_strings(r, InFP);
       break;
-    }
-  }
-  if (status != DF_ABORT) return(DF_OK);
-  else return(status);
-}
-
-int dguFileToDynGroup(FILE *InFP, DYN_GROUP *dg)
-{
-  int n = 0, nlists, c, status = DF_OK;
-
-  while(status == DF_OK && (c = getc(InFP)) != EOF) {
-    switch (c) {
-    case END_STRUCT:
-      status = DF_FINISHED;
+    case DL_FLOAT_DATA_TAG:
+      status = skip_floats(r, InFP);
       break;
-    case DG_NAME_TAG:
-      {
-	char *string;
-	int n;
-	get_string(InFP, &n, &string);
-	strncpy(DYN_GROUP_NAME(dg), string, DYN_GROUP_NAME_SIZE-1);
-	free((void *) string);
-      }
+    case DL_LONG_DATA_TAG:
+      status = skip_longs(r, InFP);
       break;
-    case DG_NLISTS_TAG:
-      get_long(InFP, (int *) &nlists);
+    case DL_SHORT_DATA_TAG:
+      status = skip_shorts(r, InFP);
       break;
-    case DG_DYNLIST_TAG:
-      {
-	DYN_LIST *dl = (DYN_LIST *) calloc(1, sizeof(DYN_LIST));
-	DYN_LIST_INCREMENT(dl) = 10;
-	status = dguFileToDynList(InFP, dl);
-	dfuAddDynGroupExistingList(dg, DYN_LIST_NAME(dl), dl);
-	n++;
+    case DL_CHAR_DATA_TAG:
+      status = skip_chars(r, InFP);
+      break;
+    case DL_LIST_DATA_TAG:
+      if (fread(&n, sizeof(int), 1, InFP) != 1) return(0);
+      if (DG_READER_FLIP(r)) n = fliplong(n);
+      for (i = 0; status && i < n; i++) {
+	if (getc(InFP) != DL_SUBLIST_TAG) return(0);
+	status = skip_list(r, InFP);
       }
       break;
     default:
       fprintf(stderr,"unknown event type %d\n", c);
-      status = DF_ABORT;
-      break;
+      return(0);
     }
   }
-  if (status != DF_ABORT) return(DF_OK);
-  else return(status);
+  return(0);
 }
 
-int dguFileToDynList(FILE *InFP, DYN_LIST *dl)
+/*--------------------------------------------------------------------
+  -----                   Buffer Skip Functions                  -----
+  -------------------------------------------------------------------*/
+
+static 
+int vskip_version(DG_READER *r, float *version)
 {
-  int c, status = DF_OK;
+  float val;
+  memcpy(&val, version, sizeof(float));
+  
+  /* 
+   * The VERSION should stay as a float, so that byte ordering can be 
+   * checked dynamically.  If it doesn't match the first way, then the
+   * reader's flip flag is set and it's tried again.
+   */
 
-  while(status == DF_OK && (c = getc(InFP)) != EOF) {
-    switch (c) {
-    case END_STRUCT:
-      status = DF_FINISHED;
-      break;
-    case DL_INCREMENT_TAG:
-      get_long(InFP, (int *) &DYN_LIST_INCREMENT(dl));
-      break;
-    case DL_FLAGS_TAG:
-      get_long(InFP, (int *) &DYN_LIST_FLAGS(dl));
-      break;
-    case DL_DATA_TAG:
-      break;
-    case DL_NAME_TAG:
-      {
-	char *string;
-	int n;
-	get_string(InFP, &n, &string);
-	strncpy(DYN_LIST_NAME(dl), string, DYN_LIST_NAME_SIZE-1);
-	free((void *) string);
-      }
-      break;
-    case DL_STRING_DATA_TAG:
-      {
-	char **data;
-	int n;
-	get_strings(InFP, &n, &data);
-	DYN_LIST_DATATYPE(dl) = DF_STRING;
-	DYN_LIST_MAX(dl) = n;
-	DYN_LIST_N(dl) = n;
-	if (n) DYN_LIST_VALS(dl) = data;
-	else {
+  if (val != dgVersion) {
+    DG_READER_FLIP(r) = 1;
+    val = flipfloat(val);
+    if (val != dgVersion) {
+      fprintf(stderr,
+	      "Unable to read this version of data file (V %5.1f/%5.1f)\n",
+	      val, flipfloat(val));
+      exit(-1);
+    }
+  }
+  else DG_READER_FLIP(r) = 0;
+  return(sizeof(float));
+}
+
+static int vskip_float(DG_READER *r)
+{ 
+  return(sizeof(float)); 
+}
+
+static int vskip_char(DG_READER *r) 
+{ 
+  return(sizeof(char));  
+}
+
+static int vskip_short(DG_READER *r) 
+{ 
+  return(sizeof(short)); 
+}
+
+static int vskip_long(DG_READER *r) 
+{ 
+  return(sizeof(int)); 
+}
+
+static int vskip_string(DG_READER *r, int *l)
+{
+  int length;
+  memcpy(&length, l, sizeof(int));
+  
+  if (DG_READER_FLIP(r)) length = fliplong(length);
+  return(sizeof(int)+length);
+}
+
+static int vskip_strings(DG_READER *r, int *l)
+{
+  int n, size, sum = 0, i;
+  char *next = (char *) (l) + sizeof(int);
+
+  memcpy(&n, l, sizeof(int));
+  if (DG_READER_FLIP(r)) n = fliplong(n);
+  
+  for (i = 0; i < n; i++) {
+    size = vskip_string(r, (int *)next);
+    sum += size;
+    next += size;
+  }
+  return(sizeof(int)+sum);
+}
+
+static int vskip_floats(DG_READER *r, int *n)
+{
+  int nvals;
+  memcpy(&nvals, n, sizeof(int));
+  if (DG_READER_FLIP(r)) nvals = fliplong(nvals);
+  return(sizeof(int)+(nvals*sizeof(float)));
+}
+
+static int vskip_shorts(DG_READER *r, int *n)
+{
+  int nvals;
+  memcpy(&nvals, n, sizeof(int));
+  if (DG_READER_FLIP(r)) nvals = fliplong(nvals);
+  return(sizeof(int)+(nvals*sizeof(short)));
+}
+
+static int vskip_longs(DG_READER *r, int *n)
+{
+  int nvals;
+  memcpy(&nvals, n, sizeof(int));
+  if (DG_READER_FLIP(r)) nvals = fliplong(nvals);
+  return(sizeof(int)+(nvals*sizeof(int)));
+}
+
+static int vskip_chars(DG_READER *r, int *n)
+{
+  int nvals;
+  memcpy(&nvals, n, sizeof(int));
+  if (DG_READER_FLIP(r)) nvals = fliplong(nvals);
+  return(sizeof(int)+(nvals*sizeof(char)));
+}
+
+/*--------------------------------------------------------------------
+  -----                    File Get Functions                    -----
+  -------------------------------------------------------------------*/
+
+static 
+void get_version(DG_READER *r, FILE *InFP, float *version)
+{
+  float val;
+  if (fread(&val, sizeof(float), 1, InFP) != 1) {
+     fprintf(stderr,"Error reading float info\n");
+     exit(-1);
+  }
+
+  /* 
+   * The VERSION should stay as a float, so that byte ordering can be 
+   * checked dynamically.  If it doesn't match the first way, then the
+   * reader's flip flag is set and it's tried again.
+   */
+
+  if (val != dgVersion) {
+    DG_READER_FLIP(r) = 1;
+    val = flipfloat(val);
+    if (val != dgVersion) {
+      fprintf(stderr,
+	      "Unable to read this version of data file (V %5.1f/%5.1f)\n",
+	      val, flipfloat(val));
+      exit(-1);
+    }
+  }
+  else DG_READER_FLIP(r) = 0;
+  *version = val;
+}
+
+
+static 
+void get_float(DG_READER *r, FILE *InFP, float *fval)
+{
+  float val;
+  if (fread(&val, sizeof(float), 1, InFP) != 1) {
+     fprintf(stderr,"Error reading float info\n");
+     exit(-1);
+  }
+  if (DG_READER_FLIP(r)) val = flipfloat(val);
+  *fval = val;
+}
+
+static
+void get_char(DG_READER *r, FILE *InFP, char *cval)
+{
+  char val;
+  if (fread(&val, sizeof(char), 1, InFP) != 1) {
+     fprintf(stderr,"Error reading char val\n");
+     exit(-1);
+  }
+  *cval = val;
+}
+
+static 
+void get_long(DG_READER *r, FILE *InFP,  int *ival)
+{
+  int val;
+  
+  if (fread(&val, sizeof(int), 1, InFP) != 1) {
+    fprintf(stderr,"Error reading int val\n");
+    exit(-1);
+  }
+  
+  if (DG_READER_FLIP(r)) val = fliplong(val);
+
+  *ival = val;
+}
+
+static
+void get_short(DG_READER *r, FILE *InFP,  short *sval)
+{
+  short val;
+  
+  if (fread(&val, sizeof(short), 1, InFP) != 1) {
+    fprintf(stderr,"Error reading short val\n");
+    exit(-1);
+  }
+  
+  if (DG_READER_FLIP(r)) val = flipshort(val);
+  *sval = val;
+}
+
+static
+void get_string(DG_READER *r, FILE *InFP, int *n, char **s)
+{
+  int length;
+  char *str;
+  
+  if (fread(&length, sizeof(int), 1, InFP) != 1) {
+    fprintf(stderr,"Error reading string length\n");
+    exit(-1);
+  }
+  
+  if (DG_READER_FLIP(r)) length = fliplong(length);
+  
+  if (length) {
+    str = (char *) malloc(length);
+    
+    if (fread(str, length, 1, InFP) != 1) {
+      fprintf(stderr,"Error reading\n");
+      exit(-1);
+    }
+  }
+  else str = strdup("");	/* malloc'd empty string */
+  
+  *n = length;
+  *s = str;
+}   
+
+static
+void get_strings(DG_READER *r, FILE *InFP, int *num, char ***s)
+{
+  int i, n, length;
+  char **strings = NULL;
+  
+  if (fread(&n, sizeof(int), 1, InFP) != 1) {
+    fprintf(stderr,"Error reading number of strings\n");
+    exit(-1);
+  }
+  if (DG_READER_FLIP(r)) n = fliplong(n);
+
+  if (n) {
+    strings = (char **) calloc(n, sizeof(char *));
+    for (i = 0; i < n; i++) {
+      get_string(r, InFP, &length, &strings[i]);
+    }
+  }
+  
+  *num = n;
+  *s = strings;
+}   
+
+static
+void get_chars(DG_READER *r, FILE *InFP, int *n, char **v)
+{
+  int nvals;
+  char *vals = NULL;
+
+  if (fread(&nvals, sizeof(int), 1, InFP) != 1) {
+    fprintf(stderr,"Error reading number of chars\n");
+    exit(-1);
+  }
+  
+  if (DG_READER_FLIP(r)) nvals = fliplong(nvals);
+  
+  if (nvals) {
+    if (!(vals = (char *) calloc(nvals, sizeof(char)))) {
+      fprintf(stderr,"Error allocating memory for char elements\n");
+      exit(-1);
+    }
+    
+    if (fread(vals, sizeof(char), nvals, InFP) != nvals) {
+      fprintf(stderr,"Error reading char elements\n");
+      exit(-1);
+    }
+  }
+
+  *n = nvals;
+  *v = vals;
+}
+
+static
+void get_shorts(DG_READER *r, FILE *InFP, int *n, short **v)
+{
+  int nvals;
+  short *vals = NULL;
+
+  if (fread(&nvals, sizeof(int), 1, InFP) != 1) {
+    fprintf(stderr,"Error reading number of shorts\n");
+    exit(-1);
+  }
+  
+  if (DG_READER_FLIP(r)) nvals = fliplong(nvals);
+  
+  if (nvals) {
+    if (!(vals = (short *) calloc(nvals, sizeof(short)))) {
+      fprintf(stderr,"Error allocating memory for short elements\n");
+      exit(-1);
+    }
+    
+    if (fread(vals, sizeof(short), nvals, InFP) != nvals) {
+      fprintf(stderr,"Error reading short elements\n");
+      exit(-1);
+    }
+  if (DG_READER_FLIP(r)) flipshorts(nvals, vals);
+  }
+
+  *n = nvals;
+  *v = vals;
+}
+
+static
+void get_longs(DG_READER *r, FILE *InFP, int *n, int **v)
+{
+  int nvals;
+  int *vals = NULL;
+
+  if (fread(&nvals, sizeof(int), 1, InFP) != 1) {
+    fprintf(stderr,"Error reading number of ints\n");
+    exit(-1);
+  }
+  
+  if (DG_READER_FLIP(r)) nvals = fliplong(nvals);
+  
+  if (nvals) {
+    if (!(vals = (int *) calloc(nvals, sizeof(int)))) {
+      fprintf(stderr,"Error allocating memory for long elements\n");
+      exit(-1);
+    }
+    
+    if (fread(vals, sizeof(int), nvals, InFP) != nvals) {
+      fprintf(stderr,"Error reading long elements\n");
+      exit(-1);
+    }
+    
+    if (DG_READER_FLIP(r)) fliplongs(nvals, vals);
+  }
+
+  *n = nvals;
+  *v = vals;
+}
+
+static
+void get_floats(DG_READER *r, FILE *InFP, int *n, float **v)
+{
+  int nvals;
+  float *vals = NULL;
+
+  if (fread(&nvals, sizeof(int), 1, InFP) != 1) {
+    fprintf(stderr,"Error reading number of floats\n");
+    exit(-1);
+  }
+  
+  if (DG_READER_FLIP(r)) nvals = fliplong(nvals);
+  
+  if (nvals) {
+    if (!(vals = (float *) calloc(nvals, sizeof(float)))) {
+      fprintf(stderr,"Error allocating memory for float elements\n");
+      exit(-1);
+    }
+    
+    if (fread(vals, sizeof(float), nvals, InFP) != nvals) {
+      fprintf(stderr,"Error reading float elements\n");
+      exit(-1);
+    }
+    
+    if (DG_READER_FLIP(r)) flipfloats(nvals, vals);
+  }
+
+  *n = nvals;
+  *v = vals;
+}
+
+/*--------------------------------------------------------------------
+  -----                  Buffer Get Functions                    -----
+  -------------------------------------------------------------------*/
+
+static
+int vget_version(DG_READER *r, float *v, float *version)
+{
+  float val;
+  memcpy(&val, v, sizeof(float));
+  if (val != dgVersion) {
+    DG_READER_FLIP(r) = 1;
+    val = flipfloat(val);
+    if (val != dgVersion) {
+      fprintf(stderr,
+	      "Unable to read this version of data file (V %5.1f/%5.1f)\n",
+	      val, flipfloat(val));
+      exit(-1);
+    }
+  }
+  else DG_READER_FLIP(r) = 0;
+  *version = val;
+  return(sizeof(float));
+}
+   
+
+static 
+int vget_float(DG_READER *r, float *fval, float *v)
+{
+  float val;
+  memcpy(&val, fval, sizeof(float));
+
+  if (DG_READER_FLIP(r)) val = flipfloat(val);
+  *v = val;
+  return(sizeof(float));
+}
+
+static 
+int vget_char(DG_READER *r, char *cval, char *c)
+{
+  *c = *cval;
+  return(sizeof(char));
+}
+
+static
+int vget_long(DG_READER *r, int *ival, int *l)
+{
+  int val;
+  memcpy(&val, ival, sizeof(int));
+
+  if (DG_READER_FLIP(r)) val = fliplong(val);
+  *l = val;
+  return(sizeof(int));
+}
+
+static 
+int vget_short(DG_READER *r, short *sval, short *s)
+{
+  short val;
+  memcpy(&val, sval, sizeof(short));
+
+  if (DG_READER_FLIP(r)) val = flipshort(val);
+  *s = val;
+  return(sizeof(short));
+}
+
+static 
+int vget_string(DG_READER *r, int *iptr, int *l, char **s)
+{
+  int length;
+  int *next = iptr+1;
+  char *str;
+  
+  memcpy(&length, iptr, sizeof(int));
+  
+  if (DG_READER_FLIP(r)) length = fliplong(length);
+  
+  if (length) {
+    str = (char *) malloc(length);
+    memcpy(str, (char *) next, length);
+  }
+  else str = strdup("");
+
+  *l = length;
+  *s = str;
+  
+  return(sizeof(int)+length);
+}
+
+
+static 
+int vget_strings(DG_READER *r, int *iptr, int *num, char ***s)
+{
+  int n, i, size, sum, length;
+  char *next = (char *) iptr + sizeof(int);
+  char **strings = NULL;
+  
+  memcpy(&n, iptr, sizeof(int));
+  if (DG_READER_FLIP(r)) n = fliplong(n);
+
+  if (n) strings = (char **) calloc(n, sizeof(char *));
+  for (i = 0, sum = 0; i < n; i++) {
+    size = vget_string(r, (int *) next, &length, &strings[i]);
+    sum += size;
+    next += size;
+  }
+  *num = n;
+  *s = strings;
+
+  return(sizeof(int)+sum);
+}
+
+/*
+ * vpool_strings -- like vget_strings, but the strings all go into one
+ * DYN_POOL block instead of being malloc'd one by one.  When borrowing,
+ * strings that are already NUL terminated in the stream aren't copied
+ * at all; they point into the buffer, which the pool holds on to.
+ */
+
+static 
+int vpool_strings(DG_READER *r, int *iptr, int *num, char ***s,
+		  DYN_POOL **p)
+{
+  int n, i, sum, length, size = 0;
+  char *next = (char *) iptr + sizeof(int);
+  char **strings = NULL;
+  DYN_POOL *pool = NULL;
+  DYN_BUFFER *source = DG_READER_BORROW(r);
+
+  memcpy(&n, iptr, sizeof(int));
+  if (DG_READER_FLIP(r)) n = fliplong(n);
+
+  /* first pass to size the pool */
+  for (i = 0, sum = 0; i < n; i++) {
+    memcpy(&length, next+sum, sizeof(int));
+    if (DG_READER_FLIP(r)) length = fliplong(length);
+    if (!source || !length || next[sum+sizeof(int)+length-1])
+      size += length+1;
+    sum += sizeof(int)+length;
+  }
+
+  if (n > 0) {
+    strings = (char **) calloc(n, sizeof(char *));
+    pool = dfuCreateDynPool(source, size);
+  }
+  for (i = 0; i < n; i++) {
+    memcpy(&length, next, sizeof(int));
+    if (DG_READER_FLIP(r)) length = fliplong(length);
+    next += sizeof(int);
+    if (source && length && !next[length-1]) strings[i] = next;
+    else {
+      strings[i] = dfuPoolAlloc(pool, length+1);
+      memcpy(strings[i], next, length);
+      strings[i][length] = 0;
+    }
+    next += length;
+  }
+  *num = n;
+  *s = strings;
+  *p = pool;
+
+  return(sizeof(int)+sum);
+}
+
+static
+int vget_shorts(DG_READER *r, int *n, int *nv, short **v)
+{
+  int nvals;
+  int *next = n+1;
+  short *vl = (short *) next;
+  short *vals = NULL;
+
+  memcpy(&nvals, n, sizeof(int));
+  if (DG_READER_FLIP(r)) nvals = fliplong(nvals);
+
+  if (nvals) {
+    if (!(vals = (short *) calloc(nvals, sizeof(short)))) {
+      fprintf(stderr,"dgutils: error allocating space for short array\n");
+      exit(-1);
+    }
+    if (DG_READER_FLIP(r)) copyflipshorts(nvals, vl, vals);
+    else memcpy(vals, vl, sizeof(short)*nvals);
+  }
+
+  *nv = nvals;
+  *v  = vals;
+
+  return(sizeof(int)+nvals*sizeof(short));
+}
+
+static
+int vget_chars(DG_READER *r, int *n, int *nv, char **v)
+{
+  int nvals;
+  int *next = n+1;
+  char *vl = (char *) next;
+  char *vals = NULL;
+
+  memcpy(&nvals, n, sizeof(int));
+  if (DG_READER_FLIP(r)) nvals = fliplong(nvals);
+
+  if (nvals) {
+    if (!(vals = (char *) calloc(nvals, sizeof(char)))) {
+      fprintf(stderr,"dgutils: error allocating space for char array\n");
+      exit(-1);
+    }
+    memcpy(vals, vl, sizeof(char)*nvals);
+  }
+
+  *nv = nvals;
+  *v  = vals;
+
+  return(sizeof(int)+nvals*sizeof(char));
+}
+
+static
+int vget_longs(DG_READER *r, int *n, int *nv, int **v)
+{
+  int nvals;
+  int *next = n+1;
+  int *vl = (int *) next;
+  int *vals = NULL;
+
+  memcpy(&nvals, n, sizeof(int));
+  if (DG_READER_FLIP(r)) nvals = fliplong(nvals);
+
+  if (nvals) {
+    if (!(vals = (int *) calloc(nvals, sizeof(int)))) {
+      fprintf(stderr,"dgutils: error allocating space for int array\n");
+      exit(-1);
+    }
+    if (DG_READER_FLIP(r)) copyfliplongs(nvals, vl, vals);
+    else memcpy(vals, vl, sizeof(int)*nvals);
+  }
+
+  *nv = nvals;
+  *v  = vals;
+
+  return(sizeof(int)+nvals*sizeof(int));
+}
+
+static
+int vget_floats(DG_READER *r, int *n, int *nv, float **v)
+{
+  int nvals;
+  int *next = n+1;
+  float *vl = (float *) next;
+  float *vals = NULL;
+
+  memcpy(&nvals, n, sizeof(int));
+  if (DG_READER_FLIP(r)) nvals = fliplong(nvals);
+
+  if (nvals) {
+    if (!(vals = (float *) calloc(nvals, sizeof(float)))) {
+      fprintf(stderr,"dgutils: error allocating space for float array\n");
+      exit(-1);
+    }
+    if (DG_READER_FLIP(r)) copyflipfloats(nvals, vl, vals);
+    else memcpy(vals, vl, sizeof(float)*nvals);
+  }
+
+  *nv = nvals;
+  *v  = vals;
+
+  return(sizeof(int)+nvals*sizeof(float));
+}
+
+/*--------------------------------------------------------------------
+  -----                  Buffer Borrow Functions                 -----
+
+      Zero-copy versions of vget_shorts/longs/floats/chars for use
+      when the buffer is owned by a DYN_BUFFER (DG_READER_BORROW).  The
+      returned pointer points into the buffer itself.  Element arrays
+      are generally not aligned in the stream (tags are single bytes),
+      so a misaligned payload is slid back onto an aligned address
+      over its own (already consumed) count field, and is byte
+      flipped in place if necessary.  The buffer is therefore changed
+      and cannot be parsed a second time.
+
+  -----                                                          -----
+  -------------------------------------------------------------------*/
+
+static
+void *vborrow_align(unsigned char *p, int nbytes, int align)
+{
+  unsigned char *q = p - ((uintptr_t) p % align);
+  if (q != p) memmove(q, p, nbytes);
+  return(q);
+}
+
+static
+int vborrow_shorts(DG_READER *r, int *n, int *nv, short **v)
+{
+  int nvals;
+  short *vals = NULL;
+
+  memcpy(&nvals, n, sizeof(int));
+  if (DG_READER_FLIP(r)) nvals = fliplong(nvals);
+
+  if (nvals) {
+    vals = (short *) vborrow_align((unsigned char *) (n+1),
+				   nvals*sizeof(short), sizeof(short));
+    if (DG_READER_FLIP(r)) flipshorts(nvals, vals);
+  }
+
+  *nv = nvals;
+  *v  = vals;
+
+  return(sizeof(int)+nvals*sizeof(short));
+}
+
+static
+int vborrow_chars(DG_READER *r, int *n, int *nv, char **v)
+{
+  int nvals;
+
+  memcpy(&nvals, n, sizeof(int));
+  if (DG_READER_FLIP(r)) nvals = fliplong(nvals);
+
+  *nv = nvals;
+  *v  = nvals ? (char *) (n+1) : NULL;
+
+  return(sizeof(int)+nvals*sizeof(char));
+}
+
+static
+int vborrow_longs(DG_READER *r, int *n, int *nv, int **v)
+{
+  int nvals;
+  int *vals = NULL;
+
+  memcpy(&nvals, n, sizeof(int));
+  if (DG_READER_FLIP(r)) nvals = fliplong(nvals);
+
+  if (nvals) {
+    vals = (int *) vborrow_align((unsigned char *) (n+1),
+				 nvals*sizeof(int), sizeof(int));
+    if (DG_READER_FLIP(r)) fliplongs(nvals, vals);
+  }
+
+  *nv = nvals;
+  *v  = vals;
+
+  return(sizeof(int)+nvals*sizeof(int));
+}
+
+static
+int vborrow_floats(DG_READER *r, int *n, int *nv, float **v)
+{
+  int nvals;
+  float *vals = NULL;
+
+  memcpy(&nvals, n, sizeof(int));
+  if (DG_READER_FLIP(r)) nvals = fliplong(nvals);
+
+  if (nvals) {
+    vals = (float *) vborrow_align((unsigned char *) (n+1),
+				   nvals*sizeof(float), sizeof(float));
+    if (DG_READER_FLIP(r)) flipfloats(nvals, vals);
+  }
+
+  *nv = nvals;
+  *v  = vals;
+
+  return(sizeof(int)+nvals*sizeof(float));
+}
+
+/* Mark dl as pointing into the current borrow buffer */
+static
+void borrow_list(DG_READER *r, DYN_LIST *dl)
+{
+  if (!DYN_LIST_N(dl)) return;
+  DYN_LIST_FLAGS(dl) |= DL_BORROWED;
+  DYN_LIST_OWNER(dl) = dfuRefDynBuffer(DG_READER_BORROW(r));
+}
+
+
+
+/*--------------------------------------------------------------------
+  -----           File to Structure Transfer Functions           -----
+  -------------------------------------------------------------------*/
+
+static int file_to_dyn_group(DG_READER *r, FILE *InFP, DYN_GROUP *dg);
+static int file_to_dyn_list(DG_READER *r, FILE *InFP, DYN_LIST *dl,
+			    int toplevel);
+
+int dgReaderFileToStruct(DG_READER *r, FILE *InFP, DYN_GROUP *dg)
+{
+  int c, i, status = DF_OK;
+  int n = DYN_GROUP_N(dg), range = DG_READER_FLAGS(r) & DG_READ_RANGE;
+  float version;
+  
+  if (!confirm_magic_number(InFP)) {
+    //    fprintf(stderr,"dgutils: file not recognized as dg format\n");
+    return(0);
+  }
+
+  while(status == DF_OK && (c = getc(InFP)) != EOF) {
+    switch (c) {
+    case END_STRUCT:
+      status = DF_FINISHED;
+      break;
+    case DG_VERSION_TAG:
+      get_version(r, InFP, &version);
+      break;
+    case DG_BEGIN_TAG:
+      status = file_to_dyn_group(r, InFP, dg);
+      break;
+    case DG_CHUNK_TAG:
+      status = file_to_chunk(r, InFP, dg);
+      break;
+    default:
+      fprintf(stderr,"unknown event type %d\n", c);
+      status = DF_ABORT;
+      break;
+    }
+  }
+
+  /*
+   * The lists were read whole (bar sublists that can't be wanted, see
+   * file_to_dyn_list()), since chunks may have added to them
+   */
+  if (range) {
+    for (i = n; i < DYN_GROUP_N(dg); i++)
+      slice_list(r, DYN_GROUP_LIST(dg, i));
+  }
+  if (status != DF_ABORT) return(DF_OK);
+  else return(status);
+}
+
+int dguFileToStruct(FILE *InFP, DYN_GROUP *dg)
+{
+  DG_READER r;
+  int status;
+
+  dgInitReader(&r);
+  status = dgReaderFileToStruct(&r, InFP, dg);
+  dgFreeReader(&r);
+  return(status);
+}
+
+/*
+ * dguFileToDynGroup / dguFileToDynList -- read a single structure from
+ * the current position of InFP, assuming native byte order (there is no
+ * version tag to check here; use dgReaderFileToStruct() for whole files).
+ */
+int dguFileToDynGroup(FILE *InFP, DYN_GROUP *dg)
+{
+  DG_READER r;
+  dgInitReader(&r);
+  return(file_to_dyn_group(&r, InFP, dg));
+}
+
+int dguFileToDynList(FILE *InFP, DYN_LIST *dl)
+{
+  DG_READER r;
+  dgInitReader(&r);
+  return(file_to_dyn_list(&r, InFP, dl, 0));
+}
+
+static int file_to_dyn_group(DG_READER *r, FILE *InFP, DYN_GROUP *dg)
+{
+  int n = 0, nlists, c, status = DF_OK;
+
+  while(status == DF_OK && (c = getc(InFP)) != EOF) {
+    switch (c) {
+    case END_STRUCT:
+      status = DF_FINISHED;
+      break;
+    case DG_NAME_TAG:
+      {
+	char *string;
+	int n;
+	get_string(r, InFP, &n, &string);
+	strncpy(DYN_GROUP_NAME(dg), string, DYN_GROUP_NAME_SIZE-1);
+	free((void *) string);
+      }
+      break;
+    case DG_NLISTS_TAG:
+      get_long(r, InFP, (int *) &nlists);
+      break;
+    case DG_DYNLIST_TAG:
+      {
+	DYN_LIST *dl = (DYN_LIST *) calloc(1, sizeof(DYN_LIST));
+	DYN_LIST_INCREMENT(dl) = 10;
+
+	/* The name comes first, so unwanted columns can be skipped */
+	if (DG_READER_NCOLUMNS(r)) {
+	  if ((c = getc(InFP)) == DL_NAME_TAG) {
+	    char *string;
+	    int n;
+	    get_string(r, InFP, &n, &string);
+	    strncpy(DYN_LIST_NAME(dl), string, DYN_LIST_NAME_SIZE-1);
+	    free((void *) string);
+	    if (!reader_wants_list(r, DYN_LIST_NAME(dl))) {
+	      free(dl);
+	      if (!skip_list(r, InFP)) status = DF_ABORT;
+	      break;
+	    }
+	  }
+	  else if (c != EOF) ungetc(c, InFP);
+	}
+
+	status = file_to_dyn_list(r, InFP, dl, 1);
+	dfuAddDynGroupExistingList(dg, DYN_LIST_NAME(dl), dl);
+	n++;
+      }
+      break;
+    default:
+      fprintf(stderr,"unknown event type %d\n", c);
+      status = DF_ABORT;
+      break;
+    }
+  }
+  if (status != DF_ABORT) return(DF_OK);
+  else return(status);
+}
+
+/*
+ * file_to_dyn_list -- read the rest of a list from InFP into dl.  The
+ * reader's range (if any) only lets toplevel lists skip sublists; it
+ * is applied by dgReaderFileToStruct().
+ */
+static int file_to_dyn_list(DG_READER *r, FILE *InFP, DYN_LIST *dl,
+			    int toplevel)
+{
+  int c, status = DF_OK;
+
+  while(status == DF_OK && (c = getc(InFP)) != EOF) {
+    switch (c) {
+    case END_STRUCT:
+      status = DF_FINISHED;
+      break;
+    case DL_INCREMENT_TAG:
+      get_long(r, InFP, (int *) &DYN_LIST_INCREMENT(dl));
+      break;
+    case DL_FLAGS_TAG:
+      get_long(r, InFP, (int *) &DYN_LIST_FLAGS(dl));
+      DYN_LIST_FLAGS(dl) &= ~(DL_BORROWED | DL_LAZY | DL_CSR | DL_POOLED);
+      break;
+    case DL_DATA_TAG:
+      break;
+    case DL_NAME_TAG:
+      {
+	char *string;
+	int n;
+	get_string(r, InFP, &n, &string);
+	strncpy(DYN_LIST_NAME(dl), string, DYN_LIST_NAME_SIZE-1);
+	free((void *) string);
+      }
+      break;
+    case DL_STRING_DATA_TAG:
+      {
+	char **data;
+	int n;
+	get_strings(r, InFP, &n, &data);
+	DYN_LIST_DATATYPE(dl) = DF_STRING;
+	DYN_LIST_MAX(dl) = n;
+	DYN_LIST_N(dl) = n;
+	if (n) DYN_LIST_VALS(dl) = data;
+	else {
+	  DYN_LIST_VALS(dl) = (char **) calloc(1, sizeof(char *));
+	  DYN_LIST_MAX(dl) = 1;
+	}
+      }
+      break;
+    case DL_FLOAT_DATA_TAG:
+      {
+	float *data;
+	int n;
+	get_floats(r, InFP, &n, &data);
+	DYN_LIST_DATATYPE(dl) = DF_FLOAT;
+	DYN_LIST_MAX(dl) = n;
+	DYN_LIST_N(dl) = n;
+	if (n) DYN_LIST_VALS(dl) = data;
+	else DYN_LIST_VALS(dl) = NULL;
+      }
+      break;
+    case DL_LONG_DATA_TAG:
+      {
+	int *data;
+	int n;
+	get_longs(r, InFP, &n, &data);
+	DYN_LIST_DATATYPE(dl) = DF_LONG;
+	DYN_LIST_MAX(dl) = n;
+	DYN_LIST_N(dl) = n;
+	if (n) DYN_LIST_VALS(dl) = data;
+	else DYN_LIST_VALS(dl) = NULL;
+      }
+      break;
+    case DL_SHORT_DATA_TAG:
+      {
+	short *data;
+	int n;
+	get_shorts(r, InFP, &n, &data);
+	DYN_LIST_DATATYPE(dl) = DF_SHORT;
+	DYN_LIST_MAX(dl) = n;
+	DYN_LIST_N(dl) = n;
+	DYN_LIST_VALS(dl) = data;
+      }
+      break;
+    case DL_CHAR_DATA_TAG:
+      {
+	char *data;
+	int n;
+	get_chars(r, InFP, &n, &data);
+	DYN_LIST_DATATYPE(dl) = DF_CHAR;
+	DYN_LIST_MAX(dl) = n;
+	DYN_LIST_N(dl) = n;
+	if (n) DYN_LIST_VALS(dl) = data;
+	else DYN_LIST_VALS(dl) = NULL;
+      }
+      break;
+    case DL_LIST_DATA_TAG:
+      {
+	DYN_LIST *newlist, **vals;
+	int n, i, start, stop;
+
+	/*
+	 * Figure out how many there are, and which might be kept: the
+	 * range is applied once any chunks have been stitched on, so
+	 * those before its start can be skipped but a stop counted from
+	 * the end isn't known yet.  Skipped sublists are left NULL.
+	 */
+	get_long(r, InFP, (int *) &n);
+	if (toplevel) {
+	  reader_range(r, n, &start, &stop);
+	  if (DG_READER_STOP(r) < 0) stop = n;
+	}
+	else { start = 0; stop = n; }
+
+	/* Set the datatype */
+	DYN_LIST_DATATYPE(dl) = DF_LIST;
+
+	/* Setup and allocate the appropriate amount of space */
+	DYN_LIST_INCREMENT(dl) = 10;
+	DYN_LIST_MAX(dl) = n ? n : 1;
+	DYN_LIST_N(dl) = n;
+	DYN_LIST_VALS(dl) = 
+	  (DYN_LIST **) calloc(DYN_LIST_MAX(dl), sizeof(DYN_LIST *));
+	vals = (DYN_LIST **) DYN_LIST_VALS(dl);
+
+	/* Now fill up the list of lists by recursively calling this func */
+	for (i = 0; i < n; i++) {
+	  if ((c = getc(InFP)) != DL_SUBLIST_TAG) return(DF_ABORT);
+	  if (i < start || i >= stop) {
+	    if (!skip_list(r, InFP)) return(DF_ABORT);
+	    continue;
+	  }
+	  newlist = (DYN_LIST *) calloc(1, sizeof(DYN_LIST));
+	  DYN_LIST_INCREMENT(newlist) = 10;
+	  status = file_to_dyn_list(r, InFP, newlist, 0);
+	  vals[i] = newlist;
+	}
+      }
+      break;
+    default:
+      fprintf(stderr,"unknown event type %d\n", c);
+      status = DF_ABORT;
+      break;
+    }
+  }
+  if (status != DF_ABORT) return(DF_OK);
+  else return(status);
+}
+
+
+/*--------------------------------------------------------------------
+  -----         Buffer to Structure Transfer Functions           -----
+  -------------------------------------------------------------------*/
+
+/*
+ * Parallel parsing: the top-level lists of a stream are independent, so
+ * once a table of contents has located each one they can be decoded
+ * concurrently.  Workers claim lists in file order from a shared counter
+ * (list sizes vary too much for a fixed split) and each decodes into its
+ * own preallocated slot, so the group can be put together in order at
+ * the end.  Smaller streams aren't worth starting threads for.
+ */
+#ifndef DG_PARALLEL_MIN_SIZE
+#define DG_PARALLEL_MIN_SIZE (1<<20)
+#endif
+
+typedef struct {
+  DG_READER      *r;		/* settings each worker copies         */
+  unsigned char  *vbuf;
+  int             bufsize;
+  int             nlists;
+  int            *offsets;	/* where each list's tag is in vbuf    */
+  DYN_LIST      **lists;	/* and the list it is decoded into     */
+  int            *status;
+  int             next;		/* next list to claim (atomic)         */
+} DG_PARSE_JOB;
+
+static DG_THREAD_FUNC(parse_worker, arg)
+{
+  DG_PARSE_JOB *job = (DG_PARSE_JOB *) arg;
+  DG_READER r;
+  BUF_DATA bdata;
+  int i;
+
+  dgInitReader(&r);
+  DG_READER_FLIP(&r) = DG_READER_FLIP(job->r);
+  DG_READER_FLAGS(&r) = DG_READER_FLAGS(job->r);
+  DG_READER_BORROW(&r) = DG_READER_BORROW(job->r);
+  DG_READER_START(&r) = DG_READER_START(job->r);
+  DG_READER_STOP(&r) = DG_READER_STOP(job->r);
+
+  BD_BUFFER(&bdata) = job->vbuf;
+  BD_SIZE(&bdata) = job->bufsize;
+
+  while ((i = dgAtomicIncrement(&job->next) - 1) < job->nlists) {
+    BD_INDEX(&bdata) = job->offsets[i] + 1; /* skip DG_DYNLIST_TAG */
+    job->status[i] = dguBufferToDynList(&r, &bdata, job->lists[i], 1);
+  }
+
+  dgFreeReader(&r);
+  DG_THREAD_RETURN;
+}
+
+/*
+ * buffer_to_struct_parallel -- parse vbuf into dg using up to
+ * DG_READER_NTHREADS(r) threads.  Returns 0 without touching dg if the
+ * stream can't be split up (in which case it should be read serially),
+ * otherwise DF_OK or DF_ABORT.
+ */
+static int buffer_to_struct_parallel(DG_READER *r, unsigned char *vbuf,
+				     int bufsize, DYN_GROUP *dg)
+{
+  DG_TOC *toc;
+  DG_PARSE_JOB job;
+  DG_THREAD *threads = NULL;
+  int i, n, nthreads, nstarted = 0, status = DF_OK;
+
+  if (!(toc = (DG_TOC *) calloc(1, sizeof(DG_TOC)))) return(0);
+  if (!dgReaderScanToc(r, vbuf, bufsize, toc)) {
+    dgFreeToc(toc);
+    return(0);
+  }
+
+  memset(&job, 0, sizeof(DG_PARSE_JOB));
+  job.r = r;
+  job.vbuf = vbuf;
+  job.bufsize = bufsize;
+  job.offsets = (int *) calloc(DG_TOC_N(toc)+1, sizeof(int));
+  job.lists = (DYN_LIST **) calloc(DG_TOC_N(toc)+1, sizeof(DYN_LIST *));
+  job.status = (int *) calloc(DG_TOC_N(toc)+1, sizeof(int));
+  if (!job.offsets || !job.lists || !job.status) goto declined;
+
+  for (i = 0, n = 0; i < DG_TOC_N(toc); i++) {
+    if (!reader_wants_list(r, DG_TOC_ENTRY_NAME(DG_TOC_ENTRY(toc, i))))
+      continue;
+    if (!(job.lists[n] = (DYN_LIST *) calloc(1, sizeof(DYN_LIST))))
+      goto declined;
+    DYN_LIST_INCREMENT(job.lists[n]) = 10;
+    job.offsets[n++] = DG_TOC_ENTRY_OFFSET(DG_TOC_ENTRY(toc, i));
+  }
+  job.nlists = n;
+  if (n < 2) goto declined;
+
+  nthreads = DG_READER_NTHREADS(r);
+  if (nthreads > n) nthreads = n;
+
+  /* The calling thread is one of the workers */
+  threads = (DG_THREAD *) calloc(nthreads, sizeof(DG_THREAD));
+  if (threads) {
+    for (i = 1; i < nthreads; i++) {
+      if (!dgThreadCreate(&threads[nstarted], parse_worker, &job)) break;
+      nstarted++;
+    }
+  }
+  parse_worker(&job);
+  for (i = 0; i < nstarted; i++) dgThreadJoin(threads[i]);
+
+  if (DG_TOC_NAME(toc)[0])
+    strncpy(DYN_GROUP_NAME(dg), DG_TOC_NAME(toc), DYN_GROUP_NAME_SIZE-1);
+
+  /* As when reading serially, stop after the first list that fails */
+  for (i = 0; i < job.nlists; i++) {
+    if (status == DF_ABORT) {
+      dfuFreeDynList(job.lists[i]);
+      continue;
+    }
+    dfuAddDynGroupExistingList(dg, DYN_LIST_NAME(job.lists[i]),
+			       job.lists[i]);
+    if (job.status[i] == DF_ABORT) status = DF_ABORT;
+  }
+
+  free(threads);
+  free(job.offsets);
+  free(job.lists);
+  free(job.status);
+  dgFreeToc(toc);
+  return(status);
+
+ declined:
+  if (job.lists) {
+    for (i = 0; job.lists[i]; i++) free(job.lists[i]);
+    free(job.lists);
+  }
+  if (job.offsets) free(job.offsets);
+  if (job.status) free(job.status);
+  dgFreeToc(toc);
+  return(0);
+}
+
+int dgReaderBufferToStruct(DG_READER *r, unsigned char *vbuf, int bufsize,
+			   DYN_GROUP *dg)
+{
+  int c, i, status = DF_OK;
+  int advance_bytes = 0, n = DYN_GROUP_N(dg), range = 0;
+  float version;
+  BUF_DATA *bdata;
+
+  if (DG_READER_STREAM(r) &&
+      !stream_wait_bytes(DG_READER_STREAM(r), DG_MAGIC_NUMBER_SIZE))
+    return(0);
+  if (!vconfirm_magic_number((char *)vbuf)) {
+    return(0);
+  }
+
+  if (!DG_READER_STREAM(r) &&
+      DG_READER_NTHREADS(r) > 1 && bufsize >= DG_PARALLEL_MIN_SIZE &&
+      (status = buffer_to_struct_parallel(r, vbuf, bufsize, dg)))
+    return(status);
+  status = DF_OK;
+
+  /*
+   * Chunks add to the lists, so a range can only be applied to the
+   * group as it's parsed if none follow; otherwise it's applied at the
+   * end.  (The buffer can't be parsed twice, since borrowing changes it.)
+   */
+  if ((DG_READER_FLAGS(r) & DG_READ_RANGE) &&
+      stream_has_chunks(r, vbuf, bufsize)) {
+    range = DG_READ_RANGE;
+    DG_READER_FLAGS(r) &= ~DG_READ_RANGE;
+  }
+
+  bdata = (BUF_DATA *) calloc(1, sizeof(BUF_DATA));
+
+  BD_BUFFER(bdata) = vbuf;
+  BD_INDEX(bdata) = DF_MAGIC_NUMBER_SIZE;
+  BD_SIZE(bdata) = bufsize;
+
+  while (status == DF_OK && BD_INDEX(bdata) < BD_SIZE(bdata)) {
+    BD_INCINDEX(bdata, advance_bytes);
+    advance_bytes = 0;
+    if (DG_READER_STREAM(r) && !stream_wait(r, bdata, 1)) {
+      status = DF_ABORT;
+      break;
+    }
+    c = BD_GETC(bdata);
+    switch (c) {
+    case END_STRUCT:
+      status = DF_FINISHED;
+      break;
+    case DG_VERSION_TAG:
+      advance_bytes += vget_version(r, (float *) BD_DATA(bdata), &version);
+      break;
+    case DG_BEGIN_TAG:
+      status = dguBufferToDynGroup(r, bdata, dg);
+      break;
+    case DG_CHUNK_TAG:
+      status = buffer_to_chunk(r, bdata, dg);
+      break;
+    default:
+      fprintf(stderr,"unknown event type %d\n", c);
+      status = DF_ABORT;
+      break;
+    }
+  }
+  free(bdata);
+
+  DG_READER_FLAGS(r) |= range;
+  if (range && status != DF_ABORT) {
+    for (i = n; i < DYN_GROUP_N(dg); i++)
+      slice_list(r, DYN_GROUP_LIST(dg, i));
+  }
+
+  if (status != DF_ABORT) return(DF_OK);
+  else return(status);
+}
+
+int dguBufferToStruct(unsigned char *vbuf, int bufsize, DYN_GROUP *dg)
+{
+  DG_READER r;
+  int status;
+
+  dgInitReader(&r);
+  status = dgReaderBufferToStruct(&r, vbuf, bufsize, dg);
+  dgFreeReader(&r);
+  return(status);
+}
+
+/*
+ * dguBufferToStructBorrowed -- parse buf without copying numeric data:
+ * each DF_LONG/SHORT/FLOAT/CHAR list is flagged DL_BORROWED, points into
+ * buf, and holds a reference on it.  The caller keeps its own reference.
+ * The contents of buf are rearranged in the process.
+ */
+int dguBufferToStructBorrowed(DYN_BUFFER *buf, DYN_GROUP *dg)
+{
+  DG_READER r;
+  int status;
+
+  dgInitReader(&r);
+  DG_READER_BORROW(&r) = buf;
+  status = dgReaderBufferToStruct(&r, DYN_BUFFER_DATA(buf),
+				  DYN_BUFFER_SIZE(buf), dg);
+  dgFreeReader(&r);
+  return(status);
+}
+
+/*
+ * buffer_wants_list -- peek at the DL_NAME_TAG that starts the list at
+ * the current position (without consuming it) and check it against the
+ * reader's columns.  Lists that don't start with a name are kept.
+ */
+static int buffer_wants_list(DG_READER *r, BUF_DATA *bdata)
+{
+  int length;
+  char name[DYN_LIST_NAME_SIZE];
+
+  if (BD_SIZE(bdata) - BD_INDEX(bdata) < (int) (1+sizeof(int)) ||
+      BD_DATA(bdata)[0] != DL_NAME_TAG) return(1);
+
+  vget_long(r, (int *) (BD_DATA(bdata)+1), &length);
+  if (length < 0 ||
+      length > BD_SIZE(bdata) - BD_INDEX(bdata) - (int) (1+sizeof(int)))
+    return(1);
+  if (length > DYN_LIST_NAME_SIZE-1) length = DYN_LIST_NAME_SIZE-1;
+  memcpy(name, BD_DATA(bdata)+1+sizeof(int), length);
+  name[length] = 0;
+
+  return(reader_wants_list(r, name));
+}
+
+static int dguBufferToDynGroup(DG_READER *r, BUF_DATA *bdata, DYN_GROUP *dg)
+{
+  int n = 0, c, status = DF_OK, advance_bytes = 0;
+  int nlists;
+
+  while (status == DF_OK && !BD_EOF(bdata)) {
+    BD_INCINDEX(bdata, advance_bytes);
+    advance_bytes = 0;
+    if (DG_READER_STREAM(r) && !stream_wait(r, bdata, 0)) {
+      status = DF_ABORT;
+      break;
+    }
+    c = BD_GETC(bdata);
+    switch (c) {
+    case END_STRUCT:
+      status = DF_FINISHED;
+      break;
+    case DG_NAME_TAG:
+      {
+	char *string;
+	int n;
+	advance_bytes += vget_string(r, (int *) BD_DATA(bdata), 
+				     &n, &string);
+	strncpy(DYN_GROUP_NAME(dg), string, DYN_GROUP_NAME_SIZE-1);
+	free((void *) string);
+      }
+      break;
+    case DG_NLISTS_TAG:
+      advance_bytes += vget_long(r, (int *) BD_DATA(bdata), &nlists);
+      break;
+    case DG_DYNLIST_TAG:
+      if (DG_READER_NCOLUMNS(r) && !buffer_wants_list(r, bdata)) {
+	int depth;
+	if (toc_scan_list(r, bdata, NULL, &depth) != DF_OK) status = DF_ABORT;
+	break;
+      }
+      {
+	DYN_LIST *dl = (DYN_LIST *) calloc(1, sizeof(DYN_LIST));
+	DYN_LIST_INCREMENT(dl) = 10;
+	status = dguBufferToDynList(r, bdata, dl, 1);
+	dfuAddDynGroupExistingList(dg, DYN_LIST_NAME(dl), dl);
+	n++;
+      }
+      break;
+    default:
+      fprintf(stderr,"unknown event type %d\n", c);
+      status = DF_ABORT;
+      break;
+    }
+  }
+  if (status != DF_ABORT) return(DF_OK);
+  else return(status);
+}
+
+/*
+ * lazy_decode -- decode sublist i of a DL_LAZY list (DYN_LAZY's decode)
+ */
+static DYN_LIST *lazy_decode(DYN_LAZY *lazy, int i)
+{
+  DG_READER r;
+  BUF_DATA bdata;
+  DYN_LIST *dl;
+  int status;
+
+  if (!(dl = (DYN_LIST *) calloc(1, sizeof(DYN_LIST)))) return(NULL);
+  DYN_LIST_INCREMENT(dl) = 10;
+
+  dgInitReader(&r);
+  DG_READER_FLIP(&r) = DYN_LAZY_FLIP(lazy);
+  DG_READER_FLAGS(&r) = DYN_LAZY_FLAGS(lazy) | DG_READ_BORROW | DG_READ_LAZY;
+  DG_READER_BORROW(&r) = DYN_LAZY_BUFFER(lazy);
+
+  BD_BUFFER(&bdata) = DYN_BUFFER_DATA(DYN_LAZY_BUFFER(lazy));
+  BD_SIZE(&bdata) = DYN_BUFFER_SIZE(DYN_LAZY_BUFFER(lazy));
+  BD_INDEX(&bdata) = DYN_LAZY_OFFSETS(lazy)[i];
+
+  status = dguBufferToDynList(&r, &bdata, dl, 0);
+  dgFreeReader(&r);
+
+  if (status != DF_OK) {
+    dfuFreeDynList(dl);
+    return(NULL);
+  }
+  return(dl);
+}
+
+/*
+ * lazy_sublists -- step over the n sublists of dl (whose vals are
+ * already allocated), noting where sublists [start, stop) begin in the
+ * borrow buffer (which bdata must be reading), and mark dl DL_LAZY so
+ * they're decoded on demand.
+ */
+static int lazy_sublists(DG_READER *r, BUF_DATA *bdata, DYN_LIST *dl,
+			 int n, int start, int stop)
+{
+  DYN_BUFFER *buf = DG_READER_BORROW(r);
+  DYN_LAZY *lazy;
+  int i, depth;
+
+  if (!(lazy = (DYN_LAZY *) calloc(1, sizeof(DYN_LAZY)))) return(DF_ABORT);
+  if (!(DYN_LAZY_OFFSETS(lazy) = 
+	(int *) calloc((stop-start) ? stop-start : 1, sizeof(int)))) {
+    free(lazy);
+    return(DF_ABORT);
+  }
+
+  for (i = 0; i < n; i++) {
+    if (BD_EOF(bdata) || BD_GETC(bdata) != DL_SUBLIST_TAG) break;
+    if (i >= start && i < stop)
+      DYN_LAZY_OFFSETS(lazy)[i-start] = BD_INDEX(bdata);
+    if (toc_scan_list(r, bdata, NULL, &depth) != DF_OK) break;
+  }
+  if (i < n) {
+    free(DYN_LAZY_OFFSETS(lazy));
+    free(lazy);
+    return(DF_ABORT);
+  }
+
+  DYN_LAZY_BUFFER(lazy) = dfuRefDynBuffer(buf);
+  DYN_LAZY_N(lazy) = stop-start;
+  DYN_LAZY_FLIP(lazy) = DG_READER_FLIP(r);
+  DYN_LAZY_FLAGS(lazy) = DG_READER_FLAGS(r) & ~DG_READ_RANGE;
+  lazy->decode = lazy_decode;
+  DYN_LIST_LAZY(dl) = lazy;
+  DYN_LIST_FLAGS(dl) |= DL_LAZY;
+  return(DF_OK);
+}
+
+/*
+ * dguBufferToDynList -- as file_to_dyn_list() for a buffer
+ */
+static int dguBufferToDynList(DG_READER *r, BUF_DATA *bdata, DYN_LIST *dl,
+			      int toplevel)
+{
+  int c, status = DF_OK;
+  int advance_bytes = 0;
+
+  while (status == DF_OK && !BD_EOF(bdata)) {
+    BD_INCINDEX(bdata, advance_bytes);
+    advance_bytes = 0;
+    c = BD_GETC(bdata);
+    switch (c) {
+    case END_STRUCT:
+      status = DF_FINISHED;
+      break;
+    case DL_INCREMENT_TAG:
+      advance_bytes += vget_long(r, (int *) BD_DATA(bdata), 
+				 (int *) &DYN_LIST_INCREMENT(dl));
+      break;
+    case DL_FLAGS_TAG:
+      advance_bytes += vget_long(r, (int *) BD_DATA(bdata), 
+				 (int *) &DYN_LIST_FLAGS(dl));
+      DYN_LIST_FLAGS(dl) &= ~(DL_BORROWED | DL_LAZY | DL_CSR | DL_POOLED);
+      break;
+    case DL_DATA_TAG:
+      break;
+    case DL_NAME_TAG:
+      {
+	char *string;
+	int n;
+	advance_bytes += vget_string(r, (int *) BD_DATA(bdata), 
+				     &n, &string);
+	strncpy(DYN_LIST_NAME(dl), string, DYN_LIST_NAME_SIZE-1);
+	free((void *) string);
+      }
+      break;
+    case DL_STRING_DATA_TAG:
+      {
+	char **data;
+	int n;
+	DYN_POOL *pool = NULL;
+	if (DG_READER_FLAGS(r) & DG_READ_POOL)
+	  advance_bytes += vpool_strings(r, (int *) BD_DATA(bdata), &n, &data,
+					 &pool);
+	else
+	  advance_bytes += vget_strings(r, (int *) BD_DATA(bdata), &n, &data);
+	DYN_LIST_DATATYPE(dl) = DF_STRING;
+	DYN_LIST_MAX(dl) = n;
+	DYN_LIST_N(dl) = n;
+	if (pool) {
+	  DYN_LIST_POOL(dl) = pool;
+	  DYN_LIST_FLAGS(dl) |= DL_POOLED;
+	}
+	if (n) DYN_LIST_VALS(dl) = data;
+	else {
 	  DYN_LIST_VALS(dl) = (char **) calloc(1, sizeof(char *));
 	  DYN_LIST_MAX(dl) = 1;
 	}
+
+      }
+      break;
+    case DL_FLOAT_DATA_TAG:
+      {
+	float *data;
+	int n;
+	if (DG_READER_BORROW(r))
+	  advance_bytes += vborrow_floats(r, (int *) BD_DATA(bdata), &n, &data);
+	else
+	  advance_bytes += vget_floats(r, (int *) BD_DATA(bdata), &n, &data);
+	DYN_LIST_DATATYPE(dl) = DF_FLOAT;
+	DYN_LIST_MAX(dl) = n;
+	DYN_LIST_N(dl) = n;
+	if (n) DYN_LIST_VALS(dl) = data;
+	else DYN_LIST_VALS(dl) = NULL;
+	if (DG_READER_BORROW(r)) borrow_list(r, dl);
+      }
+      break;
+    case DL_LONG_DATA_TAG:
+      {
+	int *data;
+	int n;
+	if (DG_READER_BORROW(r))
+	  advance_bytes += vborrow_longs(r, (int *) BD_DATA(bdata), &n, &data);
+	else
+	  advance_bytes += vget_longs(r, (int *) BD_DATA(bdata), &n, &data);
+	DYN_LIST_DATATYPE(dl) = DF_LONG;
+	DYN_LIST_MAX(dl) = n;
+	DYN_LIST_N(dl) = n;
+	if (n) DYN_LIST_VALS(dl) = data;
+	else DYN_LIST_VALS(dl) = NULL;
+	if (DG_READER_BORROW(r)) borrow_list(r, dl);
+      }
+      break;
+    case DL_SHORT_DATA_TAG:
+      {
+	short *data;
+	int n;
+	if (DG_READER_BORROW(r))
+	  advance_bytes += vborrow_shorts(r, (int *) BD_DATA(bdata), &n, &data);
+	else
+	  advance_bytes += vget_shorts(r, (int *) BD_DATA(bdata), &n, &data);
+	DYN_LIST_DATATYPE(dl) = DF_SHORT;
+	DYN_LIST_MAX(dl) = n;
+	DYN_LIST_N(dl) = n;
+	DYN_LIST_VALS(dl) = data;
+	if (DG_READER_BORROW(r)) borrow_list(r, dl);
+      }
+      break;
+    case DL_CHAR_DATA_TAG:
+      {
+	char *data;
+	int n;
+	if (DG_READER_BORROW(r))
+	  advance_bytes += vborrow_chars(r, (int *) BD_DATA(bdata), &n, &data);
+	else
+	  advance_bytes += vget_chars(r, (int *) BD_DATA(bdata), &n, &data);
+	DYN_LIST_DATATYPE(dl) = DF_CHAR;
+	DYN_LIST_MAX(dl) = n;
+	DYN_LIST_N(dl) = n;
+	if (n) DYN_LIST_VALS(dl) = data;
+	else DYN_LIST_VALS(dl) = NULL;
+	if (DG_READER_BORROW(r)) borrow_list(r, dl);
+      }
+      break;
+    case DL_LIST_DATA_TAG:
+      {
+	DYN_LIST *newlist, **vals;
+	int n, i, start, stop, depth;
+
+	/* Figure out how many there are, and which to keep */
+	advance_bytes = vget_long(r, (int *) BD_DATA(bdata), (int *) &n);
+	BD_INCINDEX(bdata, advance_bytes);
+	advance_bytes = 0;
+	if (toplevel) reader_range(r, n, &start, &stop);
+	else { start = 0; stop = n; }
+	
+	/* Set the datatype */
+	DYN_LIST_DATATYPE(dl) = DF_LIST;
+
+	/* Setup and allocate the appropriate amount of space */
+	DYN_LIST_INCREMENT(dl) = 10;
+	DYN_LIST_MAX(dl) = (stop-start) ? stop-start : 1;
+	DYN_LIST_N(dl) = stop-start;
+	DYN_LIST_VALS(dl) = 
+	  (DYN_LIST **) calloc(DYN_LIST_MAX(dl), sizeof(DYN_LIST *));
+	vals = (DYN_LIST **) DYN_LIST_VALS(dl);
+
+	/* Or copy them all into one array, if they're alike */
+	if ((DG_READER_FLAGS(r) & DG_READ_CSR) &&
+	    csr_sublists(r, bdata, dl, n, start, stop)) break;
+
+	/* Or just note where they are, to be decoded when asked for */
+	if ((DG_READER_FLAGS(r) & DG_READ_LAZY) && DG_READER_BORROW(r) &&
+	    BD_BUFFER(bdata) == DYN_BUFFER_DATA(DG_READER_BORROW(r))) {
+	  if (lazy_sublists(r, bdata, dl, n, start, stop) != DF_OK)
+	    return(DF_ABORT);
+	  break;
+	}
+
+	/* Now fill up the list of lists by recursively calling this func */
+	for (i = 0; i < n; i++) {
+	  c = BD_GETC(bdata);
+	  if (c != DL_SUBLIST_TAG) return(DF_ABORT);
+	  if (i < start || i >= stop) {
+	    if (toc_scan_list(r, bdata, NULL, &depth) != DF_OK)
+	      return(DF_ABORT);
+	    continue;
+	  }
+	  newlist = (DYN_LIST *) calloc(1, sizeof(DYN_LIST));
+	  DYN_LIST_INCREMENT(newlist) = 10;
+	  status = dguBufferToDynList(r, bdata, newlist, 0);
+	  vals[i-start] = newlist;
+	}
+      }
+      break;
+    default:
+      fprintf(stderr,"unknown event type %d\n", c);
+      status = DF_ABORT;
+      break;
+    }
+  }
+  if (toplevel && DYN_LIST_DATATYPE(dl) != DF_LIST) slice_list(r, dl);
+  if (status != DF_ABORT) return(DF_OK);
+  else return(status);
+}
+
+
+
+/*--------------------------------------------------------------------
+  -----              Table of Contents Functions                 -----
+
+      Walk a dg buffer the way dguBufferToStruct does, but only note
+      where each top-level list starts and what it holds.  Array
+      payloads are stepped over with the vskip_* functions instead of
+      being copied, so the cost depends on the number of tags rather
+      than on the number of bytes.
+
+  -----                                                          -----
+  -------------------------------------------------------------------*/
+
+/* true if at least n more bytes remain in bdata */
+#define BD_HAVE(b,n)     (BD_SIZE(b) - BD_INDEX(b) >= (int) (n))
+
+/* vskip_strings(), but never looks past the end of bdata (-1 if it would) */
+static int toc_skip_strings(DG_READER *r, BUF_DATA *bdata, int *n)
+{
+  int i, length, pos = sizeof(int);
+
+  vget_long(r, (int *) BD_DATA(bdata), n);
+  for (i = 0; i < *n; i++) {
+    if (!BD_HAVE(bdata, pos+sizeof(int))) return(-1);
+    vget_long(r, (int *) (BD_DATA(bdata)+pos), &length);
+    pos += sizeof(int);
+    if (length < 0 || length > BD_SIZE(bdata)-BD_INDEX(bdata)-pos)
+      return(-1);
+    pos += length;
+  }
+  return(pos);
+}
+
+static int toc_scan_list(DG_READER *r, BUF_DATA *bdata, DG_TOC_ENTRY *e,
+			 int *depth)
+{
+  int c, n, i, d, status = DF_OK;
+  int advance_bytes = 0;
+  int datatype = DF_VOID;
+
+  *depth = 0;
+  while (status == DF_OK) {
+    if (!BD_HAVE(bdata, advance_bytes+1)) return(DF_ABORT);
+    BD_INCINDEX(bdata, advance_bytes);
+    advance_bytes = 0;
+    c = BD_GETC(bdata);
+
+    /* every tag but these is followed by at least an int */
+    if (c != END_STRUCT && c != DL_DATA_TAG &&
+	!BD_HAVE(bdata, sizeof(int))) return(DF_ABORT);
+
+    switch (c) {
+    case END_STRUCT:
+      status = DF_FINISHED;
+      break;
+    case DL_NAME_TAG:
+      advance_bytes = vskip_string(r, (int *) BD_DATA(bdata));
+      if (e && advance_bytes >= (int) sizeof(int) &&
+	  BD_HAVE(bdata, advance_bytes)) {
+	n = advance_bytes - sizeof(int);
+	if (n > DYN_LIST_NAME_SIZE-1) n = DYN_LIST_NAME_SIZE-1;
+	memcpy(DG_TOC_ENTRY_NAME(e), BD_DATA(bdata)+sizeof(int), n);
+	DG_TOC_ENTRY_NAME(e)[n] = 0;
+      }
+      break;
+    case DL_INCREMENT_TAG:
+    case DL_FLAGS_TAG:
+      advance_bytes = vskip_long(r);
+      break;
+    case DL_DATA_TAG:
+      break;
+    case DL_STRING_DATA_TAG:
+      datatype = DF_STRING;
+      advance_bytes = toc_skip_strings(r, bdata, &n);
+      break;
+    case DL_FLOAT_DATA_TAG:
+      datatype = DF_FLOAT;
+      vget_long(r, (int *) BD_DATA(bdata), &n);
+      advance_bytes = vskip_floats(r, (int *) BD_DATA(bdata));
+      break;
+    case DL_LONG_DATA_TAG:
+      datatype = DF_LONG;
+      vget_long(r, (int *) BD_DATA(bdata), &n);
+      advance_bytes = vskip_longs(r, (int *) BD_DATA(bdata));
+      break;
+    case DL_SHORT_DATA_TAG:
+      datatype = DF_SHORT;
+      vget_long(r, (int *) BD_DATA(bdata), &n);
+      advance_bytes = vskip_shorts(r, (int *) BD_DATA(bdata));
+      break;
+    case DL_CHAR_DATA_TAG:
+      datatype = DF_CHAR;
+      vget_long(r, (int *) BD_DATA(bdata), &n);
+      advance_bytes = vskip_chars(r, (int *) BD_DATA(bdata));
+      break;
+    case DL_LIST_DATA_TAG:
+      datatype = DF_LIST;
+      BD_INCINDEX(bdata, vget_long(r, (int *) BD_DATA(bdata), &n));
+      *depth = 1;
+      for (i = 0; i < n; i++) {
+	if (!BD_HAVE(bdata, 1) || BD_GETC(bdata) != DL_SUBLIST_TAG)
+	  return(DF_ABORT);
+	if (toc_scan_list(r, bdata, NULL, &d) != DF_OK) return(DF_ABORT);
+	if (d+1 > *depth) *depth = d+1;
+      }
+      break;
+    default:
+      fprintf(stderr,"unknown event type %d\n", c);
+      return(DF_ABORT);
+    }
+    if (advance_bytes < 0) return(DF_ABORT);
+  }
+
+  if (e) {
+    DG_TOC_ENTRY_DATATYPE(e) = datatype;
+    DG_TOC_ENTRY_N(e) = (datatype == DF_VOID) ? 0 : n;
+    DG_TOC_ENTRY_DEPTH(e) = *depth;
+  }
+  return(DF_OK);
+}
+
+static int toc_scan_group(DG_READER *r, BUF_DATA *bdata, DG_TOC *toc)
+{
+  int c, n, status = DF_OK;
+  int advance_bytes = 0;
+  DG_TOC_ENTRY *e;
+
+  while (status == DF_OK) {
+    if (!BD_HAVE(bdata, advance_bytes+1)) return(DF_ABORT);
+    BD_INCINDEX(bdata, advance_bytes);
+    advance_bytes = 0;
+    c = BD_GETC(bdata);
+    switch (c) {
+    case END_STRUCT:
+      status = DF_FINISHED;
+      break;
+    case DG_NAME_TAG:
+      if (!BD_HAVE(bdata, sizeof(int))) return(DF_ABORT);
+      advance_bytes = vskip_string(r, (int *) BD_DATA(bdata));
+      if (advance_bytes < (int) sizeof(int) ||
+	  !BD_HAVE(bdata, advance_bytes)) return(DF_ABORT);
+      n = advance_bytes - sizeof(int);
+      if (n > DYN_GROUP_NAME_SIZE-1) n = DYN_GROUP_NAME_SIZE-1;
+      memcpy(DG_TOC_NAME(toc), BD_DATA(bdata)+sizeof(int), n);
+      DG_TOC_NAME(toc)[n] = 0;
+      break;
+    case DG_NLISTS_TAG:
+      if (!BD_HAVE(bdata, sizeof(int))) return(DF_ABORT);
+      advance_bytes = vget_long(r, (int *) BD_DATA(bdata), &n);
+      if (n > toc->maxentries) {
+	e = (DG_TOC_ENTRY *) realloc(toc->entries, n*sizeof(DG_TOC_ENTRY));
+	if (!e) return(DF_ABORT);
+	toc->entries = e;
+	toc->maxentries = n;
+      }
+      break;
+    case DG_DYNLIST_TAG:
+      if (DG_TOC_N(toc) == toc->maxentries) {
+	n = toc->maxentries ? 2*toc->maxentries : 16;
+	e = (DG_TOC_ENTRY *) realloc(toc->entries, n*sizeof(DG_TOC_ENTRY));
+	if (!e) return(DF_ABORT);
+	toc->entries = e;
+	toc->maxentries = n;
+      }
+      e = DG_TOC_ENTRY(toc, DG_TOC_N(toc));
+      memset(e, 0, sizeof(DG_TOC_ENTRY));
+      DG_TOC_ENTRY_OFFSET(e) = BD_INDEX(bdata)-1;
+      if (toc_scan_list(r, bdata, e, &n) != DF_OK) return(DF_ABORT);
+      DG_TOC_N(toc)++;
+      break;
+    default:
+      fprintf(stderr,"unknown event type %d\n", c);
+      return(DF_ABORT);
+    }
+  }
+  return(DF_OK);
+}
+
+/*
+ * dgReaderScanToc -- fill in toc (which must be zeroed or previously
+ * used by this function) from the dg stream in vbuf.  Returns DF_OK on
+ * success or 0 if the buffer is not a complete dg stream.
+ */
+int dgReaderScanToc(DG_READER *r, unsigned char *vbuf, int bufsize,
+		    DG_TOC *toc)
+{
+  int c, status = DF_OK;
+  float version;
+  BUF_DATA bdata;
+
+  DG_TOC_N(toc) = 0;
+  DG_TOC_NAME(toc)[0] = 0;
+
+  if (bufsize < DG_MAGIC_NUMBER_SIZE || !vconfirm_magic_number((char *)vbuf))
+    return(0);
+
+  BD_BUFFER(&bdata) = vbuf;
+  BD_INDEX(&bdata) = DG_MAGIC_NUMBER_SIZE;
+  BD_SIZE(&bdata) = bufsize;
+
+  while (status == DF_OK && !BD_EOF(&bdata)) {
+    c = BD_GETC(&bdata);
+    switch (c) {
+    case END_STRUCT:
+      status = DF_FINISHED;
+      break;
+    case DG_VERSION_TAG:
+      if (!BD_HAVE(&bdata, sizeof(float))) return(0);
+      BD_INCINDEX(&bdata, vget_version(r, (float *) BD_DATA(&bdata),
+				       &version));
+      break;
+    case DG_BEGIN_TAG:
+      if (toc_scan_group(r, &bdata, toc) != DF_OK) return(0);
+      break;
+    case DG_CHUNK_TAG:		/* lists are spread over the chunks */
+      return(0);
+    default:
+      fprintf(stderr,"unknown event type %d\n", c);
+      return(0);
+    }
+  }
+  return(DF_OK);
+}
+
+/*
+ * dgScanToc -- return a newly allocated table of contents for the dg
+ * stream in vbuf, or NULL on error.  Free it with dgFreeToc().
+ */
+DG_TOC *dgScanToc(unsigned char *vbuf, int bufsize)
+{
+  DG_READER r;
+  DG_TOC *toc;
+
+  if (!(toc = (DG_TOC *) calloc(1, sizeof(DG_TOC)))) return(NULL);
+
+  dgInitReader(&r);
+  if (!dgReaderScanToc(&r, vbuf, bufsize, toc)) {
+    dgFreeToc(toc);
+    toc = NULL;
+  }
+  dgFreeReader(&r);
+  return(toc);
+}
+
+/*
+ * dgScanTocFile -- as dgScanToc() for a .dg, .dgz or .lz4 file.  Compressed
+ * files still have to be decompressed, but nothing is converted.
+ */
+DG_TOC *dgScanTocFile(char *filename)
+{
+  FILE *fp;
+  char *suffix;
+  unsigned char *data;
+  int size, status;
+  DG_TOC *toc;
+
+  if ((suffix = strrchr(filename, '.')) && strlen(suffix) == 4 &&
+      ((suffix[1] == 'l' && suffix[2] == 'z' && suffix[3] == '4') ||
+       (suffix[1] == 'L' && suffix[2] == 'Z' && suffix[3] == '4'))) {
+    if (!(fp = fopen(filename, "rb"))) return(NULL);
+    status = decompress_lz4_file_to_buffer(fp, &size, &data);
+    fclose(fp);
+    if (!status) return(NULL);
+  }
+  /* gzread() passes uncompressed .dg files straight through */
+  else if (!gz_file_to_buffer(filename, &data, &size)) return(NULL);
+
+  toc = dgScanToc(data, size);
+  free(data);
+  return(toc);
+}
+
+void dgFreeToc(DG_TOC *toc)
+{
+  if (!toc) return;
+  if (toc->entries) free(toc->entries);
+  free(toc);
+}
+
+
+/*--------------------------------------------------------------------
+  -----                  Chunked (Appended) Files                -----
+
+      A group that grows over a session can be saved as it goes
+      without rewriting what is already on disk.  The file starts
+      as an ordinary dg stream of the group as it was when opened;
+      after that come chunks (DG_CHUNK_TAG), each laid out like a
+      group but holding just the elements added to its lists since
+      the one before.  Readers append the elements of each chunk
+      list to the group's list of the same name (or add the list if
+      the group has none), so the file reads back as one group.  An
+      incomplete last chunk, as a crash while appending would leave,
+      is ignored.  A range (DG_READ_RANGE) applies to the stitched
+      lists.  These files have no table of contents, so are always
+      read serially.
+
+  -----                                                          -----
+  -------------------------------------------------------------------*/
+
+/* list_elt_size -- bytes per element of dl's vals (0 if unknown) */
+static int list_elt_size(DYN_LIST *dl)
+{
+  switch (DYN_LIST_DATATYPE(dl)) {
+  case DF_LONG:   return(sizeof(int));
+  case DF_SHORT:  return(sizeof(short));
+  case DF_FLOAT:  return(sizeof(float));
+  case DF_CHAR:   return(sizeof(char));
+  case DF_STRING: return(sizeof(char *));
+  case DF_LIST:   return(sizeof(DYN_LIST *));
+  }
+  return(0);
+}
+
+/* append_grow -- make room to track n lists, new ones not yet written */
+static int append_grow(DG_APPENDER *a, int n)
+{
+  int *written;
+
+  if (n <= a->nlists) return(1);
+  if (!(written = (int *) realloc(a->written, n*sizeof(int)))) return(0);
+  memset(written + a->nlists, 0, (n - a->nlists)*sizeof(int));
+  a->written = written;
+  a->nlists = n;
+  return(1);
+}
+
+/* append_flush -- write out everything a has recorded and empty it */
+static int append_flush(DG_APPENDER *a)
+{
+  int status = !a->w.overflow && gather_write(&a->w, a->fp, DF_BINARY);
+  a->w.index = 0;
+  a->w.nsegs = 0;
+  return(status);
+}
+
+/*
+ * dgAppendOpen -- start the file filename (replacing any already
+ * there) with the stream holding dg, ready for dgAppendChunk().
+ * Returns 1 on success, 0 on failure.
+ */
+int dgAppendOpen(DG_APPENDER *a, char *filename, DYN_GROUP *dg)
+{
+  int i;
+
+  memset(a, 0, sizeof(DG_APPENDER));
+  if (!(a->fp = fopen(filename, "wb"))) return(0);
+  if (!dgInitWriter(&a->w) || !append_grow(a, DYN_GROUP_N(dg))) {
+    dgAppendClose(a);
+    return(0);
+  }
+  dgWriterSetGather(&a->w, 1);
+  record_dyn_group(&a->w, dg);
+  for (i = 0; i < DYN_GROUP_N(dg); i++)
+    a->written[i] = DYN_LIST_N(DYN_GROUP_LIST(dg, i));
+  if (!append_flush(a)) {
+    dgAppendClose(a);
+    return(0);
+  }
+  return(1);
+}
+
+/*
+ * dgAppendChunk -- append a chunk holding the elements added to dg's
+ * lists since they were last saved, flushed through to the file.
+ * Nothing is written if there are none.  Returns 1 on success, 0 on
+ * failure.
+ */
+int dgAppendChunk(DG_APPENDER *a, DYN_GROUP *dg)
+{
+  DYN_LIST *dl, part;
+  int i, n = 0, from;
+
+  if (!a->fp || !append_grow(a, DYN_GROUP_N(dg))) return(0);
+  for (i = 0; i < DYN_GROUP_N(dg); i++) {
+    dl = DYN_GROUP_LIST(dg, i);
+    if (DYN_LIST_N(dl) > a->written[i] && list_elt_size(dl)) n++;
+  }
+  if (!n) return(1);
+
+  begin_struct(&a->w, DG_CHUNK_TAG);
+  send_event(&a->w, DG_NLISTS_TAG, (unsigned char *) &n);
+  for (i = 0; i < DYN_GROUP_N(dg); i++) {
+    dl = DYN_GROUP_LIST(dg, i);
+    from = a->written[i];
+    a->written[i] = DYN_LIST_N(dl);
+    if (DYN_LIST_N(dl) <= from || !list_elt_size(dl)) continue;
+
+    /* the new elements, sharing dl's storage */
+    dfuLoadDynList(dl);
+    part = *dl;
+    DYN_LIST_VALS(&part) = (char *) DYN_LIST_VALS(dl) +
+      (size_t) from * list_elt_size(dl);
+    DYN_LIST_N(&part) = DYN_LIST_MAX(&part) = DYN_LIST_N(dl) - from;
+    record_dyn_list(&a->w, DG_DYNLIST_TAG, &part);
+  }
+  end_struct(&a->w);
+
+  if (!append_flush(a)) return(0);
+  a->nchunks++;
+  return(1);
+}
+
+/* dgAppendClose -- close a's file.  Returns 0 if that fails. */
+int dgAppendClose(DG_APPENDER *a)
+{
+  int status = 1;
+
+  if (a->fp && fclose(a->fp)) status = 0;
+  a->fp = NULL;
+  dgFreeWriter(&a->w);
+  if (a->written) free(a->written);
+  a->written = NULL;
+  a->nlists = 0;
+  return(status);
+}
+
+/*
+ * stitch_chunk -- append the lists read from a chunk to the lists of
+ * dg with the same names (or move them into dg, if it has none)
+ */
+static int stitch_chunk(DYN_GROUP *dg, DYN_GROUP *chunk)
+{
+  DYN_LIST *dl, *more;
+  int i, n, size;
+
+  /* each chunk looks up all of its lists, so index dg once */
+  if (!DYN_GROUP_INDEX(dg)) dfuIndexDynGroup(dg);
+
+  for (i = 0; i < DYN_GROUP_N(chunk); i++) {
+    more = DYN_GROUP_LIST(chunk, i);
+    if (!(dl = dfuFindDynList(dg, DYN_LIST_NAME(more)))) {
+      dfuAddDynGroupExistingList(dg, DYN_LIST_NAME(more), more);
+      DYN_GROUP_LIST(chunk, i) = NULL;
+      continue;
+    }
+    if (DYN_LIST_DATATYPE(dl) != DYN_LIST_DATATYPE(more)) {
+      fprintf(stderr, "dg chunk: list %s changes type\n", DYN_LIST_NAME(dl));
+      return(DF_ABORT);
+    }
+    if (!(n = DYN_LIST_N(more)) || !(size = list_elt_size(dl))) continue;
+    if (!dfuDetachDynList(dl) || !dfuLoadDynList(more)) return(DF_ABORT);
+
+    if (DYN_LIST_DATATYPE(dl) == DF_LIST) {
+      /* the sublists just change hands */
+      if (!dfuReserveDynList(dl, DYN_LIST_N(dl) + n)) return(DF_ABORT);
+      memcpy((char *) DYN_LIST_VALS(dl) + (size_t) DYN_LIST_N(dl) * size,
+	     DYN_LIST_VALS(more), (size_t) n * size);
+      DYN_LIST_N(dl) += n;
+      DYN_LIST_N(more) = 0;
+    }
+    else if (!dfuInsertDynListRange(dl, DYN_LIST_N(dl), n,
+				    DYN_LIST_VALS(more))) return(DF_ABORT);
+  }
+  return(DF_OK);
+}
+
+/*
+ * struct_size -- bytes from the current position of bdata through the
+ * END_STRUCT that closes the group or chunk being read, or -1 if that
+ * isn't all there.  bdata itself is left where it was.
+ */
+static int struct_size(DG_READER *r, BUF_DATA *bdata)
+{
+  BUF_DATA b = *bdata;
+  int n, start;
+
+  for (;;) {
+    if (!BD_HAVE(&b, 1)) return(-1);
+    if (BD_DATA(&b)[0] == END_STRUCT)
+      return(BD_INDEX(&b) + 1 - BD_INDEX(bdata));
+    start = BD_INDEX(&b);
+    if ((n = stream_element_size(r, &b, 0)) < 0) return(-1);
+    BD_INDEX(&b) = start + n;
+  }
+}
+
+/*
+ * stream_has_chunks -- whether any chunks follow the group in vbuf,
+ * found by stepping over (without decoding, or changing) the group.
+ * Says so if it can't tell.  A stream still arriving is waited for.
+ */
+static int stream_has_chunks(DG_READER *r, unsigned char *vbuf, int bufsize)
+{
+  BUF_DATA b;
+  int n;
+
+  if (DG_READER_STREAM(r) &&
+      !stream_wait_bytes(DG_READER_STREAM(r), bufsize)) return(1);
+
+  BD_BUFFER(&b) = vbuf;
+  BD_INDEX(&b) = DG_MAGIC_NUMBER_SIZE;
+  BD_SIZE(&b) = bufsize;
+
+  while (BD_HAVE(&b, 1)) {
+    switch (BD_DATA(&b)[0]) {
+    case END_STRUCT:
+      return(0);
+    case DG_VERSION_TAG:
+      if ((n = stream_element_size(r, &b, 1)) < 0) return(1);
+      BD_INDEX(&b) += n - 1;
+      break;
+    case DG_BEGIN_TAG:
+      BD_INCINDEX(&b, 1);
+      if ((n = struct_size(r, &b)) < 0) return(1);
+      BD_INCINDEX(&b, n);
+      break;
+    default:
+      return(1);
+    }
+  }
+  return(0);
+}
+
+static int chunk_incomplete(void)
+{
+  fprintf(stderr, "dg: ignoring incomplete chunk at end of stream\n");
+  return(DF_FINISHED);
+}
+
+static int buffer_to_chunk(DG_READER *r, BUF_DATA *bdata, DYN_GROUP *dg)
+{
+  DYN_GROUP *chunk;
+  int status;
+
+  /* a pipelined read waits for the chunk, and fails if it never ends */
+  if (!DG_READER_STREAM(r) && struct_size(r, bdata) < 0)
+    return(chunk_incomplete());
+
+  if (!(chunk = dfuCreateDynGroup(4))) return(DF_ABORT);
+  status = dguBufferToDynGroup(r, bdata, chunk);
+  if (status == DF_ABORT && DG_READER_STREAM(r)) status = chunk_incomplete();
+  else if (status != DF_ABORT) status = stitch_chunk(dg, chunk);
+  dfuFreeDynGroup(chunk);
+  return(status);
+}
+
+/*
+ * A chunk read through stdio is first copied into memory, element by
+ * element and without reading past its end, so that one cut short by
+ * the end of the file is noticed before any of it is decoded (the file
+ * get functions give up on the whole process at a short read).
+ */
+typedef struct {
+  unsigned char *data;
+  int size;
+  int n;
+} CHUNK_COPY;
+
+/* copy_bytes -- append the next n bytes of InFP; 0 if they aren't there */
+static int copy_bytes(FILE *InFP, CHUNK_COPY *c, int n)
+{
+  unsigned char *data;
+  int size;
+
+  if (n < 0 || n > INT_MAX - c->n) return(0);
+  if (c->n + n > c->size) {
+    size = (c->size > INT_MAX/2) ? INT_MAX : 2*c->size;
+    if (size < c->n + n) size = c->n + n;
+    if (!(data = (unsigned char *) realloc(c->data, size))) return(0);
+    c->data = data;
+    c->size = size;
+  }
+  if (n && fread(c->data + c->n, 1, n, InFP) != (size_t) n) return(0);
+  c->n += n;
+  return(1);
+}
+
+static int copy_long(DG_READER *r, FILE *InFP, CHUNK_COPY *c, int *val)
+{
+  if (!copy_bytes(InFP, c, sizeof(int))) return(0);
+  vget_long(r, (int *) (c->data + c->n - sizeof(int)), val);
+  return(1);
+}
+
+/* copy_array -- an element count followed by that many size byte values */
+static int copy_array(DG_READER *r, FILE *InFP, CHUNK_COPY *c, int size)
+{
+  int n;
+  if (!copy_long(r, InFP, c, &n) || n < 0 || n > INT_MAX/size) return(0);
+  return(copy_bytes(InFP, c, n*size));
+}
+
+static int copy_list(DG_READER *r, FILE *InFP, CHUNK_COPY *c)
+{
+  int n, i, length;
+
+  for (;;) {
+    if (!copy_bytes(InFP, c, 1)) return(0);
+    switch (c->data[c->n-1]) {
+    case END_STRUCT:
+      return(1);
+    case DL_DATA_TAG:
+      break;
+    case DL_INCREMENT_TAG:
+    case DL_FLAGS_TAG:
+      if (!copy_bytes(InFP, c, sizeof(int))) return(0);
+      break;
+    case DL_NAME_TAG:
+      if (!copy_array(r, InFP, c, 1)) return(0);
+      break;
+    case DL_STRING_DATA_TAG:
+      if (!copy_long(r, InFP, c, &n)) return(0);
+      for (i = 0; i < n; i++) {
+	if (!copy_long(r, InFP, c, &length) ||
+	    !copy_bytes(InFP, c, length)) return(0);
+      }
+      break;
+    case DL_FLOAT_DATA_TAG:
+      if (!copy_array(r, InFP, c, sizeof(float))) return(0);
+      break;
+    case DL_LONG_DATA_TAG:
+      if (!copy_array(r, InFP, c, sizeof(int))) return(0);
+      break;
+    case DL_SHORT_DATA_TAG:
+      if (!copy_array(r, InFP, c, sizeof(short))) return(0);
+      break;
+    case DL_CHAR_DATA_TAG:
+      if (!copy_array(r, InFP, c, sizeof(char))) return(0);
+      break;
+    case DL_LIST_DATA_TAG:
+      if (!copy_long(r, InFP, c, &n)) return(0);
+      for (i = 0; i < n; i++) {
+	if (!copy_bytes(InFP, c, 1) || c->data[c->n-1] != DL_SUBLIST_TAG ||
+	    !copy_list(r, InFP, c)) return(0);
+      }
+      break;
+    default:
+      return(0);
+    }
+  }
+}
+
+/* copy_chunk -- copy the rest of the chunk being read from InFP */
+static int copy_chunk(DG_READER *r, FILE *InFP, CHUNK_COPY *c)
+{
+  for (;;) {
+    if (!copy_bytes(InFP, c, 1)) return(0);
+    switch (c->data[c->n-1]) {
+    case END_STRUCT:
+      return(1);
+    case DG_NAME_TAG:
+      if (!copy_array(r, InFP, c, 1)) return(0);
+      break;
+    case DG_NLISTS_TAG:
+      if (!copy_bytes(InFP, c, sizeof(int))) return(0);
+      break;
+    case DG_DYNLIST_TAG:
+      if (!copy_list(r, InFP, c)) return(0);
+      break;
+    default:
+      return(0);
+    }
+  }
+}
+
+static int file_to_chunk(DG_READER *r, FILE *InFP, DYN_GROUP *dg)
+{
+  CHUNK_COPY copy = { NULL, 0, 0 };
+  DYN_GROUP *chunk = NULL;
+  DG_READER cr;
+  BUF_DATA bdata;
+  int status;
+
+  if (!copy_chunk(r, InFP, &copy)) {
+    if (feof(InFP)) status = chunk_incomplete(); /* ran out before its end */
+    else {
+      fprintf(stderr, "dg: unable to read chunk\n");
+      status = DF_ABORT;
+    }
+    free(copy.data);
+    return(status);
+  }
+
+  /* the copy is decoded just like any other buffer, and then dropped */
+  dgInitReader(&cr);
+  DG_READER_FLIP(&cr) = DG_READER_FLIP(r);
+  dgReaderSetColumns(&cr, DG_READER_COLUMNS(r), DG_READER_NCOLUMNS(r));
+  BD_BUFFER(&bdata) = copy.data;
+  BD_INDEX(&bdata) = 0;
+  BD_SIZE(&bdata) = copy.n;
+
+  if (!(chunk = dfuCreateDynGroup(4))) status = DF_ABORT;
+  else status = dguBufferToDynGroup(&cr, &bdata, chunk);
+  if (status != DF_ABORT) status = stitch_chunk(dg, chunk);
+  if (chunk) dfuFreeDynGroup(chunk);
+  dgFreeReader(&cr);
+  free(copy.data);
+  return(status);
+}
+
+/*--------------------------------------------------------------------
+  -----              Indexed (Random Access) .dgz Reads          -----
+
+      A gzip stream can only be inflated from the start, unless the
+      inflater's state at some point is saved: the bit position in
+      the compressed data and the last 32K of output, which is all
+      later blocks can refer back to.  dgBuildGzIndex() inflates a
+      .dgz once, saving such access points every span bytes along
+      with the stream's table of contents; dgWriteGzIndex() keeps
+      them in a sidecar file (filename.dgi).  Reading selected
+      columns can then start inflating at the nearest access point
+      before each list and stop at its end.
+
+  -----                                                          -----
+  -------------------------------------------------------------------*/
+
+#define DG_GZ_INDEX_MAGIC   "DGIX"
+#define DG_GZ_INDEX_VERSION 1
+
+/* gz_index_add -- note an access point at out[total] */
+static int gz_index_add(DG_GZ_INDEX *idx, int bits, int in,
+			unsigned char *out, int total)
+{
+  DG_GZ_POINT *p;
+  int n;
+
+  if (idx->npoints == idx->maxpoints) {
+    n = idx->maxpoints ? 2*idx->maxpoints : 16;
+    p = (DG_GZ_POINT *) realloc(idx->points, n*sizeof(DG_GZ_POINT));
+    if (!p) return(0);
+    idx->points = p;
+    idx->maxpoints = n;
+  }
+  p = &idx->points[idx->npoints];
+  if (!(p->window = (unsigned char *) calloc(1, DG_GZ_WINDOW))) return(0);
+  p->out = total;
+  p->in = in;
+  p->bits = bits;
+  n = total < DG_GZ_WINDOW ? total : DG_GZ_WINDOW;
+  memcpy(p->window, out+total-n, n);
+  idx->npoints++;
+  return(1);
+}
+
+/*
+ * dgBuildGzIndex -- inflate the gzip file filename once, noting an
+ * access point at the first block boundary after every span bytes of
+ * output (span <= 0 for DG_GZ_INDEX_SPAN), and the table of contents
+ * of the dg stream inside.  Returns NULL if it can't be read.
+ */
+DG_GZ_INDEX *dgBuildGzIndex(char *filename, int span)
+{
+  FILE *fp;
+  DG_GZ_INDEX *idx;
+  DG_READER r;
+  unsigned char *in, *out = NULL, *p;
+  unsigned int isize;
+  size_t cap, total = 0, last = 0;
+  int insize, ret, ok = 0;
+  z_stream zs;
+
+  if (span <= 0) span = DG_GZ_INDEX_SPAN;
+  if (!(fp = fopen(filename, "rb"))) return(NULL);
+  if (!map_file(fp, &in, &insize)) { fclose(fp); return(NULL); }
+  fclose(fp);
+
+  if (insize < 18 || in[0] != 0x1f || in[1] != 0x8b ||
+      !(idx = (DG_GZ_INDEX *) calloc(1, sizeof(DG_GZ_INDEX)))) {
+    unmap_file(in, insize);
+    return(NULL);
+  }
+  idx->insize = insize;
+  memcpy(idx->trailer, in+insize-8, 8);
+
+  /* ISIZE is only a hint, as there may be more than one member */
+  cap = gz_isize(in, insize, &isize) ? isize : 4 * (size_t) insize;
+  memset(&zs, 0, sizeof(zs));
+  if (!(out = (unsigned char *) malloc(cap)) ||
+      inflateInit2(&zs, 16 + MAX_WBITS) != Z_OK) goto done;
+  zs.next_in = in;
+  zs.avail_in = (uInt) insize;
+
+  for (;;) {
+    if (total == cap) {
+      if (cap >= INT_MAX) break;
+      cap = cap > INT_MAX/2 ? INT_MAX : 2*cap;
+      if (!(p = (unsigned char *) realloc(out, cap))) break;
+      out = p;
+    }
+    zs.next_out = out + total;
+    zs.avail_out = (uInt) (cap - total);
+    ret = inflate(&zs, Z_BLOCK);
+    total = zs.next_out - out;
+    if (ret == Z_STREAM_END) {
+      if (zs.avail_in >= 2 && zs.next_in[0] == 0x1f && zs.next_in[1] == 0x8b) {
+	inflateReset(&zs);
+	continue;
+      }
+      ok = 1;
+      break;
+    }
+    if (ret != Z_OK && !(ret == Z_BUF_ERROR && !zs.avail_out)) break;
+
+    /* between blocks, other than after the last one of a member */
+    if ((zs.data_type & 128) && !(zs.data_type & 64) &&
+	(!idx->npoints || total - last >= (size_t) span)) {
+      if (!gz_index_add(idx, zs.data_type & 7, insize - zs.avail_in,
+			out, (int) total)) break;
+      last = total;
+    }
+  }
+  inflateEnd(&zs);
+
+  if (ok) {
+    ok = 0;
+    idx->size = (int) total;
+    dgInitReader(&r);
+    if ((idx->toc = (DG_TOC *) calloc(1, sizeof(DG_TOC))) &&
+	dgReaderScanToc(&r, out, (int) total, idx->toc)) {
+      idx->flip = DG_READER_FLIP(&r);
+      ok = 1;
+    }
+    dgFreeReader(&r);
+  }
+
+ done:
+  if (out) free(out);
+  unmap_file(in, insize);
+  if (!ok) {
+    fprintf(stderr, "dg: unable to index \"%s\"\n", filename);
+    dgFreeGzIndex(idx);
+    return(NULL);
+  }
+  return(idx);
+}
+
+void dgFreeGzIndex(DG_GZ_INDEX *idx)
+{
+  int i;
+
+  if (!idx) return;
+  for (i = 0; i < idx->npoints; i++) free(idx->points[i].window);
+  if (idx->points) free(idx->points);
+  dgFreeToc(idx->toc);
+  free(idx);
+}
+
+/*
+ * gz_index_extract -- inflate len bytes of the stream starting at
+ * offset into buf, from the gzip data in[insize] that idx describes.
+ * Returns 1 on success, 0 on failure.
+ */
+static int gz_index_extract(DG_GZ_INDEX *idx, unsigned char *in, int insize,
+			    int offset, unsigned char *buf, int len)
+{
+  DG_GZ_POINT *p;
+  unsigned char *discard;
+  z_stream zs;
+  int lo, hi, mid, n, ret, raw = 1, skip, got = 0;
+
+  if (!idx->npoints || offset < 0 || len < 0 || offset > idx->size - len)
+    return(0);
+
+  /* the last access point at or before offset */
+  for (lo = 0, hi = idx->npoints-1; lo < hi; ) {
+    mid = (lo+hi+1)/2;
+    if (idx->points[mid].out <= offset) lo = mid;
+    else hi = mid-1;
+  }
+  p = &idx->points[lo];
+  if (p->out > offset || p->in > insize || (p->bits && p->in < 1)) return(0);
+  if (!(discard = (unsigned char *) malloc(DG_GZ_WINDOW))) return(0);
+
+  memset(&zs, 0, sizeof(zs));
+  if (inflateInit2(&zs, -MAX_WBITS) != Z_OK) { free(discard); return(0); }
+  zs.next_in = in + p->in;
+  zs.avail_in = (uInt) (insize - p->in);
+  if (p->bits) inflatePrime(&zs, p->bits, in[p->in-1] >> (8 - p->bits));
+  n = p->out < DG_GZ_WINDOW ? p->out : DG_GZ_WINDOW;
+  if (n) inflateSetDictionary(&zs, p->window, n);
+
+  skip = offset - p->out;
+  while (got < len) {
+    if (skip) {
+      zs.next_out = discard;
+      zs.avail_out = skip < DG_GZ_WINDOW ? skip : DG_GZ_WINDOW;
+    }
+    else {
+      zs.next_out = buf + got;
+      zs.avail_out = len - got;
+    }
+    n = zs.avail_out;
+    ret = inflate(&zs, Z_NO_FLUSH);
+    n -= zs.avail_out;
+    if (skip) skip -= n;
+    else got += n;
+
+    if (ret == Z_STREAM_END) {
+      /* on to the next member; a raw inflate leaves its trailer behind */
+      if (raw) {
+	if (zs.avail_in < 8) break;
+	zs.next_in += 8;
+	zs.avail_in -= 8;
+	inflateReset2(&zs, 16 + MAX_WBITS);
+	raw = 0;
+      }
+      else inflateReset(&zs);
+      if (zs.avail_in < 2 || zs.next_in[0] != 0x1f || zs.next_in[1] != 0x8b)
+	break;
+    }
+    else if (ret != Z_OK) break;
+  }
+  inflateEnd(&zs);
+  free(discard);
+  return(got == len);
+}
+
+/*
+ * dgGzIndexExtract -- read len bytes of the dg stream in the .dgz
+ * file filename, starting at offset, into buf using its index.
+ * Returns 1 on success, 0 on failure.
+ */
+int dgGzIndexExtract(DG_GZ_INDEX *idx, char *filename, int offset,
+		     unsigned char *buf, int len)
+{
+  FILE *fp;
+  unsigned char *in;
+  int insize, status;
+
+  if (!(fp = fopen(filename, "rb"))) return(0);
+  if (!map_file(fp, &in, &insize)) { fclose(fp); return(0); }
+  fclose(fp);
+  status = insize == idx->insize &&
+    gz_index_extract(idx, in, insize, offset, buf, len);
+  unmap_file(in, insize);
+  return(status);
+}
+
+/* sidecar ints are little-endian whatever the host */
+static int gz_put_int(gzFile f, int v)
+{
+  unsigned char b[4];
+  b[0] = v & 0xff; b[1] = (v >> 8) & 0xff;
+  b[2] = (v >> 16) & 0xff; b[3] = (v >> 24) & 0xff;
+  return(gzwrite(f, b, 4) == 4);
+}
+
+static int gz_get_int(gzFile f, int *v)
+{
+  unsigned char b[4];
+  if (gzread(f, b, 4) != 4) return(0);
+  *v = (int) ((unsigned int) b[0] | ((unsigned int) b[1] << 8) |
+	      ((unsigned int) b[2] << 16) | ((unsigned int) b[3] << 24));
+  return(1);
+}
+
+/*
+ * dgWriteGzIndex -- save idx to filename (gzip compressed).  Returns 1
+ * on success, 0 on failure.
+ */
+int dgWriteGzIndex(DG_GZ_INDEX *idx, char *filename)
+{
+  gzFile f;
+  DG_TOC_ENTRY *e;
+  int i, ok;
+
+  if (!(f = gzopen(filename, "wb"))) return(0);
+  ok = gzwrite(f, DG_GZ_INDEX_MAGIC, 4) == 4 &&
+    gz_put_int(f, DG_GZ_INDEX_VERSION) &&
+    gz_put_int(f, idx->insize) && gzwrite(f, idx->trailer, 8) == 8 &&
+    gz_put_int(f, idx->size) && gz_put_int(f, idx->flip) &&
+    gz_put_int(f, idx->npoints);
+  for (i = 0; ok && i < idx->npoints; i++) {
+    ok = gz_put_int(f, idx->points[i].out) &&
+      gz_put_int(f, idx->points[i].in) && gz_put_int(f, idx->points[i].bits) &&
+      gzwrite(f, idx->points[i].window, DG_GZ_WINDOW) == DG_GZ_WINDOW;
+  }
+  ok = ok &&
+    gzwrite(f, DG_TOC_NAME(idx->toc), DYN_GROUP_NAME_SIZE) ==
+    DYN_GROUP_NAME_SIZE && gz_put_int(f, DG_TOC_N(idx->toc));
+  for (i = 0; ok && i < DG_TOC_N(idx->toc); i++) {
+    e = DG_TOC_ENTRY(idx->toc, i);
+    ok = gzwrite(f, DG_TOC_ENTRY_NAME(e), DYN_LIST_NAME_SIZE) ==
+      DYN_LIST_NAME_SIZE &&
+      gz_put_int(f, DG_TOC_ENTRY_DATATYPE(e)) && gz_put_int(f, DG_TOC_ENTRY_N(e)) &&
+      gz_put_int(f, DG_TOC_ENTRY_DEPTH(e)) && gz_put_int(f, DG_TOC_ENTRY_OFFSET(e));
+  }
+  if (gzclose(f) != Z_OK) ok = 0;
+  return(ok);
+}
+
+/*
+ * dgReadGzIndex -- load an index saved by dgWriteGzIndex(), or return
+ * NULL if filename doesn't hold one.
+ */
+DG_GZ_INDEX *dgReadGzIndex(char *filename)
+{
+  gzFile f;
+  DG_GZ_INDEX *idx;
+  DG_GZ_POINT *p;
+  DG_TOC_ENTRY *e;
+  char magic[4];
+  int i, n, version, ok;
+
+  if (!(f = gzopen(filename, "rb"))) return(NULL);
+  if (!(idx = (DG_GZ_INDEX *) calloc(1, sizeof(DG_GZ_INDEX))) ||
+      !(idx->toc = (DG_TOC *) calloc(1, sizeof(DG_TOC)))) {
+    dgFreeGzIndex(idx);
+    gzclose(f);
+    return(NULL);
+  }
+
+  ok = gzread(f, magic, 4) == 4 && !memcmp(magic, DG_GZ_INDEX_MAGIC, 4) &&
+    gz_get_int(f, &version) && version == DG_GZ_INDEX_VERSION &&
+    gz_get_int(f, &idx->insize) && gzread(f, idx->trailer, 8) == 8 &&
+    gz_get_int(f, &idx->size) && gz_get_int(f, &idx->flip) &&
+    gz_get_int(f, &n) && n > 0 &&
+    (idx->points = (DG_GZ_POINT *) calloc(n, sizeof(DG_GZ_POINT)));
+  if (ok) idx->maxpoints = n;
+  for (i = 0; ok && i < n; i++) {
+    p = &idx->points[i];
+    ok = gz_get_int(f, &p->out) && gz_get_int(f, &p->in) &&
+      gz_get_int(f, &p->bits) && p->bits >= 0 && p->bits < 8 &&
+      (p->window = (unsigned char *) malloc(DG_GZ_WINDOW)) &&
+      gzread(f, p->window, DG_GZ_WINDOW) == DG_GZ_WINDOW;
+    if (p->window) idx->npoints++;
+  }
+
+  ok = ok &&
+    gzread(f, DG_TOC_NAME(idx->toc), DYN_GROUP_NAME_SIZE) ==
+    DYN_GROUP_NAME_SIZE && gz_get_int(f, &n) && n >= 0 &&
+    (!n || (idx->toc->entries =
+	    (DG_TOC_ENTRY *) calloc(n, sizeof(DG_TOC_ENTRY))));
+  if (ok) {
+    DG_TOC_NAME(idx->toc)[DYN_GROUP_NAME_SIZE-1] = 0;
+    idx->toc->maxentries = n;
+  }
+  for (i = 0; ok && i < n; i++) {
+    e = DG_TOC_ENTRY(idx->toc, i);
+    ok = gzread(f, DG_TOC_ENTRY_NAME(e), DYN_LIST_NAME_SIZE) ==
+      DYN_LIST_NAME_SIZE &&
+      gz_get_int(f, &DG_TOC_ENTRY_DATATYPE(e)) && gz_get_int(f, &DG_TOC_ENTRY_N(e)) &&
+      gz_get_int(f, &DG_TOC_ENTRY_DEPTH(e)) && gz_get_int(f, &DG_TOC_ENTRY_OFFSET(e)) &&
+      DG_TOC_ENTRY_OFFSET(e) >= 0 && DG_TOC_ENTRY_OFFSET(e) < idx->size &&
+      (!i || DG_TOC_ENTRY_OFFSET(e) > DG_TOC_ENTRY_OFFSET(e-1));
+    DG_TOC_ENTRY_NAME(e)[DYN_LIST_NAME_SIZE-1] = 0;
+    DG_TOC_N(idx->toc)++;
+  }
+  gzclose(f);
+
+  if (!ok) {
+    dgFreeGzIndex(idx);
+    return(NULL);
+  }
+  return(idx);
+}
+
+static char *gz_index_name(char *filename)
+{
+  char *name;
+
+  if (!(name = (char *) malloc(strlen(filename)+strlen(DG_GZ_INDEX_SUFFIX)+1)))
+    return(NULL);
+  strcpy(name, filename);
+  strcat(name, DG_GZ_INDEX_SUFFIX);
+  return(name);
+}
+
+/*
+ * dgIndexGzFile -- build the index of a .dgz file and save it next to
+ * it as filename.dgi, where reads of selected columns will find it.
+ * Returns 1 on success, 0 on failure.
+ */
+int dgIndexGzFile(char *filename, int span)
+{
+  DG_GZ_INDEX *idx;
+  char *name;
+  int status = 0;
+
+  if (!(idx = dgBuildGzIndex(filename, span))) return(0);
+  if ((name = gz_index_name(filename))) {
+    status = dgWriteGzIndex(idx, name);
+    free(name);
+  }
+  dgFreeGzIndex(idx);
+  return(status);
+}
+
+/*
+ * gz_index_read -- read the columns r wants from the .dgz file
+ * filename using its sidecar index.  Each list is inflated on its own,
+ * from the access point before it to its end.  Returns -1 (having read
+ * nothing) if there is no index, it no longer matches the file, or any
+ * list can't be extracted from it, so the caller can read the file
+ * the ordinary way instead.
+ */
+static int gz_index_read(DG_READER *r, char *filename, DYN_GROUP *dg)
+{
+  FILE *fp;
+  DG_GZ_INDEX *idx;
+  DG_TOC_ENTRY *e;
+  DYN_BUFFER *buf;
+  DYN_LIST *dl;
+  BUF_DATA bdata;
+  unsigned char *in, *data;
+  char *name;
+  int i, insize, start, stop, n0 = DYN_GROUP_N(dg), status = DF_OK;
+
+  if (!(name = gz_index_name(filename))) return(-1);
+  idx = dgReadGzIndex(name);
+  free(name);
+  if (!idx) return(-1);
+
+  if (!(fp = fopen(filename, "rb"))) { dgFreeGzIndex(idx); return(-1); }
+  if (!map_file(fp, &in, &insize)) {
+    fclose(fp);
+    dgFreeGzIndex(idx);
+    return(-1);
+  }
+  fclose(fp);
+  if (insize != idx->insize || memcmp(in+insize-8, idx->trailer, 8)) {
+    unmap_file(in, insize);
+    dgFreeGzIndex(idx);
+    return(-1);
+  }
+
+  DG_READER_FLIP(r) = idx->flip;
+  strncpy(DYN_GROUP_NAME(dg), DG_TOC_NAME(idx->toc), DYN_GROUP_NAME_SIZE-1);
+
+  for (i = 0; status == DF_OK && i < DG_TOC_N(idx->toc); i++) {
+    e = DG_TOC_ENTRY(idx->toc, i);
+    if (!reader_wants_list(r, DG_TOC_ENTRY_NAME(e))) continue;
+    start = DG_TOC_ENTRY_OFFSET(e);
+    stop = (i+1 < DG_TOC_N(idx->toc)) ?
+      DG_TOC_ENTRY_OFFSET(DG_TOC_ENTRY(idx->toc, i+1)) : idx->size;
+
+    if (!(data = (unsigned char *) malloc(stop-start)) ||
+	!gz_index_extract(idx, in, insize, start, data, stop-start) ||
+	data[0] != DG_DYNLIST_TAG) {
+      if (data) free(data);
+      status = DF_ABORT;
+      break;
+    }
+    BD_BUFFER(&bdata) = data;
+    BD_INDEX(&bdata) = 1;	/* skip DG_DYNLIST_TAG */
+    BD_SIZE(&bdata) = stop-start;
+
+    if (!(dl = (DYN_LIST *) calloc(1, sizeof(DYN_LIST)))) {
+      free(data);
+      status = DF_ABORT;
+      break;
+    }
+    DYN_LIST_INCREMENT(dl) = 10;
+    if (DG_READER_FLAGS(r) & (DG_READ_BORROW | DG_READ_LAZY)) {
+      if (!(buf = dfuCreateDynBuffer(data, stop-start))) {
+	free(data);
+	free(dl);
+	status = DF_ABORT;
+	break;
       }
+      DG_READER_BORROW(r) = buf;
+      status = dguBufferToDynList(r, &bdata, dl, 1);
+      DG_READER_BORROW(r) = NULL;
+      dfuUnrefDynBuffer(buf);
+    }
+    else {
+      status = dguBufferToDynList(r, &bdata, dl, 1);
+      free(data);
+    }
+    if (status != DF_OK) {
+      dfuFreeDynList(dl);
       break;
+    }
+    dfuAddDynGroupExistingList(dg, DYN_LIST_NAME(dl), dl);
+  }
+
+  unmap_file(in, insize);
+  dgFreeGzIndex(idx);
+  if (status != DF_OK) {
+    group_truncate(dg, n0);
+    return(-1);
+  }
+  return(status);
+}
+
+
+/*--------------------------------------------------------------------
+  -----                 Flattened (CSR) Lists                    -----
+
+      With DG_READ_CSR, a DF_LIST list whose sublists are all flat
+      lists of the same numeric type is read into one array holding
+      every sublist's elements end to end, plus an array of offsets,
+      instead of into a DYN_LIST per sublist.  The sublists are
+      stepped over once to check that they qualify and to count the
+      elements, then their payloads are copied (and byte flipped)
+      straight into place.
+
+  -----                                                          -----
+  -------------------------------------------------------------------*/
+
+/*
+ * csr_scan_sublist -- step over one sublist (after its DL_SUBLIST_TAG),
+ * noting its datatype (DF_VOID if it has no data) and where its data
+ * (count, then values) is.  Returns 0 if it isn't a flat numeric list,
+ * has a name (which a DL_CSR list couldn't keep), or runs off the end
+ * of bdata.
+ */
+static int csr_scan_sublist(DG_READER *r, BUF_DATA *bdata, int *datatype,
+			    int *payload)
+{
+  int c, dt, advance_bytes = 0;
+
+  *datatype = DF_VOID;
+  *payload = -1;
+  while (1) {
+    if (!BD_HAVE(bdata, advance_bytes+1)) return(0);
+    BD_INCINDEX(bdata, advance_bytes);
+    advance_bytes = 0;
+    c = BD_GETC(bdata);
+    if (c == END_STRUCT) return(1);
+    if (c == DL_DATA_TAG) continue;
+    if (!BD_HAVE(bdata, sizeof(int))) return(0);
+
+    switch (c) {
+    case DL_NAME_TAG:
+      advance_bytes = vskip_string(r, (int *) BD_DATA(bdata));
+      if (advance_bytes < (int) sizeof(int)) return(0);
+      if (advance_bytes > (int) sizeof(int) &&
+	  (!BD_HAVE(bdata, sizeof(int)+1) || BD_DATA(bdata)[sizeof(int)]))
+	return(0);
+      continue;
+    case DL_INCREMENT_TAG:
+    case DL_FLAGS_TAG:
+      advance_bytes = vskip_long(r);
+      continue;
     case DL_FLOAT_DATA_TAG:
-      {
-	float *data;
-	int n;
-	get_floats(InFP, &n, &data);
-	DYN_LIST_DATATYPE(dl) = DF_FLOAT;
-	DYN_LIST_MAX(dl) = n;
-	DYN_LIST_N(dl) = n;
-	if (n) DYN_LIST_VALS(dl) = data;
-	else DYN_LIST_VALS(dl) = NULL;
-      }
+      advance_bytes = vskip_floats(r, (int *) BD_DATA(bdata));
+      dt = DF_FLOAT;
       break;
     case DL_LONG_DATA_TAG:
-      {
-	int *data;
-	int n;
-	get_longs(InFP, &n, &data);
-	DYN_LIST_DATATYPE(dl) = DF_LONG;
-	DYN_LIST_MAX(dl) = n;
-	DYN_LIST_N(dl) = n;
-	if (n) DYN_LIST_VALS(dl) = data;
-	else DYN_LIST_VALS(dl) = NULL;
-      }
+      advance_bytes = vskip_longs(r, (int *) BD_DATA(bdata));
+      dt = DF_LONG;
       break;
     case DL_SHORT_DATA_TAG:
-      {
-	short *data;
-	int n;
-	get_shorts(InFP, &n, &data);
-	DYN_LIST_DATATYPE(dl) = DF_SHORT;
-	DYN_LIST_MAX(dl) = n;
-	DYN_LIST_N(dl) = n;
-	DYN_LIST_VALS(dl) = data;
-      }
+      advance_bytes = vskip_shorts(r, (int *) BD_DATA(bdata));
+      dt = DF_SHORT;
       break;
     case DL_CHAR_DATA_TAG:
-      {
-	char *data;
-	int n;
-	get_chars(InFP, &n, &data);
-	DYN_LIST_DATATYPE(dl) = DF_CHAR;
-	DYN_LIST_MAX(dl) = n;
-	DYN_LIST_N(dl) = n;
-	if (n) DYN_LIST_VALS(dl) = data;
-	else DYN_LIST_VALS(dl) = NULL;
-      }
+      advance_bytes = vskip_chars(r, (int *) BD_DATA(bdata));
+      dt = DF_CHAR;
       break;
-    case DL_LIST_DATA_TAG:
-      {
-	DYN_LIST *newlist, **vals;
-	int n, i;
+    default:			/* strings, lists or garbage */
+      return(0);
+    }
+
+    /* a numeric data tag */
+    if (*datatype != DF_VOID || advance_bytes < (int) sizeof(int)) return(0);
+    *datatype = dt;
+    *payload = BD_INDEX(bdata);
+  }
+}
+
+/*
+ * csr_sublists -- read the n sublists of dl (whose vals are already
+ * allocated) as a DL_CSR list, keeping [start, stop).  Returns 0,
+ * having consumed nothing, if they aren't all flat lists of one
+ * numeric type, so they can be read the usual way.
+ */
+static int csr_sublists(DG_READER *r, BUF_DATA *bdata, DYN_LIST *dl,
+			int n, int start, int stop)
+{
+  int i, m = stop-start, first = BD_INDEX(bdata);
+  int datatype = DF_VOID, dt, payload, size = 0, count;
+  int *payloads;
+  int64_t total = 0, *offsets = NULL;
+  unsigned char *values = NULL;
+  DYN_CSR *csr = NULL;
+  DYN_BUFFER *buf = NULL;
+
+  if (!(payloads = (int *) calloc(m ? m : 1, sizeof(int)))) return(0);
+
+  for (i = 0; i < n; i++) {
+    if (!BD_HAVE(bdata, 1) || BD_GETC(bdata) != DL_SUBLIST_TAG ||
+	!csr_scan_sublist(r, bdata, &dt, &payload))
+      goto decline;
+    if (i < start || i >= stop) continue;
+    payloads[i-start] = payload;
+    if (dt == DF_VOID) continue;
+    if (datatype == DF_VOID) datatype = dt;
+    else if (dt != datatype) goto decline;
+  }
+
+  switch (datatype) {
+  case DF_LONG:  size = sizeof(int);   break;
+  case DF_SHORT: size = sizeof(short); break;
+  case DF_FLOAT: size = sizeof(float); break;
+  case DF_CHAR:  size = sizeof(char);  break;
+  default:			/* nothing but empty lists */
+    goto decline;
+  }
+
+  /* offsets, and so how much room the values need */
+  if (!(offsets = (int64_t *) calloc(m+1, sizeof(int64_t)))) goto decline;
+  for (i = 0; i < m; i++) {
+    count = 0;
+    if (payloads[i] >= 0)
+      vget_long(r, (int *) (BD_BUFFER(bdata)+payloads[i]), &count);
+    if (count < 0) goto decline;
+    offsets[i+1] = total += count;
+  }
+  if (total*size > INT_MAX) goto decline;
+
+  if (!(values = (unsigned char *) malloc(total ? total*size : 1)) ||
+      !(buf = dfuCreateDynBuffer(values, (int) (total*size))) ||
+      !(csr = (DYN_CSR *) calloc(1, sizeof(DYN_CSR)))) {
+    if (!buf) free(values);
+    dfuUnrefDynBuffer(buf);
+    goto decline;
+  }
+
+  /* copy each sublist's values into place */
+  for (i = 0; i < m; i++) {
+    unsigned char *from = BD_BUFFER(bdata)+payloads[i]+sizeof(int);
+    unsigned char *to = values+offsets[i]*size;
+    count = (int) (offsets[i+1]-offsets[i]);
+    if (!count) continue;
+    if (!DG_READER_FLIP(r) || datatype == DF_CHAR)
+      memcpy(to, from, count*size);
+    else if (datatype == DF_SHORT) copyflipshorts(count, from, (short *) to);
+    else if (datatype == DF_LONG) copyfliplongs(count, from, (int *) to);
+    else copyflipfloats(count, from, (float *) to);
+  }
+  free(payloads);
+
+  DYN_CSR_DATATYPE(csr) = datatype;
+  DYN_CSR_VALUES(csr) = buf;
+  DYN_CSR_OFFSETS(csr) = offsets;
+  DYN_LIST_CSR(dl) = csr;
+  DYN_LIST_FLAGS(dl) |= DL_CSR;
+  return(1);
+
+ decline:
+  free(payloads);
+  if (offsets) free(offsets);
+  BD_INDEX(bdata) = first;
+  return(0);
+}
+
+
+/*--------------------------------------------------------------------
+  -----                 Pipelined (Streaming) Reads              -----
+
+      A large .dgz or .lz4 file is decompressed on one thread while
+      the calling thread parses whatever has arrived so far.  The
+      output buffer is allocated at its final size up front (from the
+      gzip ISIZE trailer or the LZ4 content size), so lists can still
+      borrow from it.  The parser is the ordinary buffer parser: with
+      a DG_STREAM attached to the reader it calls stream_wait() before
+      each top-level and group element, which blocks until all of
+      that element (for a DYN_LIST, found by stepping over it as the
+      table of contents does) has been decompressed.
+
+  -----                                                          -----
+  -------------------------------------------------------------------*/
+
+#ifndef DG_PIPELINE_MIN_SIZE
+#define DG_PIPELINE_MIN_SIZE (1<<18)	/* compressed bytes */
+#endif
+#define DG_PIPELINE_CHUNK (1<<18)	/* inflated between reports */
+
+struct _dg_stream {
+  unsigned char *data;		/* the whole stream, once allocated    */
+  int            size;		/* its final length                    */
+  int            avail;		/* how much of it is there so far      */
+  int            done;		/* producer has finished               */
+  int            ok;		/* and delivered all size bytes        */
+  int            cancel;	/* parser has given up                 */
+  DG_MUTEX       lock;
+  DG_COND        cond;
+  unsigned char *in;		/* gzip: the mapped file               */
+  int            insize;
+  FILE          *fp;		/* lz4: the open file                  */
+};
+
+static void stream_init(DG_STREAM *s, unsigned char *data, int size)
+{
+  memset(s, 0, sizeof(DG_STREAM));
+  s->data = data;
+  s->size = size;
+  dgMutexInit(&s->lock);
+  dgCondInit(&s->cond);
+}
+
+static void stream_destroy(DG_STREAM *s)
+{
+  dgCondDestroy(&s->cond);
+  dgMutexDestroy(&s->lock);
+}
+
+/* stream_report -- (producer) avail bytes are ready; 1 if not wanted */
+static int stream_report(DG_STREAM *s, int avail)
+{
+  int cancel;
+
+  dgMutexLock(&s->lock);
+  s->avail = avail;
+  cancel = s->cancel;
+  dgCondBroadcast(&s->cond);
+  dgMutexUnlock(&s->lock);
+  return(cancel);
+}
+
+/* stream_finish -- (producer) no more is coming */
+static void stream_finish(DG_STREAM *s, int ok)
+{
+  dgMutexLock(&s->lock);
+  if (ok) s->avail = s->size;
+  s->ok = ok;
+  s->done = 1;
+  dgCondBroadcast(&s->cond);
+  dgMutexUnlock(&s->lock);
+}
+
+/*
+ * stream_wait_bytes -- (parser) block until the buffer exists and
+ * holds at least n bytes, or the producer is done.  Returns how many
+ * bytes there are if that's at least n, otherwise 0.
+ */
+static int stream_wait_bytes(DG_STREAM *s, int n)
+{
+  int avail;
+
+  dgMutexLock(&s->lock);
+  while ((!s->data || s->avail < n) && !s->done)
+    dgCondWait(&s->cond, &s->lock);
+  avail = s->data ? s->avail : 0;
+  dgMutexUnlock(&s->lock);
+  return(avail >= n ? avail : 0);
+}
+
+/*
+ * stream_element_size -- bytes taken by the element starting at the
+ * current position, or -1 if it runs past the end of bdata.  Anything
+ * the parser will reject as corrupt counts as one byte.
+ */
+static int stream_element_size(DG_READER *r, BUF_DATA *bdata, int toplevel)
+{
+  int c, n, depth, start = BD_INDEX(bdata);
+
+  if (!BD_HAVE(bdata, 1)) return(-1);
+  c = BD_GETC(bdata);
+  if (c == END_STRUCT) return(1);
+
+  if (toplevel) {
+    if (c != DG_VERSION_TAG) return(1);
+    return(BD_HAVE(bdata, sizeof(float)) ? 1+sizeof(float) : -1);
+  }
+
+  switch (c) {
+  case DG_NAME_TAG:
+    if (!BD_HAVE(bdata, sizeof(int))) return(-1);
+    n = vskip_string(r, (int *) BD_DATA(bdata));
+    if (n < (int) sizeof(int)) return(1);
+    return(BD_HAVE(bdata, n) ? 1+n : -1);
+  case DG_NLISTS_TAG:
+    return(BD_HAVE(bdata, sizeof(int)) ? 1+sizeof(int) : -1);
+  case DG_DYNLIST_TAG:
+    if (toc_scan_list(r, bdata, NULL, &depth) != DF_OK) return(-1);
+    return(BD_INDEX(bdata) - start);
+  default:
+    return(1);
+  }
+}
+
+/*
+ * stream_wait -- block until the whole element at the current position
+ * of bdata has been decompressed.  Returns 0 if it never will be.  An
+ * element that's still incomplete isn't rescanned until the amount
+ * there beyond its start has doubled, so a huge list costs only a few
+ * scans.
+ */
+static int stream_wait(DG_READER *r, BUF_DATA *bdata, int toplevel)
+{
+  DG_STREAM *s = DG_READER_STREAM(r);
+  BUF_DATA b;
+  int avail, want = BD_INDEX(bdata)+1;
+
+  for (;;) {
+    if (!(avail = stream_wait_bytes(s, want))) return(0);
+    b = *bdata;
+    BD_SIZE(&b) = avail;
+    if (stream_element_size(r, &b, toplevel) >= 0) return(1);
+    if (avail >= s->size) return(0);
+    want = BD_INDEX(bdata) + 2*(avail-BD_INDEX(bdata)) + DG_PIPELINE_CHUNK;
+    if (want > s->size || want < 0) want = s->size;
+  }
+}
+
+/* group_truncate -- remove (and free) lists added to dg after the nth */
+static void group_truncate(DYN_GROUP *dg, int n)
+{
+  while (DYN_GROUP_N(dg) > n) {
+    DYN_GROUP_N(dg)--;
+    dfuFreeDynList(DYN_GROUP_LIST(dg, DYN_GROUP_N(dg)));
+  }
+  if (DYN_GROUP_INDEX(dg)) dfuIndexDynGroup(dg);
+}
+
+/*
+ * stream_parse -- parse s into dg as it arrives from producer thread t,
+ * then wait for t and release (or hand to borrowing lists) the buffer
+ * as read_whole_buffer() would.  Returns the parse status, or -1 (with
+ * dg as it was) if decompression failed.
+ */
+static int stream_parse(DG_READER *r, DG_STREAM *s, DG_THREAD t,
+			DYN_GROUP *dg)
+{
+  DYN_BUFFER *buf = NULL;
+  int n = DYN_GROUP_N(dg), status = 0;
+
+  stream_wait_bytes(s, 0);
+  if (s->data && (!(DG_READER_FLAGS(r) & (DG_READ_BORROW | DG_READ_LAZY)) ||
+		  (buf = dfuCreateDynBuffer(s->data, s->size)))) {
+    DG_READER_BORROW(r) = buf;
+    DG_READER_STREAM(r) = s;
+    status = dgReaderBufferToStruct(r, s->data, s->size, dg);
+    DG_READER_STREAM(r) = NULL;
+    DG_READER_BORROW(r) = NULL;
+  }
+  if (status != DF_OK) {
+    dgMutexLock(&s->lock);
+    s->cancel = 1;
+    dgMutexUnlock(&s->lock);
+  }
+  dgThreadJoin(t);
+
+  if (!s->ok) {
+    group_truncate(dg, n);
+    status = -1;
+  }
+  if (buf) dfuUnrefDynBuffer(buf);
+  else if (s->data) free(s->data);
+  return(status);
+}
+
+static DG_THREAD_FUNC(gz_stream_worker, arg)
+{
+  DG_STREAM *s = (DG_STREAM *) arg;
+  z_stream zs;
+  int status = Z_OK, left, ok = 0;
+
+  memset(&zs, 0, sizeof(zs));
+  if (inflateInit2(&zs, 16 + MAX_WBITS) == Z_OK) {
+    zs.next_in = s->in;
+    zs.avail_in = (uInt) s->insize;
+    zs.next_out = s->data;
+
+    /* there's a spare byte at the end, so the trailer can be reached */
+    while (status == Z_OK && (left = s->size+1 - (int) zs.total_out) > 0) {
+      zs.avail_out = (uInt) (left < DG_PIPELINE_CHUNK ?
+			     left : DG_PIPELINE_CHUNK);
+      status = inflate(&zs, Z_NO_FLUSH);
+      if (stream_report(s, (int) zs.total_out < s->size ?
+			(int) zs.total_out : s->size)) break;
+    }
+    ok = (status == Z_STREAM_END && !zs.avail_in &&
+	  zs.total_out == (uLong) s->size);
+    inflateEnd(&zs);
+  }
+  stream_finish(s, ok);
+  DG_THREAD_RETURN;
+}
+
+/*
+ * gz_stream -- read a single-member .dgz file in a pipeline.  Returns
+ * -1 if the file isn't suitable (small, unmappable, no plausible ISIZE,
+ * or it turns out to have more than one member), leaving it to be read
+ * the usual way.
+ */
+static int gz_stream(DG_READER *r, char *filename, DYN_GROUP *dg)
+{
+  DG_STREAM s;
+  DG_THREAD t;
+  FILE *fp;
+  unsigned char *in, *data;
+  unsigned int isize;
+  int insize, status;
+
+  if (DG_READER_NTHREADS(r) < 2 || !filename || !filename[0]) return(-1);
+  if (!(fp = fopen(filename, "rb"))) return(-1);
+  if (!map_file(fp, &in, &insize)) {
+    fclose(fp);
+    return(-1);
+  }
+  fclose(fp);
+
+  if (insize < DG_PIPELINE_MIN_SIZE || !gz_isize(in, insize, &isize) ||
+      !(data = (unsigned char *) malloc(isize+1))) {
+    unmap_file(in, insize);
+    return(-1);
+  }
+
+  stream_init(&s, data, (int) isize);
+  s.in = in;
+  s.insize = insize;
+  if (!dgThreadCreate(&t, gz_stream_worker, &s)) {
+    free(data);
+    status = -1;
+  }
+  else status = stream_parse(r, &s, t, dg);
+  stream_destroy(&s);
+  unmap_file(in, insize);
+  return(status);
+}
+
+/* lz4_progress -- decompress_lz4_file_progress() callback */
+static void lz4_progress(void *arg, unsigned char *data, size_t size,
+			 size_t nbytes)
+{
+  DG_STREAM *s = (DG_STREAM *) arg;
+
+  dgMutexLock(&s->lock);
+  s->data = data;
+  s->size = (int) size;
+  s->avail = (int) nbytes;
+  dgCondBroadcast(&s->cond);
+  dgMutexUnlock(&s->lock);
+}
+
+static DG_THREAD_FUNC(lz4_stream_worker, arg)
+{
+  DG_STREAM *s = (DG_STREAM *) arg;
+  unsigned char *data;
+  int size;
 
-	/* Figure out how many there are */
-	get_long(InFP, (int *) &n);
+  stream_finish(s, decompress_lz4_file_progress(s->fp, &size, &data,
+						 lz4_progress, s));
+  DG_THREAD_RETURN;
+}
 
-	/* Set the datatype */
-	DYN_LIST_DATATYPE(dl) = DF_LIST;
+/*
+ * lz4_stream -- read a .lz4 file in a pipeline.  Returns -1 (having
+ * read nothing) if it's too small to be worth it or fp can't seek.
+ */
+static int lz4_stream(DG_READER *r, FILE *fp, DYN_GROUP *dg)
+{
+  DG_STREAM s;
+  DG_THREAD t;
+  long insize;
+  int status;
 
-	/* Setup and allocate the appropriate amount of space */
-	DYN_LIST_INCREMENT(dl) = 10;
-	DYN_LIST_MAX(dl) = n ? n : 1;
-	DYN_LIST_N(dl) = n;
-	DYN_LIST_VALS(dl) = 
-	  (DYN_LIST **) calloc(DYN_LIST_MAX(dl), sizeof(DYN_LIST *));
-	vals = (DYN_LIST **) DYN_LIST_VALS(dl);
+  if (DG_READER_NTHREADS(r) < 2 || fseek(fp, 0, SEEK_END)) return(-1);
+  insize = ftell(fp);
+  rewind(fp);
+  if (insize < DG_PIPELINE_MIN_SIZE) return(-1);
 
-	/* Now fill up the list of lists by recursively calling this func */
-	for (i = 0; i < n; i++) {
-	  newlist = (DYN_LIST *) calloc(1, sizeof(DYN_LIST));
-	  DYN_LIST_INCREMENT(newlist) = 10;
-	  if ((c = getc(InFP)) != DL_SUBLIST_TAG) return(DF_ABORT);
-	  status = dguFileToDynList(InFP, newlist);
-	  vals[i] = newlist;
-	}
-      }
-      break;
-    default:
-      fprintf(stderr,"unknown event type %d\n", c);
-      status = DF_ABORT;
-      break;
-    }
-  }
-  if (status != DF_ABORT) return(DF_OK);
-  else return(status);
+  stream_init(&s, NULL, 0);
+  s.fp = fp;
+  if (!dgThreadCreate(&t, lz4_stream_worker, &s)) status = -1;
+  else if ((status = stream_parse(r, &s, t, dg)) < 0) status = DF_ABORT;
+  stream_destroy(&s);
+  return(status);
 }
 
 
 /*--------------------------------------------------------------------
-  -----         Buffer to Structure Transfer Functions           -----
+  -----                 Event (Callback) Parsing                 -----
+
+      dgParse() walks a stream using the same tag tables as the
+      ASCII dumps, reporting structures and data to DG_CALLBACKS
+      instead of building a DYN_GROUP.  Array data is handed over
+      in place as in borrowed reads (aligned and byte flipped within
+      the buffer), so a buffer can only be parsed once, unless the
+      reader has DG_READ_PRESERVE set, when any array that would be
+      changed is copied out to a scratch block instead.
+
+  -----                                                          -----
   -------------------------------------------------------------------*/
 
-int dguBufferToStruct(unsigned char *vbuf, int bufsize, DYN_GROUP *dg)
+/*
+ * parse_peek_name -- the name of the structure just begun, if its
+ * first tag is a NAME (DG_NAME_TAG and DL_NAME_TAG are the same), or ""
+ */
+static const char *parse_peek_name(DG_READER *r, BUF_DATA *bdata)
 {
-  int c, status = DF_OK;
-  int advance_bytes = 0;
-  float version;
-  BUF_DATA *bdata = (BUF_DATA *) calloc(1, sizeof(BUF_DATA));
+  int length;
 
-  if (!vconfirm_magic_number((char *)vbuf)) {
+  if (!BD_HAVE(bdata, 1+sizeof(int)) || BD_DATA(bdata)[0] != DL_NAME_TAG)
+    return("");
+  vget_long(r, (int *) (BD_DATA(bdata)+1), &length);
+  if (length <= 0 ||
+      length > BD_SIZE(bdata) - BD_INDEX(bdata) - (int) (1+sizeof(int)) ||
+      BD_DATA(bdata)[sizeof(int)+length] != 0)
+    return("");
+  return((const char *) BD_DATA(bdata)+1+sizeof(int));
+}
+
+/*
+ * parse_count -- read the count at the current position into n, making
+ * sure there is room for a count and n items of at least size bytes
+ */
+static int parse_count(DG_READER *r, BUF_DATA *bdata, int size, int *n)
+{
+  if (!BD_HAVE(bdata, sizeof(int))) return(0);
+  vget_long(r, (int *) BD_DATA(bdata), n);
+  if (*n < 0) return(0);
+  if (size &&
+      *n > (BD_SIZE(bdata) - BD_INDEX(bdata) - (int) sizeof(int)) / size)
     return(0);
-  }
+  return(1);
+}
 
-  BD_BUFFER(bdata) = vbuf;
-  BD_INDEX(bdata) = DF_MAGIC_NUMBER_SIZE;
-  BD_SIZE(bdata) = bufsize;
+/*
+ * parse_copy -- for DG_READ_PRESERVE, vborrow_shorts(), vborrow_longs()
+ * or vborrow_floats() (by datatype) without touching the buffer:
+ * values that would be moved or flipped are copied into *scratch
+ * (grown to *scratchsize bytes as needed).  Returns -1 if out of memory.
+ */
+static int parse_copy(DG_READER *r, int *n, int datatype, int *nv, void **v,
+		      unsigned char **scratch, int *scratchsize)
+{
+  unsigned char *p = (unsigned char *) (n+1), *s;
+  int nvals, nbytes;
+  int size = (datatype == DF_SHORT) ? sizeof(short) : sizeof(int);
 
-  while (status == DF_OK && BD_INDEX(bdata) < BD_SIZE(bdata)) {
-    BD_INCINDEX(bdata, advance_bytes);
-    advance_bytes = 0;
-    c = BD_GETC(bdata);
-    switch (c) {
-    case END_STRUCT:
-      status = DF_FINISHED;
-      break;
-    case DG_VERSION_TAG:
-      advance_bytes += vget_version((float *) BD_DATA(bdata), &version);
-      break;
-    case DG_BEGIN_TAG:
-      status = dguBufferToDynGroup(bdata, dg);
-      break;
-    default:
-      fprintf(stderr,"unknown event type %d\n", c);
-      status = DF_ABORT;
-      break;
-    }
-  }
-  free(bdata);
+  memcpy(&nvals, n, sizeof(int));
+  if (DG_READER_FLIP(r)) nvals = fliplong(nvals);
+  nbytes = nvals*size;
 
-  if (status != DF_ABORT) return(DF_OK);
-  else return(status);
+  *nv = nvals;
+  *v = NULL;
+  if (!nvals) return(sizeof(int));
+
+  if (!DG_READER_FLIP(r) && !((uintptr_t) p % size)) {
+    *v = p;
+    return(sizeof(int)+nbytes);
+  }
+  if (nbytes > *scratchsize) {
+    if (!(s = (unsigned char *) realloc(*scratch, nbytes))) return(-1);
+    *scratch = s;
+    *scratchsize = nbytes;
+  }
+  if (!DG_READER_FLIP(r)) memcpy(*scratch, p, nbytes);
+  else switch (datatype) {
+    case DF_SHORT: copyflipshorts(nvals, p, (short *) *scratch); break;
+    case DF_LONG:  copyfliplongs(nvals, p, (int *) *scratch);    break;
+    default:       copyflipfloats(nvals, p, (float *) *scratch); break;
+  }
+  *v = *scratch;
+  return(sizeof(int)+nbytes);
 }
 
-static int dguBufferToDynGroup(BUF_DATA *bdata, DYN_GROUP *dg)
+/*
+ * dgReaderParse -- report the dg stream in vbuf to cb (see DG_CALLBACKS).
+ * Returns DF_OK after a complete parse, DF_ABORT if the stream is bad or
+ * a handler stopped it, or 0 if vbuf doesn't hold dg data at all.
+ */
+int dgReaderParse(DG_READER *r, unsigned char *vbuf, int bufsize,
+		  const DG_CALLBACKS *cb, void *user)
 {
-  int n = 0, c, status = DF_OK, advance_bytes = 0;
-  int nlists;
+  DG_STRUCT_STACK *s = DG_READER_STRUCTS(r);
+  BUF_DATA bdata;
+  int c, i, n, length, advance_bytes = 0;
+  int depth = -1, ok = 1, status = DF_OK;
+  int preserve = DG_READER_FLAGS(r) & DG_READ_PRESERVE, scratchsize = 0;
+  unsigned char *scratch = NULL;
+  float version;
+  const char *str;
 
-  while (status == DF_OK && !BD_EOF(bdata)) {
-    BD_INCINDEX(bdata, advance_bytes);
+  if (bufsize < DG_MAGIC_NUMBER_SIZE || !vconfirm_magic_number((char *)vbuf))
+    return(0);
+
+  BD_BUFFER(&bdata) = vbuf;
+  BD_INDEX(&bdata) = DG_MAGIC_NUMBER_SIZE;
+  BD_SIZE(&bdata) = bufsize;
+
+  free_struct_stack(s);
+  push_struct(s, DG_TOP_LEVEL, "DG_TOP_LEVEL");
+
+  while (ok && status == DF_OK) {
+    BD_INCINDEX(&bdata, advance_bytes);
     advance_bytes = 0;
-    c = BD_GETC(bdata);
-    switch (c) {
-    case END_STRUCT:
-      status = DF_FINISHED;
-      break;
-    case DG_NAME_TAG:
-      {
-	char *string;
-	int n;
-	advance_bytes += vget_string((int *) BD_DATA(bdata), 
-				     &n, &string);
-	strncpy(DYN_GROUP_NAME(dg), string, DYN_GROUP_NAME_SIZE-1);
-	free((void *) string);
-      }
-      break;
-    case DG_NLISTS_TAG:
-      advance_bytes += vget_long((int *) BD_DATA(bdata), &nlists);
-      break;
-    case DG_DYNLIST_TAG:
-      {
-	DYN_LIST *dl = (DYN_LIST *) calloc(1, sizeof(DYN_LIST));
-	DYN_LIST_INCREMENT(dl) = 10;
-	status = dguBufferToDynList(bdata, dl);
-	dfuAddDynGroupExistingList(dg, DYN_LIST_NAME(dl), dl);
-	n++;
+    if (BD_EOF(&bdata)) break;
+    c = BD_GETC(&bdata);
+
+    if (c == END_STRUCT) {
+      switch (s->cur) {
+      case DYN_LIST_STRUCT:
+	if (cb->end_list) ok = cb->end_list(user, depth);
+	depth--;
+	break;
+      case DYN_GROUP_STRUCT:
+	if (cb->end_group) ok = cb->end_group(user);
+	break;
+      default:
+	status = DF_FINISHED;
+	continue;
       }
-      break;
-    default:
+      pop_struct(s);
+      continue;
+    }
+
+    if (c >= DGTagTableSize[s->cur]) {
       fprintf(stderr,"unknown event type %d\n", c);
       status = DF_ABORT;
       break;
     }
-  }
-  if (status != DF_ABORT) return(DF_OK);
-  else return(status);
-}
-
-static int dguBufferToDynList(BUF_DATA *bdata, DYN_LIST *dl)
-{
-  int c, status = DF_OK;
-  int advance_bytes = 0;
 
-  while (status == DF_OK && !BD_EOF(bdata)) {
-    BD_INCINDEX(bdata, advance_bytes);
-    advance_bytes = 0;
-    c = BD_GETC(bdata);
-    switch (c) {
-    case END_STRUCT:
-      status = DF_FINISHED;
+    switch (reader_data_type(r, c)) {
+    case DF_STRUCTURE:
+      push_struct(s, reader_structure_type(r, c), reader_tag_name(r, c));
+      if (s->cur == DYN_GROUP_STRUCT) {
+	if (cb->begin_group)
+	  ok = cb->begin_group(user, parse_peek_name(r, &bdata));
+      }
+      else {
+	depth++;
+	if (cb->begin_list)
+	  ok = cb->begin_list(user, parse_peek_name(r, &bdata), depth);
+      }
       break;
-    case DL_INCREMENT_TAG:
-      advance_bytes += vget_long((int *) BD_DATA(bdata), 
-				 (int *) &DYN_LIST_INCREMENT(dl));
+    case DF_VERSION:
+      if (!BD_HAVE(&bdata, sizeof(float))) status = DF_ABORT;
+      else advance_bytes = vget_version(r, (float *) BD_DATA(&bdata),
+					&version);
       break;
-    case DL_FLAGS_TAG:
-      advance_bytes += vget_long((int *) BD_DATA(bdata), 
-				 (int *) &DYN_LIST_FLAGS(dl));
+    case DF_VOID_ARRAY:
       break;
-    case DL_DATA_TAG:
+    case DF_LONG:
+      if (!BD_HAVE(&bdata, sizeof(int))) status = DF_ABORT;
+      else advance_bytes = sizeof(int);
       break;
-    case DL_NAME_TAG:
-      {
-	char *string;
-	int n;
-	advance_bytes += vget_string((int *) BD_DATA(bdata), 
-				     &n, &string);
-	strncpy(DYN_LIST_NAME(dl), string, DYN_LIST_NAME_SIZE-1);
-	free((void *) string);
-      }
+    case DF_STRING:		/* names, already passed to begin_xxx */
+      if (!parse_count(r, &bdata, 1, &length)) status = DF_ABORT;
+      else advance_bytes = sizeof(int)+length;
       break;
-    case DL_STRING_DATA_TAG:
-      {
-	char **data;
-	int n;
-	advance_bytes += vget_strings((int *) BD_DATA(bdata), &n, &data);
-	DYN_LIST_DATATYPE(dl) = DF_STRING;
-	DYN_LIST_MAX(dl) = n;
-	DYN_LIST_N(dl) = n;
-	if (n) DYN_LIST_VALS(dl) = data;
-	else {
-	  DYN_LIST_VALS(dl) = (char **) calloc(1, sizeof(char *));
-	  DYN_LIST_MAX(dl) = 1;
+    case DF_STRING_ARRAY:
+      if (!parse_count(r, &bdata, sizeof(int), &n)) {
+	status = DF_ABORT;
+	break;
+      }
+      BD_INCINDEX(&bdata, sizeof(int));
+      if (cb->data) ok = cb->data(user, DF_STRING, NULL, n);
+      for (i = 0; ok && i < n; i++) {
+	if (!parse_count(r, &bdata, 1, &length) ||
+	    (length && BD_DATA(&bdata)[sizeof(int)+length-1])) {
+	  status = DF_ABORT;
+	  break;
 	}
-
+	str = length ? (const char *) BD_DATA(&bdata)+sizeof(int) : "";
+	if (cb->string) ok = cb->string(user, i, str);
+	BD_INCINDEX(&bdata, sizeof(int)+length);
       }
       break;
-    case DL_FLOAT_DATA_TAG:
-      {
-	float *data;
-	int n;
-	advance_bytes += vget_floats((int *) BD_DATA(bdata), &n, &data);
-	DYN_LIST_DATATYPE(dl) = DF_FLOAT;
-	DYN_LIST_MAX(dl) = n;
-	DYN_LIST_N(dl) = n;
-	if (n) DYN_LIST_VALS(dl) = data;
-	else DYN_LIST_VALS(dl) = NULL;
+    case DF_CHAR_ARRAY:
+      if (!parse_count(r, &bdata, sizeof(char), &n)) status = DF_ABORT;
+      else {
+	char *vals;
+	advance_bytes = vborrow_chars(r, (int *) BD_DATA(&bdata), &n, &vals);
+	if (cb->data) ok = cb->data(user, DF_CHAR, vals, n);
       }
       break;
-    case DL_LONG_DATA_TAG:
-      {
-	int *data;
-	int n;
-	advance_bytes += vget_longs((int *) BD_DATA(bdata), &n, &data);
-	DYN_LIST_DATATYPE(dl) = DF_LONG;
-	DYN_LIST_MAX(dl) = n;
-	DYN_LIST_N(dl) = n;
-	if (n) DYN_LIST_VALS(dl) = data;
-	else DYN_LIST_VALS(dl) = NULL;
+    case DF_SHORT_ARRAY:
+      if (!parse_count(r, &bdata, sizeof(short), &n)) status = DF_ABORT;
+      else {
+	short *vals;
+	if (preserve)
+	  advance_bytes = parse_copy(r, (int *) BD_DATA(&bdata), DF_SHORT, &n,
+				     (void **) &vals, &scratch, &scratchsize);
+	else
+	  advance_bytes = vborrow_shorts(r, (int *) BD_DATA(&bdata), &n, &vals);
+	if (advance_bytes < 0) status = DF_ABORT;
+	else if (cb->data) ok = cb->data(user, DF_SHORT, vals, n);
       }
       break;
-    case DL_SHORT_DATA_TAG:
-      {
-	short *data;
-	int n;
-	advance_bytes += vget_shorts((int *) BD_DATA(bdata), &n, &data);
-	DYN_LIST_DATATYPE(dl) = DF_SHORT;
-	DYN_LIST_MAX(dl) = n;
-	DYN_LIST_N(dl) = n;
-	DYN_LIST_VALS(dl) = data;
+    case DF_LONG_ARRAY:
+      if (!parse_count(r, &bdata, sizeof(int), &n)) status = DF_ABORT;
+      else {
+	int *vals;
+	if (preserve)
+	  advance_bytes = parse_copy(r, (int *) BD_DATA(&bdata), DF_LONG, &n,
+				     (void **) &vals, &scratch, &scratchsize);
+	else
+	  advance_bytes = vborrow_longs(r, (int *) BD_DATA(&bdata), &n, &vals);
+	if (advance_bytes < 0) status = DF_ABORT;
+	else if (cb->data) ok = cb->data(user, DF_LONG, vals, n);
       }
       break;
-    case DL_CHAR_DATA_TAG:
-      {
-	char *data;
-	int n;
-	advance_bytes += vget_chars((int *) BD_DATA(bdata), &n, &data);
-	DYN_LIST_DATATYPE(dl) = DF_CHAR;
-	DYN_LIST_MAX(dl) = n;
-	DYN_LIST_N(dl) = n;
-	if (n) DYN_LIST_VALS(dl) = data;
-	else DYN_LIST_VALS(dl) = NULL;
+    case DF_FLOAT_ARRAY:
+      if (!parse_count(r, &bdata, sizeof(float), &n)) status = DF_ABORT;
+      else {
+	float *vals;
+	if (preserve)
+	  advance_bytes = parse_copy(r, (int *) BD_DATA(&bdata), DF_FLOAT, &n,
+				     (void **) &vals, &scratch, &scratchsize);
+	else
+	  advance_bytes = vborrow_floats(r, (int *) BD_DATA(&bdata), &n, &vals);
+	if (advance_bytes < 0) status = DF_ABORT;
+	else if (cb->data) ok = cb->data(user, DF_FLOAT, vals, n);
       }
       break;
-    case DL_LIST_DATA_TAG:
-      {
-	DYN_LIST *newlist, **vals;
-	int n, i;
-
-	/* Figure out how many there are */
-	advance_bytes = vget_long((int *) BD_DATA(bdata), (int *) &n);
-	BD_INCINDEX(bdata, advance_bytes);
-	advance_bytes = 0;
-	
-	/* Set the datatype */
-	DYN_LIST_DATATYPE(dl) = DF_LIST;
-
-	/* Setup and allocate the appropriate amount of space */
-	DYN_LIST_INCREMENT(dl) = 10;
-	DYN_LIST_MAX(dl) = n ? n : 1;
-	DYN_LIST_N(dl) = n;
-	DYN_LIST_VALS(dl) = 
-	  (DYN_LIST **) calloc(DYN_LIST_MAX(dl), sizeof(DYN_LIST *));
-	vals = (DYN_LIST **) DYN_LIST_VALS(dl);
-
-	/* Now fill up the list of lists by recursively calling this func */
-	for (i = 0; i < n; i++) {
-	  newlist = (DYN_LIST *) calloc(1, sizeof(DYN_LIST));
-	  DYN_LIST_INCREMENT(newlist) = 10;
-	  c = BD_GETC(bdata);
-	  if (c != DL_SUBLIST_TAG) return(DF_ABORT);
-	  status = dguBufferToDynList(bdata, newlist);
-	  vals[i] = newlist;
-	}
+    case DF_LIST_ARRAY:		/* the n sublists follow */
+      if (!parse_count(r, &bdata, 1, &n)) status = DF_ABORT;
+      else {
+	advance_bytes = sizeof(int);
+	if (cb->data) ok = cb->data(user, DF_LIST, NULL, n);
       }
       break;
     default:
@@ -2400,22 +6382,36 @@ static int dguBufferToDynList(BUF_DATA *bdata, DYN_LIST *dl)
       break;
     }
   }
-  if (status != DF_ABORT) return(DF_OK);
-  else return(status);
+
+  if (scratch) free(scratch);
+  if (!ok || status == DF_ABORT) return(DF_ABORT);
+  return(DF_OK);
 }
 
+int dgParse(unsigned char *vbuf, int bufsize, const DG_CALLBACKS *cb,
+	    void *user)
+{
+  DG_READER r;
+  int status;
+
+  dgInitReader(&r);
+  status = dgReaderParse(&r, vbuf, bufsize, cb, user);
+  dgFreeReader(&r);
+  return(status);
+}
 
 
 /*--------------------------------------------------------------------
   -----                    Output Functions                      -----
   -------------------------------------------------------------------*/
 
-void dguBufferToAscii(unsigned char *vbuf, int bufsize, FILE *OutFP)
+void dgReaderBufferToAscii(DG_READER *r, unsigned char *vbuf, int bufsize,
+			   FILE *OutFP)
 {
   int c, dtype;
   int i, advance_bytes = 0;
   
-  dgPushStruct(DG_TOP_LEVEL, "DG_TOP_LEVEL");
+  push_struct(DG_READER_STRUCTS(r), DG_TOP_LEVEL, "DG_TOP_LEVEL");
 
   if (!vconfirm_magic_number((char *)vbuf)) {
     fprintf(stderr,"dgutils: file not recognized as dg format\n");
@@ -2425,55 +6421,56 @@ void dguBufferToAscii(unsigned char *vbuf, int bufsize, FILE *OutFP)
   for (i = DG_MAGIC_NUMBER_SIZE; i < bufsize; i+=advance_bytes) {
     c = vbuf[i++];
     if (c == END_STRUCT) {
-      fprintf(OutFP, "END:   %s\n", dgGetCurrentStructName());
-      dgPopStruct();
+      fprintf(OutFP, "END:   %s\n", DG_READER_STRUCTS(r)->curname);
+      pop_struct(DG_READER_STRUCTS(r));
       advance_bytes = 0;
       continue;
     }
-    switch (dtype = dgGetDataType(c)) {
+    switch (dtype = reader_data_type(r, c)) {
     case DF_STRUCTURE:
-      fprintf(OutFP, "BEGIN: %s\n", dgGetTagName(c));
-      dgPushStruct(dgGetStructureType(c), dgGetTagName(c));
+      fprintf(OutFP, "BEGIN: %s\n", reader_tag_name(r, c));
+      push_struct(DG_READER_STRUCTS(r), reader_structure_type(r, c),
+		  reader_tag_name(r, c));
       advance_bytes = 0;
       break;
     case DF_VERSION:
-      advance_bytes = vread_version((float *) &vbuf[i], OutFP);
+      advance_bytes = vread_version(r, (float *) &vbuf[i], OutFP);
       break;
     case DF_VOID_ARRAY:
       advance_bytes = 0;
       break;
     case DF_FLAG:
-      advance_bytes = vread_flag(c, OutFP);
+      advance_bytes = vread_flag(r, c, OutFP);
       break;
     case DF_CHAR:
-      advance_bytes = vread_char(c, (char *) &vbuf[i], OutFP);
+      advance_bytes = vread_char(r, c, (char *) &vbuf[i], OutFP);
       break;
     case DF_LONG:
-      advance_bytes = vread_long(c, (int *) &vbuf[i], OutFP);
+      advance_bytes = vread_long(r, c, (int *) &vbuf[i], OutFP);
       break;
     case DF_SHORT:
-      advance_bytes = vread_short(c, (short *) &vbuf[i], OutFP);
+      advance_bytes = vread_short(r, c, (short *) &vbuf[i], OutFP);
       break;
     case DF_FLOAT:
-      advance_bytes = vread_float(c, (float *) &vbuf[i], OutFP);
+      advance_bytes = vread_float(r, c, (float *) &vbuf[i], OutFP);
       break;
     case DF_STRING:
-      advance_bytes = vread_string(c, (int *) &vbuf[i], OutFP);
+      advance_bytes = vread_string(r, c, (int *) &vbuf[i], OutFP);
       break;
     case DF_STRING_ARRAY:
-      advance_bytes = vread_strings(c, (int *) &vbuf[i], OutFP);
+      advance_bytes = vread_strings(r, c, (int *) &vbuf[i], OutFP);
       break;
     case DF_FLOAT_ARRAY:
-      advance_bytes = vread_floats(c, (int *) &vbuf[i], OutFP);
+      advance_bytes = vread_floats(r, c, (int *) &vbuf[i], OutFP);
       break;
     case DF_LONG_ARRAY:
-      advance_bytes = vread_longs(c, (int *) &vbuf[i], OutFP);
+      advance_bytes = vread_longs(r, c, (int *) &vbuf[i], OutFP);
       break;
     case DF_SHORT_ARRAY:
-      advance_bytes = vread_shorts(c, (int *) &vbuf[i], OutFP);
+      advance_bytes = vread_shorts(r, c, (int *) &vbuf[i], OutFP);
       break;
     case DF_LIST_ARRAY:
-      advance_bytes = vread_long(c, (int *) &vbuf[i], OutFP);
+      advance_bytes = vread_long(r, c, (int *) &vbuf[i], OutFP);
       break;
     default:
       fprintf(stderr,"unknown event type %d\n", c);
@@ -2482,11 +6479,19 @@ void dguBufferToAscii(unsigned char *vbuf, int bufsize, FILE *OutFP)
   }
 }
 
-void dguFileToAscii(FILE *InFP, FILE *OutFP)
+void dguBufferToAscii(unsigned char *vbuf, int bufsize, FILE *OutFP)
+{
+  DG_READER r;
+  dgInitReader(&r);
+  dgReaderBufferToAscii(&r, vbuf, bufsize, OutFP);
+  dgFreeReader(&r);
+}
+
+void dgReaderFileToAscii(DG_READER *r, FILE *InFP, FILE *OutFP)
 {
   int c, dtype;
   
-  dgPushStruct(DG_TOP_LEVEL, "DG_TOP_LEVEL");
+  push_struct(DG_READER_STRUCTS(r), DG_TOP_LEVEL, "DG_TOP_LEVEL");
 
   if (!confirm_magic_number(InFP)) {
     fprintf(stderr,"dgutils: file not recognized as dg format\n");
@@ -2495,55 +6500,56 @@ void dguFileToAscii(FILE *InFP, FILE *OutFP)
   
   while((c = getc(InFP)) != EOF) {
     if (c == END_STRUCT) {
-      fprintf(OutFP, "END:   %s\n", dgGetCurrentStructName());
-      dgPopStruct();
+      fprintf(OutFP, "END:   %s\n", DG_READER_STRUCTS(r)->curname);
+      pop_struct(DG_READER_STRUCTS(r));
       continue;
     }
-    switch (dtype = dgGetDataType(c)) {
+    switch (dtype = reader_data_type(r, c)) {
     case DF_STRUCTURE:
-      fprintf(OutFP, "BEGIN: %s\n", dgGetTagName(c));
-      dgPushStruct(dgGetStructureType(c), dgGetTagName(c));
+      fprintf(OutFP, "BEGIN: %s\n", reader_tag_name(r, c));
+      push_struct(DG_READER_STRUCTS(r), reader_structure_type(r, c),
+		  reader_tag_name(r, c));
       break;
     case DF_VERSION:
-      read_version(InFP, OutFP);
+      read_version(r, InFP, OutFP);
       break;
     case DF_VOID_ARRAY:
       break;
     case DF_FLAG:
-      read_flag(c, InFP, OutFP);
+      read_flag(r, c, InFP, OutFP);
       break;
     case DF_CHAR:
-      read_char(c, InFP, OutFP);
+      read_char(r, c, InFP, OutFP);
       break;
     case DF_LONG:
-      read_long(c, InFP, OutFP);
+      read_long(r, c, InFP, OutFP);
       break;
     case DF_SHORT:
-      read_short(c, InFP, OutFP);
+      read_short(r, c, InFP, OutFP);
       break;
     case DF_FLOAT:
-      read_float(c, InFP, OutFP);
+      read_float(r, c, InFP, OutFP);
       break;
     case DF_STRING:
-      read_string(c, InFP, OutFP);
+      read_string(r, c, InFP, OutFP);
       break;
     case DF_STRING_ARRAY:
-      read_strings(c, InFP, OutFP);
+      read_strings(r, c, InFP, OutFP);
       break;
     case DF_FLOAT_ARRAY:
-      read_floats(c, InFP, OutFP);
+      read_floats(r, c, InFP, OutFP);
       break;
     case DF_LONG_ARRAY:
-      read_longs(c, InFP, OutFP);
+      read_longs(r, c, InFP, OutFP);
       break;
     case DF_CHAR_ARRAY:
-      read_chars(c, InFP, OutFP);
+      read_chars(r, c, InFP, OutFP);
       break;
     case DF_SHORT_ARRAY:
-      read_shorts(c, InFP, OutFP);
+      read_shorts(r, c, InFP, OutFP);
       break;
     case DF_LIST_ARRAY:
-      read_long(c, InFP, OutFP);
+      read_long(r, c, InFP, OutFP);
       break;
     default:
       fprintf(stderr,"unknown event type %d\n", c);
@@ -2552,4 +6558,10 @@ void dguFileToAscii(FILE *InFP, FILE *OutFP)
   }
 }
 
-
+void dguFileToAscii(FILE *InFP, FILE *OutFP)
+{
+  DG_READER r;
+  dgInitReader(&r);
+  dgReaderFileToAscii(&r, InFP, OutFP);
+  dgFreeReader(&r);
+}
@@ -1,8 +1,36 @@
-
 /*
  * Routines for flipping bytes
  */
 
+#include <string.h>
+#include <stdint.h>
+
+#include "flipfuncs.h"
+
+/*
+ * The array routines below do their work in swap16() and swap32(),
+ * which use vector byte shuffles when the compiler is targeting a
+ * machine that has them (AVX2 and/or SSE2 on x86, NEON on ARM) and
+ * fall back to plain shifts for whatever is left over.  Loads and
+ * stores are unaligned, so src may point anywhere into a stream, and
+ * src may equal dst to flip in place.
+ */
+
+#if defined(__AVX2__)
+#define FLIP_AVX2
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || \
+  (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FLIP_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#define FLIP_NEON
+#include <arm_neon.h>
+#endif
+#ifdef FLIP_AVX2
+#include <immintrin.h>
+#endif
+
 float
 flipfloat(float oldf)
 {
@@ -75,20 +103,104 @@ flipshort(short olds)
   return(news);
 }
 
+static void swap16(unsigned char *dst, const unsigned char *src, int n)
+{
+  int i = 0;
+  uint16_t x;
+#ifdef FLIP_AVX2
+  const __m256i mask = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6,
+					9, 8, 11, 10, 13, 12, 15, 14,
+					1, 0, 3, 2, 5, 4, 7, 6,
+					9, 8, 11, 10, 13, 12, 15, 14);
+  for (; i + 16 <= n; i += 16) {
+    __m256i v = _mm256_loadu_si256((const __m256i *) (src+2*i));
+    _mm256_storeu_si256((__m256i *) (dst+2*i), _mm256_shuffle_epi8(v, mask));
+  }
+#endif
+#if defined(FLIP_SSE2)
+  for (; i + 8 <= n; i += 8) {
+    __m128i v = _mm_loadu_si128((const __m128i *) (src+2*i));
+    v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+    _mm_storeu_si128((__m128i *) (dst+2*i), v);
+  }
+#elif defined(FLIP_NEON)
+  for (; i + 8 <= n; i += 8) {
+    vst1q_u8(dst+2*i, vrev16q_u8(vld1q_u8(src+2*i)));
+  }
+#endif
+  for (; i < n; i++) {
+    memcpy(&x, src+2*i, 2);
+    x = (uint16_t) ((x >> 8) | (x << 8));
+    memcpy(dst+2*i, &x, 2);
+  }
+}
+
+static void swap32(unsigned char *dst, const unsigned char *src, int n)
+{
+  int i = 0;
+  uint32_t x;
+#ifdef FLIP_AVX2
+  const __m256i mask = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4,
+					11, 10, 9, 8, 15, 14, 13, 12,
+					3, 2, 1, 0, 7, 6, 5, 4,
+					11, 10, 9, 8, 15, 14, 13, 12);
+  for (; i + 8 <= n; i += 8) {
+    __m256i v = _mm256_loadu_si256((const __m256i *) (src+4*i));
+    _mm256_storeu_si256((__m256i *) (dst+4*i), _mm256_shuffle_epi8(v, mask));
+  }
+#endif
+#if defined(FLIP_SSE2)
+  for (; i + 4 <= n; i += 4) {
+    __m128i v = _mm_loadu_si128((const __m128i *) (src+4*i));
+    /* swap the bytes of each short, then the shorts of each int */
+    v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+    v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+    v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+    _mm_storeu_si128((__m128i *) (dst+4*i), v);
+  }
+#elif defined(FLIP_NEON)
+  for (; i + 4 <= n; i += 4) {
+    vst1q_u8(dst+4*i, vrev32q_u8(vld1q_u8(src+4*i)));
+  }
+#endif
+  for (; i < n; i++) {
+    memcpy(&x, src+4*i, 4);
+    x = (x >> 24) | ((x >> 8) & 0xff00) | ((x << 8) & 0xff0000) | (x << 24);
+    memcpy(dst+4*i, &x, 4);
+  }
+}
+
 void fliplongs(int n, int *vals)
 {
-  int i;
-  for (i = 0; i < n; i++) vals[i] = fliplong(vals[i]);
+  swap32((unsigned char *) vals, (unsigned char *) vals, n);
 }
 
 void flipshorts(int n, short *vals)
 {
-  int i;
-  for (i = 0; i < n; i++) vals[i] = flipshort(vals[i]);
+  swap16((unsigned char *) vals, (unsigned char *) vals, n);
 }
 
 void flipfloats(int n, float *vals)
 {
-  int i;
-  for (i = 0; i < n; i++) vals[i] = flipfloat(vals[i]);
+  swap32((unsigned char *) vals, (unsigned char *) vals, n);
+}
+
+/*
+ * copyflip{longs,shorts,floats} -- copy n values out of from (which
+ * needn't be aligned) into to, flipping them on the way, so a swapped
+ * array is produced in one pass instead of a memcpy() and a flip.
+ */
+void copyfliplongs(int n, const void *from, int *to)
+{
+  swap32((unsigned char *) to, (const unsigned char *) from, n);
+}
+
+void copyflipshorts(int n, const void *from, short *to)
+{
+  swap16((unsigned char *) to, (const unsigned char *) from, n);
+}
+
+void copyflipfloats(int n, const void *from, float *to)
+{
+  swap32((unsigned char *) to, (const unsigned char *) from, n);
 }
@@ -7,13 +7,22 @@
 #include <string.h>
 #include <errno.h>
 
+#include "lz4.h"
 #include "lz4frame.h"
+#include "xxhash.h"
+#include "dgthread.h"
 
 #define BUF_SIZE 512*1024
 #define LZ4_HEADER_SIZE 19
 #define LZ4_FOOTER_SIZE 4
 
-size_t compress_buffer_to_lz4_file(unsigned char *data, int src_size, FILE *out)
+/*
+ * compress_buffer_to_lz4_file_mode -- with independent set, write 1 MB
+ * blocks that don't refer back to earlier ones, so that
+ * decompress_lz4_buffer_parallel() can decode them all at once.
+ */
+size_t compress_buffer_to_lz4_file_mode(unsigned char *data, int src_size,
+					FILE *out, int independent)
 {
   LZ4F_errorCode_t r;
   LZ4F_compressionContext_t ctx;
@@ -33,6 +42,10 @@ size_t compress_buffer_to_lz4_file(unsigned char *data, int src_size, FILE *out)
 
   /* Add in source size so we can decompress into single memory block */
   lz4_preferences.frameInfo.contentSize = src_size;
+  if (independent) {
+    lz4_preferences.frameInfo.blockMode = LZ4F_blockIndependent;
+    lz4_preferences.frameInfo.blockSizeID = LZ4F_max1MB;
+  }
 
   frame_size = LZ4F_compressBound(BUF_SIZE, &lz4_preferences);
   size =  frame_size + LZ4_HEADER_SIZE + LZ4_FOOTER_SIZE;
@@ -90,6 +103,82 @@ size_t compress_buffer_to_lz4_file(unsigned char *data, int src_size, FILE *out)
   return r;
 }
 
+size_t compress_buffer_to_lz4_file(unsigned char *data, int src_size, FILE *out)
+{
+  return compress_buffer_to_lz4_file_mode(data, src_size, out, 0);
+}
+
+/*
+ * An LZ4 frame written a piece at a time, for streaming writes.  The
+ * total size often isn't known when the frame header goes out, in
+ * which case (content_size 0) the frame has no content size.
+ */
+typedef struct {
+  LZ4F_compressionContext_t ctx;
+  LZ4F_preferences_t prefs;
+  FILE  *out;
+  char  *buf;
+  size_t size;
+} LZ4_SINK;
+
+void *lz4_sink_open(FILE *out, int independent,
+		    unsigned long long content_size)
+{
+  LZ4_SINK *s;
+  size_t n;
+
+  if (!(s = (LZ4_SINK *) calloc(1, sizeof(LZ4_SINK)))) return NULL;
+  if (independent) {
+    s->prefs.frameInfo.blockMode = LZ4F_blockIndependent;
+    s->prefs.frameInfo.blockSizeID = LZ4F_max1MB;
+  }
+  s->prefs.frameInfo.contentSize = content_size;
+  s->out = out;
+  s->size = LZ4F_compressBound(BUF_SIZE, &s->prefs) +
+    LZ4_HEADER_SIZE + LZ4_FOOTER_SIZE;
+  if (LZ4F_isError(LZ4F_createCompressionContext(&s->ctx, LZ4F_VERSION)) ||
+      !(s->buf = malloc(s->size))) goto fail;
+  n = LZ4F_compressBegin(s->ctx, s->buf, s->size, &s->prefs);
+  if (LZ4F_isError(n) || fwrite(s->buf, 1, n, out) < n) goto fail;
+  return s;
+
+ fail:
+  if (s->ctx) LZ4F_freeCompressionContext(s->ctx);
+  free(s->buf);
+  free(s);
+  return NULL;
+}
+
+int lz4_sink_write(void *sink, unsigned char *data, size_t nbytes)
+{
+  LZ4_SINK *s = (LZ4_SINK *) sink;
+  size_t k, n;
+
+  while (nbytes) {
+    k = nbytes > BUF_SIZE ? BUF_SIZE : nbytes;
+    n = LZ4F_compressUpdate(s->ctx, s->buf, s->size, data, k, NULL);
+    if (LZ4F_isError(n) || fwrite(s->buf, 1, n, s->out) < n) return 0;
+    data += k;
+    nbytes -= k;
+  }
+  return 1;
+}
+
+/* lz4_sink_close -- end the frame and free s (but don't close the file) */
+int lz4_sink_close(void *sink)
+{
+  LZ4_SINK *s = (LZ4_SINK *) sink;
+  size_t n;
+  int status;
+
+  n = LZ4F_compressEnd(s->ctx, s->buf, s->size, NULL);
+  status = !LZ4F_isError(n) && fwrite(s->buf, 1, n, s->out) == n;
+  LZ4F_freeCompressionContext(s->ctx);
+  free(s->buf);
+  free(s);
+  return status;
+}
+
 static size_t get_block_size(const LZ4F_frameInfo_t* info)
 {
   switch (info->blockSizeID) {
@@ -103,7 +192,20 @@ static size_t get_block_size(const LZ4F_frameInfo_t* info)
   }
 }
 
-int decompress_lz4_file_to_buffer(FILE *in, int *size, unsigned char **data)
+/*
+ * decompress_lz4_file_progress -- as decompress_lz4_file_to_buffer(),
+ * calling progress(arg, dst, capacity, nbytes) once the output buffer
+ * has been allocated and again each time more of it has been filled,
+ * so another thread can start on it while the rest is decompressed.
+ * After the first call the buffer belongs to the caller, even if
+ * decompression goes on to fail.  Frames that don't record their
+ * content size are decompressed into a buffer grown as needed, and
+ * reported to progress only once they are complete.
+ */
+int decompress_lz4_file_progress(FILE *in, int *size, unsigned char **data,
+				 void (*progress)(void *, unsigned char *,
+						  size_t, size_t),
+				 void *arg)
 {
   unsigned char* const src = malloc(BUF_SIZE);
   unsigned char* dst = NULL, *cur_dst;
@@ -111,7 +213,7 @@ int decompress_lz4_file_to_buffer(FILE *in, int *size, unsigned char **data)
   size_t dstCapacity = 0;
   LZ4F_decompressionContext_t dctx;
   size_t ret, nbytes = 0;
-  int status = 0;
+  int status = 0, grow = 0;
 
   /* Initialization */
   if (!src) {
@@ -142,13 +244,14 @@ int decompress_lz4_file_to_buffer(FILE *in, int *size, unsigned char **data)
 	goto cleanup;
       }
 
-      /* for now, insiste content size was specified or bail */
-      if (!info.contentSize) goto cleanup;
-      dstCapacity = info.contentSize;
+      if (info.contentSize > 0x7fffffff) goto cleanup;
+      if (!(grow = !info.contentSize)) dstCapacity = info.contentSize;
+      else dstCapacity = 4*BUF_SIZE;
       nbytes = 0;
-      dst = malloc((int) dstCapacity);
+      dst = malloc(dstCapacity);
       if (!dst) { goto cleanup; }
       cur_dst = dst;
+      if (progress && !grow) progress(arg, dst, dstCapacity, 0);
       srcPtr += srcSize;
       srcSize = srcEnd - srcPtr;
     }
@@ -159,7 +262,16 @@ int decompress_lz4_file_to_buffer(FILE *in, int *size, unsigned char **data)
      */
     while (srcPtr != srcEnd && ret != 0) {
       /* INVARIANT: Any data left in dst has already been written */
-      size_t dstSize = dstCapacity-nbytes;
+      size_t dstSize;
+      if (grow && nbytes == dstCapacity) {
+	unsigned char *p;
+	if (dstCapacity >= 0x7fffffff) goto cleanup;
+	dstCapacity = dstCapacity > 0x3fffffff ? 0x7fffffff : 2*dstCapacity;
+	if (!(p = realloc(dst, dstCapacity))) goto cleanup;
+	dst = p;
+	cur_dst = dst + nbytes;
+      }
+      dstSize = dstCapacity-nbytes;
       ret = LZ4F_decompress(dctx, cur_dst, &dstSize, srcPtr, &srcSize,
 			    /* LZ4F_decompressOptions_t */ NULL);
 
@@ -168,6 +280,7 @@ int decompress_lz4_file_to_buffer(FILE *in, int *size, unsigned char **data)
       }
       nbytes+=dstSize;
       cur_dst+=dstSize;
+      if (progress && dstSize && !grow) progress(arg, dst, dstCapacity, nbytes);
 
       /* Update input */
       srcPtr += srcSize;
@@ -183,16 +296,159 @@ int decompress_lz4_file_to_buffer(FILE *in, int *size, unsigned char **data)
     goto cleanup;
   }
 
+  if (progress && grow) {
+    progress(arg, dst, nbytes, 0);
+    progress(arg, dst, nbytes, nbytes);
+  }
   if (data) *data = dst;
   if (size) *size = nbytes;
   status = 1;
   
  cleanup:
   free(src);
-  if (!data || (*data != dst)) free(dst);
+  if (progress ? (grow && !status) : (!data || *data != dst)) free(dst);
   LZ4F_freeDecompressionContext(dctx);   /* note : free works on NULL */
 
   return status;
 }
 
 
+
+int decompress_lz4_file_to_buffer(FILE *in, int *size, unsigned char **data)
+{
+  return decompress_lz4_file_progress(in, size, data, NULL, NULL);
+}
+
+/*
+ * Parallel decompression of frames written with independent blocks:
+ * every block but the last holds exactly one block size of output, so
+ * once the block headers have been walked each block's place in the
+ * output is known and they can be decoded on any number of threads.
+ */
+
+typedef struct {
+  unsigned char *src;
+  unsigned char *dst;
+  size_t         content_size;
+  size_t         block_size;
+  size_t        *blocks;	/* offset of each block's header in src */
+  int            nblocks;
+  int            checksum;	/* blocks are followed by a checksum    */
+  int            next;		/* next block to claim (atomic)         */
+  int            failed;
+} LZ4_BLOCK_JOB;
+
+static DG_THREAD_FUNC(lz4_block_worker, arg)
+{
+  LZ4_BLOCK_JOB *job = (LZ4_BLOCK_JOB *) arg;
+  unsigned char *src, *hdr;
+  size_t out, n;
+  unsigned int bsize, csize;
+  int i;
+
+  while ((i = dgAtomicIncrement(&job->next) - 1) < job->nblocks) {
+    hdr = job->src + job->blocks[i];
+    bsize = hdr[0] | (hdr[1] << 8) | (hdr[2] << 16) | ((unsigned int) hdr[3] << 24);
+    csize = bsize & 0x7fffffffU;
+    src = hdr + 4;
+    out = (size_t) i * job->block_size;
+    n = job->content_size - out;
+    if (n > job->block_size) n = job->block_size;
+
+    if (job->checksum) {
+      unsigned char *c = src + csize;
+      unsigned int sum = c[0] | (c[1] << 8) | (c[2] << 16) | ((unsigned int) c[3] << 24);
+      if (XXH32(src, csize, 0) != sum) { dgAtomicIncrement(&job->failed); continue; }
+    }
+    if (bsize & 0x80000000U) {		/* stored uncompressed */
+      if (csize != n) { dgAtomicIncrement(&job->failed); continue; }
+      memcpy(job->dst + out, src, n);
+    }
+    else if (LZ4_decompress_safe((const char *) src, (char *) job->dst + out,
+				 (int) csize, (int) n) != (int) n) {
+      dgAtomicIncrement(&job->failed);
+    }
+  }
+  DG_THREAD_RETURN;
+}
+
+/*
+ * decompress_lz4_buffer_parallel -- decompress the single LZ4 frame in
+ * src[srcSize] using up to nthreads threads.  Returns 1 on success, 0
+ * if the frame is corrupt, or -1 if it can't be done this way (linked
+ * blocks, no content size, more than one frame) and the caller should
+ * use decompress_lz4_file_to_buffer() instead.
+ */
+int decompress_lz4_buffer_parallel(unsigned char *src, size_t srcSize,
+				   int nthreads, int *size, unsigned char **data)
+{
+  LZ4F_decompressionContext_t dctx;
+  LZ4F_frameInfo_t info;
+  LZ4_BLOCK_JOB job;
+  DG_THREAD *threads = NULL;
+  size_t ret, pos, hsize = srcSize, nblocks;
+  unsigned int bsize;
+  int i, nstarted = 0, status = -1;
+
+  ret = LZ4F_createDecompressionContext(&dctx, LZ4F_VERSION);
+  if (LZ4F_isError(ret)) return -1;
+  ret = LZ4F_getFrameInfo(dctx, &info, src, &hsize);
+  LZ4F_freeDecompressionContext(dctx);
+  if (LZ4F_isError(ret) || info.blockMode != LZ4F_blockIndependent ||
+      !info.contentSize || info.contentSize > 0x7fffffff ||
+      !get_block_size(&info)) return -1;
+
+  memset(&job, 0, sizeof(job));
+  job.src = src;
+  job.content_size = (size_t) info.contentSize;
+  job.block_size = get_block_size(&info);
+  job.checksum = info.blockChecksumFlag;
+  nblocks = (job.content_size + job.block_size - 1) / job.block_size;
+  if (!(job.blocks = (size_t *) malloc(nblocks * sizeof(size_t)))) return -1;
+
+  /* walk the block headers, up to the end mark */
+  for (pos = hsize; ; ) {
+    if (pos + 4 > srcSize) goto cleanup;
+    bsize = src[pos] | (src[pos+1] << 8) | (src[pos+2] << 16) |
+      ((unsigned int) src[pos+3] << 24);
+    if (!bsize) break;
+    if ((size_t) job.nblocks == nblocks) goto cleanup;
+    job.blocks[job.nblocks++] = pos;
+    pos += 4 + (bsize & 0x7fffffffU) + (job.checksum ? 4 : 0);
+  }
+  pos += 4 + (info.contentChecksumFlag ? 4 : 0);
+  if ((size_t) job.nblocks != nblocks || pos != srcSize) goto cleanup;
+
+  if (!(job.dst = malloc(job.content_size))) goto cleanup;
+
+  if (nthreads > job.nblocks) nthreads = job.nblocks;
+  if (nthreads > 1 &&
+      (threads = (DG_THREAD *) calloc(nthreads, sizeof(DG_THREAD)))) {
+    for (i = 1; i < nthreads; i++) {
+      if (!dgThreadCreate(&threads[nstarted], lz4_block_worker, &job)) break;
+      nstarted++;
+    }
+  }
+  lz4_block_worker(&job);
+  for (i = 0; i < nstarted; i++) dgThreadJoin(threads[i]);
+  free(threads);
+
+  if (!job.failed && info.contentChecksumFlag) {
+    unsigned char *c = src + srcSize - 4;
+    unsigned int sum = c[0] | (c[1] << 8) | (c[2] << 16) | ((unsigned int) c[3] << 24);
+    if (XXH32(job.dst, job.content_size, 0) != sum) job.failed = 1;
+  }
+  if (job.failed) {
+    free(job.dst);
+    status = 0;
+    goto cleanup;
+  }
+
+  *data = job.dst;
+  *size = (int) job.content_size;
+  status = 1;
+
+ cleanup:
+  free(job.blocks);
+  return status;
+}
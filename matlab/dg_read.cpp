@@ -9,12 +9,15 @@
  * Usage: data = dg_read('filename.dg')
  *        data = dg_read('filename.dgz')
  *        data = dg_read('filename.lz4')
+ *        data = dg_read('filename.dgz', 'columns', {'stimtype','rt'})
+ *        data = dg_read('filename.dgz', 'trials', [first last])
  *
  *=================================================================*/
 
 #include "mex.hpp"
 #include "mexAdapter.hpp"
 
+#include <cmath>
 #include <cstring>
 #include <string>
 #include <vector>
@@ -36,8 +39,10 @@ using namespace matlab::data;
 using matlab::mex::ArgumentList;
 
 /*
- * gzip (.dgz) reads are decompressed fully in memory by
- * dguGzipFileToStruct() (core/dynio.c) -- no temp file.
+ * gzip (.dgz) reads go through dgReaderGzipFileToStruct() (core/dynio.c),
+ * which decompresses in memory -- no temp file -- and, as the reader
+ * borrows, leaves numeric lists pointing straight into the inflated
+ * buffer.
  */
 
 /*
@@ -78,13 +83,13 @@ private:
         switch (DYN_LIST_DATATYPE(dl)) {
         case DF_LIST:
             {
-                // Create cell array for nested lists
-                DYN_LIST **sublists = reinterpret_cast<DYN_LIST **>(DYN_LIST_VALS(dl));
+                // Create cell array for nested lists (lazy and
+                // flattened sublists are made as they're asked for)
                 std::vector<Array> cells;
                 cells.reserve(n);
                 
                 for (int i = 0; i < n; i++) {
-                    cells.push_back(dynListToArray(sublists[i]));
+                    cells.push_back(dynListToArray(dfuGetDynListList(dl, i)));
                 }
                 
                 // Create n x 1 cell array
@@ -170,6 +175,65 @@ private:
         return (fileExt == ext);
     }
 
+    /*
+     * Get list names from a char vector, a cell array of char vectors,
+     * or a string array
+     */
+    std::vector<std::string> getColumnNames(const Array& arg) {
+        std::vector<std::string> names;
+
+        switch (arg.getType()) {
+        case ArrayType::CHAR:
+            names.push_back(CharArray(arg).toAscii());
+            break;
+        case ArrayType::CELL:
+            {
+                CellArray cells(arg);
+                for (size_t i = 0; i < cells.getNumberOfElements(); i++) {
+                    Array cell = cells[i];
+                    if (cell.getType() != ArrayType::CHAR) {
+                        throwError("columns must be a cell array of names.");
+                    }
+                    names.push_back(CharArray(cell).toAscii());
+                }
+            }
+            break;
+        case ArrayType::MATLAB_STRING:
+            {
+                StringArray strings(arg);
+                for (size_t i = 0; i < strings.getNumberOfElements(); i++) {
+                    MATLABString str = strings[i];
+                    if (!str) continue;
+                    std::u16string u = *str;
+                    names.push_back(std::string(u.begin(), u.end()));
+                }
+            }
+            break;
+        default:
+            throwError("columns must be a cell array of names.");
+        }
+        return names;
+    }
+
+    /*
+     * Get a 1-based, inclusive [first last] trial range (last may be
+     * Inf) as the core's 0-based [start, stop)
+     */
+    void getTrialRange(const Array& arg, int& start, int& stop) {
+        if (arg.getType() != ArrayType::DOUBLE ||
+            arg.getNumberOfElements() != 2) {
+            throwError("trials must be [first last].");
+        }
+        TypedArray<double> range(arg);
+        std::vector<double> v(range.begin(), range.end());
+        if (!(v[0] >= 1) || !(v[1] >= v[0] - 1)) {
+            throwError("trials must be [first last] with 1 <= first <= last+1.");
+        }
+        start = v[0] - 1 >= DG_READ_END ? DG_READ_END :
+            static_cast<int>(v[0] - 1);
+        stop = v[1] >= DG_READ_END ? DG_READ_END : static_cast<int>(v[1]);
+    }
+
 public:
     MexFunction() {
         matlabPtr = getEngine();
@@ -177,8 +241,10 @@ public:
 
     void operator()(ArgumentList outputs, ArgumentList inputs) {
         // Validate arguments
-        if (inputs.size() != 1) {
-            throwError("usage: dg_read('filename')");
+        const std::string usage = "usage: dg_read('filename' "
+            "[, 'columns', names] [, 'trials', [first last]])";
+        if (inputs.size() % 2 != 1) {
+            throwError(usage);
         }
         if (outputs.size() > 1) {
             throwError("Too many output arguments.");
@@ -190,6 +256,48 @@ public:
         // Get filename
         CharArray filenameArray = inputs[0];
         std::string filename = filenameArray.toAscii();
+
+        // Optional 'columns' selects which lists to load; the rest are
+        // skipped in the file without being converted.  Optional 'trials'
+        // keeps only that range of every list.
+        std::vector<std::string> columnNames;
+        std::vector<const char*> columns;
+        bool haveRange = false;
+        int start = 0, stop = DG_READ_END;
+        for (size_t i = 1; i < inputs.size(); i += 2) {
+            if (inputs[i].getType() != ArrayType::CHAR) {
+                throwError(usage);
+            }
+            std::string option = CharArray(inputs[i]).toAscii();
+            if (option == "columns") {
+                columnNames = getColumnNames(inputs[i+1]);
+                if (columnNames.empty()) {
+                    outputs[0] = factory.createStructArray({1, 1},
+                        std::vector<std::string>());
+                    return;
+                }
+            }
+            else if (option == "trials") {
+                getTrialRange(inputs[i+1], start, stop);
+                haveRange = true;
+            }
+            else {
+                throwError(usage);
+            }
+        }
+        for (const auto& name : columnNames) {
+            columns.push_back(name.c_str());
+        }
+
+        DG_READER reader;
+        dgInitReader(&reader);
+        DG_READER_FLAGS(&reader) |= DG_READ_BORROW | DG_READ_POOL;
+        dgReaderSetColumns(&reader, columns.data(),
+                           static_cast<int>(columns.size()));
+        dgReaderSetThreads(&reader, 0); // large files decode on all cores
+        if (haveRange) {
+            dgReaderSetRange(&reader, start, stop);
+        }
         
         DYN_GROUP *dg = nullptr;
         FILE *fp = nullptr;
@@ -202,6 +310,7 @@ public:
             // Plain .dg file - no decompression needed
             fp = fopen(filename.c_str(), "rb");
             if (!fp) {
+                dgFreeReader(&reader);
                 throwError("Error opening data file \"" + filename + "\".");
             }
         }
@@ -209,12 +318,14 @@ public:
             // LZ4 compressed file - use direct reader
             dg = dfuCreateDynGroup(4);
             if (!dg) {
+                dgFreeReader(&reader);
                 throwError("dg_read: error creating new dyngroup");
             }
-            if (dgReadDynGroup(const_cast<char*>(filename.c_str()), dg) == DF_OK) {
+            if (dgReaderReadDynGroup(&reader, const_cast<char*>(filename.c_str()), dg) == DF_OK) {
                 dgLoaded = true;
             } else {
                 dfuFreeDynGroup(dg);
+                dgFreeReader(&reader);
                 throwError("dg_read: file " + filename + " not recognized as lz4/dg format");
             }
         }
@@ -222,19 +333,21 @@ public:
             // gzip-compressed (.dgz etc.): decompress fully in memory, no temp file.
             dg = dfuCreateDynGroup(4);
             if (!dg) {
+                dgFreeReader(&reader);
                 throwError("dg_read: error creating new dyngroup");
             }
-            int gstat = dguGzipFileToStruct(const_cast<char*>(filename.c_str()), dg);
+            int gstat = dgReaderGzipFileToStruct(&reader, const_cast<char*>(filename.c_str()), dg);
             if (gstat != DF_OK) {
                 std::string tryname = filename + ".dg";
-                gstat = dguGzipFileToStruct(const_cast<char*>(tryname.c_str()), dg);
+                gstat = dgReaderGzipFileToStruct(&reader, const_cast<char*>(tryname.c_str()), dg);
             }
             if (gstat != DF_OK) {
                 std::string tryname = filename + ".dgz";
-                gstat = dguGzipFileToStruct(const_cast<char*>(tryname.c_str()), dg);
+                gstat = dgReaderGzipFileToStruct(&reader, const_cast<char*>(tryname.c_str()), dg);
             }
             if (gstat != DF_OK) {
                 dfuFreeDynGroup(dg);
+                dgFreeReader(&reader);
                 throwError("dg_read: file " + filename + " not found");
             }
             dgLoaded = true;
@@ -246,19 +359,23 @@ public:
             if (!dg) {
                 fclose(fp);
                 if (needCleanup) unlink(tempname);
+                dgFreeReader(&reader);
                 throwError("Error creating dyn group.");
             }
 
-            if (!dguFileToStruct(fp, dg)) {
+            if (!dgReaderMapFileToStruct(&reader, fp, dg)) {
                 dfuFreeDynGroup(dg);
                 fclose(fp);
                 if (needCleanup) unlink(tempname);
+                dgFreeReader(&reader);
                 throwError("dg_read: file " + filename + " not recognized as dg format");
             }
             fclose(fp);
             if (needCleanup) unlink(tempname);
         }
 
+        dgFreeReader(&reader);
+
         // Convert DYN_GROUP to MATLAB struct
         int nLists = DYN_GROUP_NLISTS(dg);
         
@@ -32,8 +32,10 @@
 #endif
 
 
-/* gzip (.dgz) reads are decompressed fully in memory by
- * dguGzipFileToStruct() (core/dynio.c) -- no temp file. */
+/* gzip (.dgz) reads go through dgReaderGzipFileToStruct() (core/dynio.c),
+ * which decompresses in memory -- no temp file -- and, as the reader
+ * borrows, leaves numeric lists pointing straight into the inflated
+ * buffer. */
 
 
 static
@@ -43,7 +45,7 @@ dynListToPyObject(DYN_LIST *dl) /* Create a list from a group of dl's */
   int length;
   int i;
   npy_intp dims[1];
-  DYN_LIST **sublists;
+  DYN_LIST *sublist;
   PyObject *retval = NULL, *cell;
   length = DYN_LIST_N(dl);
 
@@ -51,9 +53,13 @@ dynListToPyObject(DYN_LIST *dl) /* Create a list from a group of dl's */
   case DF_LIST:
     {
       retval=PyList_New(length);
-      sublists = (DYN_LIST **) DYN_LIST_VALS(dl);
       for (i = 0; i < DYN_LIST_N(dl); i++) {
-	cell = dynListToPyObject(sublists[i]);
+	/* lazy and flattened (DL_LAZY, DL_CSR) sublists are made here */
+	if (!(sublist = dfuGetDynListList(dl, i))) {
+	  Py_INCREF(Py_None);
+	  cell = Py_None;
+	}
+	else cell = dynListToPyObject(sublist);
 	PyList_SetItem(retval, i, cell);
       }
       return retval;
@@ -113,17 +119,20 @@ dynListToPyObject(DYN_LIST *dl) /* Create a list from a group of dl's */
   return retval;
 }
 
+/*
+ * r holds the read options (columns, range, ...) set up by the caller
+ */
 PyObject *
-dynGroupFileToPyObject(char *filename)
+dynGroupFileToPyObject(char *filename, DG_READER *r)
 {
-  int i;
+  int i, status;
   DYN_GROUP *dg;
   FILE *fp;
   char *suffix;
   char tempname[128];
   PyObject *pygroup;
   char message[256];
-  
+
   /* No need to uncompress a .dg file */
   if ((suffix = strrchr(filename, '.')) && strstr(suffix, "dg") &&
       !strstr(suffix, "dgz")) {
@@ -146,10 +155,15 @@ dynGroupFileToPyObject(char *filename)
       PyErr_SetString(PyExc_ValueError, message);
       return NULL;
     }
-    if (dgReadDynGroup(filename, dg) == DF_OK) {
+    /* The core reader is reentrant, so let other threads run meanwhile */
+    Py_BEGIN_ALLOW_THREADS
+    status = dgReaderReadDynGroup(r, filename, dg);
+    Py_END_ALLOW_THREADS
+    if (status == DF_OK) {
       goto process_dg;
     }
     else {
+      dfuFreeDynGroup(dg);
       sprintf(message, "dg_read: file %s not recognized as lz4/dg format", 
 	      filename);
       PyErr_SetString(PyExc_ValueError, message);
@@ -167,15 +181,17 @@ dynGroupFileToPyObject(char *filename)
       PyErr_SetString(PyExc_ValueError, "dg_read: error creating new dyngroup");
       return NULL;
     }
-    gstat = dguGzipFileToStruct(filename, dg);
+    Py_BEGIN_ALLOW_THREADS
+    gstat = dgReaderGzipFileToStruct(r, filename, dg);
     if (gstat != DF_OK) {
       snprintf(fullname, sizeof(fullname), "%s.dg", filename);
-      gstat = dguGzipFileToStruct(fullname, dg);
+      gstat = dgReaderGzipFileToStruct(r, fullname, dg);
     }
     if (gstat != DF_OK) {
       snprintf(fullname, sizeof(fullname), "%s.dgz", filename);
-      gstat = dguGzipFileToStruct(fullname, dg);
+      gstat = dgReaderGzipFileToStruct(r, fullname, dg);
     }
+    Py_END_ALLOW_THREADS
     if (gstat != DF_OK) {
       dfuFreeDynGroup(dg);
       PyErr_SetString(PyExc_ValueError, "dyngroup not found");
@@ -185,9 +201,17 @@ dynGroupFileToPyObject(char *filename)
   }
 
   /* Only the raw uncompressed .dg branch reaches here (fp set above). */
-  dg = dfuCreateDynGroup(4);
+  if (!(dg = dfuCreateDynGroup(4))) {
+    fclose(fp);
+    PyErr_SetString(PyExc_ValueError, "dg_read: error creating new dyngroup");
+    return NULL;
+  }
 
-  if (!dguFileToStruct(fp, dg)) {
+  Py_BEGIN_ALLOW_THREADS
+  status = dgReaderMapFileToStruct(r, fp, dg);
+  Py_END_ALLOW_THREADS
+  if (!status) {
+    dfuFreeDynGroup(dg);
     fclose(fp);
     if (tempname[0]) unlink(tempname);
     PyErr_SetString(PyExc_ValueError,
@@ -271,14 +295,179 @@ PyObjectToDynGroupFile(PyObject *pydg)
 #endif
 
 
+/*
+ * rangeArg -- convert an optional start/stop argument; None gives dflt
+ */
+static int
+rangeArg(PyObject *o, int dflt, int *val)
+{
+  long v;
+
+  if (o == Py_None) {
+    *val = dflt;
+    return 1;
+  }
+  v = PyLong_AsLong(o);
+  if (v == -1 && PyErr_Occurred()) return 0;
+  if (v > DG_READ_END) v = DG_READ_END;
+  if (v < -DG_READ_END) v = -DG_READ_END;
+  *val = (int) v;
+  return 1;
+}
+
+/*
+ * dgread.dgread(filename, columns=None, start=None, stop=None) --
+ * columns is an optional sequence of list names to load (all others are
+ * skipped).  start/stop select elements [start:stop] of every list, as
+ * for a Python slice, e.g. start=-50 for the last 50 trials.
+ */
+static PyObject *
+dgread_dgread(PyObject *self, PyObject *args, PyObject *kwds)
+{
+  static char *kwlist[] = { "filename", "columns", "start", "stop", NULL };
+  char *filename;
+  PyObject *pycolumns = Py_None, *pystart = Py_None, *pystop = Py_None;
+  PyObject *seq = NULL, *retval;
+  const char **columns = NULL;
+  Py_ssize_t i, ncolumns = 0;
+  int start, stop;
+  DG_READER r;
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "s|OOO", kwlist,
+				   &filename, &pycolumns, &pystart, &pystop))
+    return NULL;
+
+  if (!rangeArg(pystart, 0, &start) || !rangeArg(pystop, DG_READ_END, &stop))
+    return NULL;
+
+  if (pycolumns != Py_None) {
+    if (PyUnicode_Check(pycolumns)) {
+      PyErr_SetString(PyExc_TypeError,
+		      "columns must be a sequence of names, not a string");
+      return NULL;
+    }
+    /*
+     * A tuple of our own, so the names (and the UTF-8 they point to)
+     * stay put while the read runs without the GIL, whatever other
+     * threads do to the caller's sequence.
+     */
+    if (!(seq = PySequence_Tuple(pycolumns)))
+      return NULL;
+
+    ncolumns = PyTuple_GET_SIZE(seq);
+
+    /* An empty sequence loads nothing, rather than everything */
+    if (!ncolumns) {
+      Py_DECREF(seq);
+      return PyDict_New();
+    }
+
+    if (!(columns = (const char **) calloc(ncolumns, sizeof(char *)))) {
+      Py_DECREF(seq);
+      return PyErr_NoMemory();
+    }
+    for (i = 0; i < ncolumns; i++) {
+      if (!(columns[i] =
+	    PyUnicode_AsUTF8(PyTuple_GET_ITEM(seq, i)))) {
+	free(columns);
+	Py_DECREF(seq);
+	return NULL;
+      }
+    }
+  }
+
+  dgInitReader(&r);
+  DG_READER_FLAGS(&r) |= DG_READ_BORROW | DG_READ_POOL;
+  dgReaderSetColumns(&r, columns, ncolumns);
+  dgReaderSetThreads(&r, 0);	/* large files decode on all cores */
+  if (pystart != Py_None || pystop != Py_None)
+    dgReaderSetRange(&r, start, stop);
+
+  retval = (PyObject*) dynGroupFileToPyObject(filename, &r);
+
+  dgFreeReader(&r);
+  if (columns) free(columns);
+  Py_XDECREF(seq);
+  return retval;
+}
+
+static char *
+tocTypeName(int datatype)
+{
+  switch (datatype) {
+  case DF_LONG:   return "long";
+  case DF_SHORT:  return "short";
+  case DF_FLOAT:  return "float";
+  case DF_CHAR:   return "char";
+  case DF_STRING: return "string";
+  case DF_LIST:   return "list";
+  default:        return "void";
+  }
+}
+
+/*
+ * dgread.toc(filename) -- list names, types and lengths from a tag scan
+ * (dgScanTocFile), without converting any of the data.
+ */
 static PyObject *
-dgread_dgread(PyObject *self, PyObject *args)
+dgread_toc(PyObject *self, PyObject *args)
 {
   char *filename;
+  int i;
+  DG_TOC *toc;
+  DG_TOC_ENTRY *e;
+  PyObject *retval;
+
   if (!PyArg_ParseTuple(args, "s", &filename))
     return NULL;
 
-  return (PyObject*) dynGroupFileToPyObject(filename);
+  Py_BEGIN_ALLOW_THREADS
+  toc = dgScanTocFile(filename);
+  Py_END_ALLOW_THREADS
+
+  if (!toc) {
+    PyErr_SetString(PyExc_ValueError, "dyngroup not found or invalid");
+    return NULL;
+  }
+
+  retval = PyList_New(DG_TOC_N(toc));
+  for (i = 0; i < DG_TOC_N(toc); i++) {
+    e = DG_TOC_ENTRY(toc, i);
+    PyList_SetItem(retval, i,
+		   Py_BuildValue("{s:s,s:s,s:i,s:i,s:i}",
+				 "name", DG_TOC_ENTRY_NAME(e),
+				 "type", tocTypeName(DG_TOC_ENTRY_DATATYPE(e)),
+				 "length", DG_TOC_ENTRY_N(e),
+				 "depth", DG_TOC_ENTRY_DEPTH(e),
+				 "offset", DG_TOC_ENTRY_OFFSET(e)));
+  }
+  dgFreeToc(toc);
+  return retval;
+}
+
+/*
+ * dgread.index(filename, span=0) -- write the random-access sidecar
+ * (filename.dgi) for a .dgz file, so that later dgread() calls asking
+ * for only some columns inflate just those lists (dgIndexGzFile).
+ */
+static PyObject *
+dgread_index(PyObject *self, PyObject *args)
+{
+  char *filename;
+  int span = 0, status;
+
+  if (!PyArg_ParseTuple(args, "s|i", &filename, &span))
+    return NULL;
+
+  Py_BEGIN_ALLOW_THREADS
+  status = dgIndexGzFile(filename, span);
+  Py_END_ALLOW_THREADS
+
+  if (!status) {
+    PyErr_SetString(PyExc_IOError, "unable to index gzip file");
+    return NULL;
+  }
+  Py_RETURN_NONE;
 }
 
 static PyObject *
@@ -319,7 +508,7 @@ static int base64decode (char *in, unsigned int inLen, unsigned char *out, unsig
   
   while (in < end) {
     unsigned char c = d[*in++];
-    
+
     switch (c) {
     case B64_WHITESPACE: continue;   /* skip whitespace */
     case B64_INVALID:    return 1;   /* invalid input, return error */
@@ -378,7 +567,9 @@ dgread_fromString64(PyObject *self, PyObject *args)
 static PyMethodDef
 DgreadMethods[] =
   {
-    { "dgread", dgread_dgread, METH_VARARGS },
+    { "dgread", (PyCFunction) dgread_dgread, METH_VARARGS | METH_KEYWORDS },
+    { "toc", dgread_toc, METH_VARARGS },
+    { "index", dgread_index, METH_VARARGS },
     { "fromString", dgread_fromString, METH_VARARGS },
     { "fromString64", dgread_fromString64, METH_VARARGS },
     { NULL, NULL },
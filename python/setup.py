@@ -79,6 +79,8 @@ else:
     # zlib only includes when Z_HAVE_UNISTD_H is set (normally by zlib's
     # ./configure). We vendor the unconfigured zconf.h, so define it here.
     define_macros.append(('Z_HAVE_UNISTD_H', '1'))
+    # The core decodes large files on several threads.
+    libraries.append('pthread')
 
 dgread_ext = Extension(
     'dgread',
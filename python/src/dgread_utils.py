@@ -27,7 +27,12 @@ except ImportError:
 import numpy as np
 
 
-def read(filename: Union[str, Path]) -> Dict[str, np.ndarray]:
+def read(
+    filename: Union[str, Path],
+    columns: Optional[List[str]] = None,
+    start: Optional[int] = None,
+    stop: Optional[int] = None,
+) -> Dict[str, np.ndarray]:
     """
     Read a dg/dgz file and return a dictionary of arrays.
     
@@ -38,6 +43,16 @@ def read(filename: Union[str, Path]) -> Dict[str, np.ndarray]:
     ----------
     filename : str or Path
         Path to the dg or dgz file.
+    columns : list, optional
+        Names of the lists to load.  All other lists are skipped over
+        in the file without being converted, which is much faster when
+        only a few of many lists are needed.  Names not in the file
+        are ignored.
+    start, stop : int, optional
+        Only keep elements ``[start:stop]`` of every list (e.g. a range
+        of trials), with the usual slice meaning of negative values and
+        None.  Nested lists outside the range are skipped without being
+        converted, and all lists are sliced alike so rows stay aligned.
         
     Returns
     -------
@@ -52,13 +67,17 @@ def read(filename: Union[str, Path]) -> Dict[str, np.ndarray]:
     dict_keys(['stimtype', 'response', 'rt', 'em', 'events'])
     >>> print(data['rt'][:5])
     [342, 289, 456, 312, 378]
+    >>> data = read('session.dgz', columns=['stimtype', 'rt'])
+    >>> last50 = read('session.dgz', start=-50)
     """
     filename = str(filename)
     
     if not Path(filename).exists():
         raise FileNotFoundError(f"File not found: {filename}")
     
-    return dgread.dgread(filename)
+    if columns is not None:
+        columns = list(columns)
+    return dgread.dgread(filename, columns=columns, start=start, stop=stop)
 
 
 def list_names(filename: Union[str, Path]) -> List[str]:
@@ -75,8 +94,47 @@ def list_names(filename: Union[str, Path]) -> List[str]:
     list
         List of column/list names in the file.
     """
-    data = read(filename)
-    return list(data.keys())
+    return [entry['name'] for entry in toc(filename)]
+
+
+def toc(filename: Union[str, Path]) -> List[Dict[str, Any]]:
+    """
+    Get the table of contents of a dg/dgz file without loading its data.
+    
+    Only the tag stream is scanned; list data is skipped over, not
+    converted.
+    
+    Parameters
+    ----------
+    filename : str or Path
+        Path to the dg, dgz or lz4 file.
+        
+    Returns
+    -------
+    list
+        One dict per list, in file order, with keys 'name', 'type'
+        ('long', 'short', 'float', 'char', 'string' or 'list'),
+        'length', 'depth' (levels of nested sublists) and 'offset'
+        (byte offset in the uncompressed stream).
+    """
+    filename = str(filename)
+    
+    if not Path(filename).exists():
+        raise FileNotFoundError(f"File not found: {filename}")
+    
+    return dgread.toc(filename)
+
+
+# numpy dtype that dgread.dgread() returns for each toc() type
+_TOC_DTYPES = {
+    'long': 'int32',
+    'short': 'int16',
+    'float': 'float32',
+    'char': 'int8',
+    'string': 'object',
+    'list': 'object',
+    'void': 'object',
+}
 
 
 def get_lengths(data: Dict[str, np.ndarray]) -> Dict[str, int]:
@@ -165,6 +223,8 @@ def to_dataframe(
     data: Dict[str, np.ndarray],
     columns: Optional[List[str]] = None,
     include_nested: bool = False,
+    start: Optional[int] = None,
+    stop: Optional[int] = None,
 ) -> "pd.DataFrame":
     """
     Convert dg data to a pandas DataFrame.
@@ -181,6 +241,11 @@ def to_dataframe(
         with the same length as the longest list.
     include_nested : bool, default False
         If True, include nested columns as object dtype.
+    start, stop : int, optional
+        Only keep rows ``[start:stop]`` of the selected columns, with the
+        usual slice meaning of negative values and None.  The data is
+        already in memory; pass start and stop to read() (or use
+        load_session()) to avoid converting the other trials at all.
         
     Returns
     -------
@@ -224,10 +289,11 @@ def to_dataframe(
     max_len = max(lengths.values())
     
     # Build DataFrame with columns that have the right length
+    rows = slice(start, stop)
     df_data = {}
     for name in columns:
         if name in data and len(data[name]) == max_len:
-            df_data[name] = data[name]
+            df_data[name] = data[name][rows]
     
     return pd.DataFrame(df_data)
 
@@ -236,6 +302,8 @@ def load_session(
     filename: Union[str, Path],
     columns: Optional[List[str]] = None,
     include_nested: bool = False,
+    start: Optional[int] = None,
+    stop: Optional[int] = None,
 ) -> "pd.DataFrame":
     """
     Load a dg/dgz file directly into a pandas DataFrame.
@@ -247,9 +315,11 @@ def load_session(
     filename : str or Path
         Path to the dg or dgz file.
     columns : list, optional
-        Specific columns to include.
+        Specific columns to include.  Only these are read from the file.
     include_nested : bool, default False
         If True, include nested columns as object dtype.
+    start, stop : int, optional
+        Only load trials ``[start:stop]`` (see read()).
         
     Returns
     -------
@@ -262,7 +332,7 @@ def load_session(
     >>> print(f"Loaded {len(df)} trials")
     Loaded 847 trials
     """
-    data = read(filename)
+    data = read(filename, columns=columns, start=start, stop=stop)
     return to_dataframe(data, columns=columns, include_nested=include_nested)
 
 
@@ -296,26 +366,25 @@ def summary(filename: Union[str, Path]) -> Dict[str, Any]:
     }
     """
     filename = Path(filename)
-    data = read(filename)
+    entries = toc(filename)
     
     lists_info = {}
     max_len = 0
     
-    for name, arr in data.items():
-        is_nested = arr.dtype == object and len(arr) > 0 and isinstance(arr[0], np.ndarray)
-        lists_info[name] = {
-            'length': len(arr),
-            'dtype': str(arr.dtype),
-            'nested': is_nested,
+    for entry in entries:
+        lists_info[entry['name']] = {
+            'length': entry['length'],
+            'dtype': _TOC_DTYPES[entry['type']],
+            'nested': entry['type'] == 'list' and entry['length'] > 0,
         }
-        if len(arr) > max_len:
-            max_len = len(arr)
+        if entry['length'] > max_len:
+            max_len = entry['length']
     
     return {
         'filename': filename.name,
-        'n_lists': len(data),
+        'n_lists': len(entries),
         'n_trials': max_len,
-        'rectangular': is_rectangular(data),
+        'rectangular': len({e['length'] for e in entries}) <= 1,
         'lists': lists_info,
     }
 
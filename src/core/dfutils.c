@@ -16,6 +16,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <limits.h>
 
 #if defined(SUN4) || defined(LYNX)
 #include <unistd.h>
@@ -23,8 +24,10 @@
 
 #include "utilc.h"
 #include "df.h"
+#include "dgthread.h"
 
 static int dfFlipEvents = 0;	/* to make up for byte ordering probs */
+static int dfGeometricGrowth = 0; /* double every list when it fills  */
 
 /*--------------------------------------------------------------------
   -----               Magic Number Functions                     -----
@@ -1127,9 +1130,8 @@ int vget_shorts(int *n, int *nv, short **v)
       fprintf(stderr,"dfutils: error allocating space for short array\n");
       exit(-1);
     }
-    memcpy(vals, vl, sizeof(short)*nvals);
-
-    if (dfFlipEvents) flipshorts(nvals, vals);
+    if (dfFlipEvents) copyflipshorts(nvals, vl, vals);
+    else memcpy(vals, vl, sizeof(short)*nvals);
   }
 
   *nv = nvals;
@@ -1154,11 +1156,10 @@ int vget_longs(int *n, int *nv, int **v)
       fprintf(stderr,"dfutils: error allocating space for int array\n");
       exit(-1);
     }
-    memcpy(vals, vl, sizeof(int)*nvals);
+    if (dfFlipEvents) copyfliplongs(nvals, vl, vals);
+    else memcpy(vals, vl, sizeof(int)*nvals);
   }
 
-  if (dfFlipEvents) fliplongs(nvals, vals);
-
   *nv = nvals;
   *v  = vals;
 
@@ -1181,9 +1182,8 @@ int vget_floats(int *n, int *nv, float **v)
       fprintf(stderr,"dfutils: error allocating space for float array\n");
       exit(-1);
     }
-    memcpy(vals, vl, sizeof(float)*nvals);
-    
-    if (dfFlipEvents) flipfloats(nvals, vals);
+    if (dfFlipEvents) copyflipfloats(nvals, vl, vals);
+    else memcpy(vals, vl, sizeof(float)*nvals);
   }
   
   *nv = nvals;
@@ -3007,6 +3007,13 @@ DYN_LIST *dfuCopyDynList(DYN_LIST *old)
 
   memcpy(new, old, sizeof(DYN_LIST));
 
+  /* the copy always owns its data, even if old was borrowed */
+  DYN_LIST_FLAGS(new) &= ~(DL_BORROWED | DL_LAZY | DL_CSR | DL_POOLED);
+  DYN_LIST_OWNER(new) = NULL;
+  DYN_LIST_LAZY(new) = NULL;
+  DYN_LIST_CSR(new) = NULL;
+  DYN_LIST_POOL(new) = NULL;
+
   /* 
    * This is a strange situation, but something that we take care of
    *  by making sure that the copy actually allocates some space
@@ -3053,20 +3060,30 @@ DYN_LIST *dfuCopyDynList(DYN_LIST *old)
       vals = DYN_LIST_VALS(new) = 
 	(char **)calloc(n, sizeof(char *));
       oldvals = (char **) DYN_LIST_VALS(old);
+
+      /* a pooled list is copied into a single block of a new pool */
+      if (DYN_LIST_FLAGS(old) & DL_POOLED) {
+	int size = 0;
+	for (i = 0; i < DYN_LIST_N(old); i++) size += strlen(oldvals[i])+1;
+	if ((DYN_LIST_POOL(new) = dfuCreateDynPool(NULL, size)))
+	  DYN_LIST_FLAGS(new) |= DL_POOLED;
+      }
       for (i = 0; i < DYN_LIST_N(old); i++) {
-	vals[i] = (char *) calloc(strlen(oldvals[i])+1, sizeof(char));
+	if (DYN_LIST_FLAGS(new) & DL_POOLED)
+	  vals[i] = dfuPoolAlloc(DYN_LIST_POOL(new), strlen(oldvals[i])+1);
+	else
+	  vals[i] = (char *) calloc(strlen(oldvals[i])+1, sizeof(char));
 	strcpy(vals[i], oldvals[i]);
       }
     }
     break;
   case DF_LIST:
     {
-      DYN_LIST **vals, **oldvals;
+      DYN_LIST **vals;
       vals = DYN_LIST_VALS(new) = 
 	(DYN_LIST **)calloc(n, sizeof(DYN_LIST *));
-      oldvals = (DYN_LIST **) DYN_LIST_VALS(old);
       for (i = 0; i < DYN_LIST_N(old); i++) {
-	vals[i] = dfuCopyDynList(oldvals[i]);
+	vals[i] = dfuCopyDynList(dfuGetDynListList(old, i));
       }
     }
     break;
@@ -3076,6 +3093,328 @@ DYN_LIST *dfuCopyDynList(DYN_LIST *old)
 }
 
 
+/***********************************************************************
+ *
+ * dfuDetachDynList()
+ *
+ *    Give a borrowed list (DL_BORROWED) its own copy of its data and
+ *  drop its reference to the owning buffer, or fill in all of the
+ *  sublists of a lazy or flattened one (DL_LAZY, DL_CSR).  Called
+ *  before any operation which needs to realloc or rearrange the vals.
+ *  Returns 1 on success.
+ *
+ ***********************************************************************/
+
+int dfuDetachDynList(DYN_LIST *dl)
+{
+  int size, max;
+  void *vals;
+
+  if (dl && (DYN_LIST_FLAGS(dl) & (DL_LAZY | DL_CSR)))
+    return(dfuLoadDynList(dl));
+  if (!dl || !(DYN_LIST_FLAGS(dl) & DL_BORROWED)) return(1);
+
+  switch (DYN_LIST_DATATYPE(dl)) {
+  case DF_LONG:  size = sizeof(int);   break;
+  case DF_SHORT: size = sizeof(short); break;
+  case DF_FLOAT: size = sizeof(float); break;
+  case DF_CHAR:  size = sizeof(char);  break;
+  default:
+    return(0);
+  }
+  
+  max = DYN_LIST_MAX(dl) ? DYN_LIST_MAX(dl) : 1;
+  if (!(vals = calloc(max, size))) {
+    fprintf(stderr,"dlsh/dlwish: out of memory\n");
+    return(0);
+  }
+  memcpy(vals, DYN_LIST_VALS(dl), size*DYN_LIST_N(dl));
+
+  dfuUnrefDynBuffer(DYN_LIST_OWNER(dl));
+  DYN_LIST_OWNER(dl) = NULL;
+  DYN_LIST_FLAGS(dl) &= ~DL_BORROWED;
+  DYN_LIST_MAX(dl) = max;
+  DYN_LIST_VALS(dl) = vals;
+  return(1);
+}
+
+static void free_lazy(DYN_LIST *dl)
+{
+  DYN_LAZY *lazy = DYN_LIST_LAZY(dl);
+
+  if (!(DYN_LIST_FLAGS(dl) & DL_LAZY)) return;
+  dfuUnrefDynBuffer(DYN_LAZY_BUFFER(lazy));
+  free(DYN_LAZY_OFFSETS(lazy));
+  free(lazy);
+  DYN_LIST_LAZY(dl) = NULL;
+  DYN_LIST_FLAGS(dl) &= ~DL_LAZY;
+}
+
+static void free_csr(DYN_LIST *dl)
+{
+  DYN_CSR *csr = DYN_LIST_CSR(dl);
+
+  if (!(DYN_LIST_FLAGS(dl) & DL_CSR)) return;
+  dfuUnrefDynBuffer(DYN_CSR_VALUES(csr));
+  free(DYN_CSR_OFFSETS(csr));
+  free(csr);
+  DYN_LIST_CSR(dl) = NULL;
+  DYN_LIST_FLAGS(dl) &= ~DL_CSR;
+}
+
+static void free_pool(DYN_LIST *dl)
+{
+  if (!(DYN_LIST_FLAGS(dl) & DL_POOLED)) return;
+  dfuFreeDynPool(DYN_LIST_POOL(dl));
+  DYN_LIST_POOL(dl) = NULL;
+  DYN_LIST_FLAGS(dl) &= ~DL_POOLED;
+}
+
+/* csr_sublist -- a borrowed view of sublist i of a DL_CSR list */
+static DYN_LIST *csr_sublist(DYN_CSR *csr, int i)
+{
+  DYN_LIST *dl;
+  int size = 0, n;
+
+  switch (DYN_CSR_DATATYPE(csr)) {
+  case DF_LONG:  size = sizeof(int);   break;
+  case DF_SHORT: size = sizeof(short); break;
+  case DF_FLOAT: size = sizeof(float); break;
+  case DF_CHAR:  size = sizeof(char);  break;
+  }
+
+  if (!(dl = (DYN_LIST *) calloc(1, sizeof(DYN_LIST)))) return(NULL);
+  n = (int) (DYN_CSR_OFFSETS(csr)[i+1] - DYN_CSR_OFFSETS(csr)[i]);
+  DYN_LIST_DATATYPE(dl) = DYN_CSR_DATATYPE(csr);
+  DYN_LIST_INCREMENT(dl) = 10;
+  DYN_LIST_N(dl) = DYN_LIST_MAX(dl) = n;
+  if (n) {
+    DYN_LIST_VALS(dl) = DYN_CSR_DATA(csr) + DYN_CSR_OFFSETS(csr)[i]*size;
+    DYN_LIST_FLAGS(dl) = DL_SUBLIST | DL_BORROWED;
+    DYN_LIST_OWNER(dl) = dfuRefDynBuffer(DYN_CSR_VALUES(csr));
+  }
+  else DYN_LIST_FLAGS(dl) = DL_SUBLIST;
+  return(dl);
+}
+
+
+/***********************************************************************
+ *
+ * dfuGetDynListList(DYN_LIST *, int i)
+ *
+ *    Return sublist i of a DF_LIST list, making it first if the list
+ *  is lazy or flattened (DL_LAZY, DL_CSR) and it hasn't been asked for
+ *  before.  Returns NULL if i is out of range or the sublist can't be
+ *  made.  Making sublists fills in vals, so such a list must not be
+ *  read from more than one thread at a time.
+ *
+ ***********************************************************************/
+
+DYN_LIST *dfuGetDynListList(DYN_LIST *dl, int i)
+{
+  DYN_LIST **vals;
+  DYN_LAZY *lazy;
+
+  if (!dl || DYN_LIST_DATATYPE(dl) != DF_LIST ||
+      i < 0 || i >= DYN_LIST_N(dl)) return(NULL);
+
+  vals = (DYN_LIST **) DYN_LIST_VALS(dl);
+  if (vals[i]) return(vals[i]);
+
+  if (DYN_LIST_FLAGS(dl) & DL_CSR) vals[i] = csr_sublist(DYN_LIST_CSR(dl), i);
+  else if (DYN_LIST_FLAGS(dl) & DL_LAZY) {
+    lazy = DYN_LIST_LAZY(dl);
+    if (i < DYN_LAZY_N(lazy)) vals[i] = lazy->decode(lazy, i);
+  }
+  return(vals[i]);
+}
+
+
+/***********************************************************************
+ *
+ * dfuLoadDynList(DYN_LIST *)
+ *
+ *    Make whatever sublists of a lazy or flattened list (DL_LAZY,
+ *  DL_CSR) haven't been yet and drop the state they were made from,
+ *  leaving an ordinary DF_LIST list.  Nothing happens to any other
+ *  kind of list.  Returns 1 on success.
+ *
+ ***********************************************************************/
+
+int dfuLoadDynList(DYN_LIST *dl)
+{
+  int i, n;
+
+  if (!dl || !(DYN_LIST_FLAGS(dl) & (DL_LAZY | DL_CSR))) return(1);
+
+  if (DYN_LIST_FLAGS(dl) & DL_CSR) n = DYN_LIST_N(dl);
+  else n = DYN_LAZY_N(DYN_LIST_LAZY(dl));
+  if (n > DYN_LIST_N(dl)) n = DYN_LIST_N(dl);
+  for (i = 0; i < n; i++) {
+    if (!dfuGetDynListList(dl, i)) return(0);
+  }
+  free_lazy(dl);
+  free_csr(dl);
+  return(1);
+}
+
+
+/***********************************************************************
+ *
+ * dfuCreateDynBuffer(unsigned char *data, int size)
+ *
+ *    Wrap a malloc'd block in a reference counted DYN_BUFFER.  The
+ *  buffer takes ownership of data and starts with one reference,
+ *  which belongs to the caller.  Memory that must be given back some
+ *  other way (e.g. a mapped file) can have DYN_BUFFER_RELEASE() set.
+ *
+ ***********************************************************************/
+
+DYN_BUFFER *dfuCreateDynBuffer(unsigned char *data, int size)
+{
+  DYN_BUFFER *buf = (DYN_BUFFER *) calloc(1, sizeof(DYN_BUFFER));
+  if (!buf) {
+    fprintf(stderr,"dlsh/dlwish: out of memory\n");
+    return(NULL);
+  }
+  DYN_BUFFER_DATA(buf) = data;
+  DYN_BUFFER_SIZE(buf) = size;
+  DYN_BUFFER_REFCOUNT(buf) = 1;
+  return(buf);
+}
+
+DYN_BUFFER *dfuRefDynBuffer(DYN_BUFFER *buf)
+{
+  if (buf) dgAtomicIncrement(&DYN_BUFFER_REFCOUNT(buf));
+  return(buf);
+}
+
+void dfuUnrefDynBuffer(DYN_BUFFER *buf)
+{
+  if (!buf) return;
+  if (dgAtomicDecrement(&DYN_BUFFER_REFCOUNT(buf)) > 0) return;
+  if (DYN_BUFFER_RELEASE(buf))
+    DYN_BUFFER_RELEASE(buf)(DYN_BUFFER_DATA(buf), DYN_BUFFER_SIZE(buf));
+  else if (DYN_BUFFER_DATA(buf)) free(DYN_BUFFER_DATA(buf));
+  free(buf);
+}
+
+
+/***********************************************************************
+ *
+ * dfuCreateDynPool(DYN_BUFFER *source, int size)
+ *
+ *    Create string storage for a DL_POOLED list, with a first block
+ *  of size bytes (none until something is allocated if size is 0).
+ *  If the strings will also point into source, the pool keeps a
+ *  reference to it for as long as it lives.
+ *
+ ***********************************************************************/
+
+DYN_POOL *dfuCreateDynPool(DYN_BUFFER *source, int size)
+{
+  DYN_POOL *pool = (DYN_POOL *) calloc(1, sizeof(DYN_POOL));
+  if (!pool) {
+    fprintf(stderr,"dlsh/dlwish: out of memory\n");
+    return(NULL);
+  }
+  if (size > 0) {
+    pool->blocks = (char **) malloc(sizeof(char *));
+    if (!pool->blocks || !(pool->blocks[0] = (char *) malloc(size))) {
+      fprintf(stderr,"dlsh/dlwish: out of memory\n");
+      free(pool->blocks);
+      free(pool);
+      return(NULL);
+    }
+    pool->nblocks = 1;
+    pool->size = size;
+  }
+  DYN_POOL_SOURCE(pool) = dfuRefDynBuffer(source);
+  return(pool);
+}
+
+/*
+ * dfuPoolAlloc -- n bytes from the pool, starting a new block when the
+ * current one is full.  Blocks are never moved, so strings handed out
+ * earlier stay put.
+ */
+
+char *dfuPoolAlloc(DYN_POOL *pool, int n)
+{
+  char **blocks, *s;
+  int size;
+
+  if (pool->size - pool->used < n) {
+    size = n > DYN_POOL_BLOCK_SIZE ? n : DYN_POOL_BLOCK_SIZE;
+    blocks = (char **) realloc(pool->blocks,
+			       (pool->nblocks+1)*sizeof(char *));
+    if (!blocks) {
+      fprintf(stderr,"dlsh/dlwish: out of memory\n");
+      return(NULL);
+    }
+    pool->blocks = blocks;
+    if (!(blocks[pool->nblocks] = (char *) malloc(size))) {
+      fprintf(stderr,"dlsh/dlwish: out of memory\n");
+      return(NULL);
+    }
+    pool->nblocks++;
+    pool->size = size;
+    pool->used = 0;
+  }
+  s = pool->blocks[pool->nblocks-1] + pool->used;
+  pool->used += n;
+  return(s);
+}
+
+void dfuFreeDynPool(DYN_POOL *pool)
+{
+  int i;
+  if (!pool) return;
+  for (i = 0; i < pool->nblocks; i++) free(pool->blocks[i]);
+  free(pool->blocks);
+  dfuUnrefDynBuffer(DYN_POOL_SOURCE(pool));
+  free(pool);
+}
+
+
+/***********************************************************************
+ *
+ * dfuPoolDynList(DYN_LIST *dl)
+ *
+ *    Switch a DF_STRING list to pooled storage (DL_POOLED), moving any
+ *  strings it already holds into a single block.  Strings added from
+ *  then on are carved out of the pool too, so building a long list of
+ *  strings costs a handful of mallocs rather than one per string.
+ *  Returns 1 on success.
+ *
+ ***********************************************************************/
+
+int dfuPoolDynList(DYN_LIST *dl)
+{
+  DYN_POOL *pool;
+  char **vals, *s;
+  int i, n, size = 0;
+
+  if (!dl || DYN_LIST_DATATYPE(dl) != DF_STRING) return(0);
+  if (DYN_LIST_FLAGS(dl) & DL_POOLED) return(1);
+
+  vals = (char **) DYN_LIST_VALS(dl);
+  for (i = 0; i < DYN_LIST_N(dl); i++) size += strlen(vals[i])+1;
+  if (!(pool = dfuCreateDynPool(NULL, size))) return(0);
+
+  for (i = 0; i < DYN_LIST_N(dl); i++) {
+    n = strlen(vals[i])+1;
+    s = dfuPoolAlloc(pool, n);
+    memcpy(s, vals[i], n);
+    free(vals[i]);
+    vals[i] = s;
+  }
+  DYN_LIST_POOL(dl) = pool;
+  DYN_LIST_FLAGS(dl) |= DL_POOLED;
+  return(1);
+}
+
+
 /***********************************************************************
  *
  * dfuCreateDynGroup()
@@ -3114,6 +3453,70 @@ DYN_GROUP *dfuCreateNamedDynGroup(char *name, int n)
 }
 
 
+/*
+ * Name index helpers (see DYN_GROUP in df.h).  Names are hashed and
+ * compared over the same DYN_LIST_NAME_SIZE-1 characters that are kept
+ * in a list's name.
+ */
+
+static unsigned int name_hash(char *name)
+{
+  unsigned int h = 2166136261u;	/* FNV-1a */
+  int i;
+  for (i = 0; i < DYN_LIST_NAME_SIZE-1 && name[i]; i++) {
+    h ^= (unsigned char) name[i];
+    h *= 16777619u;
+  }
+  return(h);
+}
+
+/* index_list -- enter list i, unless an earlier list has its name */
+static void index_list(DYN_GROUP *dg, int i)
+{
+  DYN_LIST *dl = DYN_GROUP_LIST(dg, i);
+  int *index = DYN_GROUP_INDEX(dg), mask = DYN_GROUP_NINDEX(dg)-1;
+  unsigned int h;
+
+  if (!dl) return;
+  for (h = name_hash(DYN_LIST_NAME(dl)) & mask; index[h]; h = (h+1) & mask) {
+    if (!strncmp(DYN_LIST_NAME(DYN_GROUP_LIST(dg, index[h]-1)),
+		 DYN_LIST_NAME(dl), DYN_LIST_NAME_SIZE-1)) return;
+  }
+  index[h] = i+1;
+}
+
+/*
+ * index_group -- (re)build the index, sized to stay under half full.
+ * If that fails the group is left with no index rather than a stale one.
+ */
+static int index_group(DYN_GROUP *dg)
+{
+  int i, n = 16, *index;
+
+  while (n < 2*(DYN_GROUP_N(dg)+1)) n <<= 1;
+  index = (int *) calloc(n, sizeof(int));
+  if (DYN_GROUP_INDEX(dg)) free(DYN_GROUP_INDEX(dg));
+  DYN_GROUP_INDEX(dg) = NULL;
+  DYN_GROUP_NINDEX(dg) = 0;
+  if (!index) {
+    fprintf(stderr,"dlsh/dlwish: out of memory\n");
+    return(0);
+  }
+  DYN_GROUP_INDEX(dg) = index;
+  DYN_GROUP_NINDEX(dg) = n;
+  for (i = 0; i < DYN_GROUP_N(dg); i++) index_list(dg, i);
+  return(1);
+}
+
+/* index_added -- keep an existing index up to date with the last list */
+static void index_added(DYN_GROUP *dg)
+{
+  if (!DYN_GROUP_INDEX(dg)) return;
+  if (2*DYN_GROUP_N(dg) > DYN_GROUP_NINDEX(dg)) index_group(dg);
+  else index_list(dg, DYN_GROUP_N(dg)-1);
+}
+
+
 /***********************************************************************
  *
  * dfuAddDynGroupList(char *name, int type, int n)
@@ -3152,6 +3555,7 @@ int dfuAddDynGroupExistingList(DYN_GROUP *dg, char *name, DYN_LIST *list)
   DYN_GROUP_N(dg)++;
   
   DYN_GROUP_LISTS(dg) = lists;
+  index_added(dg);
   return(DYN_GROUP_N(dg)-1);
 }
 
@@ -3175,6 +3579,7 @@ DYN_GROUP *dfuCopyDynGroup(DYN_GROUP *dg, char *name)
   
   for (i = 0; i < DYN_GROUP_N(dg); i++)
     dfuCopyDynGroupExistingList(newgroup, DYN_LIST_NAME(lists[i]), lists[i]);
+  if (DYN_GROUP_INDEX(dg)) index_group(newgroup);
 
   return newgroup;
 }
@@ -3202,9 +3607,64 @@ int dfuCopyDynGroupExistingList(DYN_GROUP *dg, char *name, DYN_LIST *list)
   DYN_GROUP_N(dg)++;
   
   DYN_GROUP_LISTS(dg) = lists;
+  index_added(dg);
   return(DYN_GROUP_N(dg)-1);
 }
 
+/***********************************************************************
+ *
+ * dfuIndexDynGroup(DYN_GROUP *)
+ *
+ *    Build (or rebuild) the group's name index, so that dfuFindDynList()
+ *  takes constant time however many lists the group holds.  Returns 0
+ *  if out of memory, leaving the group unindexed.
+ *
+ ***********************************************************************/
+
+int dfuIndexDynGroup(DYN_GROUP *dg)
+{
+  if (!dg) return(0);
+  return(index_group(dg));
+}
+
+/***********************************************************************
+ *
+ * dfuFindDynList(DYN_GROUP *, char *name)
+ *
+ *    Return the first list in the group called name, or NULL.  Uses
+ *  the group's index if dfuIndexDynGroup() has made one, and otherwise
+ *  looks through the lists in order.  The group is never changed, so
+ *  any number of threads may look up names in it at once.  Lists
+ *  renamed in place after they were added aren't found by new name
+ *  in an indexed group.
+ *
+ ***********************************************************************/
+
+DYN_LIST *dfuFindDynList(DYN_GROUP *dg, char *name)
+{
+  DYN_LIST *dl;
+  unsigned int h;
+  int i, mask;
+
+  if (!dg || !name) return(NULL);
+
+  if (!DYN_GROUP_INDEX(dg)) {
+    for (i = 0; i < DYN_GROUP_N(dg); i++) {
+      dl = DYN_GROUP_LIST(dg, i);
+      if (dl && !strncmp(DYN_LIST_NAME(dl), name, DYN_LIST_NAME_SIZE-1))
+	return(dl);
+    }
+    return(NULL);
+  }
+
+  mask = DYN_GROUP_NINDEX(dg)-1;
+  for (h = name_hash(name) & mask; DYN_GROUP_INDEX(dg)[h]; h = (h+1) & mask) {
+    dl = DYN_GROUP_LIST(dg, DYN_GROUP_INDEX(dg)[h]-1);
+    if (!strncmp(DYN_LIST_NAME(dl), name, DYN_LIST_NAME_SIZE-1)) return(dl);
+  }
+  return(NULL);
+}
+
 /***********************************************************************
  *
  * dfuResetDynList(DYN_LIST *)
@@ -3225,14 +3685,19 @@ void dfuResetDynList(DYN_LIST *dynlist)
     for (i = 0; i < DYN_LIST_N(dynlist); i++) {
       dfuFreeDynList(vals[i]);
     }
+    free_lazy(dynlist);
+    free_csr(dynlist);
   }
 
   /* free any allocated strings */
 
   else if (DYN_LIST_DATATYPE(dynlist) == DF_STRING) {
     char **vals = DYN_LIST_VALS(dynlist);
-    for (i = 0; i < DYN_LIST_N(dynlist); i++) {
-      if (vals[i]) free(vals[i]);
+    if (DYN_LIST_FLAGS(dynlist) & DL_POOLED) free_pool(dynlist);
+    else {
+      for (i = 0; i < DYN_LIST_N(dynlist); i++) {
+	if (vals[i]) free(vals[i]);
+      }
     }
   }
 
@@ -3253,6 +3718,7 @@ DYN_LIST *dfuResetDynListToType(DYN_LIST *dynlist, int datatype, int increment)
   if (!dynlist) return NULL;
 
   dfuResetDynList(dynlist);
+  if (!dfuDetachDynList(dynlist)) return NULL;
 
   /* Don't allow zero length allocs */
   if (!increment) increment++;
@@ -3314,6 +3780,71 @@ void dfuResetDynGroup(DYN_GROUP *dyngroup)
 }
 
 
+/***********************************************************************
+ *
+ * dfuSetDynListGeometric(DYN_LIST *, int flag)
+ * dfuSetGeometricGrowth(int flag)
+ *
+ *    Choose how a full list grows.  By default DYN_LIST_MAX() is
+ *  bumped by DYN_LIST_INCREMENT(), which is quadratic when a long list
+ *  is built one element at a time.  A DL_GEOMETRIC list (or every list,
+ *  after dfuSetGeometricGrowth(1)) instead doubles its capacity, never
+ *  growing by less than its increment.  Both return the previous
+ *  setting.
+ *
+ ***********************************************************************/
+
+int dfuSetDynListGeometric(DYN_LIST *dynlist, int flag)
+{
+  int old;
+  if (!dynlist) return 0;
+  old = (DYN_LIST_FLAGS(dynlist) & DL_GEOMETRIC) ? 1 : 0;
+  if (flag) DYN_LIST_FLAGS(dynlist) |= DL_GEOMETRIC;
+  else DYN_LIST_FLAGS(dynlist) &= ~DL_GEOMETRIC;
+  return old;
+}
+
+int dfuSetGeometricGrowth(int flag)
+{
+  int old = dfGeometricGrowth;
+  dfGeometricGrowth = flag ? 1 : 0;
+  return old;
+}
+
+/* resize_dyn_list -- reallocate vals to hold max elements */
+static int resize_dyn_list(DYN_LIST *dynlist, int size, int max)
+{
+  void *vals = realloc(DYN_LIST_VALS(dynlist), (size_t) size * max);
+  if (!vals) {
+    fprintf(stderr,"dlsh/dlwish: out of memory\n");
+    return 0;
+  }
+  DYN_LIST_VALS(dynlist) = vals;
+  DYN_LIST_MAX(dynlist) = max;
+  return 1;
+}
+
+/* grow_dyn_list -- make room for n more elements of size bytes each */
+static int grow_dyn_list(DYN_LIST *dynlist, int size, int n)
+{
+  int max = DYN_LIST_MAX(dynlist), need, step;
+
+  if (n > INT_MAX - DYN_LIST_N(dynlist)) {
+    fprintf(stderr,"dlsh/dlwish: list too long\n");
+    return 0;
+  }
+  need = DYN_LIST_N(dynlist) + n;
+  if (need <= max) return 1;
+
+  step = DYN_LIST_INCREMENT(dynlist) > 0 ? DYN_LIST_INCREMENT(dynlist) : 1;
+  if ((dfGeometricGrowth || (DYN_LIST_FLAGS(dynlist) & DL_GEOMETRIC)) &&
+      max > step) step = max;
+  max = (max > INT_MAX - step) ? INT_MAX : max + step;
+  if (max < need) max = need;
+
+  return resize_dyn_list(dynlist, size, max);
+}
+
 
 /***********************************************************************
  *
@@ -3328,13 +3859,10 @@ void dfuAddDynListLong(DYN_LIST *dynlist, int val)
 {
   int *vals;
   if (!dynlist) return;
+  if (!dfuDetachDynList(dynlist)) return;
 
+  if (!grow_dyn_list(dynlist, sizeof(int), 1)) return;
   vals = DYN_LIST_VALS(dynlist);
-
-  if (DYN_LIST_N(dynlist) == DYN_LIST_MAX(dynlist)) {
-    DYN_LIST_MAX(dynlist) += DYN_LIST_INCREMENT(dynlist);
-    vals = (int *) realloc(vals, sizeof(int)*DYN_LIST_MAX(dynlist));
-  }
   vals[DYN_LIST_N(dynlist)] = val;
   DYN_LIST_N(dynlist)++;
   
@@ -3370,12 +3898,10 @@ int dfuInsertDynListLong(DYN_LIST *dynlist, int val, int pos)
   int i;
 
   if (!dynlist || pos > DYN_LIST_N(dynlist)) return 0;
-  vals = DYN_LIST_VALS(dynlist);
+  if (!dfuDetachDynList(dynlist)) return 0;
 
-  if (DYN_LIST_N(dynlist) == DYN_LIST_MAX(dynlist)) {
-    DYN_LIST_MAX(dynlist) += DYN_LIST_INCREMENT(dynlist);
-    vals = (int *) realloc(vals, sizeof(int)*DYN_LIST_MAX(dynlist));
-  }
+  if (!grow_dyn_list(dynlist, sizeof(int), 1)) return 0;
+  vals = DYN_LIST_VALS(dynlist);
 
   for (i = DYN_LIST_N(dynlist); i > pos; i--) {
     vals[i] = vals[i-1];
@@ -3398,12 +3924,12 @@ int dfuInsertDynListLong(DYN_LIST *dynlist, int val, int pos)
 
 void dfuAddDynListShort(DYN_LIST *dynlist, short val)
 {
-  short *vals = DYN_LIST_VALS(dynlist);
+  short *vals;
 
-  if (DYN_LIST_N(dynlist) == DYN_LIST_MAX(dynlist)) {
-    DYN_LIST_MAX(dynlist) += DYN_LIST_INCREMENT(dynlist);
-    vals = (short *) realloc(vals, sizeof(short)*DYN_LIST_MAX(dynlist));
-  }
+  if (!dfuDetachDynList(dynlist)) return;
+
+  if (!grow_dyn_list(dynlist, sizeof(short), 1)) return;
+  vals = DYN_LIST_VALS(dynlist);
   vals[DYN_LIST_N(dynlist)] = val;
   DYN_LIST_N(dynlist)++;
   
@@ -3430,12 +3956,10 @@ int dfuInsertDynListShort(DYN_LIST *dynlist, short val, int pos)
   int i;
 
   if (!dynlist || pos > DYN_LIST_N(dynlist)) return 0;
-  vals = DYN_LIST_VALS(dynlist);
+  if (!dfuDetachDynList(dynlist)) return 0;
 
-  if (DYN_LIST_N(dynlist) == DYN_LIST_MAX(dynlist)) {
-    DYN_LIST_MAX(dynlist) += DYN_LIST_INCREMENT(dynlist);
-    vals = (short *) realloc(vals, sizeof(short)*DYN_LIST_MAX(dynlist));
-  }
+  if (!grow_dyn_list(dynlist, sizeof(short), 1)) return 0;
+  vals = DYN_LIST_VALS(dynlist);
   for (i = DYN_LIST_N(dynlist); i > pos; i--) {
     vals[i] = vals[i-1];
   }
@@ -3457,12 +3981,12 @@ int dfuInsertDynListShort(DYN_LIST *dynlist, short val, int pos)
 
 void dfuAddDynListFloat(DYN_LIST *dynlist, float val)
 {
-  float *vals = DYN_LIST_VALS(dynlist);
+  float *vals;
 
-  if (DYN_LIST_N(dynlist) == DYN_LIST_MAX(dynlist)) {
-    DYN_LIST_MAX(dynlist) += DYN_LIST_INCREMENT(dynlist);
-    vals = (float *) realloc(vals, sizeof(float)*DYN_LIST_MAX(dynlist));
-  }
+  if (!dfuDetachDynList(dynlist)) return;
+
+  if (!grow_dyn_list(dynlist, sizeof(float), 1)) return;
+  vals = DYN_LIST_VALS(dynlist);
   vals[DYN_LIST_N(dynlist)] = val;
   DYN_LIST_N(dynlist)++;
   
@@ -3489,12 +4013,10 @@ int dfuInsertDynListFloat(DYN_LIST *dynlist, float val, int pos)
   float *vals;
 
   if (!dynlist || pos > DYN_LIST_N(dynlist)) return 0;
-  vals = DYN_LIST_VALS(dynlist);
+  if (!dfuDetachDynList(dynlist)) return 0;
 
-  if (DYN_LIST_N(dynlist) == DYN_LIST_MAX(dynlist)) {
-    DYN_LIST_MAX(dynlist) += DYN_LIST_INCREMENT(dynlist);
-    vals = (float *) realloc(vals, sizeof(float)*DYN_LIST_MAX(dynlist));
-  }
+  if (!grow_dyn_list(dynlist, sizeof(float), 1)) return 0;
+  vals = DYN_LIST_VALS(dynlist);
 
   for (i = DYN_LIST_N(dynlist); i > pos; i--) {
     vals[i] = vals[i-1];
@@ -3517,12 +4039,12 @@ int dfuInsertDynListFloat(DYN_LIST *dynlist, float val, int pos)
 
 void dfuAddDynListChar(DYN_LIST *dynlist, unsigned char val)
 {
-  unsigned char *vals = DYN_LIST_VALS(dynlist);
+  unsigned char *vals;
 
-  if (DYN_LIST_N(dynlist) == DYN_LIST_MAX(dynlist)) {
-    DYN_LIST_MAX(dynlist) += DYN_LIST_INCREMENT(dynlist);
-    vals = (unsigned char *) realloc(vals, sizeof(char)*DYN_LIST_MAX(dynlist));
-  }
+  if (!dfuDetachDynList(dynlist)) return;
+
+  if (!grow_dyn_list(dynlist, sizeof(char), 1)) return;
+  vals = DYN_LIST_VALS(dynlist);
   vals[DYN_LIST_N(dynlist)] = val;
   DYN_LIST_N(dynlist)++;
   
@@ -3549,12 +4071,10 @@ int dfuInsertDynListChar(DYN_LIST *dynlist, unsigned char val, int pos)
   int i;
 
   if (!dynlist || pos > DYN_LIST_N(dynlist)) return 0;
-  vals = DYN_LIST_VALS(dynlist);
+  if (!dfuDetachDynList(dynlist)) return 0;
 
-  if (DYN_LIST_N(dynlist) == DYN_LIST_MAX(dynlist)) {
-    DYN_LIST_MAX(dynlist) += DYN_LIST_INCREMENT(dynlist);
-    vals = (unsigned char *) realloc(vals, sizeof(char)*DYN_LIST_MAX(dynlist));
-  }
+  if (!grow_dyn_list(dynlist, sizeof(char), 1)) return 0;
+  vals = DYN_LIST_VALS(dynlist);
 
   for (i = DYN_LIST_N(dynlist); i > pos; i--) {
     vals[i] = vals[i-1];
@@ -3576,16 +4096,26 @@ int dfuInsertDynListChar(DYN_LIST *dynlist, unsigned char val, int pos)
  *
  ***********************************************************************/
 
+/* new_string -- a copy of string, from the list's pool if it has one */
+static char *new_string(DYN_LIST *dynlist, char *string)
+{
+  int n = strlen(string)+1;
+  char *s;
+
+  if (DYN_LIST_FLAGS(dynlist) & DL_POOLED)
+    s = dfuPoolAlloc(DYN_LIST_POOL(dynlist), n);
+  else s = malloc(n);
+  if (s) memcpy(s, string, n);
+  return(s);
+}
+
 void dfuAddDynListString(DYN_LIST *dynlist, char *string)
 {
-  char **vals = (char **) DYN_LIST_VALS(dynlist);
+  char **vals;
 
-  if (DYN_LIST_N(dynlist) == DYN_LIST_MAX(dynlist)) {
-    DYN_LIST_MAX(dynlist) += DYN_LIST_INCREMENT(dynlist);
-    vals = (char **) realloc(vals, sizeof(char *)*DYN_LIST_MAX(dynlist));
-  }
-  vals[DYN_LIST_N(dynlist)] = malloc(strlen(string)+1);
-  strcpy(vals[DYN_LIST_N(dynlist)], string);
+  if (!grow_dyn_list(dynlist, sizeof(char *), 1)) return;
+  vals = (char **) DYN_LIST_VALS(dynlist);
+  vals[DYN_LIST_N(dynlist)] = new_string(dynlist, string);
 
   DYN_LIST_N(dynlist)++;
   
@@ -3612,17 +4142,13 @@ int dfuInsertDynListString(DYN_LIST *dynlist, char *string, int pos)
   int i;
 
   if (!dynlist || pos > DYN_LIST_N(dynlist)) return 0;
+  if (!grow_dyn_list(dynlist, sizeof(char *), 1)) return 0;
   vals = (char **) DYN_LIST_VALS(dynlist);
-  if (DYN_LIST_N(dynlist) == DYN_LIST_MAX(dynlist)) {
-    DYN_LIST_MAX(dynlist) += DYN_LIST_INCREMENT(dynlist);
-    vals = (char **) realloc(vals, sizeof(char *)*DYN_LIST_MAX(dynlist));
-  }
 
   for (i = DYN_LIST_N(dynlist); i > pos; i--) {
     vals[i] = vals[i-1];
   }
-  vals[pos] = malloc(strlen(string)+1);
-  strcpy(vals[pos], string);
+  vals[pos] = new_string(dynlist, string);
   
   DYN_LIST_N(dynlist)++;
   DYN_LIST_VALS(dynlist) = vals;
@@ -3640,13 +4166,10 @@ int dfuInsertDynListString(DYN_LIST *dynlist, char *string, int pos)
 
 void dfuAddDynListList(DYN_LIST *dynlist, DYN_LIST *newlist)
 {
-  DYN_LIST **vals = (DYN_LIST **) DYN_LIST_VALS(dynlist);
+  DYN_LIST **vals;
 
-  if (DYN_LIST_N(dynlist) == DYN_LIST_MAX(dynlist)) {
-    DYN_LIST_MAX(dynlist) += DYN_LIST_INCREMENT(dynlist);
-    vals = (DYN_LIST **) 
-      realloc(vals, sizeof(DYN_LIST *)*DYN_LIST_MAX(dynlist));
-  }
+  if (!grow_dyn_list(dynlist, sizeof(DYN_LIST *), 1)) return;
+  vals = (DYN_LIST **) DYN_LIST_VALS(dynlist);
 
   if (!newlist) {
     fprintf(stderr, "Attempt to add null list\n");
@@ -3670,13 +4193,10 @@ void dfuAddDynListList(DYN_LIST *dynlist, DYN_LIST *newlist)
 
 void dfuMoveDynListList(DYN_LIST *dynlist, DYN_LIST *newlist)
 {
-  DYN_LIST **vals = (DYN_LIST **) DYN_LIST_VALS(dynlist);
+  DYN_LIST **vals;
 
-  if (DYN_LIST_N(dynlist) == DYN_LIST_MAX(dynlist)) {
-    DYN_LIST_MAX(dynlist) += DYN_LIST_INCREMENT(dynlist);
-    vals = (DYN_LIST **) 
-      realloc(vals, sizeof(DYN_LIST *)*DYN_LIST_MAX(dynlist));
-  }
+  if (!grow_dyn_list(dynlist, sizeof(DYN_LIST *), 1)) return;
+  vals = (DYN_LIST **) DYN_LIST_VALS(dynlist);
 
   if (!newlist) {
     fprintf(stderr, "Attempt to add null list\n");
@@ -3710,13 +4230,10 @@ int dfuInsertDynListList(DYN_LIST *dynlist, DYN_LIST *newlist, int pos)
   DYN_LIST **vals;
 
   if (!dynlist || pos > DYN_LIST_N(dynlist)) return 0;
-  vals = (DYN_LIST **) DYN_LIST_VALS(dynlist);
+  if (!dfuDetachDynList(dynlist)) return 0;
 
-  if (DYN_LIST_N(dynlist) == DYN_LIST_MAX(dynlist)) {
-    DYN_LIST_MAX(dynlist) += DYN_LIST_INCREMENT(dynlist);
-    vals = 
-      (DYN_LIST **) realloc(vals, sizeof(DYN_LIST *)*DYN_LIST_MAX(dynlist));
-  }
+  if (!grow_dyn_list(dynlist, sizeof(DYN_LIST *), 1)) return 0;
+  vals = (DYN_LIST **) DYN_LIST_VALS(dynlist);
 
   for (i = DYN_LIST_N(dynlist); i > pos; i--) {
     vals[i] = vals[i-1];
@@ -3728,6 +4245,192 @@ int dfuInsertDynListList(DYN_LIST *dynlist, DYN_LIST *newlist, int pos)
   return 1;
 }
 
+/***********************************************************************
+ *
+ * dfuReserveDynList(DYN_LIST *, int n)
+ *
+ *    Make room for at least n elements in all, so that a known number
+ *  of adds or inserts cost a single allocation.  Returns 1 on success.
+ *
+ ***********************************************************************/
+
+/* elt_size -- bytes per element of a list's vals */
+static int elt_size(DYN_LIST *dynlist)
+{
+  switch (DYN_LIST_DATATYPE(dynlist)) {
+  case DF_LONG:   return sizeof(int);
+  case DF_SHORT:  return sizeof(short);
+  case DF_FLOAT:  return sizeof(float);
+  case DF_CHAR:   return sizeof(char);
+  case DF_STRING: return sizeof(char *);
+  case DF_LIST:   return sizeof(DYN_LIST *);
+  }
+  return 0;
+}
+
+int dfuReserveDynList(DYN_LIST *dynlist, int n)
+{
+  int size;
+  if (!dynlist || !(size = elt_size(dynlist))) return 0;
+  if (!dfuDetachDynList(dynlist)) return 0;
+  if (n <= DYN_LIST_MAX(dynlist)) return 1;
+  return resize_dyn_list(dynlist, size, n);
+}
+
+/***********************************************************************
+ *
+ * dfuAppendDynListLongs(DYN_LIST *, int n, int *vals)
+ * dfuAppendDynListShorts(DYN_LIST *, int n, short *vals)
+ * dfuAppendDynListFloats(DYN_LIST *, int n, float *vals)
+ * dfuAppendDynListChars(DYN_LIST *, int n, unsigned char *vals)
+ * dfuAppendDynListDoubles(DYN_LIST *, int n, double *vals)
+ *
+ *    Append n values to a numeric list, growing it just once.  Values
+ *  of the list's own type are copied straight in; any other type is
+ *  cast to it (so ints can go onto a DF_FLOAT list, or an R or numpy
+ *  vector of doubles onto any numeric list).  Returns 1 on success and
+ *  0 if the list is not numeric or can't grow.
+ *
+ ***********************************************************************/
+
+/* append_start -- room for n more values at the end of a numeric list */
+static void *append_start(DYN_LIST *dynlist, int n)
+{
+  int size;
+
+  if (!dynlist || n < 0) return NULL;
+  if (DYN_LIST_DATATYPE(dynlist) == DF_STRING ||
+      DYN_LIST_DATATYPE(dynlist) == DF_LIST) return NULL;
+  if (!(size = elt_size(dynlist))) return NULL;
+  if (!dfuDetachDynList(dynlist) || !grow_dyn_list(dynlist, size, n))
+    return NULL;
+  return (char *) DYN_LIST_VALS(dynlist) + (size_t) DYN_LIST_N(dynlist)*size;
+}
+
+#define APPEND_CAST(dynlist, dest, n, src)				\
+  switch (DYN_LIST_DATATYPE(dynlist)) {					\
+  case DF_LONG:								\
+    for (i = 0; i < n; i++) ((int *) dest)[i] = (int) src[i];		\
+    break;								\
+  case DF_SHORT:							\
+    for (i = 0; i < n; i++) ((short *) dest)[i] = (short) src[i];	\
+    break;								\
+  case DF_FLOAT:							\
+    for (i = 0; i < n; i++) ((float *) dest)[i] = (float) src[i];	\
+    break;								\
+  case DF_CHAR:								\
+    for (i = 0; i < n; i++)						\
+      ((unsigned char *) dest)[i] = (unsigned char) src[i];		\
+    break;								\
+  }
+
+int dfuAppendDynListLongs(DYN_LIST *dynlist, int n, int *vals)
+{
+  void *dest;
+  int i;
+
+  if (!(dest = append_start(dynlist, n))) return 0;
+  if (DYN_LIST_DATATYPE(dynlist) == DF_LONG)
+    memcpy(dest, vals, n*sizeof(int));
+  else APPEND_CAST(dynlist, dest, n, vals);
+  DYN_LIST_N(dynlist) += n;
+  return 1;
+}
+
+int dfuAppendDynListShorts(DYN_LIST *dynlist, int n, short *vals)
+{
+  void *dest;
+  int i;
+
+  if (!(dest = append_start(dynlist, n))) return 0;
+  if (DYN_LIST_DATATYPE(dynlist) == DF_SHORT)
+    memcpy(dest, vals, n*sizeof(short));
+  else APPEND_CAST(dynlist, dest, n, vals);
+  DYN_LIST_N(dynlist) += n;
+  return 1;
+}
+
+int dfuAppendDynListFloats(DYN_LIST *dynlist, int n, float *vals)
+{
+  void *dest;
+  int i;
+
+  if (!(dest = append_start(dynlist, n))) return 0;
+  if (DYN_LIST_DATATYPE(dynlist) == DF_FLOAT)
+    memcpy(dest, vals, n*sizeof(float));
+  else APPEND_CAST(dynlist, dest, n, vals);
+  DYN_LIST_N(dynlist) += n;
+  return 1;
+}
+
+int dfuAppendDynListChars(DYN_LIST *dynlist, int n, unsigned char *vals)
+{
+  void *dest;
+  int i;
+
+  if (!(dest = append_start(dynlist, n))) return 0;
+  if (DYN_LIST_DATATYPE(dynlist) == DF_CHAR)
+    memcpy(dest, vals, n*sizeof(char));
+  else APPEND_CAST(dynlist, dest, n, vals);
+  DYN_LIST_N(dynlist) += n;
+  return 1;
+}
+
+int dfuAppendDynListDoubles(DYN_LIST *dynlist, int n, double *vals)
+{
+  void *dest;
+  int i;
+
+  if (!(dest = append_start(dynlist, n))) return 0;
+  APPEND_CAST(dynlist, dest, n, vals);
+  DYN_LIST_N(dynlist) += n;
+  return 1;
+}
+
+/***********************************************************************
+ *
+ * dfuInsertDynListRange(DYN_LIST *, int pos, int n, void *vals)
+ *
+ *    Insert n elements of the list's own type at pos, moving the tail
+ *  just once, so prepending a batch (pos = 0) is linear in the length
+ *  of the list rather than in its length times n.  Strings and lists
+ *  are copied, as by dfuInsertDynListString() and
+ *  dfuInsertDynListList().  Returns 1 on success.
+ *
+ ***********************************************************************/
+
+int dfuInsertDynListRange(DYN_LIST *dynlist, int pos, int n, void *vals)
+{
+  int i, size;
+  char *dest;
+
+  if (!dynlist || n < 0 || pos < 0 || pos > DYN_LIST_N(dynlist)) return 0;
+  if (!(size = elt_size(dynlist))) return 0;
+  if (!dfuDetachDynList(dynlist) || !grow_dyn_list(dynlist, size, n))
+    return 0;
+  if (!n) return 1;
+
+  dest = (char *) DYN_LIST_VALS(dynlist) + (size_t) pos*size;
+  memmove(dest + (size_t) n*size, dest,
+	  (size_t) (DYN_LIST_N(dynlist)-pos)*size);
+
+  switch (DYN_LIST_DATATYPE(dynlist)) {
+  case DF_STRING:
+    for (i = 0; i < n; i++)
+      ((char **) dest)[i] = new_string(dynlist, ((char **) vals)[i]);
+    break;
+  case DF_LIST:
+    for (i = 0; i < n; i++)
+      ((DYN_LIST **) dest)[i] = dfuCopyDynList(((DYN_LIST **) vals)[i]);
+    break;
+  default:
+    memcpy(dest, vals, (size_t) n*size);
+    break;
+  }
+  DYN_LIST_N(dynlist) += n;
+  return 1;
+}
+
 /***********************************************************************
  *
  * dfuSetObsPeriods(DATA_FILE *, DYN_OLIST *)
@@ -4003,6 +4706,7 @@ void dfuFreeDynGroup(DYN_GROUP *dyngroup)
       dfuFreeDynList(DYN_GROUP_LIST(dyngroup,i));
   
   if (DYN_GROUP_NLISTS(dyngroup)) free(DYN_GROUP_LISTS(dyngroup));
+  if (DYN_GROUP_INDEX(dyngroup)) free(DYN_GROUP_INDEX(dyngroup));
   free(dyngroup);
 }
 
@@ -4038,18 +4742,25 @@ void dfuFreeDynList(DYN_LIST *dynlist)
     for (i = 0; i < DYN_LIST_N(dynlist); i++) {
       dfuFreeDynList(vals[i]);
     }
+    free_lazy(dynlist);
+    free_csr(dynlist);
   }
 
   /* free any allocated strings */
 
   else if (DYN_LIST_DATATYPE(dynlist) == DF_STRING) {
     char **vals = DYN_LIST_VALS(dynlist);
-    for (i = 0; i < DYN_LIST_N(dynlist); i++) {
-      if (vals[i]) free(vals[i]);
+    if (DYN_LIST_FLAGS(dynlist) & DL_POOLED) free_pool(dynlist);
+    else {
+      for (i = 0; i < DYN_LIST_N(dynlist); i++) {
+	if (vals[i]) free(vals[i]);
+      }
     }
   }
 
-  if (DYN_LIST_VALS(dynlist)) free(DYN_LIST_VALS(dynlist));
+  if (DYN_LIST_FLAGS(dynlist) & DL_BORROWED)
+    dfuUnrefDynBuffer(DYN_LIST_OWNER(dynlist));
+  else if (DYN_LIST_VALS(dynlist)) free(DYN_LIST_VALS(dynlist));
   free(dynlist);
 }
 
@@ -38,16 +38,320 @@ enum DYN_STRUCT_TYPE {
 /*
  * The only TAGS which can appear before one of the defined structures
  * are the following.  These contain info about the datafile version and
- * then enter the highest level structure.
+ * then enter the highest level structure.  A DG_CHUNK_TAG structure is
+ * laid out like a group, but adds to the lists of the group before it
+ * (see DG_APPENDER).
  */
 
-enum DG_TOP_LEVEL_TAGS { DG_VERSION_TAG, DG_BEGIN_TAG };
+enum DG_TOP_LEVEL_TAGS { DG_VERSION_TAG, DG_BEGIN_TAG, DG_CHUNK_TAG };
 enum DG_TAG { DG_NAME_TAG, DG_NLISTS_TAG, DG_DYNLIST_TAG };
 enum DL_TAG { DL_NAME_TAG, DL_INCREMENT_TAG, DL_DATA_TAG,
 	    DL_STRING_DATA_TAG, DL_CHAR_DATA_TAG, DL_SHORT_DATA_TAG,
 	    DL_LONG_DATA_TAG, DL_FLOAT_DATA_TAG, DL_LIST_DATA_TAG,
 	    DL_SUBLIST_TAG, DL_FLAGS_TAG };
 
+/***********************************************************************
+ *
+ *   Structure: DG_STRUCT_STACK
+ *
+ *   Purpose:   Tracks which structure (and so which tag table) the
+ *              current tag belongs to while walking a dg stream.
+ *
+ ***********************************************************************/
+
+typedef struct {
+  int       cur;		/* current DYN_STRUCT_TYPE             */
+  char     *curname;		/* and its name, for dumps             */
+  TAG_INFO *stack;
+  int       size;
+  int       index;
+} DG_STRUCT_STACK;
+
+/***********************************************************************
+ *
+ *   Structure: DG_READER
+ *
+ *   Purpose:   Holds all of the state needed while parsing one dg
+ *              stream, so that any number of streams can be parsed at
+ *              once (e.g. one per thread).  A reader must not be
+ *              shared between threads, but can be reused for any
+ *              number of files once initialized with dgInitReader().
+ *
+ *              While a compressed file is being read in a pipeline
+ *              (one thread decompressing, another parsing), stream
+ *              says how much of the buffer has arrived so far.
+ *
+ ***********************************************************************/
+
+typedef struct _dg_stream DG_STREAM;
+
+typedef struct {
+  int          flip;		/* stream byte order differs from ours */
+  int          flags;		/* DG_READ_xxx options                 */
+  DYN_BUFFER  *borrow;		/* zero-copy source buffer (or NULL)   */
+  const char **columns;		/* only read lists with these names    */
+  int          ncolumns;	/* (0 means read every list)           */
+  int          nthreads;	/* decode lists on this many threads   */
+  int          start;		/* DG_READ_RANGE: only keep elements   */
+  int          stop;		/* [start, stop) of top-level lists    */
+  DG_STRUCT_STACK structs;	/* nesting, for ASCII dumps            */
+  DG_STREAM   *stream;		/* buffer still arriving (or NULL)     */
+} DG_READER;
+
+#define DG_READER_FLIP(r)     ((r)->flip)
+#define DG_READER_FLAGS(r)    ((r)->flags)
+#define DG_READER_BORROW(r)   ((r)->borrow)
+#define DG_READER_COLUMNS(r)  ((r)->columns)
+#define DG_READER_NCOLUMNS(r) ((r)->ncolumns)
+#define DG_READER_NTHREADS(r) ((r)->nthreads)
+#define DG_READER_START(r)    ((r)->start)
+#define DG_READER_STOP(r)     ((r)->stop)
+#define DG_READER_STRUCTS(r)  (&(r)->structs)
+#define DG_READER_STREAM(r)   ((r)->stream)
+
+/*
+ * DG_READ_LAZY leaves the sublists of DF_LIST lists undecoded (DL_LAZY)
+ * until dfuGetDynListList() asks for them.  They are decoded from the
+ * stream itself, so it implies DG_READ_BORROW.  DG_READ_CSR reads a
+ * DF_LIST list whose sublists are all flat, unnamed and of one
+ * numeric type into a single array of values plus offsets (DL_CSR); other DF_LIST
+ * lists are read as usual.  DG_READ_POOL puts the strings of each
+ * DF_STRING list in one block (DL_POOLED), or, when borrowing, leaves
+ * them where they are in the stream.  None of these has any effect
+ * when a stream is read through stdio rather than from a buffer.
+ * DG_READ_PRESERVE only affects dgReaderParse() (see DG_CALLBACKS).
+ */
+enum DG_READ_FLAG { DG_READ_BORROW = 0x01, DG_READ_RANGE = 0x02,
+		    DG_READ_LAZY = 0x04, DG_READ_CSR = 0x08,
+		    DG_READ_POOL = 0x10, DG_READ_PRESERVE = 0x20 };
+
+#define DG_READ_END 0x7fffffff	/* range stop meaning "to the end"     */
+
+/***********************************************************************
+ *
+ *   Structure: DG_SINK
+ *
+ *   Purpose:   Where a streaming write (dgOpenBufferSink) sends the
+ *              serialized stream.  write is given successive pieces of
+ *              it and close is called once at the end; both return 1
+ *              on success and 0 on failure.  dgOpenFileSink(),
+ *              dgOpenGzipSink() and dgOpenLZ4Sink() set one up for a
+ *              file; any other destination can be used by filling in
+ *              the functions and state.
+ *
+ ***********************************************************************/
+
+#define DG_SINK_BLOCK_SIZE (1<<20)	/* most a streaming write buffers */
+
+typedef struct {
+  int  (*write)(void *state, unsigned char *data, int n);
+  int  (*close)(void *state);
+  void *state;
+} DG_SINK;
+
+/***********************************************************************
+ *
+ *   Structure: DG_IOVEC
+ *
+ *   Purpose:   One piece of a stream that is gathered from several
+ *              places rather than held in one buffer (see
+ *              dgWriterSetGather()).  Laid out like a POSIX iovec.
+ *
+ ***********************************************************************/
+
+#define DG_GATHER_MIN_SIZE 4096	/* smallest array a writer references */
+
+typedef struct {
+  void  *base;
+  size_t len;
+} DG_IOVEC;
+
+typedef struct {
+  int            bufend;	/* the buffer up to here comes first,  */
+  unsigned char *data;		/* then n bytes of the caller's array  */
+  int            n;
+} DG_GATHER_SEG;
+
+/***********************************************************************
+ *
+ *   Structure: DG_WRITER
+ *
+ *   Purpose:   Holds all of the state needed while serializing dg
+ *              streams: the buffer, its sink (if streaming) and the
+ *              structure nesting.  Like a DG_READER, a writer must not
+ *              be shared between threads, but each thread can record
+ *              into one of its own at the same time as the others.
+ *              The dgRecord...() functions use a single global writer.
+ *
+ *              A gathering writer doesn't copy arrays of at least
+ *              DG_GATHER_MIN_SIZE bytes into its buffer, but notes
+ *              where they go, and its stream is the list of pieces
+ *              dgWriterGather() returns.  Those arrays must not change
+ *              until the stream has been written.
+ *
+ ***********************************************************************/
+
+typedef struct {
+  unsigned char *buffer;
+  int       size;		/* allocated size of buffer            */
+  int       index;		/* bytes recorded (and not yet sunk)   */
+  int       increment;		/* grow buffer by at least this much   */
+  int       fixed;		/* caller's buffer: never reallocated  */
+  int       overflow;		/* and something didn't fit            */
+  DG_SINK  *sink;		/* streaming: where the buffer drains  */
+  int       sinkstatus;		/* 0 once a sink write has failed      */
+  DG_STRUCT_STACK structs;	/* nesting, to know each tag's type    */
+  int       gather;		/* reference big arrays, don't copy    */
+  DG_GATHER_SEG *segs;		/* the arrays referenced, in order     */
+  int       nsegs;
+  int       maxsegs;
+  DG_IOVEC *iov;		/* as last returned by dgWriterGather  */
+} DG_WRITER;
+
+#define DG_WRITER_BUFFER(w)     ((w)->buffer)
+#define DG_WRITER_SIZE(w)       ((w)->index)
+#define DG_WRITER_INCREMENT(w)  ((w)->increment)
+
+/***********************************************************************
+ *
+ *   Structure: DG_TOC
+ *
+ *   Purpose:   Table of contents of a dg stream, built by dgScanToc()
+ *              without reading any list data.  There is one entry per
+ *              top-level list, in file order.  Depth is 0 for a flat
+ *              list, 1 for a list of flat lists, and so on.  Offset is
+ *              the position of the list's DG_DYNLIST_TAG in the
+ *              (uncompressed) stream.
+ *
+ ***********************************************************************/
+
+typedef struct {
+  char name[DYN_LIST_NAME_SIZE];
+  int  datatype;		/* DF_LONG, DF_LIST, ...               */
+  int  n;			/* number of elements                  */
+  int  depth;			/* levels of nested sublists           */
+  int  offset;			/* byte offset of list in stream       */
+} DG_TOC_ENTRY;
+
+typedef struct {
+  char name[DYN_GROUP_NAME_SIZE];
+  int  nentries;
+  int  maxentries;
+  DG_TOC_ENTRY *entries;
+} DG_TOC;
+
+#define DG_TOC_NAME(t)         ((t)->name)
+#define DG_TOC_N(t)            ((t)->nentries)
+#define DG_TOC_ENTRY(t,i)      (&(t)->entries[i])
+
+#define DG_TOC_ENTRY_NAME(e)     ((e)->name)
+#define DG_TOC_ENTRY_DATATYPE(e) ((e)->datatype)
+#define DG_TOC_ENTRY_N(e)        ((e)->n)
+#define DG_TOC_ENTRY_DEPTH(e)    ((e)->depth)
+#define DG_TOC_ENTRY_OFFSET(e)   ((e)->offset)
+
+/***********************************************************************
+ *
+ *   Structure: DG_GZ_INDEX
+ *
+ *   Purpose:   Access points into a gzip-compressed (.dgz) dg stream,
+ *              built by dgBuildGzIndex().  Each point holds where a
+ *              deflate block starts in the file (byte in, less bits
+ *              bits of the byte before it), where that is in the
+ *              uncompressed stream (out), and the window of output
+ *              leading up to it.  The stream's table of contents and
+ *              byte order are kept with them, and the size and last
+ *              trailer of the .dgz to tell if it has since changed.
+ *
+ ***********************************************************************/
+
+#define DG_GZ_WINDOW        32768	/* deflate's history window  */
+#define DG_GZ_INDEX_SPAN    (1<<20)	/* default spacing of points */
+#define DG_GZ_INDEX_SUFFIX  ".dgi"
+
+typedef struct {
+  int out;			/* offset in the uncompressed stream   */
+  int in;			/* first whole byte in the .dgz        */
+  int bits;			/* bits used from the byte before (0-7)*/
+  unsigned char *window;	/* DG_GZ_WINDOW bytes leading to out   */
+} DG_GZ_POINT;
+
+typedef struct {
+  int insize;			/* size of the .dgz                    */
+  unsigned char trailer[8];	/* and its last 8 bytes (CRC, ISIZE)   */
+  int size;			/* length of the uncompressed stream   */
+  int flip;			/* stream byte order isn't ours        */
+  int npoints;
+  int maxpoints;
+  DG_GZ_POINT *points;
+  DG_TOC *toc;
+} DG_GZ_INDEX;
+
+#define DG_GZ_INDEX_SIZE(x)     ((x)->size)
+#define DG_GZ_INDEX_NPOINTS(x)  ((x)->npoints)
+#define DG_GZ_INDEX_TOC(x)      ((x)->toc)
+
+/***********************************************************************
+ *
+ *   Structure: DG_APPENDER
+ *
+ *   Purpose:   Saves a group that keeps growing (over a recording
+ *              session, say) by appending only what is new to its
+ *              file.  dgAppendOpen() writes the group as it is then;
+ *              each dgAppendChunk() adds a chunk holding the elements
+ *              added to each list since the last, so saving costs
+ *              only the new data and a crash loses at most the chunk
+ *              being written.  The group's lists are tracked by
+ *              position and should only ever be appended to (lists
+ *              may be added at the end).  The readers stitch the
+ *              chunks back onto the lists of the same name.
+ *
+ ***********************************************************************/
+
+typedef struct {
+  FILE      *fp;
+  DG_WRITER  w;
+  int       *written;		/* elements of each list in the file   */
+  int        nlists;		/* (the lists of the group seen so far)*/
+  int        nchunks;		/* chunks appended                     */
+} DG_APPENDER;
+
+/***********************************************************************
+ *
+ *   Structure: DG_CALLBACKS
+ *
+ *   Purpose:   Event handlers for dgParse(), which walks a dg stream
+ *              without building a DYN_GROUP.  Lists are reported
+ *              between begin_list and end_list (depth 0 for top-level
+ *              lists, 1 for their sublists, ...), with one data call
+ *              giving the list's type and length.  DF_CHAR, DF_SHORT,
+ *              DF_LONG and DF_FLOAT data point straight into the
+ *              buffer; DF_STRING data is followed by one string call
+ *              per element, and DF_LIST data (vals NULL) by its n
+ *              sublists.  Names and strings also point into the
+ *              buffer.  Any handler may be NULL; a handler returning
+ *              0 stops the parse.  The chunks of an appended file are
+ *              reported as further groups.
+ *
+ *              The buffer is modified in place: array data is slid
+ *              onto aligned addresses (over its count) and byte
+ *              flipped where the stream's byte order differs, so it
+ *              can be parsed only once.  If the reader has
+ *              DG_READ_PRESERVE set, arrays needing either are copied
+ *              into scratch space instead (valid until the data
+ *              handler returns) and the buffer is left as it was.
+ *
+ ***********************************************************************/
+
+typedef struct {
+  int (*begin_group)(void *user, const char *name);
+  int (*end_group)(void *user);
+  int (*begin_list)(void *user, const char *name, int depth);
+  int (*end_list)(void *user, int depth);
+  int (*data)(void *user, int datatype, void *vals, int n);
+  int (*string)(void *user, int index, const char *s);
+} DG_CALLBACKS;
+
 /***********************************************************************
  *
  *                      DG_FILE_IO Function Prototypes
@@ -66,9 +370,38 @@ int  dgWriteBufferCompressed(char *filename);
 unsigned char *dgGetBuffer(void);
 int dgGetBufferSize(void);
 int dgSetBufferIncrement(int);
+int dgSetLZ4Independent(int);
+int dgSetGzipThreads(int);
 int dgEstimateGroupSize(DYN_GROUP *dg);
+int dgComputeSerializedSize(DYN_GROUP *dg);
+int dgSerializeDynGroup(DYN_GROUP *dg, unsigned char *buf, int size);
+unsigned char *dgSerializeDynGroupAlloc(DYN_GROUP *dg, int *size);
+
+int dgOpenBufferSink(DG_SINK *sink);
+int dgCloseBufferSink(void);
+int dgWriteDynGroup(DYN_GROUP *dg, DG_SINK *sink);
+int dgOpenFileSink(DG_SINK *sink, char *filename);
+int dgOpenGzipSink(DG_SINK *sink, char *filename);
+int dgOpenLZ4Sink(DG_SINK *sink, char *filename);
+
+int  dgInitWriter(DG_WRITER *w);
+void dgResetWriter(DG_WRITER *w);
+void dgFreeWriter(DG_WRITER *w);
+int  dgWriterRecordDynGroup(DG_WRITER *w, DYN_GROUP *dg);
+int  dgWriterRecordDynList(DG_WRITER *w, unsigned char tag, DYN_LIST *dl);
+int  dgWriterOpenSink(DG_WRITER *w, DG_SINK *sink);
+int  dgWriterCloseSink(DG_WRITER *w);
+int  dgWriterWriteBuffer(DG_WRITER *w, char *filename, char format);
+int  dgWriterWriteBufferCompressed(DG_WRITER *w, char *filename);
+int  dgWriterSetGather(DG_WRITER *w, int flag);
+int  dgWriterGather(DG_WRITER *w, DG_IOVEC **iov);
 
-void dgRecordDynGroup(DYN_GROUP *dg);
+int  dgAppendOpen(DG_APPENDER *a, char *filename, DYN_GROUP *dg);
+int  dgAppendChunk(DG_APPENDER *a, DYN_GROUP *dg);
+int  dgAppendClose(DG_APPENDER *a);
+
+int  dgRecordDynGroup(DYN_GROUP *dg);
+int  dgRecordDynList(unsigned char tag, DYN_LIST *dl);
 
 void dgRecordMagicNumber(void);
 
@@ -100,10 +433,49 @@ int  dgGetDataType(int type);
 int  dgGetStructureType(int type);
 
 int dgReadDynGroup(char *, DYN_GROUP *dg);
+int dgReadDynGroupBorrowed(char *, DYN_GROUP *dg);
+int dgReadDynGroupColumns(char *filename, const char **names, int n,
+			   DYN_GROUP *dg);
 int dgReadDynGroupCompressed(char *, DYN_GROUP *dg);
 int dguGzipFileToStruct(char *filename, DYN_GROUP *dg);
+int dguGzipFileToStructBorrowed(char *filename, DYN_GROUP *dg);
 int dguFileToStruct(FILE *InFP, DYN_GROUP *dg);
 int dguBufferToStruct(unsigned char *vbuf, int n, DYN_GROUP *dg);
+int dguBufferToStructBorrowed(DYN_BUFFER *buf, DYN_GROUP *dg);
+
+void dgInitReader(DG_READER *r);
+void dgFreeReader(DG_READER *r);
+void dgReaderSetColumns(DG_READER *r, const char **names, int n);
+void dgReaderSetThreads(DG_READER *r, int n);
+void dgReaderSetRange(DG_READER *r, int start, int stop);
+int dgReaderReadDynGroup(DG_READER *r, char *filename, DYN_GROUP *dg);
+int dgReaderGzipFileToStruct(DG_READER *r, char *filename, DYN_GROUP *dg);
+int dgReaderFileToStruct(DG_READER *r, FILE *InFP, DYN_GROUP *dg);
+int dgReaderMapFileToStruct(DG_READER *r, FILE *InFP, DYN_GROUP *dg);
+int dgReaderBufferToStruct(DG_READER *r, unsigned char *vbuf, int n,
+			   DYN_GROUP *dg);
+void dgReaderFileToAscii(DG_READER *r, FILE *InFP, FILE *OutFP);
+void dgReaderBufferToAscii(DG_READER *r, unsigned char *vbuf, int bufsize,
+			   FILE *OutFP);
+
+DG_TOC *dgScanToc(unsigned char *vbuf, int bufsize);
+DG_TOC *dgScanTocFile(char *filename);
+int dgReaderScanToc(DG_READER *r, unsigned char *vbuf, int bufsize,
+		    DG_TOC *toc);
+void dgFreeToc(DG_TOC *toc);
+
+DG_GZ_INDEX *dgBuildGzIndex(char *filename, int span);
+DG_GZ_INDEX *dgReadGzIndex(char *filename);
+int dgWriteGzIndex(DG_GZ_INDEX *idx, char *filename);
+void dgFreeGzIndex(DG_GZ_INDEX *idx);
+int dgGzIndexExtract(DG_GZ_INDEX *idx, char *filename, int offset,
+		     unsigned char *buf, int len);
+int dgIndexGzFile(char *filename, int span);
+
+int dgParse(unsigned char *vbuf, int bufsize, const DG_CALLBACKS *cb,
+	    void *user);
+int dgReaderParse(DG_READER *r, unsigned char *vbuf, int bufsize,
+		  const DG_CALLBACKS *cb, void *user);
 
 void dguFileToAscii(FILE *InFP, FILE *OutFP);
 
@@ -20,6 +20,9 @@ int   fliplong(int);
 void fliplongs(int n, int *vals);
 void flipshorts(int n, short *vals);
 void flipfloats(int n, float *vals);
+void copyfliplongs(int n, const void *from, int *to);
+void copyflipshorts(int n, const void *from, short *to);
+void copyflipfloats(int n, const void *from, float *to);
 
 #ifdef __cplusplus
 }
@@ -74,11 +74,46 @@ static FILE *uncompress_file(char *filename, char *tempname)
 }  
 
 
+/*
+ * same_list -- 1 if a and b hold the same data (as the mapped and stdio
+ * readers should make of the same file)
+ */
+static int same_list(DYN_LIST *a, DYN_LIST *b)
+{
+  int i, size = 0;
+
+  if (!a || !b) return a == b;
+  if (DYN_LIST_DATATYPE(a) != DYN_LIST_DATATYPE(b) ||
+      DYN_LIST_N(a) != DYN_LIST_N(b) ||
+      strcmp(DYN_LIST_NAME(a), DYN_LIST_NAME(b))) return 0;
+
+  switch (DYN_LIST_DATATYPE(a)) {
+  case DF_LIST:
+    for (i = 0; i < DYN_LIST_N(a); i++)
+      if (!same_list(dfuGetDynListList(a, i), dfuGetDynListList(b, i)))
+	return 0;
+    return 1;
+  case DF_STRING:
+    for (i = 0; i < DYN_LIST_N(a); i++)
+      if (strcmp(((char **) DYN_LIST_VALS(a))[i],
+		 ((char **) DYN_LIST_VALS(b))[i])) return 0;
+    return 1;
+  case DF_LONG:  size = sizeof(int);   break;
+  case DF_SHORT: size = sizeof(short); break;
+  case DF_FLOAT: size = sizeof(float); break;
+  case DF_CHAR:  size = sizeof(char);  break;
+  }
+  return !DYN_LIST_N(a) ||
+    !memcmp(DYN_LIST_VALS(a), DYN_LIST_VALS(b), DYN_LIST_N(a)*size);
+}
+
 int main(int argc, char *argv[])
 {
 
-  DYN_GROUP *dg;
+  DYN_GROUP *dg, *sdg;
+  DG_READER r;
   FILE *fp;
+  int i, status;
   char *newname = NULL, *suffix;
   char tempname[128];
   
@@ -135,15 +170,37 @@ int main(int argc, char *argv[])
     }
   }
 
-  if (!dguFileToStruct(fp, dg)) {
+  dgInitReader(&r);
+  status = dgReaderMapFileToStruct(&r, fp, dg);
+  dgFreeReader(&r);
+  if (!status) {
     printf("dg_read: file %s not recognized as dg format\n", 
 	    argv[1]);
     fclose(fp);
     if (tempname[0]) unlink(tempname);
     exit(-1);
   }
+
+  /* the stdio reader should make the same of it */
+  rewind(fp);
+  sdg = dfuCreateDynGroup(4);
+  dgInitReader(&r);
+  status = dgReaderFileToStruct(&r, fp, sdg);
+  dgFreeReader(&r);
   fclose(fp);
   if (tempname[0]) unlink(tempname);
+  if (status != DF_OK || DYN_GROUP_N(sdg) != DYN_GROUP_N(dg)) {
+    printf("dg_read: stdio read of %s differs\n", argv[1]);
+    exit(-1);
+  }
+  for (i = 0; i < DYN_GROUP_N(dg); i++) {
+    if (!same_list(DYN_GROUP_LIST(dg, i), DYN_GROUP_LIST(sdg, i))) {
+      printf("dg_read: stdio read of %s differs in list %s\n", argv[1],
+	     DYN_LIST_NAME(DYN_GROUP_LIST(dg, i)));
+      exit(-1);
+    }
+  }
+  dfuFreeDynGroup(sdg);
 
  process_dg:
   printf("successfully read in %s\n", argv[1]);
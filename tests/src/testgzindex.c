@@ -0,0 +1,403 @@
+/*
+ * testgzindex -- index a .dgz with a small span and check that columns
+ * and ranges read through the sidecar (.dgi) match a full read, and
+ * that a stale or damaged sidecar is passed over for a full inflate.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#include <df.h>
+#include <dynio.h>
+
+#define NTRIALS 20000
+#define NJUNK   500000
+#define SPAN    65536
+
+static int Failures = 0;
+
+static void fail(const char *what, const char *why)
+{
+  if (Failures++ < 20)
+    printf("FAIL %s: %s\n", what, why);
+}
+
+static unsigned int Seed;
+
+static unsigned int lcg(void)
+{
+  Seed = Seed * 1103515245 + 12345;
+  return Seed >> 8;
+}
+
+/*
+ * make_group -- a block of noise (so the file has plenty of access
+ * points) ahead of a column of each type, NTRIALS long; seed changes
+ * the values but not the shape, and swap puts rt ahead of ids
+ */
+static DYN_GROUP *make_group(unsigned int seed, int swap)
+{
+  DYN_GROUP *dg = dfuCreateNamedDynGroup("indexed", 8);
+  DYN_LIST *ids, *rt, *sub;
+  char buf[32];
+  int i, j;
+
+  Seed = seed;
+  dfuAddDynGroupNewList(dg, "junk", DF_LONG, NJUNK);
+  dfuAddDynGroupNewList(dg, swap ? "rt" : "ids", swap ? DF_FLOAT : DF_LONG,
+			NTRIALS);
+  dfuAddDynGroupNewList(dg, swap ? "ids" : "rt", swap ? DF_LONG : DF_FLOAT,
+			NTRIALS);
+  ids = dfuFindDynList(dg, "ids");
+  rt = dfuFindDynList(dg, "rt");
+  dfuAddDynGroupNewList(dg, "codes", DF_CHAR, NTRIALS);
+  dfuAddDynGroupNewList(dg, "names", DF_STRING, NTRIALS);
+  dfuAddDynGroupNewList(dg, "spikes", DF_LIST, NTRIALS);
+
+  for (i = 0; i < NJUNK; i++)
+    dfuAddDynListLong(DYN_GROUP_LIST(dg, 0), (int) lcg());
+  for (i = 0; i < NTRIALS; i++) {
+    dfuAddDynListLong(ids, (int) (seed + i));
+    dfuAddDynListFloat(rt, (float) (lcg() % 1000) / 7.0f);
+    dfuAddDynListChar(DYN_GROUP_LIST(dg, 3), (unsigned char) lcg());
+    sprintf(buf, "t%u", lcg() % 100000);
+    dfuAddDynListString(DYN_GROUP_LIST(dg, 4), buf);
+    sub = dfuCreateDynList(DF_SHORT, 10);
+    for (j = lcg() % 8; j > 0; j--) dfuAddDynListShort(sub, (short) lcg());
+    dfuMoveDynListList(DYN_GROUP_LIST(dg, 5), sub);
+  }
+  return dg;
+}
+
+/* write_group -- save dg as the .dgz filename */
+static int write_group(DYN_GROUP *dg, char *filename)
+{
+  DG_SINK sink;
+  return dgOpenGzipSink(&sink, filename) && dgWriteDynGroup(dg, &sink);
+}
+
+/*
+ * store_group -- save dg as the .dgz filename without compressing it,
+ * so that the file's size only depends on the stream's
+ */
+static int store_group(DYN_GROUP *dg, char *filename)
+{
+  DG_WRITER w;
+  gzFile f;
+  int ok = 0;
+
+  dgInitWriter(&w);
+  if (dgWriterRecordDynGroup(&w, dg) && (f = gzopen(filename, "wb0"))) {
+    ok = gzwrite(f, DG_WRITER_BUFFER(&w), DG_WRITER_SIZE(&w)) ==
+      DG_WRITER_SIZE(&w);
+    if (gzclose(f) != Z_OK) ok = 0;
+  }
+  dgFreeWriter(&w);
+  return ok;
+}
+
+/* file_size -- length of filename, or -1 */
+static long file_size(char *filename)
+{
+  FILE *fp;
+  long size;
+
+  if (!(fp = fopen(filename, "rb"))) return -1;
+  fseek(fp, 0, SEEK_END);
+  size = ftell(fp);
+  fclose(fp);
+  return size;
+}
+
+/* same_list -- 1 if a holds elements [start, start+n) of b */
+static int same_list(DYN_LIST *a, DYN_LIST *b, int start, int n)
+{
+  int i, size = 0;
+
+  if (!a || !b) return a == b;
+  if (DYN_LIST_DATATYPE(a) != DYN_LIST_DATATYPE(b) ||
+      DYN_LIST_N(a) != n || start + n > DYN_LIST_N(b) ||
+      strcmp(DYN_LIST_NAME(a), DYN_LIST_NAME(b))) return 0;
+
+  switch (DYN_LIST_DATATYPE(a)) {
+  case DF_LIST:
+    for (i = 0; i < n; i++)
+      if (!same_list(dfuGetDynListList(a, i), dfuGetDynListList(b, start+i),
+		     0, DYN_LIST_N(dfuGetDynListList(b, start+i))))
+	return 0;
+    return 1;
+  case DF_STRING:
+    for (i = 0; i < n; i++)
+      if (strcmp(((char **) DYN_LIST_VALS(a))[i],
+		 ((char **) DYN_LIST_VALS(b))[start+i])) return 0;
+    return 1;
+  case DF_LONG:  size = sizeof(int);   break;
+  case DF_SHORT: size = sizeof(short); break;
+  case DF_FLOAT: size = sizeof(float); break;
+  case DF_CHAR:  size = sizeof(char);  break;
+  }
+  return !n || !memcmp(DYN_LIST_VALS(a),
+		       (char *) DYN_LIST_VALS(b) + start*size, n*size);
+}
+
+/*
+ * check_columns -- read names[] (elements [start, stop) of each, or
+ * all of them if stop is 0) from filename with flags, and compare them
+ * with the same lists of the full read dg
+ */
+static void check_columns(const char *what, char *filename, DYN_GROUP *dg,
+			  const char **names, int n, int flags,
+			  int start, int stop)
+{
+  DYN_GROUP *got = dfuCreateDynGroup(4);
+  DG_READER r;
+  DYN_LIST *dl;
+  int i, status;
+
+  dgInitReader(&r);
+  DG_READER_FLAGS(&r) |= flags;
+  dgReaderSetColumns(&r, names, n);
+  if (stop) dgReaderSetRange(&r, start, stop);
+  status = dgReaderGzipFileToStruct(&r, filename, got);
+  dgFreeReader(&r);
+
+  if (!stop) stop = NTRIALS;
+  if (status != DF_OK) fail(what, "read failed");
+  else if (DYN_GROUP_N(got) != n) fail(what, "wrong list count");
+  else if (strcmp(DYN_GROUP_NAME(got), DYN_GROUP_NAME(dg)))
+    fail(what, "group name");
+  else {
+    for (i = 0; i < n; i++) {
+      dl = dfuFindDynList(dg, (char *) names[i]);
+      if (!same_list(dfuFindDynList(got, (char *) names[i]), dl, start,
+		     dl == DYN_GROUP_LIST(dg, 0) ? NJUNK : stop-start))
+	fail(what, names[i]);
+    }
+  }
+  dfuFreeDynGroup(got);
+}
+
+/* reads -- every way check_columns() is asked for */
+static void reads(const char *what, char *filename, DYN_GROUP *dg)
+{
+  static const char *all[] = { "ids", "rt", "codes", "names", "spikes" };
+  static const char *some[] = { "spikes", "rt" };
+  static const char *one[] = { "codes" };
+  static const char *junk[] = { "junk", "names" };
+  char msg[80];
+
+  sprintf(msg, "%s: columns", what);
+  check_columns(msg, filename, dg, all, 5, 0, 0, 0);
+  sprintf(msg, "%s: two columns", what);
+  check_columns(msg, filename, dg, some, 2, 0, 0, 0);
+  sprintf(msg, "%s: borrowed", what);
+  check_columns(msg, filename, dg, some, 2, DG_READ_BORROW, 0, 0);
+  sprintf(msg, "%s: lazy", what);
+  check_columns(msg, filename, dg, some, 2, DG_READ_LAZY, 0, 0);
+  sprintf(msg, "%s: range", what);
+  check_columns(msg, filename, dg, all, 5, 0, 1234, 5678);
+  sprintf(msg, "%s: last rows", what);
+  check_columns(msg, filename, dg, one, 1, 0, NTRIALS-50, NTRIALS);
+  sprintf(msg, "%s: first list", what);
+  check_columns(msg, filename, dg, junk, 1, 0, 0, 0);
+}
+
+/* full_read -- the whole of filename, read without its sidecar */
+static DYN_GROUP *full_read(char *filename)
+{
+  DYN_GROUP *dg = dfuCreateDynGroup(8);
+
+  if (dguGzipFileToStruct(filename, dg) != DF_OK) {
+    dfuFreeDynGroup(dg);
+    return NULL;
+  }
+  return dg;
+}
+
+/*
+ * extract -- dgGzIndexExtract() from either side of each access point
+ * should match the inflated stream
+ */
+static void extract(DG_GZ_INDEX *idx, char *filename, char *sidecar)
+{
+  DG_WRITER w;
+  DYN_GROUP *dg;
+  unsigned char buf[4096];
+  int i, off;
+
+  dgInitWriter(&w);
+  if (!(dg = full_read(filename)) || !dgWriterRecordDynGroup(&w, dg)) {
+    fail("extract", "can't read the stream");
+    if (dg) dfuFreeDynGroup(dg);
+    dgFreeWriter(&w);
+    return;
+  }
+  if (DG_GZ_INDEX_SIZE(idx) != DG_WRITER_SIZE(&w))
+    fail("extract", "index has the wrong size");
+
+  for (i = 0; i < idx->npoints; i++) {
+    off = idx->points[i].out - 100;
+    if (off < 0) off = 0;
+    if (off + (int) sizeof(buf) > DG_WRITER_SIZE(&w)) break;
+    if (!dgGzIndexExtract(idx, filename, off, buf, sizeof(buf)) ||
+	memcmp(buf, DG_WRITER_BUFFER(&w) + off, sizeof(buf))) {
+      fail("extract", "differs from the stream");
+      break;
+    }
+  }
+  off = DG_WRITER_SIZE(&w) - 10;
+  if (!dgGzIndexExtract(idx, filename, off, buf, 10) ||
+      memcmp(buf, DG_WRITER_BUFFER(&w) + off, 10))
+    fail("extract", "differs at the end of the stream");
+  if (dgGzIndexExtract(idx, filename, off, buf, 11))
+    fail("extract", "read past the end of the stream");
+
+  /* the saved index should hold the same points */
+  dfuFreeDynGroup(dg);
+  dgFreeWriter(&w);
+  dgFreeGzIndex(idx);
+  if (!(idx = dgReadGzIndex(sidecar))) fail("extract", "sidecar unreadable");
+  else {
+    if (!dgGzIndexExtract(idx, filename, off, buf, 10))
+      fail("extract", "saved index can't extract");
+    dgFreeGzIndex(idx);
+  }
+}
+
+/*
+ * skipped -- damage the compressed bytes between the first two access
+ * points (all inside "junk"): a full read must now fail, while columns
+ * after them can only be read, correctly, by way of the index
+ */
+static void skipped(char *filename, DYN_GROUP *dg)
+{
+  static const char *some[] = { "spikes", "rt" };
+  DG_GZ_INDEX *idx;
+  DYN_GROUP *got;
+  FILE *fp;
+  int i, at;
+
+  if (!(idx = dgBuildGzIndex(filename, SPAN)) || idx->npoints < 3) {
+    fail("skipped", "too few access points");
+    if (idx) dgFreeGzIndex(idx);
+    return;
+  }
+  at = (idx->points[1].in + idx->points[2].in) / 2;
+  dgFreeGzIndex(idx);
+
+  if (!(fp = fopen(filename, "r+b"))) {
+    fail("skipped", "can't reopen");
+    return;
+  }
+  fseek(fp, at, SEEK_SET);
+  for (i = 0; i < 64; i++) fputc(i*37, fp);
+  fclose(fp);
+
+  if ((got = full_read(filename))) {
+    fail("skipped", "damaged file read in full");
+    dfuFreeDynGroup(got);
+  }
+  check_columns("skipped", filename, dg, some, 2, 0, 0, 0);
+  check_columns("skipped range", filename, dg, some, 2, 0, 10, 20);
+}
+
+int main(int argc, char *argv[])
+{
+  static char filename[] = "tgi.dgz", sidecar[] = "tgi.dgz.dgi";
+  static const char *ids[] = { "ids" };
+  DYN_GROUP *dg, *full;
+  DG_GZ_INDEX *idx;
+  FILE *fp;
+  long size;
+  char *buf;
+
+  remove(sidecar);
+  dg = make_group(1, 0);
+  if (!write_group(dg, filename)) {
+    printf("testgzindex: can't write %s\n", filename);
+    return 1;
+  }
+  if (!(full = full_read(filename))) {
+    printf("testgzindex: can't read %s\n", filename);
+    return 1;
+  }
+
+  /* no sidecar yet */
+  reads("unindexed", filename, full);
+
+  if (!dgIndexGzFile(filename, SPAN) ||
+      !(idx = dgBuildGzIndex(filename, SPAN)))
+    fail("index", "not made");
+  else {
+    if (idx->npoints < DG_GZ_INDEX_SIZE(idx) / (2*SPAN))
+      fail("index", "too few access points");
+    extract(idx, filename, sidecar);
+  }
+  reads("indexed", filename, full);
+  dfuFreeDynGroup(full);
+
+  /* the .dgz is rewritten with other values, leaving its old sidecar */
+  dfuFreeDynGroup(dg);
+  dg = make_group(2, 0);
+  if (!write_group(dg, filename) || !(full = full_read(filename))) {
+    printf("testgzindex: can't rewrite %s\n", filename);
+    return 1;
+  }
+  reads("stale", filename, full);
+  dfuFreeDynGroup(full);
+
+  /*
+   * stored, the file's size stays the same when ids and rt trade
+   * places, and the old index would find rt where it expects ids: only
+   * the trailer shows the sidecar is out of date
+   */
+  dfuFreeDynGroup(dg);
+  dg = make_group(3, 0);
+  store_group(dg, filename);
+  size = file_size(filename);
+  dgIndexGzFile(filename, SPAN);
+  dfuFreeDynGroup(dg);
+  dg = make_group(3, 1);
+  if (!store_group(dg, filename) || !(full = full_read(filename))) {
+    printf("testgzindex: can't rewrite %s\n", filename);
+    return 1;
+  }
+  if (file_size(filename) != size) fail("stale, same size", "size changed");
+  reads("stale, same size", filename, full);
+  check_columns("stale, same size: ids", filename, full, ids, 1, 0, 0, 0);
+
+  /* a sidecar cut short */
+  dgIndexGzFile(filename, SPAN);
+  if ((size = file_size(sidecar)) > 0 && (fp = fopen(sidecar, "rb"))) {
+    buf = (char *) malloc(size);
+    if (fread(buf, 1, size, fp) != (size_t) size) size = 0;
+    fclose(fp);
+    fp = fopen(sidecar, "wb");
+    fwrite(buf, 1, size/2, fp);
+    fclose(fp);
+    free(buf);
+    if ((idx = dgReadGzIndex(sidecar))) {
+      fail("truncated", "sidecar still loads");
+      dgFreeGzIndex(idx);
+    }
+  }
+  else fail("truncated", "no sidecar");
+  reads("truncated", filename, full);
+
+  /* and finally a good one, used to get past damage to the .dgz */
+  dgIndexGzFile(filename, SPAN);
+  skipped(filename, full);
+
+  dfuFreeDynGroup(full);
+  dfuFreeDynGroup(dg);
+  remove(filename);
+  remove(sidecar);
+
+  if (Failures) {
+    printf("%d failures\n", Failures);
+    return 1;
+  }
+  printf("all gz index reads ok\n");
+  return 0;
+}
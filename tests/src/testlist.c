@@ -0,0 +1,334 @@
+/*
+ * testlist -- check how dyn lists grow as they are added to, one
+ * element or many at a time, and how groups find their lists by name.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <df.h>
+#include <dynio.h>
+
+static int Failures = 0;
+
+static void fail(const char *what, const char *why)
+{
+  if (Failures++ < 20)
+    printf("FAIL %s: %s\n", what, why);
+}
+
+/* check_longs -- dl should hold first, first+1, ... (n in all) */
+static void check_longs(const char *what, DYN_LIST *dl, int first, int n)
+{
+  int i;
+
+  if (DYN_LIST_N(dl) != n) {
+    fail(what, "wrong length");
+    return;
+  }
+  for (i = 0; i < n; i++)
+    if (((int *) DYN_LIST_VALS(dl))[i] != first+i) {
+      fail(what, "wrong value");
+      return;
+    }
+}
+
+/*
+ * fill -- add n longs one at a time, returning how many times the
+ * list's capacity changed
+ */
+static int fill(DYN_LIST *dl, int n)
+{
+  int i, max = DYN_LIST_MAX(dl), grew = 0;
+
+  for (i = 0; i < n; i++) {
+    dfuAddDynListLong(dl, i);
+    if (DYN_LIST_MAX(dl) != max) {
+      max = DYN_LIST_MAX(dl);
+      grew++;
+    }
+  }
+  return grew;
+}
+
+/*
+ * geometric -- a DL_GEOMETRIC list (or any list, after
+ * dfuSetGeometricGrowth(1)) doubles when full; others grow by their
+ * increment.  The flag is saved with the list.
+ */
+static void geometric(void)
+{
+  DYN_GROUP *dg, *got;
+  DYN_LIST *dl;
+  DG_WRITER w;
+  char buf[32];
+  int i, grew, old;
+
+  dl = dfuCreateDynList(DF_LONG, 10);
+  if ((grew = fill(dl, 1000)) != 99) fail("increment", "wrong growth");
+  if (DYN_LIST_MAX(dl) != 1000) fail("increment", "wrong capacity");
+  check_longs("increment", dl, 0, 1000);
+  dfuFreeDynList(dl);
+
+  dl = dfuCreateDynList(DF_LONG, 10);
+  if (dfuSetDynListGeometric(dl, 1) != 0) fail("geometric", "already set");
+  if ((grew = fill(dl, 100000)) > 16) fail("geometric", "grew too often");
+  if (DYN_LIST_MAX(dl) >= 2*100000) fail("geometric", "grew too much");
+  check_longs("geometric", dl, 0, 100000);
+  if (dfuSetDynListGeometric(dl, 0) != 1) fail("geometric", "flag not set");
+  dfuFreeDynList(dl);
+
+  old = dfuSetGeometricGrowth(1);
+  dl = dfuCreateDynList(DF_LONG, 10);
+  if ((grew = fill(dl, 100000)) > 16)
+    fail("global geometric", "grew too often");
+  check_longs("global geometric", dl, 0, 100000);
+  dfuFreeDynList(dl);
+  dfuSetGeometricGrowth(old);
+
+  /* every type of list grows the same way */
+  dg = dfuCreateNamedDynGroup("grown", 6);
+  dfuAddDynGroupNewList(dg, "longs", DF_LONG, 1);
+  dfuAddDynGroupNewList(dg, "shorts", DF_SHORT, 1);
+  dfuAddDynGroupNewList(dg, "floats", DF_FLOAT, 1);
+  dfuAddDynGroupNewList(dg, "chars", DF_CHAR, 1);
+  dfuAddDynGroupNewList(dg, "strings", DF_STRING, 1);
+  dfuAddDynGroupNewList(dg, "lists", DF_LIST, 1);
+  dfuAddDynGroupNewList(dg, "plain", DF_LONG, 1);
+  for (i = 0; i < 6; i++) dfuSetDynListGeometric(DYN_GROUP_LIST(dg, i), 1);
+  for (i = 0; i < 5000; i++) {
+    dfuAddDynListLong(DYN_GROUP_LIST(dg, 0), i);
+    dfuAddDynListShort(DYN_GROUP_LIST(dg, 1), (short) i);
+    dfuAddDynListFloat(DYN_GROUP_LIST(dg, 2), (float) i);
+    dfuAddDynListChar(DYN_GROUP_LIST(dg, 3), (unsigned char) i);
+    sprintf(buf, "%d", i);
+    dfuAddDynListString(DYN_GROUP_LIST(dg, 4), buf);
+    dfuMoveDynListList(DYN_GROUP_LIST(dg, 5), dfuCreateDynList(DF_LONG, 1));
+    dfuAddDynListLong(DYN_GROUP_LIST(dg, 6), i);
+  }
+  for (i = 0; i < 6; i++) {
+    dl = DYN_GROUP_LIST(dg, i);
+    if (DYN_LIST_N(dl) != 5000 || DYN_LIST_MAX(dl) >= 2*5000 ||
+	DYN_LIST_MAX(dl) & (DYN_LIST_MAX(dl)-1))
+      fail(DYN_LIST_NAME(dl), "didn't double");
+  }
+  dl = DYN_GROUP_LIST(dg, 4);
+  if (strcmp(((char **) DYN_LIST_VALS(dl))[4999], "4999"))
+    fail("strings", "wrong value");
+
+  dgInitWriter(&w);
+  dgWriterRecordDynGroup(&w, dg);
+  got = dfuCreateDynGroup(4);
+  if (dguBufferToStruct(DG_WRITER_BUFFER(&w), DG_WRITER_SIZE(&w), got) !=
+      DF_OK || DYN_GROUP_N(got) != 7) fail("geometric saved", "read failed");
+  else {
+    for (i = 0; i < 7; i++)
+      if (!(DYN_LIST_FLAGS(DYN_GROUP_LIST(got, i)) & DL_GEOMETRIC) !=
+	  (i == 6))
+	fail(DYN_LIST_NAME(DYN_GROUP_LIST(got, i)), "flag not saved");
+  }
+  dfuFreeDynGroup(got);
+  dgFreeWriter(&w);
+  dfuFreeDynGroup(dg);
+}
+
+/*
+ * bulk -- reserving makes room without adding; appends and range
+ * inserts copy (or cast) a batch in with one allocation
+ */
+static void bulk(void)
+{
+  DYN_LIST *dl, *sub, *subs[2];
+  int ints[100], i;
+  short shorts[5] = { -2, -1, 0, 1, 2 };
+  float floats[3] = { 0.5f, 1.5f, 2.5f };
+  unsigned char chars[4] = { 1, 2, 3, 250 };
+  double doubles[3] = { 1.9, -2.9, 100000.25 };
+  char *strings[3] = { "a", "", "ccc" };
+  void *vals;
+
+  for (i = 0; i < 100; i++) ints[i] = i;
+
+  /* reserve */
+  dl = dfuCreateDynList(DF_LONG, 1);
+  if (!dfuReserveDynList(dl, 1000) || DYN_LIST_MAX(dl) < 1000 ||
+      DYN_LIST_N(dl)) fail("reserve", "no room made");
+  vals = DYN_LIST_VALS(dl);
+  fill(dl, 1000);
+  if (DYN_LIST_VALS(dl) != vals) fail("reserve", "reallocated anyway");
+  if (!dfuReserveDynList(dl, 10) || DYN_LIST_MAX(dl) < 1000)
+    fail("reserve", "shrank");
+  check_longs("reserve", dl, 0, 1000);
+  dfuFreeDynList(dl);
+
+  /* append, of the list's own type and cast to it */
+  dl = dfuCreateDynList(DF_LONG, 1);
+  if (!dfuAppendDynListLongs(dl, 50, ints) ||
+      !dfuAppendDynListLongs(dl, 0, ints) ||
+      !dfuAppendDynListLongs(dl, 50, ints+50))
+    fail("append longs", "failed");
+  check_longs("append longs", dl, 0, 100);
+  if (!dfuAppendDynListDoubles(dl, 3, doubles) ||
+      !dfuAppendDynListShorts(dl, 5, shorts) ||
+      !dfuAppendDynListChars(dl, 4, chars) || DYN_LIST_N(dl) != 112 ||
+      ((int *) DYN_LIST_VALS(dl))[101] != -2 ||
+      ((int *) DYN_LIST_VALS(dl))[102] != 100000 ||
+      ((int *) DYN_LIST_VALS(dl))[103] != -2 ||
+      ((int *) DYN_LIST_VALS(dl))[111] != 250)
+    fail("append cast to longs", "wrong values");
+  dfuFreeDynList(dl);
+
+  dl = dfuCreateDynList(DF_FLOAT, 1);
+  if (!dfuAppendDynListFloats(dl, 3, floats) ||
+      !dfuAppendDynListLongs(dl, 2, ints+7) || DYN_LIST_N(dl) != 5 ||
+      ((float *) DYN_LIST_VALS(dl))[2] != 2.5f ||
+      ((float *) DYN_LIST_VALS(dl))[4] != 8.0f)
+    fail("append floats", "wrong values");
+  dfuFreeDynList(dl);
+
+  dl = dfuCreateDynList(DF_SHORT, 1);
+  if (!dfuAppendDynListShorts(dl, 5, shorts) ||
+      !dfuAppendDynListFloats(dl, 3, floats) || DYN_LIST_N(dl) != 8 ||
+      ((short *) DYN_LIST_VALS(dl))[0] != -2 ||
+      ((short *) DYN_LIST_VALS(dl))[7] != 2)
+    fail("append shorts", "wrong values");
+  dfuFreeDynList(dl);
+
+  dl = dfuCreateDynList(DF_CHAR, 1);
+  if (!dfuAppendDynListChars(dl, 4, chars) || DYN_LIST_N(dl) != 4 ||
+      ((unsigned char *) DYN_LIST_VALS(dl))[3] != 250)
+    fail("append chars", "wrong values");
+  dfuFreeDynList(dl);
+
+  dl = dfuCreateDynList(DF_STRING, 1);
+  if (dfuAppendDynListLongs(dl, 3, ints) || DYN_LIST_N(dl))
+    fail("append to strings", "accepted");
+  dfuFreeDynList(dl);
+
+  /* range inserts at the start, middle and end */
+  dl = dfuCreateDynList(DF_LONG, 1);
+  if (!dfuInsertDynListRange(dl, 0, 10, ints+40) ||
+      !dfuInsertDynListRange(dl, 0, 40, ints) ||
+      !dfuInsertDynListRange(dl, 50, 40, ints+60) ||
+      !dfuInsertDynListRange(dl, 50, 10, ints+50) ||
+      !dfuInsertDynListRange(dl, 100, 0, ints))
+    fail("insert range", "failed");
+  check_longs("insert range", dl, 0, 100);
+  if (dfuInsertDynListRange(dl, 101, 1, ints) ||
+      dfuInsertDynListRange(dl, -1, 1, ints))
+    fail("insert range", "out of range");
+  check_longs("insert range", dl, 0, 100);
+  dfuFreeDynList(dl);
+
+  /* strings and lists are copied */
+  dl = dfuCreateDynList(DF_STRING, 1);
+  dfuAddDynListString(dl, "last");
+  if (!dfuInsertDynListRange(dl, 0, 3, strings) || DYN_LIST_N(dl) != 4 ||
+      strcmp(((char **) DYN_LIST_VALS(dl))[0], "a") ||
+      strcmp(((char **) DYN_LIST_VALS(dl))[1], "") ||
+      strcmp(((char **) DYN_LIST_VALS(dl))[2], "ccc") ||
+      strcmp(((char **) DYN_LIST_VALS(dl))[3], "last") ||
+      ((char **) DYN_LIST_VALS(dl))[2] == strings[2])
+    fail("insert strings", "wrong values");
+  dfuFreeDynList(dl);
+
+  dl = dfuCreateDynList(DF_LIST, 1);
+  for (i = 0; i < 2; i++) {
+    subs[i] = dfuCreateDynList(DF_LONG, 1);
+    dfuAppendDynListLongs(subs[i], 10, ints + 10*i);
+  }
+  dfuAddDynListList(dl, subs[1]);
+  if (!dfuInsertDynListRange(dl, 0, 2, subs) || DYN_LIST_N(dl) != 3)
+    fail("insert lists", "failed");
+  else {
+    for (i = 0; i < 3; i++) {
+      sub = dfuGetDynListList(dl, i);
+      if (sub == subs[0] || sub == subs[1]) fail("insert lists", "not copied");
+      else check_longs("insert lists", sub, i ? 10 : 0, 10);
+    }
+  }
+  dfuFreeDynList(subs[0]);
+  dfuFreeDynList(subs[1]);
+  dfuFreeDynList(dl);
+}
+
+/* find_all -- each of the first n lists of dg should be found by name */
+static void find_all(const char *what, DYN_GROUP *dg, int n)
+{
+  char name[32];
+  DYN_LIST *dl;
+  int i;
+
+  for (i = 0; i < n; i++) {
+    sprintf(name, "list%d", i);
+    if (!(dl = dfuFindDynList(dg, name)) || strcmp(DYN_LIST_NAME(dl), name)) {
+      fail(what, "list not found");
+      return;
+    }
+  }
+  if (dfuFindDynList(dg, "missing")) fail(what, "found a missing list");
+  dl = dfuFindDynList(dg, "dup");
+  if (!dl || DYN_LIST_DATATYPE(dl) != DF_LONG)
+    fail(what, "didn't find the first of two lists with one name");
+}
+
+/*
+ * names -- dfuFindDynList() finds the first list of each name, with or
+ * without an index, and never builds one itself (so that threads can
+ * look names up in a shared group).  Once made with dfuIndexDynGroup()
+ * an index is kept up to date as lists are added and copied.
+ */
+static void names(void)
+{
+  DYN_GROUP *dg, *copy;
+  char name[32];
+  int i;
+
+  dg = dfuCreateNamedDynGroup("named", 10);
+  dfuAddDynGroupNewList(dg, "dup", DF_LONG, 1);
+  dfuAddDynGroupNewList(dg, "dup", DF_FLOAT, 1);
+  for (i = 0; i < 100; i++) {
+    sprintf(name, "list%d", i);
+    dfuAddDynGroupNewList(dg, name, DF_LONG, 1);
+  }
+
+  find_all("unindexed", dg, 100);
+  if (DYN_GROUP_INDEX(dg)) fail("unindexed", "lookup built an index");
+  copy = dfuCopyDynGroup(dg, "copy");
+  if (DYN_GROUP_INDEX(copy)) fail("unindexed copy", "indexed");
+  find_all("unindexed copy", copy, 100);
+  dfuFreeDynGroup(copy);
+
+  if (!dfuIndexDynGroup(dg) || !DYN_GROUP_INDEX(dg))
+    fail("indexed", "no index made");
+  find_all("indexed", dg, 100);
+
+  /* enough to make the index grow */
+  for (; i < 1000; i++) {
+    sprintf(name, "list%d", i);
+    dfuAddDynGroupNewList(dg, name, DF_LONG, 1);
+  }
+  find_all("indexed, added to", dg, 1000);
+  if (2*DYN_GROUP_N(dg) > DYN_GROUP_NINDEX(dg))
+    fail("indexed, added to", "index too full");
+
+  copy = dfuCopyDynGroup(dg, "copy");
+  if (!DYN_GROUP_INDEX(copy)) fail("indexed copy", "not indexed");
+  find_all("indexed copy", copy, 1000);
+  dfuFreeDynGroup(copy);
+  dfuFreeDynGroup(dg);
+}
+
+int main(int argc, char *argv[])
+{
+  geometric();
+  bulk();
+  names();
+
+  if (Failures) {
+    printf("%d failures\n", Failures);
+    return 1;
+  }
+  printf("all lists ok\n");
+  return 0;
+}
@@ -0,0 +1,560 @@
+/*
+ * testparse -- check the readers that walk a dg stream without (or
+ * before) building a group from it: the table of contents scan and
+ * the callback parser.  Each is also given the stream as a machine of
+ * the other byte order would have written it, as are the readers.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#include <df.h>
+#include <dynio.h>
+
+static int Failures = 0;
+
+static void fail(const char *what, const char *list, const char *why)
+{
+  if (Failures++ < 20)
+    printf("FAIL %s: %s %s\n", what, list, why);
+}
+
+enum { IDS, RT, CODES, RESP, NAMES, SPIKES, EVENTS, EMPTY, NLISTS };
+static char *Names[NLISTS] = { "ids", "rt", "codes", "resp", "names",
+			       "spikes", "events", "empty" };
+static int Types[NLISTS] = { DF_LONG, DF_FLOAT, DF_SHORT, DF_CHAR,
+			     DF_STRING, DF_LIST, DF_LIST, DF_FLOAT };
+static int Lengths[NLISTS] = { 37, 1001, 19, 5, 12, 25, 9, 0 };
+static int Depths[NLISTS] = { 0, 0, 0, 0, 0, 1, 2, 0 };
+
+/*
+ * make_group -- lists of each type, with odd lengths (so arrays end
+ * partway through a vector) and nested, named sublists
+ */
+static DYN_GROUP *make_group(void)
+{
+  DYN_GROUP *dg = dfuCreateNamedDynGroup("parsed", NLISTS);
+  DYN_LIST *sub, *part;
+  char buf[32];
+  int i, j;
+
+  for (i = 0; i < NLISTS; i++)
+    dfuAddDynGroupNewList(dg, Names[i], Types[i], 10);
+
+  for (i = 0; i < Lengths[IDS]; i++)
+    dfuAddDynListLong(DYN_GROUP_LIST(dg, IDS), i*65599 - 1000000);
+  for (i = 0; i < Lengths[RT]; i++)
+    dfuAddDynListFloat(DYN_GROUP_LIST(dg, RT), i*0.25f - 100.0f);
+  for (i = 0; i < Lengths[CODES]; i++)
+    dfuAddDynListShort(DYN_GROUP_LIST(dg, CODES), (short) (i*1031 - 9000));
+  for (i = 0; i < Lengths[RESP]; i++)
+    dfuAddDynListChar(DYN_GROUP_LIST(dg, RESP), (unsigned char) (i*50));
+  for (i = 0; i < Lengths[NAMES]; i++) {
+    sprintf(buf, i%4 ? "name%d" : "", i);
+    dfuAddDynListString(DYN_GROUP_LIST(dg, NAMES), buf);
+  }
+  for (i = 0; i < Lengths[SPIKES]; i++) {
+    sub = dfuCreateDynList(DF_LONG, 10);
+    for (j = 0; j < i%9; j++) dfuAddDynListLong(sub, i*1000 + j*17);
+    dfuMoveDynListList(DYN_GROUP_LIST(dg, SPIKES), sub);
+  }
+  for (i = 0; i < Lengths[EVENTS]; i++) {
+    sub = dfuCreateDynList(DF_LIST, 2);
+    part = dfuCreateNamedDynList("types", DF_SHORT, 4);
+    for (j = 0; j < i; j++) dfuAddDynListShort(part, (short) (j - i));
+    dfuMoveDynListList(sub, part);
+    part = dfuCreateNamedDynList("times", DF_FLOAT, 4);
+    for (j = 0; j < i; j++) dfuAddDynListFloat(part, j*1.5f + i);
+    dfuMoveDynListList(sub, part);
+    dfuMoveDynListList(DYN_GROUP_LIST(dg, EVENTS), sub);
+  }
+  return dg;
+}
+
+/* same_list -- 1 if a and b hold the same data */
+static int same_list(DYN_LIST *a, DYN_LIST *b)
+{
+  int i, size = 0;
+
+  if (!a || !b) return a == b;
+  if (DYN_LIST_DATATYPE(a) != DYN_LIST_DATATYPE(b) ||
+      DYN_LIST_N(a) != DYN_LIST_N(b) ||
+      strcmp(DYN_LIST_NAME(a), DYN_LIST_NAME(b))) return 0;
+
+  switch (DYN_LIST_DATATYPE(a)) {
+  case DF_LIST:
+    for (i = 0; i < DYN_LIST_N(a); i++)
+      if (!same_list(dfuGetDynListList(a, i), dfuGetDynListList(b, i)))
+	return 0;
+    return 1;
+  case DF_STRING:
+    for (i = 0; i < DYN_LIST_N(a); i++)
+      if (strcmp(((char **) DYN_LIST_VALS(a))[i],
+		 ((char **) DYN_LIST_VALS(b))[i])) return 0;
+    return 1;
+  case DF_LONG:  size = sizeof(int);   break;
+  case DF_SHORT: size = sizeof(short); break;
+  case DF_FLOAT: size = sizeof(float); break;
+  case DF_CHAR:  size = sizeof(char);  break;
+  }
+  return !DYN_LIST_N(a) ||
+    !memcmp(DYN_LIST_VALS(a), DYN_LIST_VALS(b), DYN_LIST_N(a)*size);
+}
+
+static void check_group(const char *what, DYN_GROUP *dg, DYN_GROUP *got)
+{
+  int i;
+
+  if (strcmp(DYN_GROUP_NAME(dg), DYN_GROUP_NAME(got)))
+    fail(what, "group", "name");
+  if (DYN_GROUP_N(dg) != DYN_GROUP_N(got)) {
+    fail(what, "group", "wrong list count");
+    return;
+  }
+  for (i = 0; i < DYN_GROUP_N(dg); i++)
+    if (!same_list(DYN_GROUP_LIST(dg, i), DYN_GROUP_LIST(got, i)))
+      fail(what, DYN_LIST_NAME(DYN_GROUP_LIST(dg, i)), "differs");
+}
+
+/*********************************************************************/
+/*                     Table of contents                             */
+/*********************************************************************/
+
+/* check_toc -- toc should list the group's lists at the same offsets */
+static void check_toc(const char *what, DG_TOC *toc, DG_TOC *ref,
+		      unsigned char *vbuf)
+{
+  DG_TOC_ENTRY *e;
+  int i;
+
+  if (!toc) {
+    fail(what, "toc", "scan failed");
+    return;
+  }
+  if (strcmp(DG_TOC_NAME(toc), "parsed")) fail(what, "toc", "group name");
+  if (DG_TOC_N(toc) != NLISTS) {
+    fail(what, "toc", "wrong number of entries");
+    return;
+  }
+  for (i = 0; i < NLISTS; i++) {
+    e = DG_TOC_ENTRY(toc, i);
+    if (strcmp(DG_TOC_ENTRY_NAME(e), Names[i]))
+      fail(what, Names[i], "name");
+    if (DG_TOC_ENTRY_DATATYPE(e) != Types[i]) fail(what, Names[i], "type");
+    if (DG_TOC_ENTRY_N(e) != Lengths[i]) fail(what, Names[i], "length");
+    if (DG_TOC_ENTRY_DEPTH(e) != Depths[i]) fail(what, Names[i], "depth");
+    if (ref) {
+      if (DG_TOC_ENTRY_OFFSET(e) !=
+	  DG_TOC_ENTRY_OFFSET(DG_TOC_ENTRY(ref, i)))
+	fail(what, Names[i], "offset differs from the buffer's");
+    }
+    else if (vbuf[DG_TOC_ENTRY_OFFSET(e)] != DG_DYNLIST_TAG ||
+	     (i && DG_TOC_ENTRY_OFFSET(e) <=
+	      DG_TOC_ENTRY_OFFSET(DG_TOC_ENTRY(toc, i-1))))
+      fail(what, Names[i], "offset");
+  }
+}
+
+/* check_toc_file -- dgScanTocFile() should agree with the buffer's toc */
+static void check_toc_file(const char *what, char *filename, DG_TOC *ref)
+{
+  DG_TOC *toc = dgScanTocFile(filename);
+
+  check_toc(what, toc, ref, NULL);
+  if (toc) dgFreeToc(toc);
+  remove(filename);
+}
+
+/*
+ * toc -- dgScanToc() should describe every list without touching the
+ * buffer, and dgScanTocFile() should agree for each kind of file
+ */
+static void toc(DYN_GROUP *dg)
+{
+  DG_WRITER w;
+  DG_TOC *ref, *cut;
+  unsigned char *copy;
+  int size;
+
+  dgInitWriter(&w);
+  dgWriterRecordDynGroup(&w, dg);
+  size = DG_WRITER_SIZE(&w);
+  copy = (unsigned char *) malloc(size);
+  memcpy(copy, DG_WRITER_BUFFER(&w), size);
+
+  ref = dgScanToc(copy, size);
+  check_toc("toc buffer", ref, NULL, copy);
+  if (memcmp(copy, DG_WRITER_BUFFER(&w), size))
+    fail("toc buffer", "toc", "scan changed the buffer");
+  if (!ref) goto done;
+
+  if ((cut = dgScanToc(copy, size-1))) {
+    fail("toc short buffer", "toc", "scanned");
+    dgFreeToc(cut);
+  }
+
+  if (!dgWriterWriteBuffer(&w, "tp_toc.dg", DF_BINARY) ||
+      !dgWriterWriteBuffer(&w, "tp_toc.lz4", DF_LZ4) ||
+      !dgWriterWriteBufferCompressed(&w, "tp_toc.dgz"))
+    fail("toc files", "toc", "can't write");
+  else {
+    check_toc_file("toc .dg", "tp_toc.dg", ref);
+    check_toc_file("toc .lz4", "tp_toc.lz4", ref);
+    check_toc_file("toc .dgz", "tp_toc.dgz", ref);
+  }
+  dgFreeToc(ref);
+
+ done:
+  free(copy);
+  dgFreeWriter(&w);
+}
+
+/*********************************************************************/
+/*                     Callback parser                               */
+/*********************************************************************/
+
+/* BUILD -- what the callbacks below rebuild the parsed group in */
+typedef struct {
+  DYN_GROUP *dg;
+  int        ngroups;
+  int        depth;
+  char       names[8][DYN_LIST_NAME_SIZE];
+  DYN_LIST  *lists[8];		/* the list open at each depth */
+} BUILD;
+
+static int begin_group(void *user, const char *name)
+{
+  BUILD *b = (BUILD *) user;
+  if (!b->ngroups++)
+    strncpy(DYN_GROUP_NAME(b->dg), name, DYN_GROUP_NAME_SIZE-1);
+  return 1;
+}
+
+static int begin_list(void *user, const char *name, int depth)
+{
+  BUILD *b = (BUILD *) user;
+  if (depth < 0 || depth >= 8) return 0;
+  b->depth = depth;
+  strncpy(b->names[depth], name, DYN_LIST_NAME_SIZE-1);
+  b->names[depth][DYN_LIST_NAME_SIZE-1] = 0;
+  b->lists[depth] = NULL;
+  return 1;
+}
+
+static int data(void *user, int datatype, void *vals, int n)
+{
+  BUILD *b = (BUILD *) user;
+  DYN_LIST *dl;
+
+  dl = b->lists[b->depth] =
+    dfuCreateNamedDynList(b->names[b->depth], datatype, n > 0 ? n : 10);
+  if (!n) return 1;
+  switch (datatype) {
+  case DF_LONG:  return dfuAppendDynListLongs(dl, n, (int *) vals);
+  case DF_SHORT: return dfuAppendDynListShorts(dl, n, (short *) vals);
+  case DF_FLOAT: return dfuAppendDynListFloats(dl, n, (float *) vals);
+  case DF_CHAR:
+    return dfuAppendDynListChars(dl, n, (unsigned char *) vals);
+  }
+  return !vals;			/* strings and sublists follow */
+}
+
+static int string(void *user, int index, const char *s)
+{
+  BUILD *b = (BUILD *) user;
+  DYN_LIST *dl = b->lists[b->depth];
+
+  if (!dl || DYN_LIST_N(dl) != index) return 0;
+  dfuAddDynListString(dl, (char *) s);
+  return 1;
+}
+
+static int end_list(void *user, int depth)
+{
+  BUILD *b = (BUILD *) user;
+  DYN_LIST *dl = b->lists[depth];
+
+  if (!dl || depth != b->depth) return 0;
+  if (!depth) dfuAddDynGroupExistingList(b->dg, b->names[0], dl);
+  else if (!b->lists[depth-1]) return 0;
+  else dfuMoveDynListList(b->lists[depth-1], dl);
+  b->lists[depth] = NULL;
+  b->depth = depth-1;
+  return 1;
+}
+
+static DG_CALLBACKS Callbacks = { begin_group, NULL, begin_list, end_list,
+				  data, string };
+
+/* parse -- rebuild the group in vbuf through r's callbacks */
+static int parse(DG_READER *r, unsigned char *vbuf, int size, DYN_GROUP *dg)
+{
+  BUILD b;
+
+  memset(&b, 0, sizeof(b));
+  b.dg = dg;
+  return dgReaderParse(r, vbuf, size, &Callbacks, &b);
+}
+
+/*
+ * callbacks -- dgParse() should report the whole group; with
+ * DG_READ_PRESERVE set it should leave the buffer as it was, so that
+ * it can be parsed again
+ */
+static void callbacks(const char *what, DYN_GROUP *dg, unsigned char *stream,
+		      int size)
+{
+  DG_READER r;
+  DYN_GROUP *got;
+  unsigned char *copy = (unsigned char *) malloc(size);
+  char msg[64];
+  int pass;
+
+  memcpy(copy, stream, size);
+  dgInitReader(&r);
+  DG_READER_FLAGS(&r) |= DG_READ_PRESERVE;
+  for (pass = 0; pass < 2; pass++) {
+    sprintf(msg, "%s preserve pass %d", what, pass);
+    got = dfuCreateDynGroup(4);
+    if (parse(&r, copy, size, got) != DF_OK) fail(msg, "group", "failed");
+    else check_group(msg, dg, got);
+    if (memcmp(copy, stream, size)) fail(msg, "group", "buffer changed");
+    dfuFreeDynGroup(got);
+  }
+  dgFreeReader(&r);
+
+  /* without it the buffer may change, but the parse is the same */
+  sprintf(msg, "%s in place", what);
+  got = dfuCreateDynGroup(4);
+  dgInitReader(&r);
+  if (parse(&r, copy, size, got) != DF_OK) fail(msg, "group", "failed");
+  else check_group(msg, dg, got);
+  dgFreeReader(&r);
+  dfuFreeDynGroup(got);
+
+  free(copy);
+}
+
+static int count_list(void *user, const char *name, int depth)
+{
+  return ++*(int *) user < 3;
+}
+
+/* stopped -- a handler returning 0 stops the parse there */
+static void stopped(unsigned char *stream, int size)
+{
+  DG_CALLBACKS cb;
+  unsigned char *copy = (unsigned char *) malloc(size);
+  int n = 0;
+
+  memcpy(copy, stream, size);
+  memset(&cb, 0, sizeof(cb));
+  cb.begin_list = count_list;
+  if (dgParse(copy, size, &cb, &n) != DF_ABORT || n != 3)
+    fail("stopped parse", "group", "didn't stop");
+  if (dgParse((unsigned char *) "not a dg stream", 15, &cb, &n) != 0)
+    fail("parse non-dg", "group", "parsed");
+  free(copy);
+}
+
+/*********************************************************************/
+/*                     Byte-swapped streams                          */
+/*********************************************************************/
+
+static void swap(unsigned char *p, int size)
+{
+  unsigned char c;
+  int i;
+
+  for (i = 0; i < size/2; i++) {
+    c = p[i];
+    p[i] = p[size-1-i];
+    p[size-1-i] = c;
+  }
+}
+
+/* flip_count -- swap the count at p, returning it as it was */
+static int flip_count(unsigned char *p)
+{
+  int n;
+  memcpy(&n, p, sizeof(int));
+  swap(p, sizeof(int));
+  return n;
+}
+
+/*
+ * flip_stream -- turn a dg stream into the other byte order, as a
+ * machine of that order would have written it.  Returns 0 if the
+ * stream isn't laid out as expected.
+ */
+static int flip_stream(unsigned char *buf, int size)
+{
+  int structs[16], depth = 0, p = DG_MAGIC_NUMBER_SIZE, n, i, elt;
+  unsigned char tag;
+
+  structs[0] = DG_TOP_LEVEL;
+  while (p < size) {
+    tag = buf[p++];
+    if (tag == END_STRUCT) {
+      if (!depth--) return 0;
+      continue;
+    }
+    elt = 0;
+    switch (structs[depth]) {
+    case DG_TOP_LEVEL:
+      if (tag == DG_VERSION_TAG) elt = -1;
+      else if (tag == DG_BEGIN_TAG || tag == DG_CHUNK_TAG)
+	structs[++depth] = DYN_GROUP_STRUCT;
+      else return 0;
+      break;
+    case DYN_GROUP_STRUCT:
+      if (tag == DG_NAME_TAG) elt = 1;
+      else if (tag == DG_NLISTS_TAG) elt = -1;
+      else if (tag == DG_DYNLIST_TAG) structs[++depth] = DYN_LIST_STRUCT;
+      else return 0;
+      break;
+    case DYN_LIST_STRUCT:
+      switch (tag) {
+      case DL_NAME_TAG:
+      case DL_CHAR_DATA_TAG:  elt = 1; break;
+      case DL_SHORT_DATA_TAG: elt = 2; break;
+      case DL_LONG_DATA_TAG:
+      case DL_FLOAT_DATA_TAG: elt = 4; break;
+      case DL_INCREMENT_TAG:
+      case DL_LIST_DATA_TAG:
+      case DL_FLAGS_TAG:      elt = -1; break;
+      case DL_DATA_TAG:       break;
+      case DL_SUBLIST_TAG:    structs[++depth] = DYN_LIST_STRUCT; break;
+      case DL_STRING_DATA_TAG:
+	n = flip_count(buf+p);
+	p += sizeof(int);
+	for (i = 0; i < n; i++) p += sizeof(int) + flip_count(buf+p);
+	break;
+      default:
+	return 0;
+      }
+      break;
+    }
+    if (depth >= 15) return 0;
+    if (elt < 0) {		/* a single int or float */
+      swap(buf+p, 4);
+      p += 4;
+    }
+    else if (elt) {		/* a count and that many elements */
+      n = flip_count(buf+p);
+      p += sizeof(int);
+      for (i = 0; i < n; i++, p += elt) swap(buf+p, elt);
+    }
+  }
+  return !depth && p == size;
+}
+
+static int read_flipped(char *filename, int flags, DYN_GROUP *dg)
+{
+  DG_READER r;
+  int status;
+
+  dgInitReader(&r);
+  DG_READER_FLAGS(&r) |= flags;
+  status = dgReaderReadDynGroup(&r, filename, dg);
+  dgFreeReader(&r);
+  return status;
+}
+
+/*
+ * flipped -- a stream of the other byte order should read (however it
+ * is read), scan and parse just as one of ours does
+ */
+static void flipped(DYN_GROUP *dg, unsigned char *stream, int size)
+{
+  static int flags[] = { 0, DG_READ_BORROW, DG_READ_LAZY, DG_READ_CSR,
+			 DG_READ_POOL, DG_READ_LAZY | DG_READ_CSR };
+  unsigned char *flip = (unsigned char *) malloc(size);
+  unsigned char *copy = (unsigned char *) malloc(size);
+  DYN_GROUP *got;
+  DG_TOC *toc;
+  FILE *fp;
+  gzFile gz;
+  char msg[64];
+  int i;
+
+  memcpy(flip, stream, size);
+  if (!flip_stream(flip, size) || !memcmp(flip, stream, size)) {
+    fail("flipped", "group", "can't flip the stream");
+    goto done;
+  }
+
+  memcpy(copy, flip, size);
+  got = dfuCreateDynGroup(4);
+  if (dguBufferToStruct(copy, size, got) != DF_OK)
+    fail("flipped buffer", "group", "read failed");
+  else check_group("flipped buffer", dg, got);
+  dfuFreeDynGroup(got);
+
+  memcpy(copy, flip, size);
+  toc = dgScanToc(copy, size);
+  check_toc("flipped toc", toc, NULL, copy);
+  if (toc) dgFreeToc(toc);
+
+  callbacks("flipped", dg, flip, size);
+
+  if (!(fp = fopen("tp_flip.dg", "wb")) ||
+      fwrite(flip, 1, size, fp) != (size_t) size || fclose(fp) ||
+      !(gz = gzopen("tp_flip.dgz", "wb")) ||
+      gzwrite(gz, flip, size) != size || gzclose(gz) != Z_OK) {
+    fail("flipped files", "group", "can't write");
+    goto done;
+  }
+  for (i = 0; i < (int) (sizeof(flags)/sizeof(flags[0])); i++) {
+    sprintf(msg, "flipped .dg flags 0x%x", flags[i]);
+    got = dfuCreateDynGroup(4);
+    if (read_flipped("tp_flip.dg", flags[i], got) != DF_OK)
+      fail(msg, "group", "read failed");
+    else check_group(msg, dg, got);
+    dfuFreeDynGroup(got);
+  }
+
+  got = dfuCreateDynGroup(4);
+  if (!(fp = fopen("tp_flip.dg", "rb")) || dguFileToStruct(fp, got) != DF_OK)
+    fail("flipped stdio", "group", "read failed");
+  else check_group("flipped stdio", dg, got);
+  if (fp) fclose(fp);
+  dfuFreeDynGroup(got);
+
+  got = dfuCreateDynGroup(4);
+  if (dguGzipFileToStruct("tp_flip.dgz", got) != DF_OK)
+    fail("flipped .dgz", "group", "read failed");
+  else check_group("flipped .dgz", dg, got);
+  dfuFreeDynGroup(got);
+
+ done:
+  remove("tp_flip.dg");
+  remove("tp_flip.dgz");
+  free(flip);
+  free(copy);
+}
+
+int main(int argc, char *argv[])
+{
+  DYN_GROUP *dg = make_group();
+
+  DG_WRITER w;
+
+  toc(dg);
+
+  dgInitWriter(&w);
+  dgWriterRecordDynGroup(&w, dg);
+  callbacks("parse", dg, DG_WRITER_BUFFER(&w), DG_WRITER_SIZE(&w));
+  stopped(DG_WRITER_BUFFER(&w), DG_WRITER_SIZE(&w));
+  flipped(dg, DG_WRITER_BUFFER(&w), DG_WRITER_SIZE(&w));
+  dgFreeWriter(&w);
+  dfuFreeDynGroup(dg);
+
+  if (Failures) {
+    printf("%d failures\n", Failures);
+    return 1;
+  }
+  printf("all parses ok\n");
+  return 0;
+}
@@ -0,0 +1,491 @@
+/*
+ * testroundtrip -- write a group holding lists of every type, both in
+ * one go (.dg, .dgz and .lz4) and chunk by chunk with dgAppendChunk(),
+ * then read each file back through every reader mode, crossed with
+ * trial ranges and column selections, and check every element.  Files
+ * whose last chunk was cut off must read as they were before it.
+ *
+ * Every element is a function of its trial, so any slice of any list
+ * can be checked without keeping a copy of what was written.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#include <df.h>
+#include <dynio.h>
+
+#define NTRIALS  160		/* trials in the finished group        */
+#define NFIRST    40		/* trials written by dgAppendOpen()    */
+#define NCHUNK    30		/* trials in each appended chunk       */
+#define LATE_AT  100		/* trial at which "late" first appears */
+#define EMLEN   2048		/* floats per "em" sublist             */
+
+enum { TRIAL, RT, STIM, RESP, NAME, SPIKES, EM, EVENTS, CONDS, LATE,
+       NLISTS };
+static char *Names[NLISTS] = { "trial", "rt", "stim", "resp", "name",
+			       "spikes", "em", "events", "conds", "late" };
+
+enum { MAPPED, GZIPPED, LZ4, STDIO };
+static char *Kinds[] = { "map", "gzip", "lz4", "stdio" };
+
+static int Failures = 0;
+
+static void fail(const char *what, const char *list, int i, const char *why)
+{
+  if (Failures++ < 20)
+    printf("FAIL %s: %s[%d] %s\n", what, list, i, why);
+}
+
+/* em_val -- "em" values don't compress well, so big files stay big */
+static float em_val(int i, int j)
+{
+  return (float) ((i*7919 + j*104729) % 65521) / 16.0f;
+}
+
+/*********************************************************************/
+/*                          Writing                                  */
+/*********************************************************************/
+
+/* add_trial -- append trial i's element to each list of dg */
+static void add_trial(DYN_GROUP *dg, int i)
+{
+  DYN_LIST *sub, *ev;
+  char buf[32];
+  int j;
+
+  dfuAddDynListLong(DYN_GROUP_LIST(dg, TRIAL), i);
+  dfuAddDynListFloat(DYN_GROUP_LIST(dg, RT), i*0.5f);
+  dfuAddDynListShort(DYN_GROUP_LIST(dg, STIM), (short) (i%7 - 3));
+  dfuAddDynListChar(DYN_GROUP_LIST(dg, RESP), (char) (i%3));
+  sprintf(buf, "t%d", i);
+  dfuAddDynListString(DYN_GROUP_LIST(dg, NAME), buf);
+
+  sub = dfuCreateDynList(DF_LONG, 5);
+  for (j = 0; j < i%5; j++) dfuAddDynListLong(sub, i*10+j);
+  dfuMoveDynListList(DYN_GROUP_LIST(dg, SPIKES), sub);
+
+  sub = dfuCreateDynList(DF_FLOAT, EMLEN);
+  for (j = 0; j < EMLEN; j++) dfuAddDynListFloat(sub, em_val(i, j));
+  dfuMoveDynListList(DYN_GROUP_LIST(dg, EM), sub);
+
+  /* named, nested sublists, which can't be flattened */
+  ev = dfuCreateDynList(DF_LIST, 2);
+  sub = dfuCreateNamedDynList("labels", DF_STRING, 2);
+  sprintf(buf, "ev%d", i);
+  dfuAddDynListString(sub, "go");
+  dfuAddDynListString(sub, buf);
+  dfuMoveDynListList(ev, sub);
+  sub = dfuCreateNamedDynList("times", DF_LONG, 2);
+  dfuAddDynListLong(sub, i);
+  dfuAddDynListLong(sub, -i);
+  dfuMoveDynListList(ev, sub);
+  dfuMoveDynListList(DYN_GROUP_LIST(dg, EVENTS), ev);
+
+  /* "conds" is only filled in at the start, so no chunk touches it */
+  if (i < NFIRST) {
+    sub = dfuCreateDynList(DF_SHORT, 2);
+    dfuAddDynListShort(sub, (short) i);
+    dfuAddDynListShort(sub, (short) -i);
+    dfuMoveDynListList(DYN_GROUP_LIST(dg, CONDS), sub);
+  }
+
+  if (i == LATE_AT) dfuAddDynGroupNewList(dg, Names[LATE], DF_LONG, 10);
+  if (i >= LATE_AT) dfuAddDynListLong(DYN_GROUP_LIST(dg, LATE), 1000+i);
+}
+
+static DYN_GROUP *new_group(void)
+{
+  DYN_GROUP *dg = dfuCreateNamedDynGroup("roundtrip", NLISTS);
+  static int types[] = { DF_LONG, DF_FLOAT, DF_SHORT, DF_CHAR, DF_STRING,
+			 DF_LIST, DF_LIST, DF_LIST, DF_LIST };
+  int i;
+
+  for (i = 0; i < LATE; i++)
+    dfuAddDynGroupNewList(dg, Names[i], types[i], 10);
+  return dg;
+}
+
+static long file_size(char *filename)
+{
+  FILE *fp = fopen(filename, "rb");
+  long size = -1;
+
+  if (fp && !fseek(fp, 0, SEEK_END)) size = ftell(fp);
+  if (fp) fclose(fp);
+  return size;
+}
+
+/* copy_file -- copy the first size bytes of from, gzipped if gz is set */
+static int copy_file(char *from, char *to, long size, int gz)
+{
+  FILE *in = fopen(from, "rb"), *out = NULL;
+  gzFile gzout = NULL;
+  char buf[8192];
+  size_t n;
+  int ok;
+
+  if (!in) return 0;
+  if (gz) ok = (gzout = gzopen(to, "wb")) != NULL;
+  else ok = (out = fopen(to, "wb")) != NULL;
+  while (ok && size > 0 &&
+	 (n = fread(buf, 1, size < (long) sizeof(buf) ? size : sizeof(buf),
+		    in)) > 0) {
+    ok = gz ? gzwrite(gzout, buf, (unsigned) n) == (int) n :
+      fwrite(buf, 1, n, out) == n;
+    size -= n;
+  }
+  fclose(in);
+  if (gzout && gzclose(gzout) != Z_OK) ok = 0;
+  if (out && fclose(out)) ok = 0;
+  return ok;
+}
+
+/*
+ * write_files -- write rt_one.{dg,dgz,lz4} in one go and rt_app.dg a
+ * chunk at a time (and gzipped, as rt_app.dgz), noting in *last where
+ * the last chunk starts
+ */
+static int write_files(long *last)
+{
+  DYN_GROUP *dg = new_group();
+  DG_APPENDER a;
+  DG_WRITER w;
+  int i, ok;
+
+  for (i = 0; i < NFIRST; i++) add_trial(dg, i);
+  ok = dgAppendOpen(&a, "rt_app.dg", dg);
+  for (; ok && i < NTRIALS; i += NCHUNK) {
+    int j;
+    for (j = i; j < i+NCHUNK && j < NTRIALS; j++) add_trial(dg, j);
+    fflush(a.fp);
+    *last = file_size("rt_app.dg");
+    ok = dgAppendChunk(&a, dg);
+  }
+  if (!dgAppendClose(&a)) ok = 0;
+
+  if (ok) ok = dgInitWriter(&w);
+  if (ok) {
+    ok = dgWriterRecordDynGroup(&w, dg) &&
+      dgWriterWriteBuffer(&w, "rt_one.dg", DF_BINARY) &&
+      dgWriterWriteBuffer(&w, "rt_one.lz4", DF_LZ4) &&
+      dgWriterWriteBufferCompressed(&w, "rt_one.dgz");
+    dgFreeWriter(&w);
+  }
+  if (ok)
+    ok = copy_file("rt_app.dg", "rt_app.dgz", file_size("rt_app.dg"), 1);
+
+  dfuFreeDynGroup(dg);
+  return ok;
+}
+
+/*********************************************************************/
+/*                          Checking                                 */
+/*********************************************************************/
+
+/* list_len -- how many elements list l has after ntrials trials */
+static int list_len(int l, int ntrials)
+{
+  if (l == LATE) return ntrials > LATE_AT ? ntrials - LATE_AT : -1;
+  if (l == CONDS) return ntrials < NFIRST ? ntrials : NFIRST;
+  return ntrials;
+}
+
+/* range -- the part of an n element list a reader keeps */
+static void range(int n, int start, int stop, int *b, int *e)
+{
+  *b = start < 0 ? start + n : start;
+  *e = stop < 0 ? stop + n : stop;
+  if (*b < 0) *b = 0;
+  if (*b > n) *b = n;
+  if (*e > n) *e = n;
+  if (*e < *b) *e = *b;
+}
+
+static int check_sublist(const char *what, DYN_LIST *sub, int i,
+			 const char *name, int datatype, int n)
+{
+  if (!sub) fail(what, name, i, "sublist missing");
+  else if (DYN_LIST_DATATYPE(sub) != datatype) fail(what, name, i, "type");
+  else if (DYN_LIST_N(sub) != n) fail(what, name, i, "sublist length");
+  else if (strcmp(DYN_LIST_NAME(sub), name)) fail(what, name, i, "name");
+  else return 1;
+  return 0;
+}
+
+/* check_elt -- element k of dl should be trial i's value for list l */
+static void check_elt(const char *what, int l, DYN_LIST *dl, int k, int i)
+{
+  DYN_LIST *sub, *part;
+  char buf[32];
+  int j;
+
+  switch (l) {
+  case TRIAL:
+  case LATE:
+    if (((int *) DYN_LIST_VALS(dl))[k] != (l == LATE ? 1000+i : i))
+      fail(what, Names[l], i, "value");
+    break;
+  case RT:
+    if (((float *) DYN_LIST_VALS(dl))[k] != i*0.5f)
+      fail(what, Names[l], i, "value");
+    break;
+  case STIM:
+    if (((short *) DYN_LIST_VALS(dl))[k] != i%7 - 3)
+      fail(what, Names[l], i, "value");
+    break;
+  case RESP:
+    if (((char *) DYN_LIST_VALS(dl))[k] != i%3)
+      fail(what, Names[l], i, "value");
+    break;
+  case NAME:
+    sprintf(buf, "t%d", i);
+    if (strcmp(((char **) DYN_LIST_VALS(dl))[k], buf))
+      fail(what, Names[l], i, "value");
+    break;
+  case SPIKES:
+    sub = dfuGetDynListList(dl, k);
+    if (!check_sublist(what, sub, i, "", DF_LONG, i%5)) break;
+    for (j = 0; j < i%5; j++)
+      if (((int *) DYN_LIST_VALS(sub))[j] != i*10+j) {
+	fail(what, Names[l], i, "sublist value");
+	break;
+      }
+    break;
+  case EM:
+    sub = dfuGetDynListList(dl, k);
+    if (!check_sublist(what, sub, i, "", DF_FLOAT, EMLEN)) break;
+    for (j = 0; j < EMLEN; j++)
+      if (((float *) DYN_LIST_VALS(sub))[j] != em_val(i, j)) {
+	fail(what, Names[l], i, "sublist value");
+	break;
+      }
+    break;
+  case CONDS:
+    sub = dfuGetDynListList(dl, k);
+    if (check_sublist(what, sub, i, "", DF_SHORT, 2) &&
+	(((short *) DYN_LIST_VALS(sub))[0] != i ||
+	 ((short *) DYN_LIST_VALS(sub))[1] != -i))
+      fail(what, Names[l], i, "sublist value");
+    break;
+  case EVENTS:
+    sub = dfuGetDynListList(dl, k);
+    if (!check_sublist(what, sub, i, "", DF_LIST, 2)) break;
+    part = dfuGetDynListList(sub, 0);
+    sprintf(buf, "ev%d", i);
+    if (check_sublist(what, part, i, "labels", DF_STRING, 2) &&
+	(strcmp(((char **) DYN_LIST_VALS(part))[0], "go") ||
+	 strcmp(((char **) DYN_LIST_VALS(part))[1], buf)))
+      fail(what, Names[l], i, "labels");
+    part = dfuGetDynListList(sub, 1);
+    if (check_sublist(what, part, i, "times", DF_LONG, 2) &&
+	(((int *) DYN_LIST_VALS(part))[0] != i ||
+	 ((int *) DYN_LIST_VALS(part))[1] != -i))
+      fail(what, Names[l], i, "times");
+    break;
+  }
+}
+
+/*
+ * check_group -- dg should hold the lists in cols (a mask, 0 for all)
+ * as they were after ntrials trials, cut to [start, stop)
+ */
+static void check_group(const char *what, DYN_GROUP *dg, int ntrials,
+			int cols, int start, int stop)
+{
+  DYN_LIST *dl;
+  int l, n, b, e, k, nlists = 0;
+
+  for (l = 0; l < NLISTS; l++) {
+    dl = dfuFindDynList(dg, Names[l]);
+    n = list_len(l, ntrials);
+    if ((cols && !(cols & (1 << l))) || n < 0) {
+      if (dl) fail(what, Names[l], -1, "shouldn't be there");
+      continue;
+    }
+    nlists++;
+    if (!dl) {
+      fail(what, Names[l], -1, "missing");
+      continue;
+    }
+    range(n, start, stop, &b, &e);
+    if (DYN_LIST_N(dl) != e-b) {
+      fail(what, Names[l], -1, "wrong length");
+      continue;
+    }
+    for (k = 0; k < e-b; k++) {
+      /* "late" values count trials from its start */
+      check_elt(what, l, dl, k, l == LATE ? LATE_AT+b+k : b+k);
+    }
+  }
+  if (DYN_GROUP_N(dg) != nlists) fail(what, "group", -1, "wrong list count");
+}
+
+/*********************************************************************/
+/*                          Reading                                  */
+/*********************************************************************/
+
+static int read_file(int kind, char *filename, int flags, int nthreads,
+		     int cols, int start, int stop, DYN_GROUP *dg)
+{
+  const char *names[NLISTS];
+  DG_READER r;
+  FILE *fp;
+  int l, n = 0, status = 0;
+
+  for (l = 0; l < NLISTS; l++)
+    if (cols & (1 << l)) names[n++] = Names[l];
+
+  dgInitReader(&r);
+  DG_READER_FLAGS(&r) |= flags;
+  dgReaderSetThreads(&r, nthreads);
+  dgReaderSetColumns(&r, names, n);
+  if (start || stop != DG_READ_END) dgReaderSetRange(&r, start, stop);
+
+  switch (kind) {
+  case MAPPED:
+  case LZ4:
+    status = dgReaderReadDynGroup(&r, filename, dg);
+    break;
+  case GZIPPED:
+    status = dgReaderGzipFileToStruct(&r, filename, dg);
+    break;
+  case STDIO:
+    if ((fp = fopen(filename, "rb"))) {
+      status = dgReaderFileToStruct(&r, fp, dg);
+      fclose(fp);
+    }
+    break;
+  }
+  dgFreeReader(&r);
+  return status;
+}
+
+/* roundtrip -- read filename every way, checking it holds ntrials */
+static void roundtrip(int kind, char *filename, int ntrials)
+{
+  static int flags[] = { 0, DG_READ_BORROW, DG_READ_LAZY, DG_READ_CSR,
+			 DG_READ_POOL, DG_READ_BORROW | DG_READ_POOL,
+			 DG_READ_LAZY | DG_READ_CSR };
+  static int ranges[][2] = { { 0, DG_READ_END }, { 5, 17 },
+			     { -50, DG_READ_END }, { 3, -2 }, { -7, -3 },
+			     { 150, 10 } };
+  static int cols[] = { 0,
+			(1 << EM) | (1 << NAME) | (1 << LATE) | (1 << CONDS) };
+  char what[256];
+  DYN_GROUP *dg;
+  int f, t, rg, c, status, est[2][6][2];
+
+  for (f = 0; f < (int) (sizeof(flags)/sizeof(flags[0])); f++)
+    for (t = 1; t <= 4; t += 3)
+      for (rg = 0; rg < (int) (sizeof(ranges)/sizeof(ranges[0])); rg++)
+	for (c = 0; c < (int) (sizeof(cols)/sizeof(cols[0])); c++) {
+	  /* stdio ignores the reader's buffer options and threads */
+	  if (kind == STDIO && (flags[f] || t > 1)) continue;
+	  sprintf(what, "%s %s flags 0x%x threads %d range [%d,%d) cols 0x%x",
+		  Kinds[kind], filename, flags[f], t,
+		  ranges[rg][0], ranges[rg][1], cols[c]);
+	  dg = dfuCreateDynGroup(4);
+	  status = read_file(kind, filename, flags[f], t, cols[c],
+			     ranges[rg][0], ranges[rg][1], dg);
+	  if (status != DF_OK) {
+	    fail(what, "group", -1, "read failed");
+	    dfuFreeDynGroup(dg);
+	    continue;
+	  }
+
+	  /* lazy and flattened lists should size up like any other */
+	  if (!flags[f]) est[t/4][rg][c] = dgEstimateGroupSize(dg);
+	  else if (dgEstimateGroupSize(dg) != est[t/4][rg][c])
+	    fail(what, "group", -1, "size estimate differs");
+
+	  check_group(what, dg, ntrials, cols[c], ranges[rg][0], ranges[rg][1]);
+	  dfuFreeDynGroup(dg);
+	}
+}
+
+/*
+ * truncated -- cut rt_app.dg partway through its last chunk (which
+ * starts at last) and check the readers keep what came before
+ */
+static void truncated(long last)
+{
+  long full = file_size("rt_app.dg");
+  long cuts[6];
+  char what[256];
+  DYN_GROUP *dg;
+  int i, kind, lazy, status, before = NTRIALS - NCHUNK;
+
+  cuts[0] = last;
+  cuts[1] = last + 1;
+  cuts[2] = last + 2;
+  cuts[3] = last + 9;
+  cuts[4] = last + (full - last) / 2;
+  cuts[5] = full - 1;
+
+  for (i = 0; i < 6; i++) {
+    if (!copy_file("rt_app.dg", "rt_cut.dg", cuts[i], 0) ||
+	!copy_file("rt_app.dg", "rt_cut.dgz", cuts[i], 1)) {
+      fail("truncated", "rt_cut.dg", -1, "can't write");
+      continue;
+    }
+    for (kind = MAPPED; kind <= STDIO; kind++) {
+      if (kind == LZ4) continue;
+      for (lazy = 0; lazy < 2; lazy++) {
+	if (kind == STDIO && lazy) continue;
+	sprintf(what, "%s cut at %ld of %ld%s", Kinds[kind], cuts[i], full,
+		lazy ? " lazy" : "");
+	dg = dfuCreateDynGroup(4);
+	status = read_file(kind, kind == GZIPPED ? "rt_cut.dgz" : "rt_cut.dg",
+			   lazy ? DG_READ_LAZY : 0, 1, 0, 0, DG_READ_END, dg);
+	if (status != DF_OK) fail(what, "group", -1, "read failed");
+	else check_group(what, dg, before, 0, 0, DG_READ_END);
+	dfuFreeDynGroup(dg);
+
+	/* with a range, which the chunks make the readers apply last */
+	dg = dfuCreateDynGroup(4);
+	status = read_file(kind, kind == GZIPPED ? "rt_cut.dgz" : "rt_cut.dg",
+			   lazy ? DG_READ_LAZY : DG_READ_BORROW, 1, 0,
+			   -20, DG_READ_END, dg);
+	if (status != DF_OK) fail(what, "group", -1, "ranged read failed");
+	else check_group(what, dg, before, 0, -20, DG_READ_END);
+	dfuFreeDynGroup(dg);
+      }
+    }
+  }
+  remove("rt_cut.dg");
+  remove("rt_cut.dgz");
+}
+
+int main(int argc, char *argv[])
+{
+  long last = 0;
+
+  if (!write_files(&last)) {
+    printf("FAIL: unable to write test files\n");
+    return 1;
+  }
+
+  roundtrip(MAPPED, "rt_one.dg", NTRIALS);
+  roundtrip(STDIO, "rt_one.dg", NTRIALS);
+  roundtrip(GZIPPED, "rt_one.dgz", NTRIALS);
+  roundtrip(LZ4, "rt_one.lz4", NTRIALS);
+  roundtrip(MAPPED, "rt_app.dg", NTRIALS);
+  roundtrip(STDIO, "rt_app.dg", NTRIALS);
+  roundtrip(GZIPPED, "rt_app.dgz", NTRIALS);
+  truncated(last);
+
+  remove("rt_one.dg");
+  remove("rt_one.dgz");
+  remove("rt_one.lz4");
+  remove("rt_app.dg");
+  remove("rt_app.dgz");
+
+  if (Failures) {
+    printf("%d failures\n", Failures);
+    return 1;
+  }
+  printf("all round trips ok\n");
+  return 0;
+}
@@ -0,0 +1,323 @@
+/*
+ * testwrite -- serialize a group every way the writers can and check
+ * that each stream reads back as the group it was made from.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+#include <df.h>
+#include <dynio.h>
+
+static int Failures = 0;
+
+static void fail(const char *what, const char *why)
+{
+  if (Failures++ < 20)
+    printf("FAIL %s: %s\n", what, why);
+}
+
+/*
+ * make_group -- a group holding a list of each type, with float arrays
+ * of bign elements (big enough to gather, or to deflate in parallel)
+ */
+static DYN_GROUP *make_group(int bign)
+{
+  DYN_GROUP *dg = dfuCreateNamedDynGroup("written", 8);
+  DYN_LIST *dl, *sub;
+  char buf[32];
+  int i, j;
+
+  dfuAddDynGroupNewList(dg, "ids", DF_LONG, 10);
+  dfuAddDynGroupNewList(dg, "wave", DF_FLOAT, 10);
+  dfuAddDynGroupNewList(dg, "codes", DF_SHORT, 10);
+  dfuAddDynGroupNewList(dg, "flags", DF_CHAR, 10);
+  dfuAddDynGroupNewList(dg, "names", DF_STRING, 10);
+  dfuAddDynGroupNewList(dg, "trials", DF_LIST, 10);
+  dfuAddDynGroupNewList(dg, "empty", DF_LONG, 10);
+
+  for (i = 0; i < 100; i++) {
+    dfuAddDynListLong(DYN_GROUP_LIST(dg, 0), i*i - 50);
+    dfuAddDynListShort(DYN_GROUP_LIST(dg, 2), (short) (i - 30));
+    dfuAddDynListChar(DYN_GROUP_LIST(dg, 3), (unsigned char) i);
+    sprintf(buf, "name%d", i);
+    dfuAddDynListString(DYN_GROUP_LIST(dg, 4), buf);
+  }
+  for (i = 0; i < bign; i++)
+    dfuAddDynListFloat(DYN_GROUP_LIST(dg, 1),
+		       (float) ((i*7919) % 65521) / 8.0f);
+
+  /* a small, a big and an empty sublist per trial */
+  dl = DYN_GROUP_LIST(dg, 5);
+  for (i = 0; i < 3; i++) {
+    sub = dfuCreateDynList(DF_LONG, 10);
+    for (j = 0; j < 5; j++) dfuAddDynListLong(sub, i*10 + j);
+    dfuMoveDynListList(dl, sub);
+    sub = dfuCreateNamedDynList("samples", DF_FLOAT, 10);
+    for (j = 0; j < bign; j++)
+      dfuAddDynListFloat(sub, (float) ((i*104729 + j*31) % 4099));
+    dfuMoveDynListList(dl, sub);
+    dfuMoveDynListList(dl, dfuCreateDynList(DF_SHORT, 10));
+  }
+  return dg;
+}
+
+/* same_list -- 1 if a and b hold the same data */
+static int same_list(DYN_LIST *a, DYN_LIST *b)
+{
+  int i, size = 0;
+
+  if (!a || !b) return a == b;
+  if (DYN_LIST_DATATYPE(a) != DYN_LIST_DATATYPE(b) ||
+      DYN_LIST_N(a) != DYN_LIST_N(b) ||
+      strcmp(DYN_LIST_NAME(a), DYN_LIST_NAME(b))) return 0;
+
+  switch (DYN_LIST_DATATYPE(a)) {
+  case DF_LIST:
+    for (i = 0; i < DYN_LIST_N(a); i++)
+      if (!same_list(dfuGetDynListList(a, i), dfuGetDynListList(b, i)))
+	return 0;
+    return 1;
+  case DF_STRING:
+    for (i = 0; i < DYN_LIST_N(a); i++)
+      if (strcmp(((char **) DYN_LIST_VALS(a))[i],
+		 ((char **) DYN_LIST_VALS(b))[i])) return 0;
+    return 1;
+  case DF_LONG:  size = sizeof(int);   break;
+  case DF_SHORT: size = sizeof(short); break;
+  case DF_FLOAT: size = sizeof(float); break;
+  case DF_CHAR:  size = sizeof(char);  break;
+  }
+  return !DYN_LIST_N(a) ||
+    !memcmp(DYN_LIST_VALS(a), DYN_LIST_VALS(b), DYN_LIST_N(a)*size);
+}
+
+static void check_group(const char *what, DYN_GROUP *dg, DYN_GROUP *got)
+{
+  int i;
+
+  if (strcmp(DYN_GROUP_NAME(dg), DYN_GROUP_NAME(got)))
+    fail(what, "group name");
+  if (DYN_GROUP_N(dg) != DYN_GROUP_N(got)) {
+    fail(what, "wrong list count");
+    return;
+  }
+  for (i = 0; i < DYN_GROUP_N(dg); i++)
+    if (!same_list(DYN_GROUP_LIST(dg, i), DYN_GROUP_LIST(got, i)))
+      fail(what, DYN_LIST_NAME(DYN_GROUP_LIST(dg, i)));
+}
+
+/* check_buffer -- vbuf should read back as dg */
+static void check_buffer(const char *what, DYN_GROUP *dg,
+			 unsigned char *vbuf, int n)
+{
+  DYN_GROUP *got = dfuCreateDynGroup(4);
+
+  if (dguBufferToStruct(vbuf, n, got) != DF_OK) fail(what, "read failed");
+  else check_group(what, dg, got);
+  dfuFreeDynGroup(got);
+}
+
+/* check_file -- filename (removed afterwards) should read back as dg */
+static void check_file(const char *what, DYN_GROUP *dg, char *filename)
+{
+  DYN_GROUP *got = dfuCreateDynGroup(4);
+  int status;
+
+  if (strstr(filename, ".dgz")) status = dguGzipFileToStruct(filename, got);
+  else status = dgReadDynGroup(filename, got);
+  if (status != DF_OK) fail(what, "read failed");
+  else check_group(what, dg, got);
+  dfuFreeDynGroup(got);
+  remove(filename);
+}
+
+/*
+ * serialize -- dgComputeSerializedSize() should be exact: the group
+ * fits a buffer of that size, matching what a writer records, and not
+ * one a byte smaller
+ */
+static void serialize(DYN_GROUP *dg)
+{
+  DG_WRITER w;
+  unsigned char *buf, *alloced;
+  int size, n;
+
+  if ((size = dgComputeSerializedSize(dg)) <= 0) {
+    fail("serialize", "no size");
+    return;
+  }
+  buf = (unsigned char *) malloc(size);
+
+  if ((n = dgSerializeDynGroup(dg, buf, size)) != size)
+    fail("serialize", "exact buffer not filled");
+  else check_buffer("serialize", dg, buf, n);
+
+  if (dgSerializeDynGroup(dg, buf, size-1) != 0)
+    fail("serialize", "fit in a buffer too small");
+
+  dgInitWriter(&w);
+  if (!dgWriterRecordDynGroup(&w, dg) || DG_WRITER_SIZE(&w) != size ||
+      !dgSerializeDynGroup(dg, buf, size) ||
+      memcmp(DG_WRITER_BUFFER(&w), buf, size))
+    fail("serialize", "differs from the writer's stream");
+  dgFreeWriter(&w);
+  free(buf);
+
+  if (!(alloced = dgSerializeDynGroupAlloc(dg, &n)) || n != size)
+    fail("serialize alloc", "wrong size");
+  else check_buffer("serialize alloc", dg, alloced, n);
+  if (alloced) free(alloced);
+}
+
+/* sinks -- dgWriteDynGroup() through each of the file sinks */
+static void sinks(DYN_GROUP *dg, const char *what)
+{
+  DG_SINK sink;
+  char msg[64];
+
+  sprintf(msg, "%s file sink", what);
+  if (!dgOpenFileSink(&sink, "tw_sink.dg") || !dgWriteDynGroup(dg, &sink))
+    fail(msg, "write failed");
+  else check_file(msg, dg, "tw_sink.dg");
+
+  sprintf(msg, "%s gzip sink", what);
+  if (!dgOpenGzipSink(&sink, "tw_sink.dgz") || !dgWriteDynGroup(dg, &sink))
+    fail(msg, "write failed");
+  else check_file(msg, dg, "tw_sink.dgz");
+
+  sprintf(msg, "%s lz4 sink", what);
+  if (!dgOpenLZ4Sink(&sink, "tw_sink.lz4") || !dgWriteDynGroup(dg, &sink))
+    fail(msg, "write failed");
+  else check_file(msg, dg, "tw_sink.lz4");
+}
+
+/*
+ * gather -- a gathering writer's pieces should make up the stream a
+ * copying writer records, and write out (with writev() or through
+ * gzip) as that stream
+ */
+static void gather(DYN_GROUP *dg)
+{
+  DG_WRITER w, copy;
+  DG_IOVEC *iov;
+  int i, n, at = 0;
+
+  dgInitWriter(&copy);
+  dgWriterRecordDynGroup(&copy, dg);
+
+  dgInitWriter(&w);
+  dgWriterSetGather(&w, 1);
+  if (!dgWriterRecordDynGroup(&w, dg) || (n = dgWriterGather(&w, &iov)) < 0)
+    fail("gather", "record failed");
+  else if (n < 2) fail("gather", "nothing gathered");
+  else {
+    for (i = 0; i < n; i++) {
+      if (at + (int) iov[i].len > DG_WRITER_SIZE(&copy) ||
+	  memcmp(DG_WRITER_BUFFER(&copy) + at, iov[i].base, iov[i].len)) {
+	fail("gather", "pieces differ from the stream");
+	break;
+      }
+      at += iov[i].len;
+    }
+    if (i == n && at != DG_WRITER_SIZE(&copy))
+      fail("gather", "pieces are short");
+  }
+
+  if (!dgWriterWriteBuffer(&w, "tw_gather.dg", DF_BINARY))
+    fail("gather writev", "write failed");
+  else check_file("gather writev", dg, "tw_gather.dg");
+  if (!dgWriterWriteBufferCompressed(&w, "tw_gather.dgz"))
+    fail("gather gzip", "write failed");
+  else check_file("gather gzip", dg, "tw_gather.dgz");
+
+#ifndef _WIN32
+  /* a failed gzip write shouldn't leave its file open */
+  if (!access("/dev/full", W_OK)) {
+    int fd = dup(0);
+    close(fd);
+    if (dgWriterWriteBufferCompressed(&w, "/dev/full") ||
+	dgWriterWriteBufferCompressed(&copy, "/dev/full"))
+      fail("gzip", "write to a full device succeeded");
+    if ((n = dup(0)) != fd) fail("gzip", "failed write left file open");
+    close(n);
+  }
+#endif
+
+  dgFreeWriter(&w);
+  dgFreeWriter(&copy);
+}
+
+/*
+ * parallel_gzip -- a stream of a megabyte or more deflated on several
+ * threads should be one gzip member that inflates to the stream
+ */
+static void parallel_gzip(DYN_GROUP *dg)
+{
+  DG_WRITER w;
+  gzFile in;
+  FILE *fp;
+  unsigned char *got, trailer[8];
+  int n, size, old = dgSetGzipThreads(4);
+
+  dgInitWriter(&w);
+  dgWriterRecordDynGroup(&w, dg);
+  size = DG_WRITER_SIZE(&w);
+  if (size < (1<<20)) fail("parallel gzip", "stream too small to test");
+
+  if (!dgWriterWriteBufferCompressed(&w, "tw_par.dgz")) {
+    fail("parallel gzip", "write failed");
+    dgFreeWriter(&w);
+    dgSetGzipThreads(old);
+    return;
+  }
+
+  /* the ISIZE of the one and only member is the whole stream */
+  if (!(fp = fopen("tw_par.dgz", "rb")) || fseek(fp, -8, SEEK_END) ||
+      fread(trailer, 1, 8, fp) != 8 ||
+      (trailer[4] | trailer[5] << 8 | trailer[6] << 16 |
+       (unsigned) trailer[7] << 24) != (unsigned) size)
+    fail("parallel gzip", "trailer doesn't give the stream size");
+  if (fp) fclose(fp);
+
+  got = (unsigned char *) malloc(size+1);
+  if (!(in = gzopen("tw_par.dgz", "rb"))) fail("parallel gzip", "can't open");
+  else {
+    if ((n = gzread(in, got, size+1)) != size)
+      fail("parallel gzip", "inflates to the wrong length");
+    else if (memcmp(got, DG_WRITER_BUFFER(&w), size))
+      fail("parallel gzip", "inflates to the wrong data");
+    gzclose(in);
+  }
+  free(got);
+  check_file("parallel gzip", dg, "tw_par.dgz");
+
+  dgFreeWriter(&w);
+  dgSetGzipThreads(old);
+}
+
+int main(int argc, char *argv[])
+{
+  DYN_GROUP *small = make_group(2000);
+  DYN_GROUP *big = make_group(300000);
+
+  serialize(small);
+  sinks(small, "small");
+  sinks(big, "big");		/* arrays bigger than a sink block */
+  gather(small);
+  gather(big);
+  parallel_gzip(big);
+  dfuFreeDynGroup(small);
+  dfuFreeDynGroup(big);
+
+  if (Failures) {
+    printf("%d failures\n", Failures);
+    return 1;
+  }
+  printf("all writes ok\n");
+  return 0;
+}